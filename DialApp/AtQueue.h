@@ -0,0 +1,71 @@
+/*******************************************************************\
+ Filename    :  AtQueue.h
+ Purpose     :  Sent AT commands waiting for their final result
+\*******************************************************************/
+
+#ifndef _ATQUEUE_H_
+#define _ATQUEUE_H_
+
+#include "def.h"
+#include "deblog.h"
+#include "spsc_ring.h"
+
+
+/*
+   AT commands whose responses are collected (the rest are AtCmd_Other)
+ */
+enum AtCmd
+{
+	AtCmd_Other,
+	AtCmd_Clcc,				// AT+CLCC
+	AtCmd_Cpbs,				// AT+CPBS=<storage>
+	AtCmd_CpbrRange,		// AT+CPBR=?
+	AtCmd_Cpbr				// AT+CPBR=<first>,<last>
+};
+
+
+/*
+ ****************************************************************************************
+ The AG answers the AT commands in order, so the final result (OK/ERROR) received belongs
+ to the oldest command without it, and the response lines belong to the same command.
+ The commands are sent by the SM thread and the results are received by the AT receive
+ thread: one producer and one consumer, the queue doesn't lock.
+ ****************************************************************************************
+ */
+class AtQueue
+{
+  public:
+	enum { Size = 32 };
+
+  public:
+	// SM: new connection, before the first command is sent
+	void Clear ()			{ Cmds.Clear(); }
+
+	// SM: the command was sent
+	void Sent (AtCmd cmd)
+	{
+		if (!Cmds.Push (cmd))
+			LogMsg ("AtQueue overflow, AT command %d is not tracked", cmd);
+	}
+
+	// Receive thread: the command the response lines belong to
+	AtCmd Current ()
+	{
+		int n;
+		const AtCmd* cmd = Cmds.AcquireRead (n);
+		return n ? *cmd : AtCmd_Other;
+	}
+
+	// Receive thread: the final result was received, returns its command
+	AtCmd Final ()
+	{
+		AtCmd cmd;
+		return Cmds.Pop (cmd) ? cmd : AtCmd_Other;
+	}
+
+  protected:
+	SPSC_RING<AtCmd,Size>	Cmds;
+};
+
+
+#endif  // _ATQUEUE_H_
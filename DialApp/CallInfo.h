@@ -8,11 +8,13 @@
 #include "def.h"
 #include "str.h"
 #include "DialAppType.h"
+#include "Phonebook.h"
+#include "PhoneNumber.h"
 
 
 /*
  * CallInfo template: supported T type = char & wchar
- * Class object and its dynamic info string are allocated from one memory block.
+ * Class object, its dynamic info string and the phone book name buffer are allocated from one memory block.
  */
 template<class T> class CallInfo
 {
@@ -21,7 +23,9 @@ template<class T> class CallInfo
 
   public:
 	T *				Info;
+	T *				NameBuf;		// the name from the phone book when the AG doesn't send it
 	DialAppAbonent	InfoParsed;
+	uint64			NumberKey;		// PhoneNumber::Key of InfoParsed.Number, set by Parse2NumberName
 
 	DialAppAbonent* GetAbonent()  { return &InfoParsed; }
 
@@ -61,12 +65,13 @@ inline CallInfo<char>::CallInfo (char * info) : Info((char*)this + sizeof(CallIn
 {
 	// this object is already initialized to 0 by calloc
 	strcpy ((char*)Info, info);
+	NameBuf = Info + strlen(info) + 1;
 }
 
 template<> 
 inline void * CallInfo<char>::operator new (size_t size, char * info)
 {
-	return calloc (1, sizeof(CallInfo<char>) + strlen(info) + 1);
+	return calloc (1, sizeof(CallInfo<char>) + strlen(info) + 1 + DIALAPP_MAX_CALLNAME);
 }
 
 template<class T> 
@@ -81,6 +86,7 @@ inline bool CallInfo<char>::Parse2NumberName ()
 {
 	InfoParsed.Name   = 0;
 	InfoParsed.Number = 0;
+	NumberKey		  = 0;
 
 	STRB str(Info);
 
@@ -93,6 +99,7 @@ inline bool CallInfo<char>::Parse2NumberName ()
 		return false;
 	*s2 = '\0';	
 	InfoParsed.Number = s1 + 1;
+	NumberKey		  = PhoneNumber::Key (InfoParsed.Number);
 
 	// Search for "Name"
 	if (s1 = str.ScanCharNext('\"'))
@@ -103,18 +110,10 @@ inline bool CallInfo<char>::Parse2NumberName ()
 		*s2 = '\0';	
 		InfoParsed.Name = s1 + 1;
 	}
-	return true;
-}
-
 
-// Help func for CallInfo<char>::Compare
-inline bool CompareStrings (char*s1, char*s2)
-{
-	if (s1 == s2)
-		return true;
-	if (!s1 || !s2)
-		return false;
-	return (strcmp(s1,s2) == 0);
+	if ((!InfoParsed.Name || !*InfoParsed.Name)  &&  PhonebookObj.Lookup (NumberKey, NameBuf, DIALAPP_MAX_CALLNAME))
+		InfoParsed.Name = NameBuf;
+	return true;
 }
 
 
@@ -123,7 +122,8 @@ inline bool CallInfo<char>::Compare (CallInfo * x)
 {
 	if (!x)
 		return false;
-	if (!CompareStrings(InfoParsed.Number, x->InfoParsed.Number))
+	// "+972..." of +CLIP and "0..." of +CLCC are the same caller
+	if (!PhoneNumber::IsSame (NumberKey, InfoParsed.Number, x->NumberKey, x->InfoParsed.Number))
 		return false;
 	//KS: Don't take Name into account for now: the negative effect occurs when name is present and then absent 
 	//if (!CompareStrings(InfoParsed.Name, x->InfoParsed.Name))
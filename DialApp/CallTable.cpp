@@ -0,0 +1,189 @@
+/*******************************************************************\
+ Filename    :  CallTable.cpp
+ Purpose     :  Phone calls table built from AT+CLCC responses
+\*******************************************************************/
+
+#include "def.h"
+#include "deblog.h"
+#include "strscan.h"
+#include "CallTable.h"
+#include "Phonebook.h"
+
+
+void CallTable::Reset ()
+{
+	Lock.Lock();
+	NumBuilding = NumReady = 0;
+	Ready		= false;
+	Lock.Unlock();
+
+	Calls.Num = 0;
+}
+
+
+void CallTable::AddLine (cchar* clcc)
+{
+	if (NumBuilding < MaxCalls  &&  Parse (clcc, &Building[NumBuilding]))
+		NumBuilding++;
+	else
+		LogMsg ("Skipped +CLCC:%s", clcc);
+}
+
+
+bool CallTable::ListDone (bool ok)
+{
+	if (ok) {
+		Lock.Lock();
+		memcpy (ReadyList, Building, NumBuilding * sizeof(DialAppCall));
+		NumReady = NumBuilding;
+		Ready	 = true;
+		Lock.Unlock();
+	}
+	NumBuilding = 0;
+	return ok;
+}
+
+
+DialAppCall* CallTable::Find (DialAppCall* calls, int num, int idx)
+{
+	for (int i = 0; i < num; i++)
+		if (calls[i].Idx == idx)
+			return &calls[i];
+	return 0;
+}
+
+
+int CallTable::Apply (DialAppCall* changes)
+{
+	DialAppCall list [MaxCalls];
+	int			num, i, n = 0;
+
+	Lock.Lock();
+	if (!Ready) {
+		Lock.Unlock();
+		return 0;
+	}
+	num = NumReady;
+	memcpy (list, ReadyList, num * sizeof(DialAppCall));
+	Ready = false;
+	Lock.Unlock();
+
+	// The calls are matched by their index, it's kept by the AG while the call exists
+	for (i = 0; i < num; i++)
+	{
+		DialAppCall* prev = Find (Calls.Call, Calls.Num, list[i].Idx);
+		uint32 change = 0;
+
+		if (!prev)
+			change = DIALAPP_CALL_ADDED;
+		else {
+			if (prev->Status != list[i].Status)
+				change |= DIALAPP_CALL_STATUS;
+			if (prev->Multiparty != list[i].Multiparty)
+				change |= DIALAPP_CALL_MULTIPARTY;
+			if (strcmp (prev->Number, list[i].Number) || strcmp (prev->Name, list[i].Name))
+				change |= DIALAPP_CALL_NUMBER;
+		}
+		list[i].Change = change;
+		if (change)
+			changes[n++] = list[i];
+	}
+
+	for (i = 0; i < (int)Calls.Num; i++)
+	{
+		if (!Find (list, num, Calls.Call[i].Idx)) {
+			changes[n] = Calls.Call[i];
+			changes[n++].Change = DIALAPP_CALL_REMOVED;
+		}
+	}
+
+	memcpy (Calls.Call, list, num * sizeof(DialAppCall));
+	Calls.Num = num;
+	return n;
+}
+
+
+DialAppCall* CallTable::FindCurrent ()
+{
+	DialAppCall* setup = 0;
+
+	for (uint32 i = 0; i < Calls.Num; i++)
+	{
+		switch (Calls.Call[i].Status)
+		{
+			case DialAppCallStatus_Active:
+				return &Calls.Call[i];
+			case DialAppCallStatus_Dialing:
+			case DialAppCallStatus_Alerting:
+			case DialAppCallStatus_Incoming:
+				if (!setup)
+					setup = &Calls.Call[i];
+				break;
+		}
+	}
+	return setup;
+}
+
+
+// Copies the quoted string at s to dst (truncating), returns the position after the closing quote or 0
+static cchar* ParseQuoted (cchar* s, char* dst, int size)
+{
+	int n = 0;
+
+	while (*s == ' ')
+		s++;
+	if (*s++ != '\"')
+		return 0;
+	for (; *s && *s != '\"'; s++)
+		if (n < size - 1)
+			dst[n++] = *s;
+	dst[n] = '\0';
+	return (*s == '\"') ? s + 1 : 0;
+}
+
+
+// Parses the integer at s and skips the following comma, returns the position after it or 0
+static cchar* ParseInt (cchar* s, int* x)
+{
+	cchar* end = strscanInt (s, x);
+
+	if (!end)
+		return 0;
+	while (*end == ' ')
+		end++;
+	return (*end == ',') ? end + 1 : end;
+}
+
+
+bool CallTable::Parse (cchar* clcc, DialAppCall* call)
+{
+	int	   x[5];
+	cchar* s = clcc;
+
+	memset (call, 0, sizeof(DialAppCall));
+
+	for (int i = 0; i < 5; i++) {
+		if ( !(s = ParseInt (s, &x[i])) )
+			return false;
+	}
+	if (x[0] <= 0  ||  x[2] < DialAppCallStatus_Active  ||  x[2] > DialAppCallStatus_Waiting)
+		return false;
+
+	call->Idx		 = x[0];
+	call->Incoming	 = (x[1] == 1);
+	call->Status	 = DialAppCallStatus(x[2]);
+	call->Mode		 = x[3];
+	call->Multiparty = (x[4] == 1);
+
+	// Optional: "<number>",<type>[,"<name>"]
+	if (*s  &&  (s = ParseQuoted (s, call->Number, sizeof(call->Number))))
+	{
+		while (*s == ' ')
+			s++;
+		if (*s++ == ','  &&  (s = ParseInt (s, &call->Type)))
+			ParseQuoted (s, call->Name, sizeof(call->Name));
+	}
+	if (!call->Name[0]  &&  call->Number[0])
+		PhonebookObj.Lookup (call->Number, call->Name, sizeof(call->Name));
+	return true;
+}
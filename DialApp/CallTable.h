@@ -0,0 +1,63 @@
+/*******************************************************************\
+ Filename    :  CallTable.h
+ Purpose     :  Phone calls table built from AT+CLCC responses
+\*******************************************************************/
+
+#ifndef _CALLTABLE_H_
+#define _CALLTABLE_H_
+
+#include "def.h"
+#include "mutex.h"
+#include "DialAppType.h"
+
+
+/*
+ ****************************************************************************************
+ The table of the phone calls (AT+CLCC) with the incremental update.
+
+ The AT receive thread collects the "+CLCC:" lines of a response into the building list,
+ the final result of the AT+CLCC command (OK/ERROR, see AtQueue) hands it over to the SM, 
+ which applies the differences to its snapshot and reports the changed calls only.
+
+ All lists are fixed arrays with inline strings, so the polling allocates nothing.
+ ****************************************************************************************
+ */
+class CallTable
+{
+  public:
+	enum {
+		MaxCalls   = DIALAPP_MAX_CALLS,
+		MaxChanges = 2 * DIALAPP_MAX_CALLS		// all removed and all added
+	};
+
+  public:
+	CallTable()		{ Reset(); }
+
+	// AT receive side (InHandMng)
+	void AddLine  (cchar* clcc);				// "+CLCC:" line without the prefix
+	bool ListDone (bool ok);					// AT+CLCC final result, returns true when the list is ready to Apply
+
+	// SM side
+	void Reset ();								// connection lost: no calls
+	int  Apply (DialAppCall* changes);			// applies the ready list, returns the number of changed calls put to changes
+	DialAppCalls* GetCalls ()					{ return &Calls; }
+	DialAppCall*  FindCurrent ();				// the active call, or the call being set up, or 0
+
+	static bool Parse (cchar* clcc, DialAppCall* call);	// "<idx>,<dir>,<stat>,<mode>,<mpty>[,"<number>",<type>[,"<name>"]]"
+
+  protected:
+	static DialAppCall* Find (DialAppCall* calls, int num, int idx);
+
+  protected:
+	Mutex			Lock;						// the hand over
+	int				NumBuilding;				// receive thread only
+	DialAppCall		Building [MaxCalls];
+	bool			Ready;
+	int				NumReady;
+	DialAppCall		ReadyList [MaxCalls];
+
+	DialAppCalls	Calls;						// SM snapshot (DialAppParam.Calls)
+};
+
+
+#endif  // _CALLTABLE_H_
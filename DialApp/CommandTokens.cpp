@@ -0,0 +1,112 @@
+/*******************************************************************\
+ Filename    :  CommandTokens.cpp
+ Purpose     :  Completion tokens of the asynchronous host commands
+\*******************************************************************/
+
+#include "def.h"
+#include "deblog.h"
+#include "CommandTokens.h"
+
+
+CommandTokens CommandTokensObj;
+
+
+DialAppToken CommandTokens::New (DialAppDoneCb done, void* context)
+{
+	MUTEXLOCK (Lock);
+
+	for (int i = 0; i < MaxTokens; i++)
+	{
+		SLOT& s = Slots[i];
+		if (s.Token)
+			continue;
+
+		uint32 seq;
+		do {
+			seq = ++Sequence & (0xFFFFFFFF >> SeqShift);
+		} while (!seq);
+
+		s.Token		= (seq << SeqShift) | i;
+		s.DoneCb	= done;
+		s.Context	= context;
+		s.Status	= DialAppError_Ok;
+		s.State		= 0;
+		s.Completed = false;
+		Signals[i].Reset();		// may be left signaled by the previous token of the slot
+		return s.Token;
+	}
+
+	LogMsg ("CommandTokens: all %d tokens are in use", MaxTokens);
+	return 0;
+}
+
+
+void CommandTokens::Done (DialAppToken token, int status, int state)
+{
+	int				i = token & SlotMask;
+	SLOT&			s = Slots[i];
+	DialAppDoneCb	cb;
+	void*			context;
+
+	Lock.Lock();
+	if (s.Token != token  ||  s.Completed) {
+		Lock.Unlock();
+		return;
+	}
+
+	if (s.DoneCb) {
+		cb		= s.DoneCb;
+		context = s.Context;
+		s.Token = 0;
+		Lock.Unlock();
+		cb (token, DialAppError(status), DialAppState(state), context);
+		return;
+	}
+
+	s.Status	= status;
+	s.State		= state;
+	s.Completed = true;
+	Lock.Unlock();
+	Signals[i].Signal();
+}
+
+
+int CommandTokens::Wait (DialAppToken token, unsigned timeout, int* state)
+{
+	int		i = token & SlotMask;
+	SLOT&	s = Slots[i];
+	int		status;
+
+	Lock.Lock();
+	if (!token  ||  s.Token != token  ||  s.DoneCb) {
+		Lock.Unlock();
+		return DialAppError_InternalError;		// unknown token or a callback one
+	}
+
+	if (!s.Completed) {
+		Lock.Unlock();
+		Signals[i].Wait (timeout);
+		Lock.Lock();
+		if (!s.Completed) {
+			Lock.Unlock();
+			return DialAppError_Pending;
+		}
+	}
+
+	status = s.Status;
+	if (state)
+		*state = s.State;
+	s.Token = 0;
+	Lock.Unlock();
+	return status;
+}
+
+
+void CommandTokens::CancelAll ()
+{
+	for (int i = 0; i < MaxTokens; i++) {
+		DialAppToken token = Slots[i].Token;
+		if (token)
+			Done (token, DialAppError_InternalError, DialAppState_Init);
+	}
+}
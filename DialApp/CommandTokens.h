@@ -0,0 +1,66 @@
+/*******************************************************************\
+ Filename    :  CommandTokens.h
+ Purpose     :  Completion tokens of the asynchronous host commands
+\*******************************************************************/
+
+#ifndef _COMMANDTOKENS_H_
+#define _COMMANDTOKENS_H_
+
+#include "def.h"
+#include "mutex.h"
+#include "DialAppType.h"
+
+
+/*
+ ****************************************************************************************
+ The token is the slot index in the low bits and a sequence number above them, so a
+ stale token (already completed or collected) doesn't match the reused slot.
+
+ New	- dialappSubmit, in the host thread
+ Done	- the SM thread, after the command event was executed (or dialappSubmit itself when
+		  the command could not be queued). With a DialAppDoneCb the callback is called
+		  and the slot is freed, otherwise the result waits in the slot for Wait.
+ Wait	- dialappWait, in the host thread: takes the result and frees the slot.
+		  One waiter per token.
+ ****************************************************************************************
+ */
+class CommandTokens
+{
+  public:
+	enum {
+		MaxTokens = 16,					// power of 2
+		SlotMask  = MaxTokens - 1,
+		SeqShift  = 4
+	};
+
+  public:
+	CommandTokens () : Sequence(0)		{ memset (Slots, 0, sizeof(Slots)); }
+
+	DialAppToken New  (DialAppDoneCb done, void* context);		// 0 if all tokens are in use
+	void		 Done (DialAppToken token, int status, int state);
+	int			 Wait (DialAppToken token, unsigned timeout, int* state);
+	void		 CancelAll ();										// dialappEnd: the pending ones complete with DialAppError_InternalError
+
+  protected:
+	struct SLOT
+	{
+		DialAppToken	Token;			// 0 - free
+		DialAppDoneCb	DoneCb;
+		void		   *Context;
+		int				Status;
+		int				State;
+		bool			Completed;
+	};
+
+  protected:
+	Mutex	Lock;
+	Event	Signals [MaxTokens];
+	SLOT	Slots [MaxTokens];
+	uint32	Sequence;
+};
+
+
+extern CommandTokens CommandTokensObj;
+
+
+#endif  // _COMMANDTOKENS_H_
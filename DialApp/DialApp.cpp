@@ -10,11 +10,13 @@
 #include "DialApp.h"
 #include "deblog.h"
 #include "timer.h"
+#include "thread.h"
 #include "InHand.h"
 #include "ScoApp.h"
 #include "smBase.h"
 #include "HfpSm.h"
 #include "CallInfo.h"
+#include "CommandTokens.h"
 
 
 // Registry path for keeping HFP DialApp parameters
@@ -121,22 +123,45 @@ static void dialappCb (DialAppState state, DialAppError status, uint32 flags, Di
 }
 
 
+// Completion of the dialappSubmit commands, called in the SM thread
+static void dialappCommandDone (SMEVENT* ev, SM* sm, bool processed)
+{
+	int status = processed ? sm->ReportedError : DialAppError_IncorrectState4Call;
+	CommandTokensObj.Done (ev->Token, status, sm->State);
+}
 
-/***********************************************************************************************\
-										Public functions
-\***********************************************************************************************/
 
-void dialappInit (DialAppCb cb, bool pcsound)
+static void dialappInitProgress (DialAppInitStep step)
 {
-	DebLog::Init("DialApp");
+	HfpSmObj.PublicParams.InitStep = step;
+	dialappCb (DialAppState_Init, DialAppError_Ok, DIALAPP_FLAG_INITPROGRESS, &HfpSmObj.PublicParams);
+}
 
-	LogMsg ("dialappInit: starting DialApp");
-	dialappUserCb = cb;
 
+
+/***********************************************************************************************\
+										Init
+\***********************************************************************************************/
+
+/*
+ The init body of both dialappInit and dialappInitAsync. The progress callbacks are sent
+ by the async one only: the synchronous hosts don't expect DIALAPP_FLAG_INITPROGRESS.
+ There is no progress after HfpSm::Init - the SM thread is already running and its
+ DIALAPP_FLAG_INITSTATE callback is the last step.
+ */
+static void dialappStart (bool pcsound, bool progress)
+{
 	Timer::Init();
+	PhoneNumber::Init();
 	InHand::Init();
+	if (progress)
+		dialappInitProgress (DialAppInitStep_Bluetooth);
+
 	SmBase::Init();
+	SmBase::SetCommandDone (dialappCommandDone);
 	ScoApp::Init();
+	if (progress)
+		dialappInitProgress (DialAppInitStep_Audio);
 
 	// Because of some errors from HFP SM may be thrown in separate threads during init, 
 	// we need to implement here the mechanism to catch such asynchronous errors.
@@ -159,9 +184,104 @@ void dialappInit (DialAppCb cb, bool pcsound)
 }
 
 
+/*
+ dialappInitAsync thread: one-shot, ends with the init. The errors are reported by the
+ callback (the state is DialAppState_Init), the host calls dialappEnd then.
+ */
+class DialAppInitThread : public Thread
+{
+  public:
+	DialAppInitThread () : Thread("DialAppInit"), Started(false), PcSound(true)  {}
+
+	void Start (bool pcsound)
+	{
+		Join();		// the previous one, if it has called dialappEnd itself
+		PcSound = pcsound;
+		Started = true;
+		Construct();
+		Execute();
+	}
+
+	// dialappEnd may be called by the host from the failure callback, i.e. on this thread: it can't
+	// wait for itself, so it's joined by the next Start or End (the thread only returns after the callback)
+	void End ()
+	{
+		if (GetCurThreadId() != GetThreadId())
+			Join();
+	}
+
+  protected:
+	void Join ()
+	{
+		if (!Started)
+			return;
+		WaitEnding();
+		CloseHandle (hThread);
+		hThread = 0;
+		Started = false;
+	}
+
+  protected:
+	virtual void Run ()
+	{
+		int err = DialAppError_Ok;
+
+		try {
+			dialappInitProgress (DialAppInitStep_Started);
+			dialappStart (PcSound, true);
+		}
+		catch (int e) {
+			err = e;
+		}
+		catch (...) {
+			err = DialAppError_InternalError;
+		}
+
+		if (err) {
+			LogMsg ("dialappInitAsync: init failed, error %d", err);
+			dialappCb (DialAppState_Init, DialAppError(err), DIALAPP_FLAG_INITPROGRESS, &HfpSmObj.PublicParams);
+		}
+	}
+
+  protected:
+	bool	Started;
+	bool	PcSound;
+};
+
+static DialAppInitThread dialappInitThread;
+
+
+
+/***********************************************************************************************\
+										Public functions
+\***********************************************************************************************/
+
+void dialappInit (DialAppCb cb, bool pcsound)
+{
+	DebLog::Init("DialApp");
+
+	LogMsg ("dialappInit: starting DialApp");
+	dialappUserCb = cb;
+
+	dialappStart (pcsound, false);
+}
+
+
+void dialappInitAsync (DialAppCb cb, bool pcsound)
+{
+	DebLog::Init("DialApp");
+
+	LogMsg ("dialappInitAsync: starting DialApp");
+	dialappUserCb = cb;
+
+	dialappInitThread.Start (pcsound);
+}
+
+
 void dialappEnd ()
 {
 	LogMsg ("dialappEnd: stopping DialApp");
+	dialappInitThread.End();
 	// TODO gracefully finalize the SM
 	// HfpSm::PutEvent_Disconnect();
 	HfpSm::End();
@@ -169,6 +289,7 @@ void dialappEnd ()
 	SmBase::End();
 	InHand::End();
 	Timer::End();
+	CommandTokensObj.CancelAll();
 	DebLog::End();
 }
 
@@ -273,6 +394,110 @@ void dialappPcSound (bool pcsound)
 }
 
 
+bool dialappGetScoStats (DialAppScoStats* stats)
+{
+	SCO_STATS s;
+
+	if (!HfpSmObj.ScoAppObj || !HfpSmObj.ScoAppObj->GetScoStats(s))
+		return false;
+
+	stats->BytesIn		= s.BytesIn;
+	stats->BytesOut		= s.BytesOut;
+	stats->FramesIn		= s.FramesIn;
+	stats->FramesOut	= s.FramesOut;
+	stats->ErrorsIn		= s.ErrorsIn;
+	stats->ErrorsOut	= s.ErrorsOut;
+	stats->LastError	= s.LastError;
+	stats->PacketTypes	= s.PacketTypes;
+	stats->LatencyMax	= s.LatencyMax;
+	for (int i = 0; i < DIALAPP_SCO_LATENCY_BUCKETS; i++)
+		stats->Latency[i] = (i < SCO_STATS_LATENCY_BUCKETS) ? s.Latency[i] : 0;
+
+	const DriftEstimator::Stats & d = HfpSmObj.ScoAppObj->GetDriftStats();
+	stats->DriftPpm		= d.RatioPpm;
+	stats->DriftFill	= d.FillLast;
+	stats->DriftUpdates	= d.Updates;
+	return true;
+}
+
+
+void dialappGetIndicators (DialAppIndicators* indicators)
+{
+	HfpSmObj.Indicators.Snapshot (indicators);
+}
+
+
+bool dialappLookupName (cchar* number, char* name, int size)
+{
+	if (!number || !name || size <= 0)
+		return false;
+	return PhonebookObj.Lookup (number, name, size);
+}
+
+
+void dialappSyncPhonebook ()
+{
+	HfpSm::PutEvent_Phonebook (true);
+}
+
+
+DialAppToken dialappSubmit (const DialAppRequest* req)
+{
+	DialAppToken token;
+	bool		 queued;
+
+	if (!req  ||  !(token = CommandTokensObj.New (req->Done, req->Context)))
+		return 0;
+
+	// The token may be completed (and even collected) by the SM thread before this function returns
+	switch (req->Command)
+	{
+		case DialAppCommand_SelectDevice:
+			// rescan: a device paired after the init is not in the cached list yet
+			if (!req->DevAddr  ||  !InHand::FindDevice (req->DevAddr, true)) {
+				CommandTokensObj.Done (token, DialAppError_UnknownDevice, HfpSmObj.State);
+				return token;
+			}
+			queued = HfpSm::PutEvent_SelectDevice (req->DevAddr, token);
+			break;
+
+		case DialAppCommand_ForgetDevice:	queued = HfpSm::PutEvent_ForgetDevice (token);				break;
+		case DialAppCommand_Answer:			queued = HfpSm::PutEvent_Answer (token);					break;
+		case DialAppCommand_EndCall:		queued = HfpSm::PutEvent_CallEnd (token);					break;
+		case DialAppCommand_PutOnHold:		queued = HfpSm::PutEvent_PutOnHold (token);					break;
+		case DialAppCommand_SendDtmf:		queued = HfpSm::PutEvent_SendDtmf (req->Dtmf, token);		break;
+		case DialAppCommand_PcSound:		queued = HfpSm::PutEvent_Headset (req->PcSound, token);		break;
+		case DialAppCommand_SyncPhonebook:	queued = HfpSm::PutEvent_Phonebook (true, token);			break;
+
+		case DialAppCommand_Call:
+			if (!req->Number) {
+				CommandTokensObj.Done (token, DialAppError_IncorrectState4Call, HfpSmObj.State);
+				return token;
+			}
+			queued = HfpSm::PutEvent_StartOutgoingCall (req->Number, token);
+			break;
+
+		default:
+			CommandTokensObj.Done (token, DialAppError_InternalError, HfpSmObj.State);
+			return token;
+	}
+
+	if (!queued)
+		CommandTokensObj.Done (token, DialAppError_InsufficientResources, HfpSmObj.State);
+	return token;
+}
+
+
+DialAppError dialappWait (DialAppToken token, uint32 timeout, DialAppState* state)
+{
+	int st = HfpSmObj.State;
+	int status = CommandTokensObj.Wait (token, timeout, &st);
+	if (state)
+		*state = DialAppState(st);
+	return DialAppError(status);
+}
+
+
 void dialappDebugMode (DialAppDebug debugtype, int mode)
 {
 	switch (debugtype)
@@ -285,6 +510,39 @@ void dialappDebugMode (DialAppDebug debugtype, int mode)
 		case DialAppDebug_DisconnectNow:
 			HfpSm::PutEvent_Disconnect();
 			break;
+
+		case DialAppDebug_WarmReconnect:
+			HfpSm::SetWarmReconnect (mode != 0);
+			break;
+
+		case DialAppDebug_Trace:
+			DebLog::SetTracing (mode != 0);
+			break;
+
+		case DialAppDebug_VoiceProc:
+			ScoApp::SetVoiceCapture (mode ? VOICE_CAPTURE_NATIVE : VOICE_CAPTURE_DMO);
+			break;
+
+		case DialAppDebug_ScoBatch:
+			ScoApp::SetScoBatchMode (mode != 0);
+			break;
+
+		case DialAppDebug_AudioBackend:
+			if ((mode & ~DIALAPP_AUDIO_FREERUN) <= AUDIO_BACKEND_NULL)
+				ScoApp::SetAudioBackend (AUDIO_BACKEND(mode & ~DIALAPP_AUDIO_FREERUN), !(mode & DIALAPP_AUDIO_FREERUN), "DialAppSpk.wav", "DialAppMic.wav");
+			break;
+
+		case DialAppDebug_DuplexEngine:
+			ScoApp::SetDuplexEngine (mode != 0);
+			break;
+
+		case DialAppDebug_ScoRing:
+			ScoApp::SetScoRingMode (mode != 0);
+			break;
+
+		case DialAppDebug_ContReader:
+			ScoApp::SetContReaderMode (mode != 0);
+			break;
 	}
 }
 
@@ -21,9 +21,19 @@ enum DialAppDebug
 {
 	DialAppDebug_DisablePnonePolling,	// Disable phone polling for automatic connection
 	DialAppDebug_DisconnectNow,			// Disconnect phone (to test the polling)
-	DialAppDebug_ConnectNow				// Connect phone (when disconnected)
+	DialAppDebug_ConnectNow,			// Connect phone (when disconnected)
+	DialAppDebug_WarmReconnect,			// mode != 0: keep the SCO server and the AG indicators mapping over link drops (see HfpSm::SetWarmReconnect)
+	DialAppDebug_Trace,					// mode != 0: the debug log is on (default), mode = 0: off, nothing is formatted
+	DialAppDebug_VoiceProc,				// mode != 0: the microphone goes through WaveIn API and the native AEC/NS/AGC instead of the Voice Capture DMO (call before dialappInit)
+	DialAppDebug_ScoBatch,				// mode != 0: the SCO voice chunks go through IOCTL_HFP_SCO_BATCH instead of ReadFile/WriteFile (call before dialappInit)
+	DialAppDebug_AudioBackend,			// mode: 0 - sound card (default), 1 - WAV files (DialAppSpk.wav written, DialAppMic.wav read), 2 - null; | DIALAPP_AUDIO_FREERUN: not paced in real time (call before dialappInit)
+	DialAppDebug_DuplexEngine,			// mode != 0: the voice goes through one duplex thread (WaveDuplex) with the native AEC/NS/AGC instead of the WaveOut/WaveIn threads (call before dialappInit)
+	DialAppDebug_ScoRing,				// mode != 0: the SCO voice goes through the driver's shared memory ring instead of ReadFile/WriteFile (call before dialappInit)
+	DialAppDebug_ContReader				// mode != 0: the driver keeps SCO IN transfers posted into its frame ring while the voice passes (call before dialappInit)
 };
 
+#define DIALAPP_AUDIO_FREERUN		0x100
+
 
 
 
@@ -56,6 +66,29 @@ enum DialAppDebug
 void  dialappInit (DialAppCb cb, bool pcsound = true);
 
 
+/*
+ *************************************************************************************
+ Non-blocking variant of dialappInit: the init runs in a separate thread and the 
+ function returns immediately, so a UI thread doesn't stall on opening the driver and 
+ the audio devices.
+ Parameters:
+	cb		- Callback function pointer (see DialAppCb description).
+	pcsound - see dialappInit.
+ Exceptions: 
+    throw int exception if an error happened.
+ Callback:
+	The progress callbacks with state = DialAppState_Init, DIALAPP_FLAG_INITPROGRESS 
+	flag and the DialAppParam param->InitStep set (see DialAppInitStep), called in the 
+	init thread. Then the usual DIALAPP_FLAG_INITSTATE callback signals that the init 
+	is completed. If the init fails, the DIALAPP_FLAG_INITPROGRESS callback comes with 
+	the error status instead; the external application must call dialappEnd() then.
+	The other DialApp functions may be called after the DIALAPP_FLAG_INITSTATE 
+	callback only.
+ *************************************************************************************
+ */
+void  dialappInitAsync (DialAppCb cb, bool pcsound = true);
+
+
 /*
  *************************************************************************************
  Finalizes the DialApp application and closes the driver.
@@ -280,6 +313,121 @@ void dialappDebugMode (DialAppDebug debugtype, int mode = 0) throw();
 void dialappPutOnHold() throw();
 
 
+/*
+ *************************************************************************************
+ Gets the statistics of the current SCO voice connection (or of the last closed one) 
+ from the HFP driver. The call is cheap and may be used for periodic polling, e.g. 
+ for a link quality indicator.
+ Parameters:
+	stats - receives the statistics.
+ Exceptions: 
+	No exceptions.
+ Callback:
+	No callbacks.
+ Returns:
+	false if there was no SCO connection yet.
+ *************************************************************************************
+ */
+bool dialappGetScoStats (DialAppScoStats* stats) throw();
+
+
+/*
+ *************************************************************************************
+ Gets the current phone indicators (signal, battery, roaming, service and the call 
+ indicators). The function doesn't lock and may be called from any thread, but usually 
+ it's needed once only: then the changes come with DIALAPP_FLAG_INDICATORS callbacks.
+ Parameters:
+	indicators - receives the indicators, all DIALAPP_IND_UNKNOWN when there is no
+	             HFP connection.
+ Exceptions: 
+	No exceptions.
+ Callback:
+	No callbacks.
+ *************************************************************************************
+ */
+void dialappGetIndicators (DialAppIndicators* indicators) throw();
+
+
+/*
+ *************************************************************************************
+ Finds the name of the phone number in the phone book of the selected device.
+ The book is read from the phone after each HFP connection (AT+CPBR) and is kept on 
+ the disk, so the lookup works without the connection too. The numbers are matched by 
+ their last digits, so "+44 20 7946 0018" and "020 7946 0018" are the same number.
+ The function may be called from any thread.
+ Parameters:
+	number - phone number in any format
+	name   - receives the name
+	size   - name buffer size, longer names are truncated
+ Exceptions: 
+	No exceptions.
+ Callback:
+	No callbacks.
+ Returns:
+	false if the number is not found.
+ *************************************************************************************
+ */
+bool dialappLookupName (cchar* number, char* name, int size) throw();
+
+
+/*
+ *************************************************************************************
+ Reads the phone book from the phone again. Normally the book is read once and the 
+ following connections reuse it (a broken sync is resumed), this function is needed 
+ when the book was changed on the phone. Ignored while a sync is in progress or there
+ is no HFP connection.
+ Exceptions: 
+	No exceptions.
+ Callback:
+	No callbacks.
+ *************************************************************************************
+ */
+void dialappSyncPhonebook () throw();
+
+
+/*
+ *************************************************************************************
+ Submits a command to the State Machine and returns immediately with the command token
+ (see DialAppCommand). The token is completed when the State Machine has executed the
+ command transition: the completion callback req->Done is called then (in the State 
+ Machine thread, it must not block), or, if req->Done = 0, the result waits for 
+ dialappWait. The completion may come before dialappSubmit returns.
+ Up to 16 tokens may be pending at a time.
+ Parameters:
+	req - the command and its parameters (the structure may be temporal).
+ Exceptions: 
+	No exceptions.
+ Callback:
+	The DialAppCb callbacks of the command are the same as of the correspondent 
+	synchronous function.
+ Returns:
+	The token, 0 if req is 0 or there are too many pending tokens.
+ *************************************************************************************
+ */
+DialAppToken dialappSubmit (const DialAppRequest* req) throw();
+
+
+/*
+ *************************************************************************************
+ Waits for the completion of the token returned by dialappSubmit with req->Done = 0.
+ Once completed, the token is freed and may not be waited again.
+ Parameters:
+	token	- the command token.
+	timeout - milliseconds, 0 - poll, 0xFFFFFFFF - infinite.
+	state	- receives the State Machine state after the command transition (optional).
+ Exceptions: 
+	No exceptions.
+ Callback:
+	No callbacks.
+ Returns:
+	The command status (see DialAppCommand), DialAppError_Pending if the timeout 
+	expired (the token is still valid), DialAppError_InternalError if the token is 
+	unknown, has a completion callback or was cancelled by dialappEnd.
+ *************************************************************************************
+ */
+DialAppError dialappWait (DialAppToken token, uint32 timeout, DialAppState* state = 0) throw();
+
+
 
 /********************************************************************************************\
 								Dynamic Linkage Support
@@ -303,6 +451,13 @@ typedef void  	(*DIALAPPPcSound)			(bool pcsound) throw();
 typedef void 	(*DIALAPPSendDtmf)			(cchar dialchar) throw();
 typedef void 	(*DIALAPPDebugMode)			(DialAppDebug debugtype, int mode) throw();
 typedef void 	(*DIALAPPPutOnHold)			() throw();
+typedef bool 	(*DIALAPPGetScoStats)		(DialAppScoStats* stats) throw();
+typedef void 	(*DIALAPPGetIndicators)		(DialAppIndicators* indicators) throw();
+typedef bool 	(*DIALAPPLookupName)		(cchar* number, char* name, int size) throw();
+typedef void 	(*DIALAPPSyncPhonebook)		() throw();
+typedef void  	(*DIALAPPInitAsync)			(DialAppCb cb, bool pcsound);
+typedef DialAppToken (*DIALAPPSubmit)		(const DialAppRequest* req) throw();
+typedef DialAppError (*DIALAPPWait)			(DialAppToken token, uint32 timeout, DialAppState* state) throw();
 
 
 extern DIALAPPInit 				_dialappInit;				
@@ -319,6 +474,13 @@ extern DIALAPPPcSound			_dialappPcSound;
 extern DIALAPPSendDtmf			_dialappSendDtmf;			
 extern DIALAPPDebugMode			_dialappDebugMode;			
 extern DIALAPPPutOnHold			_dialappPutOnHold;
+extern DIALAPPGetScoStats		_dialappGetScoStats;
+extern DIALAPPGetIndicators		_dialappGetIndicators;
+extern DIALAPPLookupName		_dialappLookupName;
+extern DIALAPPSyncPhonebook		_dialappSyncPhonebook;
+extern DIALAPPInitAsync			_dialappInitAsync;
+extern DIALAPPSubmit			_dialappSubmit;
+extern DIALAPPWait				_dialappWait;
 
 
 #define DIALAPP_LINKAGE_VARIABLES	\
@@ -335,10 +497,17 @@ extern DIALAPPPutOnHold			_dialappPutOnHold;
 		DIALAPPPcSound				_dialappPcSound;				\
 		DIALAPPSendDtmf				_dialappSendDtmf;				\
 		DIALAPPDebugMode			_dialappDebugMode;				\
-		DIALAPPPutOnHold			_dialappPutOnHold
+		DIALAPPPutOnHold			_dialappPutOnHold;				\
+		DIALAPPGetScoStats			_dialappGetScoStats;			\
+		DIALAPPGetIndicators		_dialappGetIndicators;			\
+		DIALAPPLookupName			_dialappLookupName;				\
+		DIALAPPSyncPhonebook		_dialappSyncPhonebook;			\
+		DIALAPPInitAsync			_dialappInitAsync;				\
+		DIALAPPSubmit				_dialappSubmit;					\
+		DIALAPPWait					_dialappWait
 
 
-inline void dialappInit (DialAppCb cb, bool pcsound = true)
+inline void dialappLoad ()
 {
 	static HINSTANCE instDialapp = LoadLibraryA("DialApp.dll");
 	if (!instDialapp)
@@ -358,10 +527,27 @@ inline void dialappInit (DialAppCb cb, bool pcsound = true)
 	_dialappSendDtmf 			= (DIALAPPSendDtmf) 		GetProcAddress (instDialapp, "dialappSendDtmf");
 	_dialappDebugMode 			= (DIALAPPDebugMode) 		GetProcAddress (instDialapp, "dialappDebugMode");
 	_dialappPutOnHold 			= (DIALAPPPutOnHold) 		GetProcAddress (instDialapp, "dialappPutOnHold");
+	_dialappGetScoStats 		= (DIALAPPGetScoStats) 		GetProcAddress (instDialapp, "dialappGetScoStats");
+	_dialappGetIndicators 		= (DIALAPPGetIndicators) 	GetProcAddress (instDialapp, "dialappGetIndicators");
+	_dialappLookupName 			= (DIALAPPLookupName) 		GetProcAddress (instDialapp, "dialappLookupName");
+	_dialappSyncPhonebook 		= (DIALAPPSyncPhonebook) 	GetProcAddress (instDialapp, "dialappSyncPhonebook");
+	_dialappInitAsync 			= (DIALAPPInitAsync) 		GetProcAddress (instDialapp, "dialappInitAsync");
+	_dialappSubmit 				= (DIALAPPSubmit) 			GetProcAddress (instDialapp, "dialappSubmit");
+	_dialappWait 				= (DIALAPPWait) 			GetProcAddress (instDialapp, "dialappWait");
+}
 
+inline void dialappInit (DialAppCb cb, bool pcsound = true)
+{
+	dialappLoad();
 	_dialappInit(cb,pcsound);
 }
 
+inline void dialappInitAsync (DialAppCb cb, bool pcsound = true)
+{
+	dialappLoad();
+	_dialappInitAsync(cb,pcsound);
+}
+
 inline void  dialappEnd ()
 {
 	_dialappEnd();
@@ -427,6 +613,36 @@ inline void dialappPutOnHold() throw()
 	_dialappPutOnHold();
 }
 
+inline bool dialappGetScoStats (DialAppScoStats* stats) throw()
+{
+	return _dialappGetScoStats(stats);
+}
+
+inline void dialappGetIndicators (DialAppIndicators* indicators) throw()
+{
+	_dialappGetIndicators(indicators);
+}
+
+inline bool dialappLookupName (cchar* number, char* name, int size) throw()
+{
+	return _dialappLookupName(number, name, size);
+}
+
+inline void dialappSyncPhonebook () throw()
+{
+	_dialappSyncPhonebook();
+}
+
+inline DialAppToken dialappSubmit (const DialAppRequest* req) throw()
+{
+	return _dialappSubmit(req);
+}
+
+inline DialAppError dialappWait (DialAppToken token, uint32 timeout, DialAppState* state = 0) throw()
+{
+	return _dialappWait(token, timeout, state);
+}
+
 
 #endif	// DIALAPP_DYN_USAGE
 
@@ -58,6 +58,9 @@ enum DialAppError
 	DialAppError_WaveInError				,
 	DialAppError_WaveBuffersError			,
 	DialAppError_MediaObjectInError			,
+
+	// Asynchronous API errors
+	DialAppError_Pending					,	// dialappWait timed out, the command is not completed yet
 };
 
 
@@ -107,6 +110,122 @@ struct DialAppAbonent
 };
 
 
+/*
+ *************************************************************************************
+ SCO voice link statistics (see dialappGetScoStats).
+ *************************************************************************************
+ */
+#define DIALAPP_SCO_LATENCY_BUCKETS		8
+
+struct DialAppScoStats
+{
+	uint64	BytesIn;		// Received voice bytes
+	uint64	BytesOut;		// Sent voice bytes
+	uint32	FramesIn;		// Successful incoming SCO transfers
+	uint32	FramesOut;		// Successful outgoing SCO transfers
+	uint32	ErrorsIn;		// Failed incoming SCO transfers
+	uint32	ErrorsOut;		// Failed outgoing SCO transfers
+	int		LastError;		// Driver's status of the last failed transfer or 0
+	uint32	PacketTypes;	// (e)SCO packet types of the channel, Bluetooth HCI bitmask
+	uint32	LatencyMax;		// Max transfer time in the driver, microseconds
+	uint32	Latency[DIALAPP_SCO_LATENCY_BUCKETS];	// Transfer time histogram: <1, <2, <4, <8, <16, <32, <64, >=64 ms
+	double	DriftPpm;		// Sound card vs. SCO clock correction applied to the voice, (ratio-1)*1e6; 0 if not estimated (no sound card)
+	int		DriftFill;		// Last measured speaker queue fill, samples
+	uint32	DriftUpdates;	// Drift estimator updates, one per speaker chunk
+};
+
+
+/*
+ *************************************************************************************
+ AG (phone) indicators, reported by the phone via AT+CIND/+CIEV (see dialappGetIndicators
+ and DIALAPP_FLAG_INDICATORS). DialAppIndicators.Value is indexed by DialAppIndicator,
+ the Present and Changed masks have the DIALAPP_IND_BIT(DialAppIndicator) bits.
+ *************************************************************************************
+ */
+enum DialAppIndicator
+{
+	DialAppIndicator_Call,			// 0 - no calls, 1 - call is active
+	DialAppIndicator_CallSetup,		// 0 - none, 1 - incoming, 2 - outgoing, 3 - remote party being alerted
+	DialAppIndicator_CallHeld,		// 0 - none, 1 - held and active, 2 - held only
+	DialAppIndicator_Service,		// 0/1 - network service availability
+	DialAppIndicator_Signal,		// 0..5 - signal strength
+	DialAppIndicator_Roam,			// 0/1 - roaming
+	DialAppIndicator_BattChg,		// 0..5 - battery charge level
+	DialAppIndicator_Num
+};
+
+#define DIALAPP_IND_BIT(ind)		(1u << (ind))
+#define DIALAPP_IND_UNKNOWN			(-1)		// Not reported (yet) by the phone or no HFP connection
+
+struct DialAppIndicators
+{
+	uint32	Present;						// Indicators supported by the phone
+	uint32	Changed;						// Indicators changed since the previous DIALAPP_FLAG_INDICATORS callback (0 in dialappGetIndicators)
+	int		Value[DialAppIndicator_Num];	// Current values or DIALAPP_IND_UNKNOWN
+};
+
+
+/*
+ *************************************************************************************
+ Phone calls table, reported by the phone via AT+CLCC (see DIALAPP_FLAG_CALL).
+ DialAppCallStatus values are the +CLCC <stat> ones.
+ *************************************************************************************
+ */
+#define DIALAPP_MAX_CALLS			7
+#define DIALAPP_MAX_NUMBER			32		// including the terminating 0, longer numbers are truncated
+#define DIALAPP_MAX_CALLNAME		32		// including the terminating 0, longer names are truncated
+
+enum DialAppCallStatus
+{
+	DialAppCallStatus_Active,
+	DialAppCallStatus_Held,
+	DialAppCallStatus_Dialing,		// outgoing
+	DialAppCallStatus_Alerting,		// outgoing
+	DialAppCallStatus_Incoming,
+	DialAppCallStatus_Waiting		// incoming
+};
+
+// DialAppCall.Change bits
+#define DIALAPP_CALL_ADDED			0x01	// New call
+#define DIALAPP_CALL_REMOVED		0x02	// The call has gone, the other fields are the last known
+#define DIALAPP_CALL_STATUS			0x04	// Status was changed
+#define DIALAPP_CALL_NUMBER			0x08	// Number or Name was changed
+#define DIALAPP_CALL_MULTIPARTY		0x10	// Multiparty was changed
+
+struct DialAppCall
+{
+	int					Idx;						// Call index in the phone (+CLCC <idx>), from 1
+	bool				Incoming;					// Direction
+	bool				Multiparty;					// The call is a part of a conference
+	DialAppCallStatus	Status;
+	int					Mode;						// 0 - voice, 1 - data, 2 - fax
+	int					Type;						// Number type (e.g. 145 for an international number), 0 if not given
+	uint32				Change;						// DIALAPP_CALL_... bits, set in DIALAPP_FLAG_CALL callbacks
+	char				Number[DIALAPP_MAX_NUMBER];
+	char				Name[DIALAPP_MAX_CALLNAME];	// Phone book name, may be empty
+};
+
+struct DialAppCalls
+{
+	uint32		Num;
+	DialAppCall	Call[DIALAPP_MAX_CALLS];
+};
+
+
+/*
+ *************************************************************************************
+ dialappInitAsync progress steps (see DIALAPP_FLAG_INITPROGRESS). The init completes 
+ with the usual DIALAPP_FLAG_INITSTATE callback.
+ *************************************************************************************
+ */
+enum DialAppInitStep
+{
+	DialAppInitStep_Started,		// The init thread is running
+	DialAppInitStep_Bluetooth,		// The Bluetooth radio and the HFP driver are opened
+	DialAppInitStep_Audio,			// The State Machine and the audio are started, the voice devices are being checked
+};
+
+
 /*
  *************************************************************************************
  DIALAPP_FLAG_... bits correspondent to DialAppParam fields and passed as one 32-bit 
@@ -122,6 +241,9 @@ struct DialAppAbonent
 #define DIALAPP_FLAG_ABONENT_CURRENT	0x08	// DialAppParam.AbonentCurrent was set
 #define DIALAPP_FLAG_ABONENT_WAITING	0x10	// DialAppParam.AbonentWaiting was set (for incoming 3-way call)
 #define DIALAPP_FLAG_ABONENT_HELD		0x20	// DialAppParam.AbonentHeld was set (call is placed on hold or active/held calls swapped)
+#define DIALAPP_FLAG_INDICATORS			0x40	// DialAppParam.Indicators was changed, the changed ones are in its Changed mask
+#define DIALAPP_FLAG_CALL				0x80	// DialAppParam.CallChanged is the changed call (one callback per call), DialAppParam.Calls is updated
+#define DIALAPP_FLAG_INITPROGRESS		0x100	// DialAppParam.InitStep was changed (dialappInitAsync only, state = DialAppState_Init); with an error status the init failed
 #define DIALAPP_FLAG_NEWSTATE	  0x40000000	// Set when current state was changed
 #define DIALAPP_FLAG_INITSTATE	  0x80000000	// Set one-time when the SM started, in 1st callback only, before entering to the idle state (when SM's data, e.g. paired device list, are already initialized)
 
@@ -141,6 +263,10 @@ struct DialAppParam
 	DialAppAbonent *AbonentCurrent;	// Currently in call abonent information (DIALAPP_FLAG_ABONENT_CURRENT flag)
 	DialAppAbonent *AbonentWaiting;	// Waiting abonent information (DIALAPP_FLAG_ABONENT_WAITING flag)
 	DialAppAbonent *AbonentHeld;	// On hold abonent information (DIALAPP_FLAG_ABONENT_HELD flag)
+	DialAppIndicators *Indicators;	// Phone indicators (DIALAPP_FLAG_INDICATORS flag)
+	DialAppCalls	*Calls;			// All calls in the phone (DIALAPP_FLAG_CALL flag)
+	DialAppCall		*CallChanged;	// The changed call (DIALAPP_FLAG_CALL flag), 0 in other callbacks
+	DialAppInitStep	 InitStep;		// dialappInitAsync progress (DIALAPP_FLAG_INITPROGRESS flag)
 };
 
 
@@ -163,4 +289,47 @@ typedef void (*DialAppCb) (DialAppState state, DialAppError status, uint32 flags
 
 
 
+/*
+ *************************************************************************************
+ Asynchronous commands (see dialappSubmit). Each submitted command gets a token, the 
+ token is completed when the State Machine has executed the command:
+	DialAppError_Ok	- the command was accepted in the current state, the state passed
+					  to DialAppDoneCb/dialappWait is the state after the transition
+	error			- the error the command transition reported (also reported to 
+					  DialAppCb), DialAppError_IncorrectState4Call if the command is 
+					  not served in the current state
+ The further progress (e.g. the call answered by the remote side) comes via DialAppCb
+ as before.
+ *************************************************************************************
+ */
+enum DialAppCommand
+{
+	DialAppCommand_SelectDevice,	// DevAddr: one of dialappGetPairedDevices (the pairing dialog is not supported)
+	DialAppCommand_ForgetDevice,
+	DialAppCommand_Call,			// Number
+	DialAppCommand_Answer,
+	DialAppCommand_EndCall,
+	DialAppCommand_PutOnHold,
+	DialAppCommand_SendDtmf,		// Dtmf
+	DialAppCommand_PcSound,			// PcSound
+	DialAppCommand_SyncPhonebook
+};
+
+typedef uint32 DialAppToken;		// 0 is not a token
+
+typedef void (*DialAppDoneCb) (DialAppToken token, DialAppError status, DialAppState state, void* context);
+
+struct DialAppRequest
+{
+	DialAppCommand	Command;
+	uint64			DevAddr;		// DialAppCommand_SelectDevice
+	cchar		   *Number;			// DialAppCommand_Call (the string is copied)
+	char			Dtmf;			// DialAppCommand_SendDtmf
+	bool			PcSound;		// DialAppCommand_PcSound
+	DialAppDoneCb	Done;			// Completion callback, or 0: then the token must be collected by dialappWait
+	void		   *Context;		// Passed to Done
+};
+
+
+
 #endif // _DIALAPPTYPES_H
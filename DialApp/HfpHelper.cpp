@@ -9,7 +9,7 @@
 #include "InHand.h"
 
 
-STRB HfpIndicators::ServNames[NumServices] = { "call", "callsetup", "callheld" };
+STRB HfpIndicators::ServNames[NumServices] = { "call", "callsetup", "callheld", "service", "signal", "roam", "battchg" };
 
 
 bool HfpIndicators::Construct (char* mapping)
@@ -20,7 +20,7 @@ bool HfpIndicators::Construct (char* mapping)
 	STRB str(mapping);
 
 	// 1st ScanCharNext instead ScanChar is ok because the first mapping char should be '('
-	for (i = 0;  i < MaxServices;  i++)
+	for (i = 0;  i < MaxIndicators;  i++)
 	{
 		if ( !(s1 = str.ScanCharNext('\"')) )
 			break;
@@ -30,19 +30,22 @@ bool HfpIndicators::Construct (char* mapping)
 		for (int j = 0; j < NumServices; j++)
 			if (ServNames[j] == (cchar*)(s1+1)) {
 				ServIdxes[j] = i + 1;  // HFP indicator index starts from 1
-				n++;
+				IdxServ[i+1] = j;
+				if (j < NumMandatory)
+					n++;
 				break;
 			}
 	}
 
 	NumServicesPresent = i;
 
-	if (n != NumServices) {
+	if (n != NumMandatory) {
 		LogMsg ("ParseAndSetAtIndicators failed");
 		return (Constructed=false);
 	}
 
-	InHand::SetIndicatorsNumbers (ServIdxes[CALL], ServIdxes[CALLSETUP], ServIdxes[CALLHELD]);
+	LogMsg ("Indicators: call=%d, callsetup=%d, callheld=%d, service=%d, signal=%d, roam=%d, battchg=%d",
+			ServIdxes[CALL], ServIdxes[CALLSETUP], ServIdxes[CALLHELD], ServIdxes[SERVICE], ServIdxes[SIGNAL], ServIdxes[ROAM], ServIdxes[BATTCHG]);
 	return (Constructed=true);
 }
 
@@ -50,21 +53,17 @@ bool HfpIndicators::Construct (char* mapping)
 void  HfpIndicators::SetStatuses (char* statuses)
 {
 	STRB str(statuses);
-	int	 idx, i, x;
+	int	 serv, i, x;
 
 	for (i = 0;  i < NumServicesPresent;  i++)
 	{
-		// detect idx for i (CALL, CALLSETUP, ...)
-		idx = -1;
-		for (int j = 0; j < NumServices; j++)
-			if (i == ServIdxes[j]-1) // HFP indicator index starts from 1
-				{ idx = j;  break; }
+		serv = IdxServ[i+1];	// HFP indicator index starts from 1
 
 		char* s = str.SeekInt(&x);
 		if (!s)
 			break;
-		if (idx >= 0)
-			ServStatuses[idx] = x;
+		if (serv >= 0)
+			ServStatuses[serv] = x;
 		if (str.SeekChar() == '\0')
 			{ i++; break; }
 	}
@@ -81,7 +80,7 @@ int HfpIndicators::GetCurrentState ()
 	if (!Constructed || (NumServicesPresent != NumStatusesPresent))
 		return -1;
 
-	// See remarks at InHandMng::SetIndicatorsNumbers
+	// See remarks at HfpIndicators::Service
 	if (ServStatuses[CALL] == 1)
 		return HfpSm::STATE_InCall;
 	if (ServStatuses[CALLSETUP] == 1)
@@ -91,3 +90,148 @@ int HfpIndicators::GetCurrentState ()
 
 	return HfpSm::STATE_HfpConnected;
 }
+
+
+int HfpIndicators::Update (int idx, int val)
+{
+	if (!Constructed  ||  idx < 1  ||  idx > MaxIndicators)
+		return -1;
+
+	int serv = IdxServ[idx];
+	if (serv >= 0)
+		ServStatuses[serv] = val;
+	return serv;
+}
+
+
+bool HfpIndicators::ParseEvent (cchar* ciev, int* idx, int* val)
+{
+	// "<idx>,<val>", spaces are tolerated (strscanInt skips the leading ones)
+	cchar* end = strscanInt (ciev, idx);
+
+	if (!end)
+		return false;
+	while (*end == ' ')
+		end++;
+	if (*end++ != ',')
+		return false;
+	return strscanInt (end, val) != 0;
+}
+
+
+uint32 HfpIndicators::GetPresent ()
+{
+	uint32 present = 0;
+
+	for (int i = 0; i < NumServices; i++)
+		if (ServIdxes[i])
+			present |= DIALAPP_IND_BIT(i);
+	return present;
+}
+
+
+
+/*
+ ****************************************************************************************
+ HfpIndicatorCache
+ ****************************************************************************************
+ */
+
+void HfpIndicatorCache::Clear ()
+{
+	Data.Present = 0;
+	Data.Changed = 0;
+	for (int i = 0; i < DialAppIndicator_Num; i++)
+		Data.Value[i] = DIALAPP_IND_UNKNOWN;
+}
+
+
+void HfpIndicatorCache::EndUpdate (uint32 changed)
+{
+	InterlockedIncrement (&Seq);
+	Lock.Unlock();
+
+	if (changed) {
+		InterlockedOr (&ChangedMask, changed);
+		// One event for the burst, the next changes are delivered by it.
+		// Not posted: re-armed, otherwise no event would ever be posted again
+		if (InterlockedExchange (&Pending, 1) == 0  &&  !HfpSm::PutEvent_Indicators())
+			InterlockedExchange (&Pending, 0);
+	}
+}
+
+
+void HfpIndicatorCache::Reset ()
+{
+	uint32 changed = 0;
+
+	BeginUpdate();
+	for (int i = 0; i < DialAppIndicator_Num; i++)
+		if (Data.Value[i] != DIALAPP_IND_UNKNOWN)
+			changed |= DIALAPP_IND_BIT(i);
+	Clear();
+	EndUpdate (changed);
+}
+
+
+void HfpIndicatorCache::Set (uint32 present, const int* values)
+{
+	uint32 changed = 0;
+
+	BeginUpdate();
+	Data.Present = present;
+	for (int i = 0; i < DialAppIndicator_Num; i++)
+	{
+		int val = (present & DIALAPP_IND_BIT(i)) ? values[i] : DIALAPP_IND_UNKNOWN;
+		if (Data.Value[i] != val) {
+			Data.Value[i] = val;
+			changed |= DIALAPP_IND_BIT(i);
+		}
+	}
+	EndUpdate (changed);
+}
+
+
+void HfpIndicatorCache::Set (int ind, int val)
+{
+	uint32 changed = 0;
+
+	if (ind < 0  ||  ind >= DialAppIndicator_Num)
+		return;
+
+	BeginUpdate();
+	if (Data.Value[ind] != val) {
+		Data.Value[ind] = val;
+		changed = DIALAPP_IND_BIT(ind);
+	}
+	EndUpdate (changed);
+}
+
+
+void HfpIndicatorCache::Snapshot (DialAppIndicators* out)
+{
+	LONG seq;
+
+	for (;;)
+	{
+		seq = Seq;
+		if (seq & 1) {
+			YieldProcessor();
+			continue;
+		}
+		MemoryBarrier();
+		*out = Data;
+		MemoryBarrier();
+		if (Seq == seq)
+			break;
+	}
+	out->Changed = 0;
+}
+
+
+uint32 HfpIndicatorCache::TakeChanged ()
+{
+	// Re-arm first: a change after taking the mask posts a new event
+	InterlockedExchange (&Pending, 0);
+	return (uint32) InterlockedExchange (&ChangedMask, 0);
+}
@@ -12,38 +12,57 @@
 
 /*
  ****************************************************************************************
- Help class to represent HFP indicators (AT+CIND commands).
+ Help class to represent HFP indicators (AT+CIND and +CIEV commands).
+ The mapping (AT+CIND=?) gives the AG indicator numbers, then the "+CIEV: <idx>,<val>"
+ events are dispatched through the IdxServ array indexed by the indicator number.
  ****************************************************************************************
  */
 class HfpIndicators
 {
+  public:
+	// Same order as DialAppIndicator, so the Service is the public indicator too
+	enum Service {
+		CALL		= DialAppIndicator_Call,		// 0 - no calls, 1 - call is active
+		CALLSETUP	= DialAppIndicator_CallSetup,	// 0 - not in call set up, 1 - incoming call process ongoing, 2 - outgoing call set up is ongoing,
+													// 3 - remote party being alerted in an outgoing call
+		CALLHELD	= DialAppIndicator_CallHeld,	// 0 - no calls held, 1 - held and active, 2 - held only
+		SERVICE		= DialAppIndicator_Service,		// 0/1 - network service availability
+		SIGNAL		= DialAppIndicator_Signal,		// 0..5 - signal strength
+		ROAM		= DialAppIndicator_Roam,		// 0/1 - roaming
+		BATTCHG		= DialAppIndicator_BattChg,		// 0..5 - battery charge level
+		NumServices = DialAppIndicator_Num,
+		NumMandatory = CALLHELD + 1,	// call, callsetup, callheld are needed for the HFP SM
+		MaxIndicators = 20
+	};
+
   public:
 	HfpIndicators() : Constructed(false)
 	{
 		NumServicesPresent = NumStatusesPresent = 0;
 		memset (ServIdxes, 0, sizeof(ServIdxes));
 		memset (ServStatuses, 0, sizeof(ServStatuses));
+		memset (IdxServ, -1, sizeof(IdxServ));
 	}
 
 	bool  Construct	(char* mapping);
 	void  SetStatuses (char* statuses);
 	int   GetCurrentState ();	// return HfpSm::STATE or -1 when not detected
 
+	int   Update (int idx, int val);						// "+CIEV: <idx>,<val>" event, returns Service or -1 when not tracked
+	int   GetStatus (Service serv)	{ return ServStatuses[serv]; }
+	bool  IsPresent (Service serv)	{ return ServIdxes[serv] != 0; }
+	const int* GetStatuses ()		{ return ServStatuses; }
+	uint32 GetPresent ();								// DIALAPP_IND_BIT mask
+
+	static bool ParseEvent (cchar* ciev, int* idx, int* val);	// parses "<idx>,<val>" of "+CIEV: <idx>,<val>"
+
   public:
 	bool Constructed;
 
   protected:
-	enum {
-		CALL,
-		CALLSETUP,
-		CALLHELD,
-		NumServices,
-		MaxServices = 10
-	};
-
-  protected:
-	int  ServIdxes  [NumServices];
+	int  ServIdxes  [NumServices];			// Service => AG indicator number (from 1), 0 if not present
 	int  ServStatuses [NumServices];
+	int  IdxServ [MaxIndicators+1];			// AG indicator number => Service, -1 if not tracked
 	int  NumServicesPresent;
 	int  NumStatusesPresent;
 
@@ -14,6 +14,7 @@ IMPL_STATES (HfpSm, STATE_LIST_HFPSM)
 HfpSm				HfpSmObj;
 HfpSmCb  			HfpSm::UserCallback;
 HfpSmInitReturn*	HfpSm::InitEvent;
+bool				HfpSm::WarmReconnect;
 
 
 //static
@@ -45,11 +46,20 @@ void HfpSm::ScoCritErrorCallback()
 }
 
 
+//static
+void HfpSm::ScoIoCallback (SCO_IO io, int error)
+{
+	SMEVENT Event = {SM_HFP, (io == SCO_IO_OPEN) ? SMEV_ScoOpened : SMEV_ScoClosed};
+	Event.Param.ReportError = error;
+	SmBase::PutEvent (&Event, SMQ_HIGH);
+}
+
+
 void HfpSm::Construct()
 {
 	MyTimer.Construct ();
 	SMT<HfpSm>::Construct (SM_HFP);
-	ScoAppObj = new ScoApp (ScoConnectCallback, ScoDisconnectCallback, ScoCritErrorCallback);
+	ScoAppObj = new ScoApp (ScoConnectCallback, ScoDisconnectCallback, ScoCritErrorCallback, ScoIoCallback);
 }
 
 
@@ -181,6 +191,18 @@ void HfpSm::Init (DialAppCb cb, HfpSmInitReturn* initevent)
 	InitStateNode (STATE_InCall,			SMEV_CallEnded,					STATE_HfpConnected,		&FinalizeCallEnding);
 	/*--------------------------------------------------------------------------------------------------*/
 
+	/*---------------------------------- Any STATE  ----------------------------------------------------*/
+	// SCO channel open/close complete asynchronously, so their events may come in any state.
+	// Indicators changes are notified in any state too (the cache is reset when the connection is lost).
+	// The phone book sync runs in the background of any state.
+	for (int state = 0; state < NSTATES; state++) {
+		InitStateNode (state,				SMEV_ScoOpened,					state,					&ScoOpened);
+		InitStateNode (state,				SMEV_ScoClosed,					state,					&ScoClosed);
+		InitStateNode (state,				SMEV_Indicators,				state,					&IndicatorsChanged);
+		InitStateNode (state,				SMEV_Phonebook,					state,					&PhonebookSync);
+	}
+	/*--------------------------------------------------------------------------------------------------*/
+
 	HfpSm::InitEvent = initevent;
 	UserCallback.Construct (cb);
 	HfpSmObj.Construct();
@@ -215,8 +237,12 @@ void HfpSm::StartVoiceHlp (bool waveonly)
 	try
 	{
 		ScoAppObj->OpenSco(waveonly);
-		ScoAppObj->VoiceStart();
-		PublicParams.PcSound = true;
+		if (waveonly) {
+			// The voice channel is already active
+			ScoAppObj->VoiceStart();
+			PublicParams.PcSound = true;
+		}
+		// else the voice starts on SMEV_ScoOpened
 	}
 	catch (int err)
 	{
@@ -283,6 +309,34 @@ void HfpSm::SetCallInfo4CurrentCall (CallInfo<char> *info)
 }
 
 
+// Applies the complete AT+CLCC response: the changed calls are reported one by one
+void HfpSm::UpdateCalls ()
+{
+	DialAppCall changes [CallTable::MaxChanges];
+	int n = Calls.Apply (changes);
+
+	for (int i = 0; i < n; i++) {
+		LogMsg ("Call %d: status %d, change %X", changes[i].Idx, changes[i].Status, changes[i].Change);
+		PublicParams.CallChanged = &changes[i];
+		UserCallback.CallChanged();
+	}
+	PublicParams.CallChanged = 0;
+
+	// The current call abonent: its CallInfo is rebuilt only when the number is another (in any form)
+	DialAppCall* call = Calls.FindCurrent();
+	if (call  &&  call->Number[0]  &&  
+		(!CallInfoCurrent || !PhoneNumber::IsSame (CallInfoCurrent->NumberKey, CallInfoCurrent->InfoParsed.Number, PhoneNumber::Key (call->Number), call->Number)))
+	{
+		STR<DIALAPP_MAX_NUMBER + DIALAPP_MAX_CALLNAME + 8> info;
+		if (call->Name[0])
+			info.Sprintf ("\"%s\",\"%s\"", call->Number, call->Name);
+		else
+			info.Sprintf ("\"%s\"", call->Number);
+		SetCallInfo4CurrentCall (new ((char*)info) CallInfo<char>((char*)info));
+	}
+}
+
+
 void HfpSm::SetCallInfo4WaitingCall (CallInfo<char> *info)
 {
 	if (CallInfoWaiting)
@@ -361,6 +415,25 @@ void HfpSm::SetCallInfo4HeldCall (SMEV_ATRESPONSE heldstatus)
 }
 
 
+// Drops the state kept for the warm reconnect: the next HFP connect is cold
+void HfpSm::WarmReset ()
+{
+	if (WarmAddr) {
+		ScoAppObj->StopServer();
+		WarmAddr = 0;
+	}
+	InHand::FreeIndicators();
+}
+
+
+void HfpSm::ResetLinkState ()
+{
+	Indicators.Reset();
+	Calls.Reset();
+	PhonebookObj.Stop();	// resumed on the next connect
+}
+
+
 bool HfpSm::IsCurStateSupportingVoiceSwitch()
 {
 	if (PublicParams.PcSound && !PublicParams.PcSoundPref) {
@@ -452,6 +525,7 @@ bool HfpSm::SelectDevice (SMEVENT* ev, int param)
 
 	LogMsg ("Selected device: %llX, %s", addr, dev->Name);
 	PublicParams.CurDevice = dev;
+	PhonebookObj.Open (addr);	// the synced book is available before the connection
 	UserCallback.DevicePresent();
 	MyTimer.Start(TIMEOUT_CONNECTION_POLLING,true);
 	PutEvent_ConnectStart(addr);
@@ -459,6 +533,8 @@ bool HfpSm::SelectDevice (SMEVENT* ev, int param)
 	end_func:
 	if (State >= STATE_HfpConnected)
 		ScoAppObj->StopServer();
+	WarmReset();	// even for the same device: selecting starts from the cold state
+	ResetLinkState();
 	return true;
 }
 
@@ -477,16 +553,24 @@ bool HfpSm::ForgetDevice (SMEVENT* ev, int param)
 			InHand::Disconnect();
 		UserCallback.DeviceForgot();
 	}
+	WarmReset();
+	ResetLinkState();
+	PhonebookObj.Close();
 	return true;
 }
 
 
 bool HfpSm::Disconnect (SMEVENT* ev, int param)
 {
-	if (State >= STATE_HfpConnecting)
-		ScoAppObj->StopServer();
+	// The warm state outlives the link drop, the server registration stays in the driver
+	if (!WarmReconnect  ||  !WarmAddr  ||  WarmAddr != PublicParams.CurDevice->Address) {
+		if (State >= STATE_HfpConnecting)
+			ScoAppObj->StopServer();
+		WarmReset();
+	}
 	if (State > STATE_Disconnected)
 		InHand::Disconnect();
+	ResetLinkState();		// the host is notified with the unknown values
 	MyTimer.Start (TIMEOUT_CONNECTION_POLLING, true);
 	if (ev->Param.ReportError)
 		UserCallback.NotifyFailure (ev->Param.ReportError);
@@ -505,6 +589,7 @@ bool HfpSm::Disconnect (SMEVENT* ev, int param)
 bool HfpSm::Connect (SMEVENT* ev, int param)
 {
 	MyTimer.Start (TIMEOUT_CONNECTION_POLLING, true);
+	ConnectStartTime = Timer::GetCurMilli();
 	InHand::BeginConnect (PublicParams.CurDevice->Address);
 	return true;
 }
@@ -515,6 +600,7 @@ bool HfpSm::Connected (SMEVENT* ev, int param)
 	// In the case of timeout the timer is stopped because of single timer event 
 	if (ev->Ev != SMEV_Timeout)
 		MyTimer.Stop();	
+	LinkTime = Timer::GetCurMilli() - ConnectStartTime;
 	HfpSm::PutEvent_HfpConnectStart();
 	return true;
 }
@@ -525,12 +611,21 @@ bool HfpSm::HfpConnect (SMEVENT* ev, int param)
 	// In the case HFP negotiation will not be completed in the given time,
 	// we assume that it's ok and will jump to the next state
 	HfpIndicatorsState = -1;
-	InHand::ClearIndicatorsNumbers();
+	WarmConnect = WarmReconnect  &&  WarmAddr == PublicParams.CurDevice->Address  &&  ScoAppObj->IsStarted();
+	if (!WarmConnect)
+		InHand::FreeIndicators();
+	AtCommands.Clear();
 	try
 	{
-		ScoAppObj->StartServer (PublicParams.CurDevice->Address, PublicParams.PcSoundPref);
+		unsigned t = Timer::GetCurMilli();
+		if (WarmConnect)
+			ScoAppObj->SetIncomingReadiness (PublicParams.PcSoundPref);	// the server is registered already
+		else
+			ScoAppObj->StartServer (PublicParams.CurDevice->Address, PublicParams.PcSoundPref);
+		SlcStartTime = Timer::GetCurMilli();
+		ServerTime	 = SlcStartTime - t;
 		MyTimer.Start(TIMEOUT_HFP_NEGOTIATION,true);
-		InHand::BeginHfpConnect();
+		InHand::BeginHfpConnect(WarmConnect);
 	}
 	catch (int err)
 	{
@@ -545,6 +640,16 @@ bool HfpSm::HfpConnected (SMEVENT* ev, int param)
 {
 	MyTimer.Stop();
 
+	unsigned slctime = Timer::GetCurMilli() - SlcStartTime;
+	LogMsg ("HFP connected (%s): link %u ms, SCO server %u ms, AT handshake %u ms, total %u ms", 
+			WarmConnect ? "warm" : "cold", LinkTime, ServerTime, slctime, LinkTime + ServerTime + slctime);
+	if (WarmReconnect)
+		WarmAddr = PublicParams.CurDevice->Address;
+
+	// The book is read after the handshake, the lookup uses the previous sync meanwhile
+	PhonebookObj.Open (PublicParams.CurDevice->Address);
+	PhonebookObj.Start();
+
 	// After STATE_HfpConnecting we can also jump to call states, they should have own callbacks
 	if (State_next == STATE_HfpConnected)
 		UserCallback.HfpConnected();
@@ -570,6 +675,8 @@ bool HfpSm::ConnectFailure (SMEVENT* ev, int param)
 bool HfpSm::ServiceConnectFailure (SMEVENT* ev, int param)
 {
 	InHand::Disconnect ();
+	WarmReset();	// the kept state may be the failure cause, the next attempt is cold
+	ResetLinkState();
 	// Here must return to Disconnected state 
 	MyTimer.Start(TIMEOUT_CONNECTION_POLLING,true);
 	UserCallback.NotifyFailure (DialAppError_ServiceConnectFailure);
@@ -691,6 +798,67 @@ bool HfpSm::RejectVoice (SMEVENT* ev, int param)
 }
 
 
+bool HfpSm::ScoOpened (SMEVENT* ev, int param)
+{
+	if (ev->Param.ReportError) {
+		HfpSm::PutEvent_Failure(DialAppError_OpenScoFailure);	// the same notice as failing to start voice
+		return true;
+	}
+
+	// While the SCO was opening the voice could be switched off or the call could end
+	if (!PublicParams.PcSoundPref || !IsCurStateSupportingVoiceSwitch()) {
+		LogMsg ("The voice is not needed anymore, closing SCO");
+		StopVoiceHlp(false);
+		return true;
+	}
+
+	try
+	{
+		ScoAppObj->VoiceStart();
+		PublicParams.PcSound = true;
+	}
+	catch (int err)
+	{
+		LogMsg("EXCEPTION %d", err);
+		HfpSm::PutEvent_Failure(DialAppError_OpenScoFailure);
+	}
+	UserCallback.PcSoundOnOff (DIALAPP_FLAG_PCSOUND);
+	return true;
+}
+
+
+bool HfpSm::ScoClosed (SMEVENT* ev, int param)
+{
+	// Failure to close SCO is not noticed: it may be the normal case, e.g. the remote has closed it first
+	if (ev->Param.ReportError)
+		LogMsg ("SCO close failed #%d", ev->Param.ReportError);
+	return true;
+}
+
+
+bool HfpSm::IndicatorsChanged (SMEVENT* ev, int param)
+{
+	// All changes since the previous notification in one callback
+	uint32 changed = Indicators.TakeChanged();
+	if (changed) {
+		Indicators.Snapshot (&IndicatorsParam);
+		IndicatorsParam.Changed = changed;
+		UserCallback.IndicatorsChanged();
+	}
+	return true;
+}
+
+
+bool HfpSm::PhonebookSync (SMEVENT* ev, int param)
+{
+	if (!ev->Param.PhonebookFull)
+		PhonebookObj.Continue();	// no-op if the sync was stopped meanwhile
+	else if (State >= STATE_HfpConnected)
+		PhonebookObj.Start (true);	// ignored while a sync is in progress
+	return true;
+}
+
+
 bool HfpSm::Ringing (SMEVENT* ev, int param)
 {
 	InHand::ListCurrentCalls();
@@ -741,6 +909,9 @@ bool HfpSm::AtProcessing (SMEVENT* ev, int param)
 			break;
 
 		case SMEV_AtResponse_ListCurrentCalls:
+			UpdateCalls();
+			break;
+
 		case SMEV_AtResponse_CallingLineId:
 			SetCallInfo4CurrentCall (ev->Param.InfoCh);
 			break;
@@ -13,6 +13,8 @@
 #include "InHand.h"
 #include "ScoApp.h"
 #include "CallInfo.h"
+#include "CallTable.h"
+#include "Phonebook.h"
 
 
 #define STATE_LIST_HFPSM	\
@@ -52,6 +54,8 @@ class HfpSmCb
 	void CallCurrentInfo		();
 	void CallWaitingInfo		();
 	void CallHeldInfo			(uint32 addflag = 0);
+	void IndicatorsChanged		();
+	void CallChanged			();
 
   protected:
 	DialAppCb	CbFunc;
@@ -71,6 +75,40 @@ struct HfpPublicParam: public DialAppParam
 };
 
 
+// Phone indicators cache: fed by AT+CIND/+CIEV in the AT receive thread (and reset by the SM), 
+// read by the SM and by dialappGetIndicators in any thread.
+// The writers are serialized with the mutex, the readers don't lock: the sequence counter is odd while 
+// the data is being updated and the reader retries if it has changed during the copy.
+// Changes are coalesced: while a SMEV_Indicators event is pending, new changes just join its mask.
+// If the event can't be posted (the queue is full), the next change tries again with the whole mask.
+class HfpIndicatorCache
+{
+  public:
+	HfpIndicatorCache() : Seq(0), ChangedMask(0), Pending(0)	{ Clear(); }
+
+	// Writers
+	void Reset ();											// all unknown (no HFP connection)
+	void Set (uint32 present, const int* values);			// AT+CIND? response, values indexed by DialAppIndicator
+	void Set (int ind, int val);							// +CIEV event
+
+	// Readers
+	void   Snapshot (DialAppIndicators* out);				// lock free
+	uint32 TakeChanged ();									// SM: the changes to notify, re-arms the notification
+
+  protected:
+	void Clear ();
+	void BeginUpdate ()		{ Lock.Lock();  InterlockedIncrement (&Seq); }
+	void EndUpdate (uint32 changed);
+
+  protected:
+	Mutex				Lock;
+	volatile LONG		Seq;
+	volatile LONG		ChangedMask;	// not yet notified changes
+	volatile LONG		Pending;		// SMEV_Indicators is posted and not yet processed
+	DialAppIndicators	Data;
+};
+
+
 // Object passed to HfpSm::Init to receive result asynchronously
 struct HfpSmInitReturn
 {
@@ -99,21 +137,34 @@ class HfpSm: public SMT<HfpSm>
 	static void Init(DialAppCb cb, HfpSmInitReturn* initevent);
 	static void End();
 
+	// Warm reconnect: after the link drop the SCO server registration (with its event references in the driver)
+	// and the AG indicators mapping are kept, so reconnecting to the same device takes RFCOMM connect and
+	// the AT handshake without AT+CIND=?. Selecting/forgetting a device or a handshake failure drops them.
+	static void SetWarmReconnect (bool warm)	{ WarmReconnect = warm; }
+
   protected:
 	static HfpSmCb				UserCallback;
 	static HfpSmInitReturn *	InitEvent;
+	static bool					WarmReconnect;
 
   public:
-	HfpSm(): SMT<HfpSm>("HfpSm  "), MyTimer(SM_HFP, SMEV_Timeout), ScoAppObj(0), CallInfoCurrent(0), CallInfoHeld(0), CallInfoWaiting(0), InitEventsCnt(0)
+	HfpSm(): SMT<HfpSm>("HfpSm  "), MyTimer(SM_HFP, SMEV_Timeout), ScoAppObj(0), CallInfoCurrent(0), CallInfoHeld(0), CallInfoWaiting(0), InitEventsCnt(0), WarmAddr(0), WarmConnect(false)
 	{
 		memset (&PublicParams, 0, sizeof(DialAppParam));
+		PublicParams.Indicators = &IndicatorsParam;
+		PublicParams.Calls		= Calls.GetCalls();
+		Indicators.Snapshot (&IndicatorsParam);
 	}
 
 	void Construct();
 	void Destruct();
 
   public:
-	HfpPublicParam	 PublicParams;
+	HfpPublicParam	  PublicParams;
+	DialAppIndicators IndicatorsParam;		// PublicParams.Indicators, updated before DIALAPP_FLAG_INDICATORS callbacks
+	HfpIndicatorCache Indicators;
+	CallTable		  Calls;					// AT+CLCC calls, PublicParams.Calls
+	AtQueue			  AtCommands;				// Sent AT commands, routes the responses
 
   public:
 	SmTimer		MyTimer;
@@ -121,6 +172,14 @@ class HfpSm: public SMT<HfpSm>
 	int			HfpIndicatorsState;			// its type is STATE or -1 meaning HfpConnected state is not achieved 
 	unsigned    IncallStartTime;
 	unsigned    InitEventsCnt;
+	uint64		WarmAddr;					// Device whose SCO server and indicators mapping are kept over the link drop, or 0
+	bool		WarmConnect;				// The current HFP connect is warm
+
+	// Connect time per phase (Timer::GetCurMilli), logged when HFP gets connected
+	unsigned	ConnectStartTime;			// RFCOMM connect started
+	unsigned	LinkTime;					// RFCOMM connect
+	unsigned	ServerTime;					// SCO server registration
+	unsigned	SlcStartTime;				// AT handshake started
 
 	CallInfo<char>   *CallInfoCurrent;		// Set in InCall state after the abonent information is present
 	CallInfo<char>   *CallInfoHeld;			// Set in InCall state when the Current call is turned to Held, it is indication about Held call presence
@@ -142,17 +201,19 @@ class HfpSm: public SMT<HfpSm>
 		SmBase::PutEvent (&Event, SMQ_HIGH);
 	}
 
-	static void PutEvent_SelectDevice (uint64 addr)
+	static bool PutEvent_SelectDevice (uint64 addr, uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_SelectDevice};
 		Event.Param.BthAddr = addr;
-		SmBase::PutEvent (&Event, SMQ_LOW);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 
-	static void PutEvent_ForgetDevice ()
+	static bool PutEvent_ForgetDevice (uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_ForgetDevice};
-		SmBase::PutEvent (&Event, SMQ_LOW);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 	
 	static void PutEvent_ConnectStart (uint64 addr)
@@ -181,24 +242,27 @@ class HfpSm: public SMT<HfpSm>
 		SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 
-	static void PutEvent_Headset (bool headset_on)
+	static bool PutEvent_Headset (bool headset_on, uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_SwitchHeadset};
 		Event.Param.PcSound = headset_on;
-		SmBase::PutEvent (&Event, SMQ_HIGH);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_HIGH);
 	}
 
-	static void PutEvent_StartOutgoingCall (cchar* dialnumber)
+	static bool PutEvent_StartOutgoingCall (cchar* dialnumber, uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_StartOutgoingCall};
 		Event.Param.CallNumber = new ((char*)dialnumber) CallInfo<char>((char*)dialnumber);
-		SmBase::PutEvent (&Event, SMQ_LOW);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 
-	static void PutEvent_Answer ()
+	static bool PutEvent_Answer (uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_Answer};
-		SmBase::PutEvent (&Event, SMQ_HIGH);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_HIGH);
 	}
 
 	static void PutEvent_AtResponse (SMEV_ATRESPONSE resp)
@@ -232,10 +296,11 @@ class HfpSm: public SMT<HfpSm>
 		SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 
-	static void PutEvent_CallEnd ()
+	static bool PutEvent_CallEnd (uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_CallEnd};
-		SmBase::PutEvent (&Event, SMQ_HIGH);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_HIGH);
 	}
 
 	static void PutEvent_CallEnded ()
@@ -250,17 +315,19 @@ class HfpSm: public SMT<HfpSm>
 		SmBase::PutEvent (&Event, SMQ_HIGH);
 	}
 
-	static void PutEvent_SendDtmf (cchar dialinfo)
+	static bool PutEvent_SendDtmf (cchar dialinfo, uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_SendDtmf};
 		Event.Param.Dtmf = dialinfo;
-		SmBase::PutEvent (&Event, SMQ_LOW);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 
-	static void PutEvent_PutOnHold ()
+	static bool PutEvent_PutOnHold (uint32 token = 0)
 	{
 		SMEVENT Event = {SM_HFP, SMEV_PutOnHold};
-		SmBase::PutEvent (&Event, SMQ_LOW);
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_LOW);
 	}
 
 	static void PutEvent_CallWaiting(char* info)
@@ -284,12 +351,27 @@ class HfpSm: public SMT<HfpSm>
 		Event.Param.AtResponse = resp;
 		SmBase::PutEvent (&Event, SMQ_HIGH);
 	}
+
+	static bool PutEvent_Indicators ()
+	{
+		SMEVENT Event = {SM_HFP, SMEV_Indicators};
+		return SmBase::PutEvent (&Event, SMQ_LOW);
+	}
+
+	static bool PutEvent_Phonebook (bool full = false, uint32 token = 0)
+	{
+		SMEVENT Event = {SM_HFP, SMEV_Phonebook};
+		Event.Param.PhonebookFull = full;
+		Event.Token = token;
+		return SmBase::PutEvent (&Event, SMQ_LOW);
+	}
 	
   // SCO App callbacks
   private:
 	static void ScoConnectCallback ();
 	static void ScoDisconnectCallback ();
 	static void ScoCritErrorCallback ();
+	static void ScoIoCallback (SCO_IO io, int error);
 
   // Help functions
   private:
@@ -301,6 +383,9 @@ class HfpSm: public SMT<HfpSm>
 	void SetCallInfo4HeldCall    (SMEV_ATRESPONSE heldstatus);
 	void ClearAllCallInfo ();
 	bool IsCurStateSupportingVoiceSwitch();
+	void WarmReset ();
+	void ResetLinkState ();			// the connection state kept for the host and the phone book sync
+	void UpdateCalls ();
 
   // Transitions
   private:
@@ -326,6 +411,10 @@ class HfpSm: public SMT<HfpSm>
 	bool SwitchedVoiceOnOff			(SMEVENT* ev, int param);
 	bool StopVoice					(SMEVENT* ev, int param);
 	bool RejectVoice				(SMEVENT* ev, int param);
+	bool ScoOpened					(SMEVENT* ev, int param);
+	bool ScoClosed					(SMEVENT* ev, int param);
+	bool IndicatorsChanged			(SMEVENT* ev, int param);
+	bool PhonebookSync				(SMEVENT* ev, int param);
 	bool ConnectFailure				(SMEVENT* ev, int param);
 	bool ServiceConnectFailure		(SMEVENT* ev, int param);
 	bool Ringing					(SMEVENT* ev, int param);
@@ -367,6 +456,7 @@ inline void HfpSmCb::DevicePresent (uint32 addflag)
 inline void HfpSmCb::DeviceUnknown ()
 {
 	uint32 flag = (HfpSmObj.State_next != HfpSmObj.State) ? DIALAPP_FLAG_NEWSTATE:0;
+	HfpSmObj.ReportedError = DialAppError_UnknownDevice;
 	CbFunc (DialAppState(HfpSmObj.State_next), DialAppError_UnknownDevice, DIALAPP_FLAG_CURDEV|flag, &HfpSmObj.PublicParams);
 }
 
@@ -379,6 +469,7 @@ inline void HfpSmCb::DeviceForgot ()
 inline void HfpSmCb::NotifyFailure (int error)
 {
 	uint32 flag = (HfpSmObj.State_next != HfpSmObj.State) ? DIALAPP_FLAG_NEWSTATE:0;
+	HfpSmObj.ReportedError = error;
 	CbFunc (DialAppState(HfpSmObj.State_next), DialAppError(error), flag, &HfpSmObj.PublicParams);
 	LogMsg ("ERROR %d Reported To User", error);
 }
@@ -446,5 +537,17 @@ inline void HfpSmCb::CallHeldInfo (uint32 addflag)
 	CbFunc (DialAppState(HfpSmObj.State), DialAppError_Ok, flag, &HfpSmObj.PublicParams);
 }
 
+inline void HfpSmCb::CallChanged ()
+{
+	// DIALAPP_FLAG_NEWSTATE in this case is impossible
+	CbFunc (DialAppState(HfpSmObj.State), DialAppError_Ok, DIALAPP_FLAG_CALL, &HfpSmObj.PublicParams);
+}
+
+inline void HfpSmCb::IndicatorsChanged ()
+{
+	// DIALAPP_FLAG_NEWSTATE in this case is impossible
+	CbFunc (DialAppState(HfpSmObj.State), DialAppError_Ok, DIALAPP_FLAG_INDICATORS, &HfpSmObj.PublicParams);
+}
+
 
 #endif  // _HFPSM_H_
@@ -0,0 +1,93 @@
+/*******************************************************************\
+ Filename    :  PhoneNumber.cpp
+ Purpose     :  Phone number normalization to a packed 64-bit key
+\*******************************************************************/
+
+#include "def.h"
+#include "PhoneNumber.h"
+
+
+char PhoneNumber::CountryCode [MaxCountryCode + 1];
+
+
+void PhoneNumber::Init ()
+{
+	char cc[8];
+
+	// LOCALE_ICOUNTRY is the international phone code of the country/region
+	if (GetLocaleInfoA (LOCALE_USER_DEFAULT, LOCALE_ICOUNTRY, cc, sizeof(cc)))
+		SetCountryCode (cc);
+}
+
+
+void PhoneNumber::SetCountryCode (cchar* cc)
+{
+	int n = 0;
+
+	if (cc  &&  cc[0] != '0') {
+		while (n <= MaxCountryCode  &&  cc[n] >= '0'  &&  cc[n] <= '9')
+			n++;
+		if (cc[n]  ||  n > MaxCountryCode)
+			n = 0;
+		memcpy (CountryCode, cc, n);
+	}
+	CountryCode[n] = '\0';
+}
+
+
+static inline uint64 Tbcd (char c)
+{
+	return (c == '*') ? 0xA : (c == '#') ? 0xB : uint64(c - '0');
+}
+
+
+uint64 PhoneNumber::Key (cchar* number)
+{
+	char	digits [MaxDialable];
+	cchar*	cc	  = "";
+	int		len	  = 0;
+	bool	plus  = false;
+	bool	local = false;		// a service code: kept as dialed
+	uint64	key	  = 0;
+	int		n	  = 0, i;
+
+	if (!number)
+		return 0;
+
+	for (cchar* s = number;  *s  &&  *s != ','  &&  *s != ';'  &&  *s != 'p'  &&  *s != 'P'  &&  *s != 'w'  &&  *s != 'W';  s++)
+	{
+		if ((*s >= '0'  &&  *s <= '9')  ||  *s == '*'  ||  *s == '#') {
+			local |= (*s == '*'  ||  *s == '#');
+			if (len < MaxDialable)
+				digits[len++] = *s;
+		}
+		else if (*s == '+'  &&  !len)
+			plus = true;
+	}
+
+	cchar* d   = digits;
+	bool   nanp = (CountryCode[0] == '1'  &&  !CountryCode[1]);
+
+	if (!plus  &&  !local)
+	{
+		if (len > 2  &&  d[0] == '0'  &&  d[1] == '0')
+			d += 2;									// international prefix
+		else if (nanp  &&  len > 3  &&  d[0] == '0'  &&  d[1] == '1'  &&  d[2] == '1')
+			d += 3;
+		else if (len > 1  &&  d[0] == '0') {
+			d  += 1;								// trunk prefix
+			cc	= CountryCode;
+		}
+		else if (nanp  &&  len == 10)
+			cc	= CountryCode;
+		len -= int(d - digits);
+	}
+
+	// The last MaxDigits of the country code and the number
+	for (i = len - 1;  i >= 0  &&  n < MaxDigits;  i--)
+		key |= Tbcd (d[i]) << (4 * n++);
+	for (i = int(strlen (cc)) - 1;  i >= 0  &&  n < MaxDigits;  i--)
+		key |= Tbcd (cc[i]) << (4 * n++);
+
+	return n ? (key | ((uint64)n << CountShift)) : 0;
+}
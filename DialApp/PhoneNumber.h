@@ -0,0 +1,71 @@
+/*******************************************************************\
+ Filename    :  PhoneNumber.h
+ Purpose     :  Phone number normalization to a packed 64-bit key
+\*******************************************************************/
+
+#ifndef _PHONENUMBER_H_
+#define _PHONENUMBER_H_
+
+#include "def.h"
+
+
+/*
+ ****************************************************************************************
+ The AG reports the same number in different forms: "+972501234567" in +CLIP,
+ "0501234567" in +CLCC, "050-123-4567" in the phone book. The number is normalized once
+ to a key, then the numbers are compared as integers and the key indexes the phone book.
+
+ The number is brought to its international (E.164) form: '+' or the international prefix
+ ("00", "011" in the NANP) is dropped, the national trunk prefix '0' is replaced by the home
+ country code (CountryCode, of the Windows locale by default); in the NANP the 10-digit
+ numbers get the country code. The other numbers (local ones, service codes with '*' or '#')
+ are kept as dialed, so they match exactly.
+
+ The key packs up to MaxDigits dialable characters in TBCD (4 bits per character,
+ '*' = 0xA, '#' = 0xB), the last one in the lowest nibble, and their count in the highest
+ nibble; a longer number (not an E.164 one) keeps its last MaxDigits. Separators and the
+ letters are skipped, the post-dial part (after a pause ',', 'p' or a wait ';', 'w') is not
+ a part of the number. 0 is the key of a number without digits (a hidden or an unknown one).
+ ****************************************************************************************
+ */
+class PhoneNumber
+{
+  public:
+	enum {
+		MaxDigits		= 15,		// E.164 max, fills the 60 bits below the count
+		CountShift		= 60,
+		MaxCountryCode	= 3,
+		MaxDialable		= 48		// Longer input is cut
+	};
+
+  public:
+	// Takes CountryCode from the Windows user locale. Call before the keys are made (dialappInit).
+	static void	  Init ();
+	// Home country calling code for the national numbers, e.g. "972"; 0 or an invalid one: unknown,
+	// the trunk prefix is dropped only
+	static void	  SetCountryCode (cchar* cc);
+
+	static uint64 Key (cchar* number);
+	static int	  KeyDigits (uint64 key)	{ return int(key >> CountShift); }
+
+	// Numbers comparison, the keys of both are 0: the raw strings are compared
+	static bool	  IsSame (uint64 key1, cchar* number1, uint64 key2, cchar* number2);
+
+  protected:
+	static char	  CountryCode [MaxCountryCode + 1];
+};
+
+
+inline bool PhoneNumber::IsSame (uint64 key1, cchar* number1, uint64 key2, cchar* number2)
+{
+	if (key1 || key2)
+		return key1 == key2;
+	if (number1 == number2)
+		return true;
+	if (!number1 || !number2)
+		return false;
+	return strcmp (number1, number2) == 0;
+}
+
+
+#endif  // _PHONENUMBER_H_
@@ -0,0 +1,501 @@
+/*******************************************************************\
+ Filename    :  Phonebook.cpp
+ Purpose     :  Phone book sync (AT+CPBS/AT+CPBR) and the name lookup
+\*******************************************************************/
+
+#include "def.h"
+#include "deblog.h"
+#include "str.h"
+#include "Phonebook.h"
+#include "HfpSm.h"
+
+
+Phonebook PhonebookObj;
+
+
+Phonebook::Phonebook () : Addr(0), State(Sync_Idle), CmdOk(false), InFlight(0), NextIdx(0), PendingHead(0),
+						  RawFile(INVALID_HANDLE_VALUE), BookFile(INVALID_HANDLE_VALUE), BookMapping(0), View(0), Header(0)
+{
+	memset (&Raw, 0, sizeof(Raw));
+}
+
+
+void Phonebook::GetPath (char* path, cchar* ext)
+{
+	char dir[MAX_PATH];
+
+	DWORD n = GetEnvironmentVariableA ("LOCALAPPDATA", dir, MAX_PATH);
+	if (!n || n >= MAX_PATH)
+		GetTempPathA (MAX_PATH, dir);
+
+	STRB str(path);
+	str.Sprintf ("%s\\DialApp", dir);
+	CreateDirectoryA (path, 0);
+	str.Sprintf ("%s\\DialApp\\pb_%012llX.%s", dir, Addr, ext);
+}
+
+
+/********************************************************************************\
+								Mapping and lookup
+\********************************************************************************/
+
+bool Phonebook::Map ()
+{
+	char path[MAX_PATH+32];
+	GetPath (path, "pbk");
+
+	BookFile = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+	if (BookFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD size = GetFileSize (BookFile, 0);
+	if (size >= sizeof(PbFileHeader)  &&  (BookMapping = CreateFileMappingA (BookFile, 0, PAGE_READONLY, 0, 0, 0)))
+		View = (const byte*) MapViewOfFile (BookMapping, FILE_MAP_READ, 0, 0, 0);
+
+	Header = (const PbFileHeader*) View;
+	if (!View  ||  Header->Magic != PB_MAGIC  ||
+		sizeof(PbFileHeader) + Header->Count * sizeof(PbIndexEntry) > Header->PoolOffset  ||  Header->PoolOffset + Header->PoolSize > size)
+	{
+		LogMsg ("Phonebook %s is corrupted", path);
+		Unmap();
+		DeleteFileA (path);
+		return false;
+	}
+	LogMsg ("Phonebook %llX mapped: %d entries", Addr, Header->Count);
+	return true;
+}
+
+
+void Phonebook::Unmap ()
+{
+	if (View)
+		UnmapViewOfFile (View);
+	if (BookMapping)
+		CloseHandle (BookMapping);
+	if (BookFile != INVALID_HANDLE_VALUE)
+		CloseHandle (BookFile);
+	View		= 0;
+	Header		= 0;
+	BookMapping = 0;
+	BookFile	= INVALID_HANDLE_VALUE;
+}
+
+
+bool Phonebook::Lookup (cchar* number, char* name, int size)
+{
+	return Lookup (PhoneNumber::Key (number), name, size);
+}
+
+
+bool Phonebook::Lookup (uint64 key, char* name, int size)
+{
+	bool found = false;
+
+	if (!key)
+		return false;
+
+	Lock.Lock();
+	if (Header)
+	{
+		const PbIndexEntry* idx = (const PbIndexEntry*) (View + sizeof(PbFileHeader));
+		cchar* pool = (cchar*) View + Header->PoolOffset;
+		uint32 lo = 0, hi = Header->Count;
+
+		// lower bound of the key
+		while (lo < hi) {
+			uint32 mid = (lo + hi) / 2;
+			if (idx[mid].Key < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < Header->Count  &&  idx[lo].Key == key  &&  idx[lo].Offset < Header->PoolSize)
+		{
+			cchar* s = pool + idx[lo].Offset;
+			s += strlen(s) + 1;		// skip the number
+			if (*s) {
+				strncpy (name, s, size - 1);
+				name[size-1] = '\0';
+				found = true;
+			}
+		}
+	}
+	Lock.Unlock();
+	return found;
+}
+
+
+void Phonebook::Open (uint64 addr)
+{
+	if (addr == Addr)
+		return;		// mapped already or not synced yet (Build maps it)
+	Close();
+	Lock.Lock();
+	Addr = addr;
+	Map();
+	Lock.Unlock();
+}
+
+
+void Phonebook::Close ()
+{
+	Stop();
+	Lock.Lock();
+	Unmap();
+	Addr = 0;
+	Lock.Unlock();
+}
+
+
+/********************************************************************************\
+								Sync, SM side
+\********************************************************************************/
+
+void Phonebook::WriteRawHeader ()
+{
+	DWORD n;
+	LONG  high = 0;
+
+	SetFilePointer (RawFile, 0, 0, FILE_BEGIN);
+	WriteFile (RawFile, &Raw, sizeof(Raw), &n, 0);
+	SetFilePointer (RawFile, 0, &high, FILE_END);
+}
+
+
+void Phonebook::Start (bool full)
+{
+	char  path[MAX_PATH+32];
+	DWORD n;
+
+	if (!Addr  ||  State != Sync_Idle)
+		return;
+
+	GetPath (path, "raw");
+	if (full)
+		DeleteFileA (path);
+
+	Lock.Lock();
+	RawFile = CreateFileA (path, GENERIC_READ|GENERIC_WRITE, 0, 0, OPEN_ALWAYS, 0, 0);
+	if (RawFile == INVALID_HANDLE_VALUE) {
+		Lock.Unlock();
+		LogMsg ("Phonebook: cannot open %s (%d)", path, GetLastError());
+		return;
+	}
+
+	if (ReadFile (RawFile, &Raw, sizeof(Raw), &n, 0)  &&  n == sizeof(Raw)  &&  Raw.Magic == PB_MAGIC_RAW  &&  Raw.Size >= sizeof(Raw))
+	{
+		// Resume: drop the entries of the ranges which were not completed
+		SetFilePointer (RawFile, Raw.Size, 0, FILE_BEGIN);
+		SetEndOfFile (RawFile);
+		NextIdx = Raw.Done + 1;
+		LogMsg ("Phonebook: resuming sync at %d of %d..%d", NextIdx, Raw.First, Raw.Last);
+	}
+	else if (View  &&  !full)
+	{
+		// The book is synced already (there is no change tracking in AT+CPBR)
+		CloseHandle (RawFile);
+		RawFile = INVALID_HANDLE_VALUE;
+		DeleteFileA (path);
+		Lock.Unlock();
+		return;
+	}
+	else
+	{
+		memset (&Raw, 0, sizeof(Raw));
+		Raw.Magic = PB_MAGIC_RAW;
+		Raw.Size  = sizeof(Raw);
+		strcpy (Raw.Storage, "ME");
+		SetFilePointer (RawFile, 0, 0, FILE_BEGIN);
+		SetEndOfFile (RawFile);
+		WriteRawHeader();
+		NextIdx = 0;
+	}
+
+	State		= Sync_Select;
+	InFlight	= 0;
+	PendingHead = 0;
+	Lock.Unlock();
+
+	InHand::PhonebookSelect (Raw.Storage);
+}
+
+
+void Phonebook::Stop ()
+{
+	Lock.Lock();
+	if (RawFile != INVALID_HANDLE_VALUE) {
+		CloseHandle (RawFile);
+		RawFile = INVALID_HANDLE_VALUE;
+	}
+	State	 = Sync_Idle;
+	InFlight = 0;
+	Lock.Unlock();
+}
+
+
+void Phonebook::SendRanges ()
+{
+	while (InFlight < Pipeline  &&  NextIdx <= Raw.Last)
+	{
+		uint32 last = min (NextIdx + RangeSize - 1, Raw.Last);
+
+		Lock.Lock();
+		PendingLast [(PendingHead + InFlight) % Pipeline] = last;
+		InFlight++;
+		Lock.Unlock();
+
+		InHand::PhonebookRead (NextIdx, last);
+		NextIdx = last + 1;
+	}
+}
+
+
+void Phonebook::Continue ()
+{
+	switch (State)
+	{
+		case Sync_Select:
+			if (!CmdOk) {
+				// Not all phones have the phone memory book, try the SIM one
+				if (strcmp (Raw.Storage, "ME") == 0) {
+					strcpy (Raw.Storage, "SM");
+					InHand::PhonebookSelect (Raw.Storage);
+					return;
+				}
+				LogMsg ("Phonebook: no storage available");
+				Stop();
+				return;
+			}
+			if (Raw.Last) {
+				State = Sync_Read;	// resumed, the range is known
+				break;
+			}
+			State = Sync_Range;
+			InHand::PhonebookRead (0, 0);
+			return;
+
+		case Sync_Range:
+			if (!CmdOk  ||  !Raw.Last  ||  Raw.Last < Raw.First) {
+				LogMsg ("Phonebook: no range (%d..%d)", Raw.First, Raw.Last);
+				Stop();
+				return;
+			}
+			Lock.Lock();
+			Raw.Done = Raw.First - 1;
+			WriteRawHeader();
+			Lock.Unlock();
+			NextIdx = Raw.First;
+			State	= Sync_Read;
+			break;
+
+		case Sync_Read:
+			break;
+
+		default:
+			return;
+	}
+
+	SendRanges();
+
+	if (InFlight == 0  &&  NextIdx > Raw.Last)
+		Build();
+}
+
+
+/********************************************************************************\
+								Sync, AT receive side
+\********************************************************************************/
+
+void Phonebook::AddLine (AtCmd cmd, cchar* cpbr)
+{
+	Lock.Lock();
+	if (State == Sync_Idle  ||  RawFile == INVALID_HANDLE_VALUE) {
+		Lock.Unlock();
+		return;
+	}
+
+	if (cmd == AtCmd_CpbrRange)
+	{
+		// "(<first>-<last>),<nlength>,<tlength>"
+		int first = 0, last = 0;
+		if (sscanf (cpbr, " (%d-%d)", &first, &last) == 2  &&  first > 0  &&  last >= first) {
+			Raw.First = first;
+			Raw.Last  = last;
+		}
+	}
+	else if (cmd == AtCmd_Cpbr)
+	{
+		// "<index>,"<number>",<type>,"<text>"": the number and the text are the 1st and the 2nd quoted strings
+		char   rec [2 + PB_MAX_NUMBER + PB_MAX_NAME];
+		int	   len[2] = {0, 0};
+		cchar* s = cpbr;
+
+		for (int i = 0; i < 2; i++)
+		{
+			if ( !(s = strchr (s, '\"')) )
+				break;
+			cchar* e = strchr (++s, '\"');
+			if (!e)
+				break;
+			len[i] = min (int(e - s), i ? PB_MAX_NAME : PB_MAX_NUMBER);
+			memcpy (rec + 2 + (i ? len[0] : 0), s, len[i]);
+			s = e + 1;
+		}
+
+		if (len[0]) {
+			DWORD n;
+			rec[0] = (char) len[0];
+			rec[1] = (char) len[1];
+			WriteFile (RawFile, rec, 2 + len[0] + len[1], &n, 0);
+		}
+	}
+	Lock.Unlock();
+}
+
+
+void Phonebook::CommandDone (AtCmd cmd, bool ok)
+{
+	Lock.Lock();
+	if (State != Sync_Idle)
+	{
+		if (cmd == AtCmd_Cpbr) {
+			// Failed range (e.g. "+CME ERROR: not found" for the empty one) is skipped, not to stall the sync
+			if (InFlight) {
+				Raw.Done = PendingLast[PendingHead];
+				PendingHead = (PendingHead + 1) % Pipeline;
+				InFlight--;
+			}
+			if (RawFile != INVALID_HANDLE_VALUE) {
+				Raw.Size = GetFileSize (RawFile, 0);
+				WriteRawHeader();
+			}
+		}
+		else
+			CmdOk = ok;
+	}
+	Lock.Unlock();
+	HfpSm::PutEvent_Phonebook();
+}
+
+
+/********************************************************************************\
+								Index build
+\********************************************************************************/
+
+static int ComparePbIndexEntry (const void* a, const void* b)
+{
+	uint64 x = ((const PbIndexEntry*)a)->Key;
+	uint64 y = ((const PbIndexEntry*)b)->Key;
+	return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+void Phonebook::Build ()
+{
+	char	 rawpath[MAX_PATH+32], path[MAX_PATH+32], tmppath[MAX_PATH+32];
+	HANDLE	 map = 0, tmp = INVALID_HANDLE_VALUE;
+	const byte* raw = 0;
+	PbIndexEntry* index = 0;
+	uint32	 count = 0, poolsize = 0;
+	DWORD	 n, size;
+	const byte *p, *end;
+
+	GetPath (rawpath, "raw");
+	GetPath (path, "pbk");
+	GetPath (tmppath, "tmp");
+
+	Lock.Lock();
+	State = Sync_Idle;
+	size  = GetFileSize (RawFile, 0);
+	if (size > sizeof(PbRawHeader)  &&  (map = CreateFileMappingA (RawFile, 0, PAGE_READONLY, 0, 0, 0)))
+		raw = (const byte*) MapViewOfFile (map, FILE_MAP_READ, 0, 0, 0);
+	Lock.Unlock();
+
+	// Records are read from the mapped raw file, only the index is in the heap
+	if (raw)
+	{
+		end = raw + size;
+		for (p = raw + sizeof(PbRawHeader);  p + 2 <= end  &&  p + 2 + p[0] + p[1] <= end;  p += 2 + p[0] + p[1])
+			count++;
+
+		index = new PbIndexEntry [count ? count : 1];
+
+		tmp = CreateFileA (tmppath, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0, 0);
+		if (tmp != INVALID_HANDLE_VALUE)
+		{
+			PbFileHeader hdr;
+			char		 str [PB_MAX_NUMBER + PB_MAX_NAME + 2];
+			uint32		 pooloffset = sizeof(PbFileHeader) + count * sizeof(PbIndexEntry);
+
+			// The pool goes after the index space: the records without digits leave it a bit oversized
+			SetFilePointer (tmp, pooloffset, 0, FILE_BEGIN);
+
+			count = 0;
+			for (p = raw + sizeof(PbRawHeader);  p + 2 <= end  &&  p + 2 + p[0] + p[1] <= end;  p += 2 + p[0] + p[1])
+			{
+				int nlen = p[0], tlen = p[1];
+				memcpy (str, p + 2, nlen);
+				str[nlen] = '\0';
+				memcpy (str + nlen + 1, p + 2 + nlen, tlen);
+				str[nlen + 1 + tlen] = '\0';
+
+				uint64 key = PhoneNumber::Key (str);
+				if (!key)
+					continue;
+				index[count].Key	  = key;
+				index[count].Offset	  = poolsize;
+				index[count].Reserved = 0;
+				count++;
+
+				WriteFile (tmp, str, nlen + tlen + 2, &n, 0);
+				poolsize += nlen + tlen + 2;
+			}
+
+			qsort (index, count, sizeof(PbIndexEntry), ComparePbIndexEntry);
+
+			hdr.Magic	   = PB_MAGIC;
+			hdr.Count	   = count;
+			hdr.PoolOffset = pooloffset;
+			hdr.PoolSize   = poolsize;
+			SetFilePointer (tmp, 0, 0, FILE_BEGIN);
+			WriteFile (tmp, &hdr, sizeof(hdr), &n, 0);
+			WriteFile (tmp, index, count * sizeof(PbIndexEntry), &n, 0);
+			CloseHandle (tmp);
+		}
+
+		UnmapViewOfFile (raw);
+	}
+	else if (size <= sizeof(PbRawHeader))
+	{
+		// Nothing was read (empty phonebook): the empty index replaces the raw file all the same,
+		// otherwise the sync is resumed and built again on every connect
+		tmp = CreateFileA (tmppath, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0, 0);
+		if (tmp != INVALID_HANDLE_VALUE)
+		{
+			PbFileHeader hdr;
+			hdr.Magic	   = PB_MAGIC;
+			hdr.Count	   = 0;
+			hdr.PoolOffset = sizeof(PbFileHeader);
+			hdr.PoolSize   = 0;
+			WriteFile (tmp, &hdr, sizeof(hdr), &n, 0);
+			CloseHandle (tmp);
+		}
+	}
+	if (map)
+		CloseHandle (map);
+	delete[] index;
+
+	Lock.Lock();
+	CloseHandle (RawFile);
+	RawFile = INVALID_HANDLE_VALUE;
+	if (tmp != INVALID_HANDLE_VALUE)
+	{
+		Unmap();
+		if (MoveFileExA (tmppath, path, MOVEFILE_REPLACE_EXISTING))
+			DeleteFileA (rawpath);
+		Map();
+	}
+	Lock.Unlock();
+
+	LogMsg ("Phonebook %llX synced: %d entries (%s)", Addr, count, Raw.Storage);
+}
@@ -0,0 +1,132 @@
+/*******************************************************************\
+ Filename    :  Phonebook.h
+ Purpose     :  Phone book sync (AT+CPBS/AT+CPBR) and the name lookup
+\*******************************************************************/
+
+#ifndef _PHONEBOOK_H_
+#define _PHONEBOOK_H_
+
+#include "def.h"
+#include "mutex.h"
+#include "AtQueue.h"
+#include "PhoneNumber.h"
+
+
+/*
+ ****************************************************************************************
+ Phone book files, one pair per device in %LOCALAPPDATA%\DialApp (or %TEMP%\DialApp):
+
+ pb_<address>.raw - the sync in progress: PbRawHeader and the records as they are read
+                    (uint8 number length, uint8 name length, number, name). The header
+                    keeps the synced part, so a dropped connection resumes from there.
+ pb_<address>.pbk - the synced book, memory mapped for the lookup: PbFileHeader, the index
+                    sorted by PhoneNumber::Key and the string pool ("number\0name\0").
+ ****************************************************************************************
+ */
+#define PB_MAGIC_RAW		0x57415250	// "PRAW"
+#define PB_MAGIC			0x33425048	// "HPB3", the E.164 TBCD keys
+#define PB_MAX_NUMBER		64
+#define PB_MAX_NAME			64
+
+
+struct PbRawHeader
+{
+	uint32	Magic;
+	uint32	First;						// Book range (AT+CPBR=?)
+	uint32	Last;
+	uint32	Done;						// Entries up to this index are synced, First-1 if none
+	uint32	Size;						// File size when Done was reached
+	char	Storage[4];					// AT+CPBS storage
+};
+
+struct PbFileHeader
+{
+	uint32	Magic;
+	uint32	Count;						// Index entries
+	uint32	PoolOffset;					// From the file start
+	uint32	PoolSize;
+};
+
+struct PbIndexEntry
+{
+	uint64	Key;						// PhoneNumber::Key
+	uint32	Offset;						// Pool offset of "number\0name\0"
+	uint32	Reserved;
+};
+
+
+
+/*
+ ****************************************************************************************
+ The sync is driven by the SM thread: it sends the commands and processes SMEV_Phonebook,
+ which is posted by the AT receive thread on each command completion. The entries are 
+ streamed to the raw file by the receive thread, AT+CPBR ranges are pipelined.
+ When the whole range is read the index is built and the book is remapped.
+ ****************************************************************************************
+ */
+class Phonebook
+{
+  public:
+	enum {
+		RangeSize = 40,					// Entries per AT+CPBR
+		Pipeline  = 2					// AT+CPBR commands in flight
+	};
+
+	enum SyncState {
+		Sync_Idle,
+		Sync_Select,					// AT+CPBS sent
+		Sync_Range,						// AT+CPBR=? sent
+		Sync_Read						// AT+CPBR=<first>,<last> are being sent
+	};
+
+  public:
+	Phonebook();
+	~Phonebook()	{ Close(); }
+
+	// SM side
+	void Open	  (uint64 addr);		// Maps the synced book of the device
+	void Close	  ();
+	void Start	  (bool full = false);	// Starts (resumes) the sync on the connected device, full: from scratch
+	void Stop	  ();					// Connection lost: the sync will be resumed by the next Start
+	void Continue ();					// SMEV_Phonebook
+
+	// AT receive side
+	void AddLine	 (AtCmd cmd, cchar* cpbr);	// "+CPBR:" line without the prefix
+	void CommandDone (AtCmd cmd, bool ok);
+
+	// Any thread: O(log n) in the mapped index
+	bool Lookup (cchar* number, char* name, int size);
+	bool Lookup (uint64 key, char* name, int size);
+
+  protected:
+	void SendRanges ();
+	void Build ();
+	bool Map ();
+	void Unmap ();
+	void WriteRawHeader ();
+	void GetPath (char* path, cchar* ext);
+
+  protected:
+	Mutex			Lock;				// receive/SM sides and the mapping
+	uint64			Addr;
+	SyncState		State;
+	bool			CmdOk;				// last AT+CPBS / AT+CPBR=? result
+	int				InFlight;			// AT+CPBR commands sent
+	uint32			NextIdx;			// next entry index to request
+	uint32			PendingLast[Pipeline];	// last entry index of the ranges in flight (FIFO)
+	int				PendingHead;
+
+	HANDLE			RawFile;
+	PbRawHeader		Raw;
+
+	HANDLE			BookFile;
+	HANDLE			BookMapping;
+	const byte*		View;
+	const PbFileHeader* Header;
+};
+
+
+extern Phonebook PhonebookObj;
+
+
+#endif  // _PHONEBOOK_H_
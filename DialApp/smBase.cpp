@@ -19,13 +19,13 @@ SmBase	SmBase::This;
 SM*		SmBase::SmGlobalArray [SMID_NUMS];
 
 Semaph	SmBase::QueueSemaphor;
+SMCOMMANDDONE SmBase::CommandDone;
 
-FIFO_ALLOC <SMEVENT,SmBase::SM_HQUEUE_SIZE>  SmBase::QueueHigh;
-FIFO_ALLOC <SMEVENT,SmBase::SM_LQUEUE_SIZE>  SmBase::QueueLow;
+RING_BUFFER_ALLOC <SMEVENT,SmBase::SM_HQUEUE_SIZE>  SmBase::QueueHigh;
+RING_BUFFER_ALLOC <SMEVENT,SmBase::SM_LQUEUE_SIZE>  SmBase::QueueLow;
 
 #ifdef SMBASE_CHOICES
-SMCHOICE  SM::ChoiceBuffer[SMBASE_CHOICES];
-int		  SM::ChoiceNextIdx;
+STATIC_VECTOR <SMCHOICE,SMBASE_CHOICES>  SM::ChoiceBuffer;
 #endif
 
 /***********************************************************************************************\
@@ -44,8 +44,13 @@ bool SM::Execute (SMEVENT *pEv)
 	} F;
 
     ASSERT_f (this == SmBase::SmGlobalArray[SmId]);
+    ReportedError = 0;
 
-	LogMsg ("[ %6s:%-14s ] < - - - - - - - - '%s'\n", enumTable_SMID[SmId], aStateNames[State], smidFormatEventName(pEv));
+	if (DebLog::IsTracing())
+	{
+		StrallocScope scope;	// the event name string lives until the message is out
+		LogMsg ("[ %6s:%-14s ] < - - - - - - - - '%s'\n", enum_SMID(SmId), aStateNames[State], smidFormatEventName(pEv));
+	}
     //prnEventPrint (pEv);
 
     pEvState = & aStates[State][pEv->Ev];
@@ -74,7 +79,7 @@ bool SM::Execute (SMEVENT *pEv)
         }
         State_prev = State;
         State = State_next;
-        LogMsg ("[ %6s:%-14s ]\n\n", enumTable_SMID[SmId],  aStateNames[State]);
+        LogMsg ("[ %6s:%-14s ]\n\n", enum_SMID(SmId),  aStateNames[State]);
         return true;
     }        
 
@@ -110,7 +115,7 @@ bool SmBase::PutEvent (SMEVENT *pEv, SMQ level)
     {
         case SMQ_IMMEDIATE:
             ASSERT_f (pEv->SmId && pEv->SmId!=SMID_ALL);
-            SmGlobalArray[pEv->SmId]->Execute (pEv);
+            ExecuteEvent (pEv);
             res = true;
             goto exit;
 
@@ -148,12 +153,21 @@ void SmBase::Destruct()
 	LogMsg("Destructed");
 }
 
+void SmBase::ExecuteEvent (SMEVENT *pEv)
+{
+	SM*  sm = SmGlobalArray[pEv->SmId];
+	bool processed = sm->Execute (pEv);
+	if (pEv->Token && CommandDone)
+		CommandDone (pEv, sm, processed);
+}
+
+
 void SmBase::Run ()
 {
 	LogMsg("Task started...");
 
     SMEVENT *ev;
-    FIFO<SMEVENT> * fifos[] = { &QueueHigh, &QueueLow };
+    RING_BUFFER<SMEVENT> * fifos[] = { &QueueHigh, &QueueLow };
     
     // Do endless loop SMQ_HIGH..SMQ_LOW
     for (int i = SMQ_HIGH; ; i = (i+1) & 1)
@@ -162,7 +176,7 @@ void SmBase::Run ()
 			QueueSemaphor.Take();
         while (!fifos[i]->IsEmpty()) {
             ev = fifos[i]->GetFirst();
-            SmGlobalArray[ev->SmId]->Execute (ev);
+            ExecuteEvent (ev);
             fifos[i]->ReleaseFirst();
             if (i == SMQ_LOW)
                 break;
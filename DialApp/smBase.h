@@ -10,7 +10,7 @@
 #include "def.h"
 #include "smId.h"
 #include "deblog.h"
-#include "fifo_cse.h"
+#include "fixed_cont.h"
 #include "thread.h"
 
 
@@ -40,6 +40,13 @@ struct SM;
 struct SMEVENT;
 
 
+/* 
+   Host command completion, called after a SM has executed an event with a Token
+   (processed: the SM state has a transition for the event)
+*/
+typedef void (*SMCOMMANDDONE) (SMEVENT* ev, SM* sm, bool processed);
+
+
 /* 
    SM transition function types
 */
@@ -93,17 +100,16 @@ struct SM : public DebLog
     int          State;						// Current state
     int          State_prev;				// Previous state (for debug purpose only)
     int          State_next;				// Set when SM::Execute runs and may be used in the trunsactions (note: choice functions are run BEFORE this field is updated)
+    int          ReportedError;				// Error reported to the host by the transition of the event being executed, 0 if none
 
 	bool Execute (SMEVENT *pEvent);			// One-cycle SM execute
 
 	#ifdef SMBASE_CHOICES
-	static SMCHOICE	ChoiceBuffer[SMBASE_CHOICES];
-	static int		ChoiceNextIdx;
+	static STATIC_VECTOR <SMCHOICE,SMBASE_CHOICES>  ChoiceBuffer;
 	static SMCHOICE* NewChoice(int n)
 	{
-		ASSERT_0 (ChoiceNextIdx + n <= SMBASE_CHOICES);
-		SMCHOICE* ret = &ChoiceBuffer[ChoiceNextIdx];
-		ChoiceNextIdx += n;
+		SMCHOICE* ret = ChoiceBuffer.Append(n);
+		ASSERT_0 (ret);
 		return ret;
 	}
 	#endif
@@ -229,13 +235,14 @@ template <class T> struct SMT : public SM
 
 
 /* 
-   Event element structure (16 bytes).
+   Event element structure.
 */
 struct SMEVENT
 {
     SMID        SmId;           // Destination SM ID (may be SMID_ALL)
     SMEV        Ev;		        // Event number (of TEVENTNUM type)
     SMEV_PAR    Param;		    // Event parameters
+    uint32      Token;          // Host command token completed by this event (see SMCOMMANDDONE), 0 if none
 };
 
 
@@ -247,8 +254,8 @@ class SmBase : public DebLog, public Thread
 	template <class T> friend struct SMT;
 
 	enum {
-		SM_HQUEUE_SIZE =  5,	// High-priority event queue size
-		SM_LQUEUE_SIZE = 10		// Low-priority event queue size
+		SM_HQUEUE_SIZE =  8,	// High-priority event queue size (power of 2)
+		SM_LQUEUE_SIZE = 16		// Low-priority event queue size (power of 2)
 	};
 
   public:
@@ -258,6 +265,9 @@ class SmBase : public DebLog, public Thread
 	/* Send event to a specific SM via prioritized queue */
 	static bool PutEvent (SMEVENT *pEv, SMQ level);
 
+	/* Completion of the events with Token */
+	static void SetCommandDone (SMCOMMANDDONE func)	{ CommandDone = func; }
+
   public:
 	SmBase() : DebLog("SmBase "), Thread("SmBase") {};
 
@@ -266,11 +276,13 @@ class SmBase : public DebLog, public Thread
 
   protected:
     virtual void Run();
+	static  void ExecuteEvent (SMEVENT *pEv);
 
   protected:
 	static Semaph	QueueSemaphor;
-	static FIFO_ALLOC <SMEVENT,SM_HQUEUE_SIZE>  QueueHigh;
-	static FIFO_ALLOC <SMEVENT,SM_LQUEUE_SIZE>  QueueLow;
+	static SMCOMMANDDONE CommandDone;
+	static RING_BUFFER_ALLOC <SMEVENT,SM_HQUEUE_SIZE>  QueueHigh;
+	static RING_BUFFER_ALLOC <SMEVENT,SM_LQUEUE_SIZE>  QueueLow;
 
 	/* Array of the all State machines */
 	static SM* SmGlobalArray [SMID_NUMS];
@@ -16,47 +16,73 @@ IMPL_ENUM (SMEV, SMEV_LIST)
 IMPL_ENUM (SMEV_ATRESPONSE, SMEV_ATRESPONSE_LIST)
 
 
+/*
+ "Name (details)" in a scratch string (no sprintf), or the plain name when no scratch is left.
+ The caller should call it only when the trace is on (DebLog::IsTracing).
+ */
+static bool smidAddName (STRB& str, int ev)
+{
+	if (!str.GetStr())
+		return false;
+	const ENUM_NAME& name = enumName_SMEV(ev);
+	str.Add (name.Str, name.Len);
+	str.Add (" (", 2);
+	return true;
+}
+
+
 cchar* smidFormatEventName (SMEVENT *pEv)
 {
+	STRB str;
+
 	switch (pEv->Ev)
 	{
 		case SMEV_Error:
-			{
-				// Detail the failure event (it's common for all SMs)
-				STRB str (strallocGet());
-				str.Sprintf ("%s (#%d)", enumTable_SMEV[pEv->Ev], pEv->Param.ReportError);
-				return (char*) str;
-			}
+		case SMEV_ScoOpened:
+		case SMEV_ScoClosed:
+			// Detail the failure event (it's common for all SMs)
+			str.Construct (strallocGet(), STRALLOC_MAXLEN);
+			if (!smidAddName (str, pEv->Ev))
+				break;
+			str += '#';
+			str += pEv->Param.ReportError;
+			break;
 
 		case SMEV_AtResponse:
 			{
-				STRB str (strallocGet());
-				str.Sprintf ("%s (%s)", enumTable_SMEV[pEv->Ev], enumTable_SMEV_ATRESPONSE[pEv->Param.AtResponse]);
-				return (char*) str;
+				str.Construct (strallocGet(), STRALLOC_MAXLEN);
+				if (!smidAddName (str, pEv->Ev))
+					break;
+				const ENUM_NAME& resp = enumName_SMEV_ATRESPONSE(pEv->Param.AtResponse);
+				str.Add (resp.Str, resp.Len);
 			}
+			break;
 
 		case SMEV_SelectDevice:
-			{
-				STRB str (strallocGet());
-				str.Sprintf ("%s (%llX)", enumTable_SMEV[pEv->Ev], pEv->Param.BthAddr);
-				return (char*) str;
-			}
+			str.Construct (strallocGet(), STRALLOC_MAXLEN);
+			if (!smidAddName (str, pEv->Ev))
+				break;
+			str.AddHex (pEv->Param.BthAddr);
+			break;
 
 		case SMEV_SendDtmf:
-			{
-				STRB str (strallocGet());
-				str.Sprintf ("%s (%c)", enumTable_SMEV[pEv->Ev], pEv->Param.Dtmf);
-				return (char*) str;
-			}
+			str.Construct (strallocGet(), STRALLOC_MAXLEN);
+			if (!smidAddName (str, pEv->Ev))
+				break;
+			str += pEv->Param.Dtmf;
+			break;
 
 		case SMEV_SwitchHeadset:
 		case SMEV_SwitchVoice:
-			{
-				STRB str (strallocGet());
-				str.Sprintf ("%s (%d)", enumTable_SMEV[pEv->Ev], pEv->Param.PcSound);
-				return (char*) str;
-			}
+			str.Construct (strallocGet(), STRALLOC_MAXLEN);
+			if (!smidAddName (str, pEv->Ev))
+				break;
+			str += int(pEv->Param.PcSound);
+			break;
 	}
 
-	return enumTable_SMEV[pEv->Ev];
+	if (!str.GetStr())
+		return enum_SMEV(pEv->Ev);
+	str += ')';
+	return (char*) str;
 }
@@ -42,7 +42,11 @@
     ENUM_ENTRY (SMEV, SendDtmf				),	\
 	ENUM_ENTRY (SMEV, PutOnHold				),	\
 	ENUM_ENTRY (SMEV, CallWaiting			),	\
-	ENUM_ENTRY (SMEV, CallHeld				)
+	ENUM_ENTRY (SMEV, CallHeld				),	\
+	ENUM_ENTRY (SMEV, ScoOpened				),	\
+	ENUM_ENTRY (SMEV, ScoClosed				),	\
+	ENUM_ENTRY (SMEV, Indicators			),	\
+	ENUM_ENTRY (SMEV, Phonebook				)
 
 
 /*
@@ -85,6 +89,7 @@ struct SMEV_PAR
 		bool					PcSound;
 		char					Dtmf;
 		CallInfo<char>*			CallNumber;
+		bool					PhonebookFull;		// SMEV_Phonebook requested by the host: sync from scratch
 	};
 
 	struct {
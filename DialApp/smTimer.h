@@ -17,6 +17,7 @@ class SmTimer : public Timer
 	{
 		Event.SmId = smid;
 		Event.Ev   = ev;
+		Event.Token = 0;
 	}
 
     bool Construct ()
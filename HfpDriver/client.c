@@ -15,6 +15,7 @@ Environment:
 #include "connection.h"
 #include "clisrv.h"
 #include "client.h"
+#include "server.h"
 
 #define INITGUID
 #include "hfppublic.h"
@@ -81,8 +82,7 @@ void HfpIndicationCallback (_In_ PVOID Context, _In_ SCO_INDICATION_CODE Indicat
         case ScoIndicationRemoteDisconnect:
             // This is an indication that server has disconnected. In response we disconnect from our end
 			TraceEvents (TRACE_LEVEL_INFORMATION, DBG_CONNECT, "HfpIndicationCallback - Disconnect");
-			if (connection->DevCtx->KevScoDisconnect)
-				KeSetEvent(connection->DevCtx->KevScoDisconnect,0,FALSE);
+			HfpSrvSignal (connection->DevCtx, connection->FileObject, HfpScoEventDisconnect);
             HfpConnectionObjectRemoteDisconnect (connection->DevCtx, connection);
             break;
     }
@@ -107,7 +107,7 @@ void HfpRemoteConnectCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Targe
     {
         connection->ChannelHandle   = brb->ChannelHandle;
         connection->RemoteAddress   = brb->BtAddress;
-        connection->ConnectionState = ConnectionStateConnected;
+        HfpConnectionObjectConnectDone (connection, TRUE);
 
         // Set the file context to the connection passed in
 		GetFileContext(WdfRequestGetFileObject(Request))->Connection = connection;
@@ -116,9 +116,9 @@ void HfpRemoteConnectCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Targe
         // HfpConnectionObjectRemoteDisconnect (devCtx, connection);
     }
     else {
-        connection->ConnectionState = ConnectionStateConnectFailed;
-		if (connection->DevCtx->KevScoCritError)
-			KeSetEvent(connection->DevCtx->KevScoCritError,0,FALSE);
+        HfpConnectionObjectConnectDone (connection, FALSE);
+		HfpSrvDetachConnection (connection);
+		HfpSrvSignal (connection->DevCtx, connection->FileObject, HfpScoEventCritError);
     }
 
     // Complete the Create request
@@ -135,10 +135,17 @@ NTSTATUS HfpOpenRemoteConnection (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOB
     WDFOBJECT						connectionObject;    
     HFP_CONNECTION*					connection = 0;
     struct _BRB_SCO_OPEN_CHANNEL*	brb;
+    BTH_ADDR						remoteAddr;
 
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Outgoing SCO connect request");
 
+    if (GetFileContext(fileObject)->Connection) {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, "Only one SCO connection per file supported");
+        status = STATUS_DEVICE_BUSY;
+        goto exit;
+    }
+
     // Create the connection object that would store information about the open channel
     // Set file object as the parent for this connection object
     status = HfpConnectionObjectCreate (devCtx, fileObject/*parent*/, &connectionObject);
@@ -146,7 +153,17 @@ NTSTATUS HfpOpenRemoteConnection (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOB
         goto exit;
 
     connection = GetConnectionObjectContext(connectionObject);
-    connection->ConnectionState = ConnectionStateConnecting;
+    ConnStateSet (&connection->State, ConnectionStateConnecting);
+
+    // The remote device is the one this file has registered the SCO server for
+    remoteAddr = HfpSrvAttachConnection (devCtx, fileObject, connection);
+    if (!remoteAddr) {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, "No SCO server registered by this file or the remote is already connected");
+        status = STATUS_INVALID_DEVICE_STATE;
+        WdfObjectDelete(connectionObject);
+        connection = 0;
+        goto exit;
+    }
 
     // Get the BRB from request context and initialize it as BRB_SCO_OPEN_CHANNEL
     brb = (struct _BRB_SCO_OPEN_CHANNEL*) GetRequestContext(Request);
@@ -155,7 +172,7 @@ NTSTATUS HfpOpenRemoteConnection (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOB
     
     brb->Hdr.ClientContext[0] = connection;
 
-    brb->BtAddress			= devCtx->RemoteBthAddress;
+    brb->BtAddress			= remoteAddr;
 	brb->TransmitBandwidth	= 
 	brb->ReceiveBandwidth	= 8000;  // 64Kb/s
 	brb->MaxLatency			= 50;
@@ -171,16 +188,16 @@ NTSTATUS HfpOpenRemoteConnection (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOB
     status = HfpSharedSendBrbAsync(devCtx->IoTarget, Request, (PBRB)brb, sizeof(*brb), HfpRemoteConnectCompletion, brb/*Context*/);
     if (!NT_SUCCESS(status)) {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, "Sending BRB for opening connection failed, Status %X", status);
+        HfpSrvDetachConnection (connection);
         goto exit;
     }            
 
 	exit:
     if (!NT_SUCCESS(status)) {
         if (connection)
-            connection->ConnectionState = ConnectionStateConnectFailed;    // to facilitate debugging
+            ConnStateSet (&connection->State, ConnectionStateConnectFailed);    // to facilitate debugging
 
-		if (devCtx->KevScoCritError)
-			KeSetEvent(devCtx->KevScoCritError,0,FALSE);
+		HfpSrvSignal (devCtx, fileObject, HfpScoEventCritError);
 
         // In case of failure of this routine we will fail Create which will delete file object 
 		// and since connection object is child of the file object, it will be deleted too
@@ -24,6 +24,7 @@ NTSTATUS HfpSharedDeviceContextInit (HFPDEVICE_CONTEXT* devCtx, WDFDEVICE Device
 {
     NTSTATUS status;
     WDF_OBJECT_ATTRIBUTES attributes;
+    ULONG i;
         
     devCtx->Device   = Device;
     devCtx->IoTarget = WdfDeviceGetIoTarget(Device);
@@ -39,6 +40,32 @@ NTSTATUS HfpSharedDeviceContextInit (HFPDEVICE_CONTEXT* devCtx, WDFDEVICE Device
         goto exit;        
     }
 
+    // Table of per-remote SCO servers, each server has its own request so that they are registered independently
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = Device;
+
+    status = WdfSpinLockCreate (&attributes, &devCtx->ScoTableLock);
+    if (!NT_SUCCESS(status))  {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "Failed to create SCO table lock, Status=%X", status);
+        goto exit;        
+    }
+
+    status = WdfWaitLockCreate (&attributes, &devCtx->ScoServerLock);
+    if (!NT_SUCCESS(status))  {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "Failed to create SCO server lock, Status=%X", status);
+        goto exit;        
+    }
+
+    ScoTableInit (&devCtx->ScoTable);
+
+    for (i = 0; i < SCO_TABLE_MAX; i++) {
+        status = WdfRequestCreate (&attributes, devCtx->IoTarget, &devCtx->Servers[i].Request);
+        if (!NT_SUCCESS(status))  {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "Failed to pre-allocate SCO server request, Status=%X", status);
+            goto exit;        
+        }
+    }
+
 	exit:
     return status;
 }
@@ -13,6 +13,9 @@
 #include "device.h"
 #include "connection.h"
 #include "clisrv.h"
+#include "server.h"
+#include "contread.h"
+#include "shmring.h"
 
 
 #if defined(EVENT_TRACING)
@@ -23,6 +26,7 @@
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text (PAGE, HfpEvtConnectionObjectCleanup)
 #pragma alloc_text (PAGE, HfpConnectionObjectRemoteDisconnectSynchronously)
+#pragma alloc_text (PAGE, HfpConnectionObjectDeleteClosed)
 #endif
 
 
@@ -33,9 +37,16 @@ void HfpEvtConnectionObjectCleanup (_In_ WDFOBJECT  ConnectionObject)
 
     PAGED_CODE();
         
-    // Here may be "WaitForAndUninitializeContinuousReader for the connection"
-    // We do not have continuous readers in the driver
+    // The delete runs this callback despite the ring's reference, so the ring is stopped here
+    HfpShmRingDetach (connection);
+    HfpContReaderStop (connection, NULL);
     KeWaitForSingleObject(&connection->DisconnectEvent, Executive, KernelMode, FALSE, NULL);
+    HfpSrvDetachConnection (connection);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Transfer pool: hits %d, misses %d, max in use %d, errors %d",
+				connection->XferPool.Hits, connection->XferPool.Misses, connection->XferPool.InUseMax, connection->XferPool.Errors);
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "SCO stats: in %d frames, %d errors; out %d frames, %d errors; max latency %d us, last error %X",
+				connection->Stats.FramesIn, connection->Stats.ErrorsIn, connection->Stats.FramesOut, connection->Stats.ErrorsOut, connection->Stats.LatencyMax, connection->Stats.LastError);
     WdfObjectDelete(connection->ConnectDisconnectRequest);
 }
 
@@ -47,6 +58,7 @@ NTSTATUS HfpConnectionObjectInit (_In_ WDFOBJECT ConnectionObject, _In_ HFPDEVIC
     NTSTATUS status;
     WDF_OBJECT_ATTRIBUTES attributes;
     HFP_CONNECTION* connection = GetConnectionObjectContext(ConnectionObject);
+    ULONG i;
 
     // Initialize spinlock
     WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
@@ -64,10 +76,29 @@ NTSTATUS HfpConnectionObjectInit (_In_ WDFOBJECT ConnectionObject, _In_ HFPDEVIC
     // Initialize event
     KeInitializeEvent(&connection->DisconnectEvent, NotificationEvent, TRUE);
 
+    // Preallocate SCO transfer contexts: BRB memory objects and batch frame requests are created once here, not per request.
+    // DataMemory gets the frame buffer by WdfMemoryAssignBuffer, till then it wraps the BRB.
+    for (i = 0; i < HFP_XFER_POOL_SIZE; i++) {
+        connection->Xfers[i].Connection = connection;
+        connection->Xfers[i].Index		= i;
+        status = WdfMemoryCreatePreallocated (&attributes, &connection->Xfers[i].Brb, sizeof(connection->Xfers[i].Brb), &connection->Xfers[i].BrbMemory);
+        if (!NT_SUCCESS(status))
+            goto exit;
+        status = WdfRequestCreate (&attributes, devCtx->IoTarget, &connection->Xfers[i].Request);
+        if (!NT_SUCCESS(status))
+            goto exit;
+        status = WdfMemoryCreatePreallocated (&attributes, &connection->Xfers[i].Brb, sizeof(connection->Xfers[i].Brb), &connection->Xfers[i].DataMemory);
+        if (!NT_SUCCESS(status))
+            goto exit;
+    }
+    XferPoolInit (&connection->XferPool, HFP_XFER_POOL_SIZE);
+    HfpContReaderInit (connection);
+    ScoStatsInit (&connection->Stats, devCtx->ScoPacketTypes);	// the channel is opened with these packet types
+
     // Initialize list entry
     connection->DevCtx = devCtx;
 	connection->FileObject = (WDFFILEOBJECT) parentObject;		// Our connection parent is always FileObject
-    connection->ConnectionState = ConnectionStateInitialized;
+    ConnStateInit (&connection->State, ConnectionStateInitialized);
 
 	exit:
     return status;
@@ -113,6 +144,22 @@ NTSTATUS HfpConnectionObjectCreate (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFOBJE
 
 
 
+/*
+ Disconnect is over: completes the pending CLOSE_SCO request and sets the event
+*/
+static void HfpConnectionObjectDisconnected (_In_ HFP_CONNECTION* connection)
+{
+    WDFREQUEST request = (WDFREQUEST) InterlockedExchangePointer ((PVOID*)&connection->CloseRequest, NULL);
+
+    // Disconnect complete, set the event
+    KeSetEvent(&connection->DisconnectEvent, 0, FALSE);    
+
+    if (request)
+        WdfRequestComplete (request, STATUS_SUCCESS);
+}
+
+
+
 void HfpConnectionObjectDisconnectCompletion(
     _In_ WDFREQUEST   Request,
     _In_ WDFIOTARGET  Target,
@@ -127,54 +174,36 @@ void HfpConnectionObjectDisconnectCompletion(
     UNREFERENCED_PARAMETER(Target);
     UNREFERENCED_PARAMETER(Params);
 
+    ConnStateSet (&connection->State, ConnectionStateDisconnected);
+
     WdfSpinLockAcquire(connection->ConnectionLock);
-    connection->ConnectionState = ConnectionStateDisconnected;
 	NT_ASSERT (connection->FileObject);
 	GetFileContext(connection->FileObject)->Connection = 0;
     WdfSpinLockRelease(connection->ConnectionLock);
 
-    // Disconnect complete, set the event
-    KeSetEvent(&connection->DisconnectEvent, 0, FALSE);    
+    // The remote device may be connected again
+    HfpSrvDetachConnection (connection);
+
+    HfpConnectionObjectDisconnected (connection);
 }
 
 
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-BOOLEAN HfpConnectionObjectRemoteDisconnect(_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* connection)
+/*
+ Performs the action deferred till the submission references run down
+*/
+static void HfpConnectionObjectRundown (_In_ HFP_CONNECTION* connection, _In_ CONN_ACTION action)
 {
 	struct _BRB_SCO_CLOSE_CHANNEL * disconnectBrb;
+    HFPDEVICE_CONTEXT* devCtx = connection->DevCtx;
 
-	TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "HfpConnectionObjectRemoteDisconnect, connection=%X", connection);
-
-    // Here may be "Continuous readers cancellation for the connection"
-    // We do not have continuous readers in the driver
-    
-    WdfSpinLockAcquire(connection->ConnectionLock);
-    
-    if (connection->ConnectionState == ConnectionStateConnecting) 
-    {
-        // If the connection is not completed yet set the state to disconnecting.
-        // In such case we should send CLOSE_CHANNEL Brb down after we receive connect completion.
-        connection->ConnectionState = ConnectionStateDisconnecting;
-
-        // Clear event to indicate that we are in disconnecting state. It will be set when disconnect is completed
-        KeClearEvent(&connection->DisconnectEvent);
-        WdfSpinLockRelease(connection->ConnectionLock);
-        return TRUE;
-
-    } 
-    else if (connection->ConnectionState != ConnectionStateConnected)
-    {
-        // Do nothing if we are not connected
-        WdfSpinLockRelease(connection->ConnectionLock);
-        return FALSE;
-    }
-
-    connection->ConnectionState = ConnectionStateDisconnecting;
-    WdfSpinLockRelease(connection->ConnectionLock);
-
-    // We are now sending the disconnect, so clear the event.
-    KeClearEvent(&connection->DisconnectEvent);
+    if (action == ConnActionSignal) {
+		// The connect failed after the disconnect was started: there is no channel to close
+		HfpConnectionObjectDisconnected (connection);
+		return;
+	}
+    if (action != ConnActionClose)
+		return;
 
     devCtx->ProfileDrvInterface.BthReuseBrb(&connection->ConnectDisconnectBrb, BRB_SCO_CLOSE_CHANNEL);
 
@@ -192,12 +221,104 @@ BOOLEAN HfpConnectionObjectRemoteDisconnect(_In_ HFPDEVICE_CONTEXT* devCtx, _In_
         HfpConnectionObjectDisconnectCompletion,
         connection
         );    
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectRemoteDisconnect(_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* connection)
+{
+	TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "HfpConnectionObjectRemoteDisconnect, connection=%X", connection);
+
+    UNREFERENCED_PARAMETER(devCtx);
+
+    HfpContReaderCancel (connection);
+
+    // Connected -> Disconnecting, or Connecting -> Disconnecting and then CLOSE_CHANNEL is sent 
+    // after the connect completion. Do nothing if we are not connected or already disconnecting.
+    if (!ConnStateBeginDisconnect (&connection->State))
+		return FALSE;
+
+    // Clear event to indicate that we are in disconnecting state. It will be set when disconnect is completed.
+    // Our reference holds the close (and the connect completion) off till the event is cleared.
+    KeClearEvent(&connection->DisconnectEvent);
+
+    // The last reference sends CLOSE_CHANNEL: ours, or of a transfer being sent right now
+    HfpConnectionObjectRundown (connection, ConnStateRelease (&connection->State));
+    return TRUE;
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectConnectDone (_In_ HFP_CONNECTION* Connection, _In_ BOOLEAN Success)
+{
+    CONN_ACTION action;
+    BOOLEAN		connected = (BOOLEAN) ConnStateConnectDone (&Connection->State, Success, &action);
+
+    HfpConnectionObjectRundown (Connection, action);
+    return connected;
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectAcquireTransfer (_In_ HFP_CONNECTION* Connection)
+{
+    return (BOOLEAN) ConnStateAcquire (&Connection->State);
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectReleaseTransfer (_In_ HFP_CONNECTION* Connection)
+{
+    HfpConnectionObjectRundown (Connection, ConnStateRelease (&Connection->State));
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectDisconnectAsync (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* Connection, _In_ WDFREQUEST Request)
+{
+    // One close request at a time, another one is completed by the caller at once
+    if (InterlockedCompareExchangePointer ((PVOID*)&Connection->CloseRequest, Request, NULL) != NULL)
+        return FALSE;
+
+    if (HfpConnectionObjectRemoteDisconnect (devCtx, Connection)) {
+        // We started the disconnect, so nobody else deletes the connection
+        GetFileContext(Connection->FileObject)->Closed = Connection;
+        return TRUE;
+    }
+
+    // Not connected or already disconnecting: if the disconnect is over take the request back,
+    // otherwise the disconnect completion completes it
+    if (KeReadStateEvent (&Connection->DisconnectEvent)  &&
+        InterlockedCompareExchangePointer ((PVOID*)&Connection->CloseRequest, NULL, Request) == Request)
+        return FALSE;
 
     return TRUE;
 }
 
 
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpConnectionObjectDeleteClosed (_In_ WDFFILEOBJECT fileObject)
+{
+    HFP_FILE_CONTEXT* fileCtx = GetFileContext(fileObject);
+    HFP_CONNECTION*   closed  = fileCtx->Closed;
+
+    PAGED_CODE();
+
+    if (closed) {
+        // The cleanup callback waits for the disconnect
+        fileCtx->Closed = 0;
+        WdfObjectDelete (WdfObjectContextGetObject(closed));
+    }
+}
+
+
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 void HfpConnectionObjectRemoteDisconnectSynchronously (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* Connection)
 {
@@ -208,6 +329,101 @@ void HfpConnectionObjectRemoteDisconnectSynchronously (_In_ HFPDEVICE_CONTEXT* d
 
 
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+HFP_SCO_XFER* HfpConnectionObjectGetXfer (_In_ HFP_CONNECTION* Connection)
+{
+    ULONG idx = XferPoolGet (&Connection->XferPool);
+
+    return (idx == XFER_POOL_NONE) ? NULL : &Connection->Xfers[idx];
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectPutXfer (_In_ HFP_SCO_XFER* Xfer)
+{
+    int ok = XferPoolPut (&Xfer->Connection->XferPool, Xfer->Index);
+
+    NT_ASSERT (ok);
+    UNREFERENCED_PARAMETER(ok);
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS HfpConnectionObjectFormatRequestForPooledScoTransfer (_In_ HFP_CONNECTION* Connection, _In_ WDFREQUEST Request, _In_ HFP_SCO_XFER* Xfer, _In_ WDFMEMORY Memory, _In_ ULONG TransferFlags)
+{
+    NTSTATUS status;
+    struct _BRB_SCO_TRANSFER *brb = &Xfer->Brb;
+    size_t bufferSize;
+
+    // No lock: the caller's submission reference keeps the channel open
+    NT_ASSERT (ConnStateRefs(&Connection->State) != 0);
+
+    Connection->DevCtx->ProfileDrvInterface.BthReuseBrb((PBRB)brb, BRB_SCO_TRANSFER);
+
+    brb->BtAddress = Connection->RemoteAddress;
+    brb->BufferMDL = NULL;
+    brb->Buffer    = WdfMemoryGetBuffer(Memory, &bufferSize);
+
+    if (bufferSize > (ULONG)(-1)) {
+        status = STATUS_BUFFER_OVERFLOW;
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "Buffer passed in longer than max ULONG, Status %X", status);
+        goto exit;
+    }
+
+    brb->BufferSize    = (ULONG) bufferSize;
+    brb->ChannelHandle = Connection->ChannelHandle;
+    brb->TransferFlags = TransferFlags;
+    HfpConnectionObjectStampTransfer (Connection, brb);
+
+    status = WdfIoTargetFormatRequestForInternalIoctlOthers (Connection->DevCtx->IoTarget, Request, IOCTL_INTERNAL_BTH_SUBMIT_BRB,
+															 Xfer->BrbMemory, NULL, NULL, NULL, NULL, NULL);
+    if (!NT_SUCCESS(status))
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_UTIL, "Formatting request 0x%p with pooled Brb 0x%p failed, Status %X", Request, brb, status);
+
+	exit:
+    return status;
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectStampTransfer (_In_ HFP_CONNECTION* Connection, _In_ struct _BRB_SCO_TRANSFER* Brb)
+{
+    // The low part of the interrupt time (100 ns units) is enough: the difference wraps in 7 minutes
+    Brb->Hdr.ClientContext[2] = Connection;
+    Brb->Hdr.ClientContext[3] = (PVOID)(ULONG_PTR)(ULONG) KeQueryInterruptTime();
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectTransferDone (_In_ struct _BRB_SCO_TRANSFER* Brb, _In_ NTSTATUS Status)
+{
+    HFP_CONNECTION* connection = (HFP_CONNECTION*) Brb->Hdr.ClientContext[2];
+    ULONG			latency	   = ((ULONG) KeQueryInterruptTime() - (ULONG)(ULONG_PTR) Brb->Hdr.ClientContext[3]) / 10;
+
+    if (!connection)
+		return;
+
+    // Interlocked counters, the completions of both directions take no lock
+    ScoStatsAccount (&connection->Stats, (Brb->TransferFlags & SCO_TRANSFER_DIRECTION_IN) != 0, Brb->BufferSize, Status, latency);
+
+    // The transfer's submission reference, the last one after a disconnect sends CLOSE_CHANNEL
+    HfpConnectionObjectReleaseTransfer (connection);
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectGetStats (_In_ HFP_CONNECTION* Connection, _Out_ SCO_STATS* Stats)
+{
+    ScoStatsSnapshot (Stats, &Connection->Stats);
+}
+
+
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 NTSTATUS FormatRequestWithBrb (_In_ WDFIOTARGET IoTarget, _In_ WDFREQUEST Request, _In_ PBRB Brb, _In_ size_t BrbSize)
 {
@@ -268,15 +484,8 @@ NTSTATUS HfpConnectionObjectFormatRequestForScoTransfer(
     size_t bufferSize;
     BOOLEAN brbAllocatedLocally = FALSE; //whether this function allocated the BRB
 
-    WdfSpinLockAcquire(Connection->ConnectionLock);
-
-    if (Connection->ConnectionState != ConnectionStateConnected) {
-        status = STATUS_CONNECTION_DISCONNECTED;
-        WdfSpinLockRelease(Connection->ConnectionLock);
-        goto exit;
-    }
-
-    WdfSpinLockRelease(Connection->ConnectionLock);
+    // No lock: the caller's submission reference keeps the channel open
+    NT_ASSERT (ConnStateRefs(&Connection->State) != 0);
 
     if (!(*Brb)) {
         brb = (struct _BRB_SCO_TRANSFER*) Connection->DevCtx->ProfileDrvInterface.BthAllocateBrb (BRB_SCO_TRANSFER, POOLTAG_HFPDRIVER);
@@ -308,6 +517,7 @@ NTSTATUS HfpConnectionObjectFormatRequestForScoTransfer(
     brb->BufferSize    = (ULONG) bufferSize;
     brb->ChannelHandle = Connection->ChannelHandle;
     brb->TransferFlags = TransferFlags;
+    HfpConnectionObjectStampTransfer (Connection, brb);
 
     //TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,  "Format Request For SCO: bufferSize = %d\n", bufferSize);
     status = FormatRequestWithBrb (Connection->DevCtx->IoTarget, Request, (PBRB) brb, sizeof(*brb));
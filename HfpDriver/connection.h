@@ -19,24 +19,75 @@
     Both client and server utilize connection object although continuous reader
     functionality is utilized only by server.
 
-	HFP driver doesn't use the continuous reader at all: all IO operations are 
-	initiated by User Mode applications.
+	By default HFP driver doesn't use the continuous reader: all IO operations are 
+	initiated by User Mode applications. The optional continuous reader (contread.c, 
+	IOCTL_HFP_CONT_READER_START) keeps SCO IN transfers posted into a frame ring, and 
+	Read requests are served from the ring.
 	
  Environment:
     Kernel mode
 --*/
 
+#include "connstate.h"
+#include "xferpool.h"
+#include "framering.h"
+#include "scostats.h"
 
 
-typedef enum {
-    ConnectionStateUnitialized = 0,
-    ConnectionStateInitialized,
-    ConnectionStateConnecting,
-    ConnectionStateConnected,
-    ConnectionStateConnectFailed,
-    ConnectionStateDisconnecting,
-    ConnectionStateDisconnected
-} HFP_CONNECTION_STATE;
+#define HFP_XFER_POOL_SIZE		32		// Preallocated SCO transfer contexts per connection: Read/Write requests and a read and a write batch
+
+
+
+/*
+  Preallocated SCO transfer context, taken from the connection pool for a Read/Write request
+  and returned on its completion, or for a batch frame (IOCTL_HFP_SCO_BATCH) and returned on
+  the batch completion. A Read/Write request is sent itself, a batch frame is sent with Request.
+*/
+typedef struct HFP_SCO_XFER
+{
+    struct HFP_CONNECTION*		Connection;
+    ULONG						Index;			// Index in the connection pool
+    struct _BRB_SCO_TRANSFER	Brb;
+    WDFMEMORY					BrbMemory;		// Preallocated memory for Brb, the request argument
+    WDFREQUEST					Request;		// Reused for batch frames
+    WDFMEMORY					DataMemory;		// Preallocated memory object, assigned to the batch frame data
+} HFP_SCO_XFER;
+
+
+#define HFP_CONT_READER_MAX_DEPTH	4		// Max SCO IN transfers kept posted by the continuous reader
+
+
+/*
+  Continuous reader transfer
+*/
+typedef struct
+{
+    struct HFP_CONNECTION*	Connection;
+    WDFREQUEST				Request;		// Reused for every transfer
+    WDFMEMORY				DataMemory;		// Preallocated memory over Buffer
+    UCHAR*					Buffer;			// FrameSize bytes
+    HFP_SCO_XFER			Xfer;			// BRB and its memory object
+    BOOLEAN					Posted;
+} HFP_CONT_READER_XFER;
+
+
+/*
+  Continuous reader, protected by ConnectionLock
+*/
+typedef struct
+{
+    BOOLEAN					Running;		// Read requests are served from Ring
+    BOOLEAN					Stopping;		// No more reposts
+    ULONG					Depth;			// Number of used Xfers
+    ULONG					Active;			// Transfers posted or being reposted
+    KEVENT					IdleEvent;		// Signaled when Active is 0
+    FRAME_RING				Ring;
+    PVOID					Memory;			// Ring and transfer buffers
+    WDFREQUEST				PendingRead;	// Read request waiting for frames
+    PVOID					PendingBuffer;
+    ULONG					PendingLength;
+    HFP_CONT_READER_XFER	Xfers[HFP_CONT_READER_MAX_DEPTH];
+} HFP_CONT_READER;
 
 
 /*
@@ -46,13 +97,19 @@ typedef struct HFP_CONNECTION
 {
     HFPDEVICE_CONTEXT*		DevCtx;						// This device context
 	WDFFILEOBJECT			FileObject;					// This connection parent FileObject
-    HFP_CONNECTION_STATE	ConnectionState;			// Connection state for connect/disconnect handshake
+    CONN_STATE				State;						// Connection state for connect/disconnect handshake with submission references, lock free (connstate.h)
     WDFSPINLOCK             ConnectionLock;				// Connection lock, used to synchronize access to HFP_CONNECTION members
     SCO_CHANNEL_HANDLE		ChannelHandle;				// SCO channel handle
     BTH_ADDR				RemoteAddress;				// Remote device address
     struct _BRB				ConnectDisconnectBrb;		// Preallocated BRB request used for connect/disconnect
     WDFREQUEST				ConnectDisconnectRequest;	// WDF Request for connect/disconnect
     KEVENT					DisconnectEvent;			// Event used to wait for disconnection - it is non-signaled when connection is in ConnectionStateDisconnecting; transitionary state and signaled otherwise
+    WDFREQUEST				CloseRequest;				// CLOSE_SCO request pending till the disconnect completes or 0
+    XFER_POOL				XferPool;					// Free list of Xfers, lock free (xferpool.h)
+    HFP_SCO_XFER			Xfers[HFP_XFER_POOL_SIZE];	// Preallocated SCO transfer contexts
+    HFP_CONT_READER			ContReader;					// Optional continuous reader
+    struct HFP_SHM_RING*	ShmRing;					// Linked shared memory ring or 0, taken by interlocked exchange (shmring.h)
+    SCO_STATS				Stats;						// Transfer statistics (IOCTL_HFP_SCO_STATS), interlocked (scostats.h)
 } HFP_CONNECTION;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(HFP_CONNECTION, GetConnectionObjectContext)
@@ -92,6 +149,81 @@ BOOLEAN HfpConnectionObjectRemoteDisconnect(_In_ HFPDEVICE_CONTEXT* devCtx, _In_
 
 
 
+/*
+ Accounts the connect completion and performs the deferred close if a disconnect was
+ started while connecting
+
+ Arguments:
+    Connection	- Connection
+    Success		- The channel is open (ChannelHandle is set)
+
+ Return Value:
+    TRUE if the connection is Connected now.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectConnectDone (_In_ HFP_CONNECTION* Connection, _In_ BOOLEAN Success);
+
+
+
+/*
+ Takes a submission reference: while it's held the connection stays usable for formatting
+ and sending a SCO transfer, a disconnect closes the channel only after it's released.
+ The reference of a sent transfer is kept by the transfer and released by its completion
+ (HfpConnectionObjectTransferDone), so CLOSE_CHANNEL never overtakes a transfer in flight.
+ If the transfer is not sent, the caller releases the reference.
+ Takes no lock.
+
+ Arguments:
+    Connection	- Connection
+
+ Return Value:
+    FALSE if the connection is not Connected.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectAcquireTransfer (_In_ HFP_CONNECTION* Connection);
+
+
+/*
+ Releases the submission reference, the last one after a disconnect sends CLOSE_CHANNEL
+
+ Arguments:
+    Connection	- Connection
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectReleaseTransfer (_In_ HFP_CONNECTION* Connection);
+
+
+
+/*
+ Disconnects the connection on behalf of CLOSE_SCO request: the request is completed when the
+ disconnect completes, so the caller doesn't wait. The connection is kept in the file's Closed
+ and deleted by HfpConnectionObjectDeleteClosed.
+
+ Arguments:
+    devCtx		- Device context header
+    Connection	- Connection which is to be disconnected
+    Request		- CLOSE_SCO request
+
+ Return Value:
+    TRUE if the request will be completed by the disconnect completion,
+    FALSE if there is nothing to wait for and the caller completes the request.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpConnectionObjectDisconnectAsync (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* Connection, _In_ WDFREQUEST Request);
+
+
+
+/*
+ Deletes the file's connection closed by CLOSE_SCO, if any (waits for its disconnect)
+
+ Arguments:
+    fileObject - File object
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpConnectionObjectDeleteClosed (_In_ WDFFILEOBJECT fileObject);
+
+
+
 /*
  This routine disconnects the connection synchronously
 
@@ -105,7 +237,7 @@ void HfpConnectionObjectRemoteDisconnectSynchronously (_In_ HFPDEVICE_CONTEXT* d
 
 
 /*
- Formats a request for SCO transfer
+ Formats a request for SCO transfer, the caller holds a submission reference (HfpConnectionObjectAcquireTransfer)
 
  Arguments:
     Connection	- Connection on which SCO transfer will be made
@@ -130,6 +262,79 @@ HfpConnectionObjectFormatRequestForScoTransfer(
 
 
 
+/*
+ Takes a preallocated SCO transfer context from the connection pool
+
+ Arguments:
+    Connection	- Connection on which SCO transfer will be made
+
+ Return Value:
+    The transfer context or NULL if the pool is exhausted (the caller falls back to the request context BRB)
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+HFP_SCO_XFER* HfpConnectionObjectGetXfer (_In_ HFP_CONNECTION* Connection);
+
+
+/*
+ Returns the transfer context to the connection pool
+
+ Arguments:
+    Xfer - Transfer context taken by HfpConnectionObjectGetXfer
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectPutXfer (_In_ HFP_SCO_XFER* Xfer);
+
+
+/*
+ Formats a request for SCO transfer with a pooled transfer context, the caller holds a submission reference.
+ Unlike HfpConnectionObjectFormatRequestForScoTransfer it neither allocates a BRB nor creates
+ a memory object for it: Xfer->BrbMemory is the preallocated wrapper of Xfer->Brb.
+
+ Arguments:
+    Connection	- Connection on which SCO transfer will be made
+    Request		- Request to be formatted
+    Xfer		- Pooled transfer context
+    Memory		- Memory object which has the buffer for transfer
+    TransferFlags - Transfer flags which include direction of the transfer
+
+ Return Value:
+    NTSTATUS Status code.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS HfpConnectionObjectFormatRequestForPooledScoTransfer (_In_ HFP_CONNECTION* Connection, _In_ WDFREQUEST Request, _In_ HFP_SCO_XFER* Xfer, _In_ WDFMEMORY Memory, _In_ ULONG TransferFlags);
+
+
+
+/*
+ Marks the formatted SCO transfer BRB with its connection and the current time, for the statistics.
+ Uses Brb->Hdr.ClientContext[2] and [3], so it must be called after BthReuseBrb.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectStampTransfer (_In_ HFP_CONNECTION* Connection, _In_ struct _BRB_SCO_TRANSFER* Brb);
+
+
+/*
+ Accounts the completed SCO transfer in its connection statistics (the BRB is stamped by
+ HfpConnectionObjectStampTransfer) and releases the submission reference of the transfer.
+ Must be called by the completion routine of every sent transfer.
+
+ Arguments:
+    Brb	   - Completed transfer BRB
+    Status - Completion status
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectTransferDone (_In_ struct _BRB_SCO_TRANSFER* Brb, _In_ NTSTATUS Status);
+
+
+/*
+ Copies the connection statistics, they are kept after the disconnect till the object is deleted.
+ Takes no lock: the transfers may be accounted meanwhile.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpConnectionObjectGetStats (_In_ HFP_CONNECTION* Connection, _Out_ SCO_STATS* Stats);
+
+
+
 /*
  This routine is invoked by the Framework when connection object  gets deleted 
  (either explicitly or implicitly because of parent deletion).
@@ -0,0 +1,155 @@
+/*++
+
+Module Name:
+    connstate.c
+
+Abstract:
+    Connection state word: lock free state transitions and rundown of SCO transfer submissions.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "connstate.h"
+
+
+#if defined(_WIN32)
+#define CONN_STATE_CAS(cs, exchange, comparand)		InterlockedCompareExchange ((cs), (exchange), (comparand))
+#else
+#define CONN_STATE_CAS(cs, exchange, comparand)		__sync_val_compare_and_swap ((cs), (comparand), (exchange))
+#endif
+
+#define CONN_STATE_OF(w)	((HFP_CONNECTION_STATE)((w) & CONN_STATE_MASK))
+#define CONN_REFS_OF(w)		((ULONG)(w) >> CONN_STATE_REFSHIFT)
+
+
+
+void ConnStateInit (CONN_STATE* cs, HFP_CONNECTION_STATE state)
+{
+	*cs = (LONG) state;
+}
+
+
+HFP_CONNECTION_STATE ConnStateGet (CONN_STATE* cs)
+{
+	return CONN_STATE_OF(*cs);
+}
+
+
+ULONG ConnStateRefs (CONN_STATE* cs)
+{
+	return CONN_REFS_OF(*cs);
+}
+
+
+HFP_CONNECTION_STATE ConnStateSet (CONN_STATE* cs, HFP_CONNECTION_STATE state)
+{
+	LONG old, neww;
+
+	do {
+		old	 = *cs;
+		neww = (old & ~CONN_STATE_MASK) | (LONG)state;
+	} while (CONN_STATE_CAS(cs, neww, old) != old);
+
+	return CONN_STATE_OF(old);
+}
+
+
+int ConnStateAcquire (CONN_STATE* cs)
+{
+	LONG old;
+
+	do {
+		old = *cs;
+		if (CONN_STATE_OF(old) != ConnectionStateConnected)
+			return 0;
+	} while (CONN_STATE_CAS(cs, old + CONN_STATE_REF, old) != old);
+
+	return 1;
+}
+
+
+CONN_ACTION ConnStateRelease (CONN_STATE* cs)
+{
+	LONG		old, neww;
+	CONN_ACTION	action;
+
+	do {
+		old	   = *cs;
+		neww   = old - CONN_STATE_REF;
+		action = ConnActionNone;
+
+		// The last reference performs the deferred action, the flag is cleared in the same step
+		if (CONN_REFS_OF(neww) == 0) {
+			if (neww & CONN_STATE_CLOSE) {
+				neww  &= ~CONN_STATE_CLOSE;
+				action = ConnActionClose;
+			}
+			else if (neww & CONN_STATE_SIGNAL) {
+				neww  &= ~CONN_STATE_SIGNAL;
+				action = ConnActionSignal;
+			}
+		}
+	} while (CONN_STATE_CAS(cs, neww, old) != old);
+
+	return action;
+}
+
+
+int ConnStateBeginDisconnect (CONN_STATE* cs)
+{
+	LONG old, neww;
+
+	do {
+		old = *cs;
+		switch (CONN_STATE_OF(old))
+		{
+			case ConnectionStateConnected:
+				neww = (old & ~CONN_STATE_MASK) | ConnectionStateDisconnecting | CONN_STATE_CLOSE;
+				break;
+			case ConnectionStateConnecting:
+				// No channel yet: the connect completion sets CONN_STATE_CLOSE
+				neww = (old & ~CONN_STATE_MASK) | ConnectionStateDisconnecting;
+				break;
+			default:
+				return 0;
+		}
+		neww += CONN_STATE_REF;
+	} while (CONN_STATE_CAS(cs, neww, old) != old);
+
+	return 1;
+}
+
+
+int ConnStateConnectDone (CONN_STATE* cs, int success, CONN_ACTION* action)
+{
+	LONG old, neww;
+
+	do {
+		old		= *cs;
+		*action = ConnActionNone;
+
+		if (CONN_STATE_OF(old) == ConnectionStateConnecting)
+			neww = (old & ~CONN_STATE_MASK) | (success ? ConnectionStateConnected : ConnectionStateConnectFailed);
+		else if (CONN_STATE_OF(old) == ConnectionStateDisconnecting)
+		{
+			// Disconnect was started while connecting: close the open channel or just report the end
+			neww = success ? old : ((old & ~CONN_STATE_MASK) | ConnectionStateConnectFailed);
+			if (CONN_REFS_OF(old))
+				neww |= success ? CONN_STATE_CLOSE : CONN_STATE_SIGNAL;
+			else
+				*action = success ? ConnActionClose : ConnActionSignal;
+		}
+		else
+			return 0;	// not connecting, nothing to account
+
+	} while (CONN_STATE_CAS(cs, neww, old) != old);
+
+	return CONN_STATE_OF(neww) == ConnectionStateConnected;
+}
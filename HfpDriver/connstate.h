@@ -0,0 +1,154 @@
+/*++
+
+Module Name:
+    connstate.h
+
+Abstract:
+    Connection state word: lock free state transitions and rundown of SCO transfer submissions.
+
+    The state, two deferred action flags and the count of submissions in progress share one
+    LONG updated by compare-and-swap, so checking the state and taking a reference is a single
+    atomic step and the transfer hot path takes no lock:
+
+        bits 0-3	HFP_CONNECTION_STATE
+        bit  4		CONN_STATE_CLOSE:  the channel must be closed when the references run down
+        bit  5		CONN_STATE_SIGNAL: the disconnect is over when the references run down
+        bits 8-31	references
+
+    A reference is taken only in the Connected state and is held from the formatting of a
+    transfer (it reads the channel handle) till its completion. Starting a disconnect moves the state
+    to Disconnecting and takes a reference too: whoever drops the last reference performs the
+    deferred action (sends CLOSE_CHANNEL or signals the disconnect), exactly once. So the close
+    never overlaps a transfer in flight and the disconnect initiator can't race with the connect
+    completion, with no waiting at DISPATCH_LEVEL.
+
+    Transitions:
+        Initialized		-> Connecting								ConnStateSet
+        Connecting		-> Connected | ConnectFailed				ConnStateConnectDone
+        Connecting		-> Disconnecting (close after connected)	ConnStateBeginDisconnect
+        Connected		-> Disconnecting							ConnStateBeginDisconnect
+        Disconnecting	-> Disconnected								ConnStateSet (close completion)
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum {
+    ConnectionStateUnitialized = 0,
+    ConnectionStateInitialized,
+    ConnectionStateConnecting,
+    ConnectionStateConnected,
+    ConnectionStateConnectFailed,
+    ConnectionStateDisconnecting,
+    ConnectionStateDisconnected
+} HFP_CONNECTION_STATE;
+
+
+typedef volatile LONG	CONN_STATE;
+
+#define CONN_STATE_MASK		0x0000000F
+#define CONN_STATE_CLOSE	0x00000010
+#define CONN_STATE_SIGNAL	0x00000020
+#define CONN_STATE_REF		0x00000100
+#define CONN_STATE_REFSHIFT	8
+
+
+/*
+  Deferred actions returned to the caller, which performs them
+*/
+typedef enum {
+    ConnActionNone = 0,
+    ConnActionClose,		// Send CLOSE_CHANNEL
+    ConnActionSignal		// Signal the disconnect completion (no channel to close)
+} CONN_ACTION;
+
+
+
+/*
+ Initializes the word, no concurrent access is allowed
+*/
+void ConnStateInit (CONN_STATE* cs, HFP_CONNECTION_STATE state);
+
+
+/*
+ Current state (a snapshot)
+*/
+HFP_CONNECTION_STATE ConnStateGet (CONN_STATE* cs);
+
+
+/*
+ Number of references (a snapshot)
+*/
+ULONG ConnStateRefs (CONN_STATE* cs);
+
+
+/*
+ Sets the state unconditionally keeping the flags and the references, returns the previous state
+*/
+HFP_CONNECTION_STATE ConnStateSet (CONN_STATE* cs, HFP_CONNECTION_STATE state);
+
+
+/*
+ Takes a submission reference if the state is Connected.
+ Returns nonzero on success, then ConnStateRelease must follow.
+*/
+int ConnStateAcquire (CONN_STATE* cs);
+
+
+/*
+ Drops a reference taken by ConnStateAcquire or ConnStateBeginDisconnect.
+ Returns the deferred action if this was the last reference.
+*/
+CONN_ACTION ConnStateRelease (CONN_STATE* cs);
+
+
+/*
+ Starts a disconnect: Connected or Connecting -> Disconnecting. On success takes a reference,
+ the caller prepares for the disconnect completion and then calls ConnStateRelease.
+ From Connecting the close is deferred till the connect completion.
+
+ Return Value:
+    Nonzero if this call started the disconnect, zero if the connection is not connected/connecting
+    or is already disconnecting.
+*/
+int ConnStateBeginDisconnect (CONN_STATE* cs);
+
+
+/*
+ Accounts the connect completion: Connecting -> Connected or ConnectFailed.
+ If a disconnect was started meanwhile, the state stays Disconnecting (or becomes ConnectFailed)
+ and the close (or the signal) is deferred till the references run down.
+
+ Arguments:
+    cs		- State word
+    success	- The channel is open
+    action	- Receives the action to perform now
+
+ Return Value:
+    Nonzero if the connection is Connected now.
+*/
+int ConnStateConnectDone (CONN_STATE* cs, int success, CONN_ACTION* action);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,430 @@
+/*++
+
+Module Name:
+    contread.c
+
+Abstract:
+    Optional continuous reader of incoming SCO audio
+
+Environment:
+    Kernel mode only
+--*/
+
+#include "driver.h"
+#include "device.h"
+#include "connection.h"
+#include "contread.h"
+
+#if defined(EVENT_TRACING)
+#include "contread.tmh"
+#endif
+
+EVT_WDF_REQUEST_CANCEL	HfpContReaderReadCancel;
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpContReaderInit (_In_ HFP_CONNECTION* Connection)
+{
+    KeInitializeEvent (&Connection->ContReader.IdleEvent, NotificationEvent, TRUE);
+}
+
+
+
+static void HfpContReaderFree (_In_ HFP_CONNECTION* Connection)
+{
+    HFP_CONT_READER*	reader = &Connection->ContReader;
+    ULONG				i;
+
+    for (i = 0; i < HFP_CONT_READER_MAX_DEPTH; i++) {
+		if (reader->Xfers[i].Request)
+			WdfObjectDelete (reader->Xfers[i].Request);		// deletes its memory objects also
+	}
+    RtlZeroMemory (reader->Xfers, sizeof(reader->Xfers));
+
+    if (reader->Memory)
+		ExFreePoolWithTag (reader->Memory, POOLTAG_HFPDRIVER);
+
+    WdfSpinLockAcquire (Connection->ConnectionLock);
+    reader->Memory = NULL;
+    reader->Depth  = 0;
+    WdfSpinLockRelease (Connection->ConnectionLock);
+
+    GetFileContext(Connection->FileObject)->ContReader = 0;
+}
+
+
+
+/*
+ Must be called under the ConnectionLock: the transfer stops being active
+*/
+static void HfpContReaderRelease (_In_ HFP_CONT_READER* reader)
+{
+    if (--reader->Active == 0)
+		KeSetEvent (&reader->IdleEvent, 0, FALSE);
+}
+
+
+
+/*
+ Must be called under the ConnectionLock. Takes the frames for a Read of the given buffer if the
+ Read can be completed now: the ring has enough frames to fill it, or no transfers are active anymore.
+ Returns FALSE if the Read has to wait.
+*/
+static BOOLEAN HfpContReaderTake (_In_ HFP_CONT_READER* reader, _Out_ PVOID buffer, _In_ ULONG length, _Out_ NTSTATUS* status, _Out_ ULONG* info)
+{
+    ULONG need = length / reader->Ring.FrameSize;
+    ULONG frames;
+
+    if (need == 0)
+		need = 1;
+    if (need > reader->Ring.SlotCount)
+		need = reader->Ring.SlotCount;
+
+    if (FrameRingCount(&reader->Ring) < need  &&  reader->Active)
+		return FALSE;
+
+    *info	= FrameRingDrain (&reader->Ring, buffer, length, &frames);
+    *status = (*info || reader->Active) ? STATUS_SUCCESS : STATUS_CONNECTION_DISCONNECTED;
+    return TRUE;
+}
+
+
+
+/*
+ Completes the Read request taken from PendingRead, unless the cancel routine owns it
+*/
+static void HfpContReaderCompleteRead (_In_ WDFREQUEST read, _In_ NTSTATUS status, _In_ ULONG info)
+{
+    if (WdfRequestUnmarkCancelable(read) != STATUS_CANCELLED)
+		WdfRequestCompleteWithInformation (read, status, info);
+}
+
+
+
+void HfpContReaderReadCancel (_In_ WDFREQUEST Request)
+{
+    // Not the file's Connection: it's cleared on disconnect while the reader still exists
+    HFP_CONNECTION*	connection = GetFileContext(WdfRequestGetFileObject(Request))->ContReader;
+
+    // No reader means it's stopped and PendingRead is already taken
+    if (connection) {
+		WdfSpinLockAcquire (connection->ConnectionLock);
+		if (connection->ContReader.PendingRead == Request)
+			connection->ContReader.PendingRead = NULL;
+		WdfSpinLockRelease (connection->ConnectionLock);
+	}
+
+    WdfRequestComplete (Request, STATUS_CANCELLED);
+}
+
+
+
+/*
+ Accounts the transfer completion and completes the pending Read if it can be filled now.
+ Returns TRUE if the transfer has to be reposted, otherwise the transfer is not active anymore.
+*/
+static BOOLEAN HfpContReaderDone (_In_ HFP_CONT_READER_XFER* xfer, _In_ NTSTATUS status, _In_ ULONG transferred)
+{
+    HFP_CONNECTION*		connection = xfer->Connection;
+    HFP_CONT_READER*	reader = &connection->ContReader;
+    WDFREQUEST			read = NULL;
+    NTSTATUS			readStatus;
+    ULONG				info;
+    BOOLEAN				repost;
+
+    WdfSpinLockAcquire (connection->ConnectionLock);
+
+    if (NT_SUCCESS(status))
+		FrameRingPush (&reader->Ring, xfer->Buffer, transferred);	// drops the oldest frame when full
+    else
+		reader->Ring.Stat.Errors++;
+
+    xfer->Posted = FALSE;
+
+    // A failed transfer is not reposted: it means the connection is closed or broken
+    repost = NT_SUCCESS(status) && !reader->Stopping;
+    if (!repost)
+		HfpContReaderRelease (reader);
+
+    if (reader->PendingRead  &&  HfpContReaderTake (reader, reader->PendingBuffer, reader->PendingLength, &readStatus, &info)) {
+		read = reader->PendingRead;
+		reader->PendingRead = NULL;
+	}
+
+    WdfSpinLockRelease (connection->ConnectionLock);
+
+    if (read)
+		HfpContReaderCompleteRead (read, readStatus, info);
+
+    return repost;
+}
+
+
+
+/*
+ Posts the active transfer, reusing its request and BRB
+*/
+static void HfpContReaderPost (_In_ HFP_CONT_READER_XFER* xfer)
+{
+    HFP_CONNECTION*				connection = xfer->Connection;
+    HFP_CONT_READER*			reader = &connection->ContReader;
+    WDF_REQUEST_REUSE_PARAMS	reuseParams;
+    NTSTATUS					status;
+
+    WdfSpinLockAcquire (connection->ConnectionLock);
+    if (reader->Stopping) {
+		HfpContReaderRelease (reader);
+		WdfSpinLockRelease (connection->ConnectionLock);
+		return;
+	}
+    xfer->Posted = TRUE;
+    WdfSpinLockRelease (connection->ConnectionLock);
+
+    WDF_REQUEST_REUSE_PARAMS_INIT (&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+    status = WdfRequestReuse (xfer->Request, &reuseParams);
+    if (!NT_SUCCESS(status))
+		goto exit;
+
+    if (!HfpConnectionObjectAcquireTransfer (connection)) {
+		status = STATUS_CONNECTION_DISCONNECTED;
+		goto exit;
+	}
+
+    status = HfpConnectionObjectFormatRequestForPooledScoTransfer (connection, xfer->Request, &xfer->Xfer, xfer->DataMemory, SCO_TRANSFER_DIRECTION_IN);
+    if (NT_SUCCESS(status)) {
+		WdfRequestSetCompletionRoutine (xfer->Request, HfpContReaderCompletion, xfer);
+		if (!WdfRequestSend (xfer->Request, connection->DevCtx->IoTarget, NULL))
+			status = WdfRequestGetStatus (xfer->Request);
+	}
+
+    // The sent transfer keeps the reference, its completion releases it
+    if (NT_SUCCESS(status))
+		return;
+    HfpConnectionObjectReleaseTransfer (connection);
+
+	exit:
+    TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER, "Continuous reader transfer post failed, Status %X", status);
+    HfpContReaderDone (xfer, status, 0);
+}
+
+
+
+void HfpContReaderCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Target, _In_ PWDF_REQUEST_COMPLETION_PARAMS Params, _In_ WDFCONTEXT Context)
+{
+    HFP_CONT_READER_XFER* xfer = (HFP_CONT_READER_XFER*) Context;
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    if (Params->IoStatus.Status)
+		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONT_READER, "Continuous reader transfer completion, Status %X", Params->IoStatus.Status);
+
+    HfpConnectionObjectTransferDone (&xfer->Xfer.Brb, Params->IoStatus.Status);
+
+    if (HfpContReaderDone (xfer, Params->IoStatus.Status, xfer->Xfer.Brb.BufferSize))
+		HfpContReaderPost (xfer);
+}
+
+
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS HfpContReaderStart (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* Connection, _In_ HFP_CONT_READER_START* Params)
+{
+    NTSTATUS				status;
+    HFP_CONT_READER*		reader = &Connection->ContReader;
+    WDFOBJECT				connectionObject = WdfObjectContextGetObject(Connection);
+    WDF_OBJECT_ATTRIBUTES	attributes;
+    size_t					ringSize;
+    PVOID					memory;
+    UCHAR*					buffers;
+    ULONG					i;
+
+    PAGED_CODE();
+
+    ringSize = FrameRingMemSize (Params->SlotCount, Params->FrameSize);
+    if (!ringSize  ||  Params->Depth == 0  ||  Params->Depth > HFP_CONT_READER_MAX_DEPTH) {
+		TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER, "Invalid continuous reader parameters: depth %d, %d frames x %d bytes", Params->Depth, Params->SlotCount, Params->FrameSize);
+		return STATUS_INVALID_PARAMETER;
+	}
+
+    memory = ExAllocatePoolWithTag (NonPagedPool, ringSize + Params->Depth*Params->FrameSize, POOLTAG_HFPDRIVER);
+    if (!memory)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+    // The reader memory is owned by the first caller, the reader runs until it's stopped
+    WdfSpinLockAcquire (Connection->ConnectionLock);
+    if (ConnStateGet(&Connection->State) != ConnectionStateConnected)
+		status = STATUS_CONNECTION_DISCONNECTED;
+    else if (reader->Memory  ||  reader->Active)
+		status = STATUS_DEVICE_BUSY;
+    else {
+		status = STATUS_SUCCESS;
+		reader->Memory	 = memory;
+		reader->Depth	 = Params->Depth;
+		reader->Stopping = FALSE;
+		FrameRingInit (&reader->Ring, memory, Params->SlotCount, Params->FrameSize);
+	}
+    WdfSpinLockRelease (Connection->ConnectionLock);
+
+    if (!NT_SUCCESS(status)) {
+		ExFreePoolWithTag (memory, POOLTAG_HFPDRIVER);
+		return status;
+	}
+
+    buffers = (UCHAR*)memory + ringSize;
+
+    for (i = 0; i < Params->Depth; i++)
+	{
+		HFP_CONT_READER_XFER* xfer = &reader->Xfers[i];
+
+		xfer->Connection		= Connection;
+		xfer->Buffer			= buffers + i*Params->FrameSize;
+		xfer->Xfer.Connection	= Connection;
+		xfer->Xfer.Index		= i;
+
+		WDF_OBJECT_ATTRIBUTES_INIT (&attributes);
+		attributes.ParentObject = connectionObject;
+		status = WdfRequestCreate (&attributes, devCtx->IoTarget, &xfer->Request);
+		if (!NT_SUCCESS(status))
+			goto exit;
+
+		WDF_OBJECT_ATTRIBUTES_INIT (&attributes);
+		attributes.ParentObject = xfer->Request;
+		status = WdfMemoryCreatePreallocated (&attributes, xfer->Buffer, Params->FrameSize, &xfer->DataMemory);
+		if (!NT_SUCCESS(status))
+			goto exit;
+
+		status = WdfMemoryCreatePreallocated (&attributes, &xfer->Xfer.Brb, sizeof(xfer->Xfer.Brb), &xfer->Xfer.BrbMemory);
+		if (!NT_SUCCESS(status))
+			goto exit;
+	}
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONT_READER, "Continuous reader started: depth %d, %d frames x %d bytes", Params->Depth, Params->SlotCount, Params->FrameSize);
+
+    GetFileContext(Connection->FileObject)->ContReader = Connection;
+
+    WdfSpinLockAcquire (Connection->ConnectionLock);
+    reader->Active	= Params->Depth;
+    reader->Running = TRUE;
+    KeClearEvent (&reader->IdleEvent);
+    WdfSpinLockRelease (Connection->ConnectionLock);
+
+    for (i = 0; i < Params->Depth; i++)
+		HfpContReaderPost (&reader->Xfers[i]);
+
+    return STATUS_SUCCESS;
+
+	exit:
+    TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER, "Continuous reader start failed, Status %X", status);
+    HfpContReaderFree (Connection);
+    return status;
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpContReaderCancel (_In_ HFP_CONNECTION* Connection)
+{
+    HFP_CONT_READER*	reader = &Connection->ContReader;
+    ULONG				i;
+
+    WdfSpinLockAcquire (Connection->ConnectionLock);
+    reader->Stopping = TRUE;
+    WdfSpinLockRelease (Connection->ConnectionLock);
+
+    // Cancellation only speeds up the stop: a transfer which is just being reposted is not
+    // cancelled, it completes in one frame time and is not reposted anymore
+    for (i = 0; i < HFP_CONT_READER_MAX_DEPTH; i++) {
+		if (reader->Xfers[i].Request  &&  reader->Xfers[i].Posted)
+			WdfRequestCancelSentRequest (reader->Xfers[i].Request);
+	}
+}
+
+
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpContReaderStop (_In_ HFP_CONNECTION* Connection, _Out_opt_ FRAME_RING_STATS* Stats)
+{
+    HFP_CONT_READER*	reader = &Connection->ContReader;
+    WDFREQUEST			read;
+
+    WdfSpinLockAcquire (Connection->ConnectionLock);
+    if (!reader->Running) {
+		WdfSpinLockRelease (Connection->ConnectionLock);
+		return;
+	}
+    reader->Running = FALSE;
+    read = reader->PendingRead;
+    reader->PendingRead = NULL;
+    WdfSpinLockRelease (Connection->ConnectionLock);
+
+    if (read)
+		HfpContReaderCompleteRead (read, STATUS_CANCELLED, 0);
+
+    HfpContReaderCancel (Connection);
+    KeWaitForSingleObject (&reader->IdleEvent, Executive, KernelMode, FALSE, NULL);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONT_READER, "Continuous reader stopped: %d frames, %d bytes, overruns %d, drained %d, max fill %d, errors %d",
+				reader->Ring.Stat.Frames, reader->Ring.Stat.Bytes, reader->Ring.Stat.Overruns, reader->Ring.Stat.Drained, reader->Ring.Stat.MaxFill, reader->Ring.Stat.Errors);
+
+    if (Stats)
+		*Stats = reader->Ring.Stat;
+
+    HfpContReaderFree (Connection);
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpContReaderRead (_In_ HFP_CONNECTION* Connection, _In_ WDFREQUEST Request)
+{
+    HFP_CONT_READER*	reader = &Connection->ContReader;
+    NTSTATUS			status;
+    PVOID				buffer;
+    size_t				length;
+    ULONG				info = 0;
+    BOOLEAN				complete = TRUE;
+
+    if (!reader->Running)
+		return FALSE;
+
+    status = WdfRequestRetrieveOutputBuffer (Request, 1, &buffer, &length);
+    if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER, "WdfRequestRetrieveOutputBuffer failed, request 0x%p, Status %X", Request, status);
+		WdfRequestComplete (Request, status);
+		return TRUE;
+	}
+    if (length > (ULONG)(-1))
+		length = (ULONG)(-1);
+
+    WdfSpinLockAcquire (Connection->ConnectionLock);
+
+    if (!reader->Running) {
+		WdfSpinLockRelease (Connection->ConnectionLock);
+		return FALSE;
+	}
+
+    // A frame doesn't fit: the Read would be completed empty forever
+    if (length < reader->Ring.FrameSize)
+		status = STATUS_BUFFER_TOO_SMALL;
+    else if (HfpContReaderTake (reader, buffer, (ULONG)length, &status, &info))
+		;
+    else if (reader->PendingRead)
+		status = STATUS_DEVICE_BUSY;		// one Read at a time
+    else {
+		status = WdfRequestMarkCancelableEx (Request, HfpContReaderReadCancel);
+		if (NT_SUCCESS(status)) {
+			reader->PendingRead	  = Request;
+			reader->PendingBuffer = buffer;
+			reader->PendingLength = (ULONG)length;
+			complete = FALSE;
+		}
+	}
+
+    WdfSpinLockRelease (Connection->ConnectionLock);
+
+    if (complete)
+		WdfRequestCompleteWithInformation (Request, status, info);
+    return TRUE;
+}
@@ -0,0 +1,99 @@
+/*++
+
+Module Name:
+    contread.h
+
+Abstract:
+    Optional continuous reader of incoming SCO audio.
+
+    While it runs, Depth SCO IN transfers are always posted, their frames go to the connection's
+    frame ring (framering.h), and Read requests drain whole frames from the ring: inbound audio
+    doesn't depend on the application having a ReadFile pending. A Read is completed when the
+    ring has enough frames to fill it, otherwise it waits (one pending Read at a time).
+    A Read buffer smaller than FrameSize fails with STATUS_BUFFER_TOO_SMALL: frames are never split.
+
+Environment:
+    Kernel mode only
+--*/
+
+
+
+/*
+ Initializes the continuous reader state, called once when the connection object is initialized
+
+ Arguments:
+    Connection - Connection
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpContReaderInit (_In_ HFP_CONNECTION* Connection);
+
+
+
+/*
+ Handles IOCTL_HFP_CONT_READER_START: allocates the ring and the transfers and posts them
+
+ Arguments:
+    devCtx		- Device context
+    Connection	- Connected SCO connection
+    Params		- Reader parameters
+
+ Return Value:
+    NTSTATUS Status code.
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS HfpContReaderStart (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* Connection, _In_ HFP_CONT_READER_START* Params);
+
+
+
+/*
+ Handles IOCTL_HFP_CONT_READER_STOP and the connection cleanup: stops the transfers, waits for
+ them and frees the resources. A pending Read is cancelled. Does nothing if the reader is not running.
+
+ Arguments:
+    Connection	- Connection
+    Stats		- Receives the reader statistics, may be NULL
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpContReaderStop (_In_ HFP_CONNECTION* Connection, _Out_opt_ FRAME_RING_STATS* Stats);
+
+
+
+/*
+ Stops reposting and cancels the posted transfers, without waiting (used on disconnect)
+
+ Arguments:
+    Connection	- Connection
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpContReaderCancel (_In_ HFP_CONNECTION* Connection);
+
+
+
+/*
+ Serves a Read request from the ring if the reader is running
+
+ Arguments:
+    Connection	- Connection
+    Request		- Read request
+
+ Return Value:
+    FALSE if the reader is not running: the caller sends the Read as SCO transfer.
+    TRUE if the request is completed or is pending. A Read smaller than FrameSize is
+    completed with STATUS_BUFFER_TOO_SMALL.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpContReaderRead (_In_ HFP_CONNECTION* Connection, _In_ WDFREQUEST Request);
+
+
+
+/*
+ Completion routine for the continuous reader transfers: pushes the frame to the ring,
+ completes the pending Read if it can be filled now and reposts the transfer.
+
+Arguments:
+    Request - Transfer request
+    Target  - Target to which request was sent
+    Params  - Completion parameters for the request
+    Context - We receive HFP_CONT_READER_XFER as the context
+*/
+EVT_WDF_REQUEST_COMPLETION_ROUTINE	HfpContReaderCompletion;
@@ -17,6 +17,7 @@ Environment:
 #include "client.h"
 #include "server.h"
 #include "queue.h"
+#include "shmring.h"
 
 #define INITGUID
 #include "hfppublic.h"
@@ -31,6 +32,7 @@ Environment:
 #pragma alloc_text (PAGE, HfpEvtFileCreate)
 #pragma alloc_text (PAGE, HfpEvtFileCleanup)
 #pragma alloc_text (PAGE, HfpEvtFileClose)
+#pragma alloc_text (PAGE, HfpEvtIoInCallerContext)
 #endif
 
 
@@ -70,6 +72,9 @@ NTSTATUS HfpEvtDriverDeviceAdd (_In_ WDFDRIVER  Driver, _Inout_ PWDFDEVICE_INIT
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE (&requestAttributes, BRB);
     WdfDeviceInitSetRequestAttributes(DeviceInit, &requestAttributes);
 
+    // The shared memory ring is mapped to the process of the requester, the queue may be called in any context
+    WdfDeviceInitSetIoInCallerContextCallback (DeviceInit, HfpEvtIoInCallerContext);
+
     // Set device attributes
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&deviceAttributes, HFPDEVICE_CONTEXT);
     status = WdfDeviceCreate (&DeviceInit, &deviceAttributes, &device);
@@ -121,8 +126,8 @@ NTSTATUS HfpEvtDriverDeviceAdd (_In_ WDFDRIVER  Driver, _Inout_ PWDFDEVICE_INIT
 	{
 	struct _BRB_SCO_GET_SYSTEM_INFO* brb;
 
-	devCtx->ProfileDrvInterface.BthReuseBrb(&(devCtx->RegisterUnregisterBrb), BRB_SCO_GET_SYSTEM_INFO);
-	brb = (struct _BRB_SCO_GET_SYSTEM_INFO*) &(devCtx->RegisterUnregisterBrb);
+	devCtx->ProfileDrvInterface.BthReuseBrb(&(devCtx->InitBrb), BRB_SCO_GET_SYSTEM_INFO);
+	brb = (struct _BRB_SCO_GET_SYSTEM_INFO*) &(devCtx->InitBrb);
 	status = HfpSharedSendBrbSynchronously (devCtx->IoTarget, devCtx->Request, (PBRB)brb, sizeof(*brb));
 	if (!NT_SUCCESS(status)) {
 		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "BRB_SCO_GET_SYSTEM_INFO failed, Status %X", status);
@@ -171,13 +176,12 @@ void HfpEvtDeviceSelfManagedIoCleanup (_In_ WDFDEVICE  Device)
 	HFPDEVICE_CONTEXT* devCtx = GetClientDeviceContext(Device);
 
 	PAGED_CODE();
-	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "HfpEvtDeviceSelfManagedIoCleanup, ScoServerHandle = %X", devCtx->ScoServerHandle);
+	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "HfpEvtDeviceSelfManagedIoCleanup, SCO servers = %d", devCtx->ScoTable.Count);
 
 	if (devCtx->SdpRecordHandle)
 		HfpSrvRemoveSdpRecord(devCtx);
 
-	if (devCtx->ScoServerHandle)
-		HfpSrvUnregisterScoServer(devCtx, 0);
+	HfpSrvUnregisterAllScoServers(devCtx);
 
 	// After this point no more connections can come because we have unregistered server.
 }
@@ -185,47 +189,38 @@ void HfpEvtDeviceSelfManagedIoCleanup (_In_ WDFDEVICE  Device)
 
 void HfpEvtFileCreate (_In_ WDFDEVICE Device, _In_ WDFREQUEST Request, _In_ WDFFILEOBJECT fileObject)
 {
-	NTSTATUS status = STATUS_SUCCESS;
-
-	UNREFERENCED_PARAMETER(Device);
-
+	PAGED_CODE();
 	TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "HfpEvtFileCreate");
 
-	if (GetClientDeviceContext(Device)->FileObject)	{
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ERROR: Device is already open");
-		status = STATUS_INVALID_DEVICE_REQUEST;
-		goto exit;
-	}
-	else  {
-		GetClientDeviceContext(Device)->FileObject = fileObject;
-	}
+	// Several files may be open: one per remote device, each registers its own SCO server
 
 	// Must be cleared before we may open it in the HfpEvtQueueIoDeviceControl,IOCTL_HFP_OPEN_SCO
 	// In order to check this state when closing
 	NT_ASSERT (GetFileContext(fileObject)->Connection == 0);
 
-	PAGED_CODE();
-
 	// All the activity of this function is moved to HfpEvtQueueIoDeviceControl-IOCTL_HFP_OPEN_SCO,
 	// because of the user application first must supply the destination Bluetooth device address,
 	// and only then the SCO channel may be opened and the tx/rx will start.
-	// As result this function is empty.
 
-	exit:
-	WdfRequestComplete(Request, status);
+	WdfRequestComplete(Request, STATUS_SUCCESS);
 }
 
 
 void HfpEvtFileCleanup (_In_ WDFFILEOBJECT  fileObject)
 {
 	HFPDEVICE_CONTEXT*	devCtx = GetClientDeviceContext(WdfFileObjectGetDevice(fileObject));
-	HFP_CONNECTION*		connection = GetFileContext(fileObject)->Connection;
+	HFP_CONNECTION*		connection;
 	PAGED_CODE();
 	TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "HfpEvtFileCleanup, fileObject=%X", fileObject);
-	NT_ASSERT (devCtx->FileObject == fileObject);
-	devCtx->FileObject = 0;
+
+	// The ring mapping belongs to the file, it's unmapped from its process here
+	HfpShmRingUnmap (fileObject);
+
+	// The file's SCO server goes first, so no incoming connection comes for the file after that
+	HfpSrvUnregisterScoServer (devCtx, fileObject);
 
 	// Since this routine is called at passive level we can disconnect synchronously
+	connection = GetFileContext(fileObject)->Connection;
 	if (connection)
 		HfpConnectionObjectRemoteDisconnectSynchronously (devCtx, connection);
 }
@@ -239,3 +234,24 @@ void HfpEvtFileClose (_In_ WDFFILEOBJECT  fileObject)
 	TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "HfpEvtFileClose, fileObject=%X, connection=%X", fileObject, connection);
 }
 
+
+
+void HfpEvtIoInCallerContext (_In_ WDFDEVICE Device, _In_ WDFREQUEST Request)
+{
+	WDF_REQUEST_PARAMETERS	params;
+	NTSTATUS				status;
+	PAGED_CODE();
+
+	WDF_REQUEST_PARAMETERS_INIT (&params);
+	WdfRequestGetParameters (Request, &params);
+
+	if (params.Type == WdfRequestTypeDeviceControl  &&  params.Parameters.DeviceIoControl.IoControlCode == IOCTL_HFP_SCO_RING_MAP) {
+		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtIoInCallerContext: SCO_RING_MAP");
+		HfpShmRingMapRequest (GetClientDeviceContext(Device), Request, params.Parameters.DeviceIoControl.OutputBufferLength, params.Parameters.DeviceIoControl.InputBufferLength);
+		return;
+	}
+
+	status = WdfDeviceEnqueueRequest (Device, Request);
+	if (!NT_SUCCESS(status))
+		WdfRequestComplete (Request, status);
+}
@@ -12,6 +12,31 @@
 
 #include "trace.h"
 #include "hfppublic.h"
+#include "scotable.h"
+
+
+/*
+  SCO server events of a remote device, associated with correspondent User-mode Events
+*/
+typedef enum {
+    HfpScoEventConnect = 0,
+    HfpScoEventDisconnect,
+    HfpScoEventCritError,
+    HfpScoEventCount
+} HFP_SCO_EVENT;
+
+
+/*
+  SCO server registered for a remote device, the driver part of a SCO_TABLE entry
+*/
+typedef struct
+{
+    SCO_SERVER_HANDLE				ScoServerHandle;		// Handle obtained by registering SCO server
+    WDFREQUEST						Request;				// Request used for server register/unregister
+    struct _BRB						RegisterUnregisterBrb;	// BRB used for server register/unregister
+	BOOLEAN							ConnectReadiness;		// To confirm incoming SCO connection only when this flag is true
+	PKEVENT							Kev[HfpScoEventCount];	// Events associated with correspondent User-mode Events
+} HFP_SCO_SERVER;
 
 
 /*
@@ -23,17 +48,14 @@ typedef struct
     WDFIOTARGET						IoTarget;				// Default I/O target
     BTH_PROFILE_DRIVER_INTERFACE	ProfileDrvInterface;	// Profile driver interface which contains profile driver DDI
     WDFREQUEST						Request;				// Preallocated request to be reused during initialization/deinitialzation phase, access to this request is not synchronized
-	WDFFILEOBJECT					FileObject;				// Current file object or 0, if no application currently opened us (we support only one application at a time)
     BTH_ADDR						LocalBthAddr;			// Local Bluetooth Address
-    BTH_ADDR						RemoteBthAddress;		// Destination Bluetooth address
     HANDLE_SDP						SdpRecordHandle;		// Handle to published SDP record
-    SCO_SERVER_HANDLE				ScoServerHandle;		// Handle obtained by registering SCO server
-    struct _BRB						RegisterUnregisterBrb;	// BRB used for server register
-	BOOLEAN							ConnectReadiness;		// To confirm incoming SCO connection only when this flag is true
+    struct _BRB						InitBrb;				// BRB used during initialization, with Request
     USHORT							ScoPacketTypes;			// Supported (e)SCO packet types: taken from BT Radio and then passed when opening SCOs
-	PKEVENT							KevScoConnect;			// SCO Connect Event associated with correspondent User-mode Event
-	PKEVENT							KevScoDisconnect;		// SCO Disconnect Event associated with correspondent User-mode Event
-	PKEVENT							KevScoCritError;		// SCO Critical Error Event associated with correspondent User-mode Event
+    WDFSPINLOCK						ScoTableLock;			// Protects ScoTable and the Servers' readiness and events
+    WDFWAITLOCK						ScoServerLock;			// Serializes the SCO servers' registration and unregistration: ScoTable entries are added and removed only under it
+    SCO_TABLE						ScoTable;				// Remote devices: their owner files and connections
+    HFP_SCO_SERVER					Servers[SCO_TABLE_MAX];	// SCO servers, parallel to ScoTable entries
 	#if (NTDDI_VERSION >= NTDDI_WIN8)
     BTH_HOST_FEATURE_MASK			LocalFeatures;			// Features supported by the local stack
 	#endif
@@ -42,6 +64,7 @@ typedef struct
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(HFPDEVICE_CONTEXT, GetClientDeviceContext)
 
 struct HFP_CONNECTION;
+struct HFP_SHM_RING;
 
 
 /*
@@ -49,7 +72,10 @@ struct HFP_CONNECTION;
 */
 typedef struct
 {
-    struct HFP_CONNECTION *	 Connection;		// Connection opened for this file (only one connection per file supported)
+    struct HFP_CONNECTION *	 Connection;		// Connection opened for this file: one per file, so I/O is routed by the file (an application opens a file per remote device)
+    struct HFP_SHM_RING *	 ShmRing;			// Shared memory SCO ring mapped to this file's process or 0
+    struct HFP_CONNECTION *	 ContReader;		// Connection with running continuous reader or 0 (it outlives Connection on disconnect)
+    struct HFP_CONNECTION *	 Closed;			// Connection closed by CLOSE_SCO or 0, deleted by the next OPEN_SCO/CLOSE_SCO or with the file
 } HFP_FILE_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BRB, GetRequestContext);    
@@ -132,3 +158,16 @@ EVT_WDF_FILE_CLOSE	 HfpEvtFileClose;
     fileObject - File object corresponding to Close
 */
 EVT_WDF_FILE_CLEANUP	HfpEvtFileCleanup;
+
+
+
+/*
+ Called by the framework in the context of the requesting thread before the request is queued.
+ IOCTL_HFP_SCO_RING_MAP is handled here since it maps memory to the calling process; the rest
+ of the requests are passed to the default queue.
+
+ Arguments:
+    Device	- Framework device object
+    Request	- The request
+*/
+EVT_WDF_IO_IN_CALLER_CONTEXT	HfpEvtIoInCallerContext;
@@ -0,0 +1,118 @@
+/*++
+
+Module Name:
+    framering.c
+
+Abstract:
+    Ring of received SCO frames for the continuous reader: the portable bookkeeping.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#define FrameRingCopy(d,s,n)	RtlCopyMemory(d,s,n)
+#elif defined(_WIN32)
+#include <windows.h>
+#define FrameRingCopy(d,s,n)	memcpy(d,s,n)
+#else
+#include <string.h>
+#define FrameRingCopy(d,s,n)	memcpy(d,s,n)
+#endif
+
+#include "framering.h"
+
+
+size_t FrameRingMemSize (ULONG slotcount, ULONG framesize)
+{
+	if (slotcount < 2 || slotcount > FRAME_RING_MAX_SLOTS || (slotcount & (slotcount-1)) ||
+		framesize == 0 || framesize > FRAME_RING_MAX_FRAME)
+		return 0;
+
+	return slotcount * sizeof(ULONG) + (size_t)slotcount * framesize;
+}
+
+
+void FrameRingInit (FRAME_RING* ring, void* mem, ULONG slotcount, ULONG framesize)
+{
+	ring->SlotCount = slotcount;
+	ring->FrameSize = framesize;
+	ring->Head		= 0;
+	ring->Tail		= 0;
+	ring->Length	= (ULONG*) mem;
+	ring->Data		= (UCHAR*) mem + slotcount * sizeof(ULONG);
+
+	ring->Stat.Frames	= 0;
+	ring->Stat.Bytes	= 0;
+	ring->Stat.Overruns = 0;
+	ring->Stat.Drained	= 0;
+	ring->Stat.MaxFill	= 0;
+	ring->Stat.Errors	= 0;
+}
+
+
+void FrameRingClear (FRAME_RING* ring)
+{
+	ring->Tail = ring->Head;
+}
+
+
+ULONG FrameRingCount (FRAME_RING* ring)
+{
+	return ring->Head - ring->Tail;
+}
+
+
+int FrameRingPush (FRAME_RING* ring, const void* data, ULONG len)
+{
+	ULONG slot, fill;
+	int	  overrun = 0;
+
+	if (ring->Head - ring->Tail == ring->SlotCount) {
+		ring->Tail++;				// drop the oldest frame
+		ring->Stat.Overruns++;
+		overrun = 1;
+	}
+
+	if (len > ring->FrameSize)
+		len = ring->FrameSize;
+
+	slot = ring->Head & (ring->SlotCount-1);
+	FrameRingCopy (ring->Data + slot * ring->FrameSize, data, len);
+	ring->Length[slot] = len;
+	ring->Head++;
+
+	ring->Stat.Frames++;
+	ring->Stat.Bytes += len;
+	fill = ring->Head - ring->Tail;
+	if (fill > ring->Stat.MaxFill)
+		ring->Stat.MaxFill = fill;
+
+	return overrun;
+}
+
+
+ULONG FrameRingDrain (FRAME_RING* ring, void* buf, ULONG buflen, ULONG* frames)
+{
+	ULONG n = 0, nframes = 0;
+
+	while (ring->Tail != ring->Head)
+	{
+		ULONG slot = ring->Tail & (ring->SlotCount-1);
+		ULONG len  = ring->Length[slot];
+
+		if (n + len > buflen)
+			break;
+
+		FrameRingCopy ((UCHAR*)buf + n, ring->Data + slot * ring->FrameSize, len);
+		n += len;
+		nframes++;
+		ring->Tail++;
+	}
+
+	ring->Stat.Drained += nframes;
+	if (frames)
+		*frames = nframes;
+	return n;
+}
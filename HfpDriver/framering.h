@@ -0,0 +1,120 @@
+/*++
+
+Module Name:
+    framering.h
+
+Abstract:
+    Ring of received SCO frames for the continuous reader: the portable bookkeeping.
+
+    The ring keeps whole frames (up to FrameSize bytes each) in SlotCount slots.
+    The producer (SCO IN completions) never waits: when the ring is full the oldest frame is
+    dropped and counted as an overrun, keeping the freshest audio. The consumer drains as
+    many whole frames as fit into its buffer.
+    The ring is not thread safe: the caller serializes the calls (the driver uses its
+    ConnectionLock).
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define FRAME_RING_MAX_SLOTS	1024		// Must be a power of 2
+#define FRAME_RING_MAX_FRAME	4096
+
+
+/*
+  Continuous reader statistics, also returned by IOCTL_HFP_CONT_READER_STOP
+*/
+typedef struct
+{
+	ULONG	Frames;			// Pushed frames
+	ULONG	Bytes;			// Pushed bytes
+	ULONG	Overruns;		// Frames dropped because the ring was full
+	ULONG	Drained;		// Frames taken by the consumer
+	ULONG	MaxFill;		// High watermark, in frames
+	ULONG	Errors;			// Failed SCO transfers (counted by the driver)
+} FRAME_RING_STATS;
+
+
+typedef struct
+{
+	ULONG				SlotCount;		// Power of 2
+	ULONG				FrameSize;		// Max bytes per frame
+	ULONG				Head;			// Free-running indices
+	ULONG				Tail;
+	ULONG*				Length;			// SlotCount frame lengths
+	UCHAR*				Data;			// SlotCount * FrameSize bytes
+	FRAME_RING_STATS	Stat;
+} FRAME_RING;
+
+
+
+/*
+ Memory needed for the ring of the given geometry, or 0 if the geometry is invalid
+*/
+size_t FrameRingMemSize (ULONG slotcount, ULONG framesize);
+
+
+/*
+ Initializes the ring on the caller's memory of FrameRingMemSize bytes
+*/
+void FrameRingInit (FRAME_RING* ring, void* mem, ULONG slotcount, ULONG framesize);
+
+
+/*
+ Drops all the frames (the statistics are kept)
+*/
+void FrameRingClear (FRAME_RING* ring);
+
+
+/*
+ Number of frames in the ring
+*/
+ULONG FrameRingCount (FRAME_RING* ring);
+
+
+/*
+ Stores a frame (truncated to FrameSize). If the ring is full, the oldest frame is dropped.
+
+ Return Value:
+    1 if a frame was dropped (overrun), otherwise 0
+*/
+int FrameRingPush (FRAME_RING* ring, const void* data, ULONG len);
+
+
+/*
+ Copies as many whole frames as fit into the buffer, and removes them from the ring.
+
+ Arguments:
+    ring	- Ring
+    buf		- Destination buffer
+    buflen	- Destination buffer size
+    frames	- Receives the number of the copied frames, may be NULL
+
+ Return Value:
+    Number of copied bytes
+*/
+ULONG FrameRingDrain (FRAME_RING* ring, void* buf, ULONG buflen, ULONG* frames);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,11 @@ Abstract:
 
 #pragma once
 
+#include "scobatch.h"
+#include "scoshm.h"
+#include "framering.h"
+#include "scostats.h"
+
 
 #define POOLTAG_HFPDRIVER 'htbw'
 
@@ -38,18 +43,50 @@ extern __declspec(selectany) const PWSTR BthHfpDriverName = L"HfpDriver";
 #endif
 
 
+/*
+  SCO server registration: one remote device per file handle (the events belong to this remote).
+  Several remote devices are served by opening a handle per each.
+*/
 typedef struct
 {
 	UINT64		DestAddr;				// Destination Bluetooth device
 	UINT64		EvHandleScoConnect;		// User-mode Event handle for SCO Connect
 	UINT64		EvHandleScoDisconnect;	// User-mode Event handle for SCO Disconnect
 	UINT64		EvHandleScoCritError;	// User-mode Event handle for SCO Critical error
-	BOOLEAN		ConnectReadiness;		// HFPDEVICE_CONTEXT::ConnectReadiness init value
+	BOOLEAN		ConnectReadiness;		// HFP_SCO_SERVER::ConnectReadiness init value
 } HFP_REG_SERVER;
 
 
+typedef struct
+{
+	ULONG		SlotCount;				// Slots per direction, a power of 2 (see scoshm.h)
+	ULONG		SlotSize;				// Data bytes per slot, i.e. SCO transfer size
+	UINT64		EvHandleRx;				// User-mode Event handle: the driver sets it when Rx slots are published
+} HFP_SCO_RING_MAP_IN;
+
+typedef struct
+{
+	UINT64		Address;				// User-mode address of the mapped SCO_SHM_HEADER
+	ULONG		Size;					// Mapped bytes
+} HFP_SCO_RING_MAP_OUT;
+
+
+typedef struct
+{
+	ULONG		Depth;					// SCO IN transfers kept posted, 1..HFP_CONT_READER_MAX_DEPTH
+	ULONG		SlotCount;				// Ring frames, a power of 2 (see framering.h)
+	ULONG		FrameSize;				// Bytes per frame, i.e. SCO transfer size
+} HFP_CONT_READER_START;
+
+
 #define IOCTL_HFP_REG_SERVER			CTL_CODE (FILE_DEVICE_TRANSPORT, 2048, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #define IOCTL_HFP_UNREG_SERVER			CTL_CODE (FILE_DEVICE_TRANSPORT, 2049, METHOD_BUFFERED, FILE_ANY_ACCESS)
-#define IOCTL_HFP_OPEN_SCO				CTL_CODE (FILE_DEVICE_TRANSPORT, 2050, METHOD_BUFFERED, FILE_ANY_ACCESS)
-#define IOCTL_HFP_CLOSE_SCO				CTL_CODE (FILE_DEVICE_TRANSPORT, 2051, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_HFP_OPEN_SCO				CTL_CODE (FILE_DEVICE_TRANSPORT, 2050, METHOD_BUFFERED, FILE_ANY_ACCESS)	// Pends till the channel is open, use overlapped I/O
+#define IOCTL_HFP_CLOSE_SCO				CTL_CODE (FILE_DEVICE_TRANSPORT, 2051, METHOD_BUFFERED, FILE_ANY_ACCESS)	// Pends till the channel is closed, use overlapped I/O
 #define IOCTL_HFP_INCOMING_READINESS	CTL_CODE (FILE_DEVICE_TRANSPORT, 2052, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_HFP_SCO_BATCH				CTL_CODE (FILE_DEVICE_TRANSPORT, 2053, METHOD_BUFFERED, FILE_ANY_ACCESS)	// HFP_SCO_BATCH_IN -> HFP_SCO_BATCH_OUT, see scobatch.h
+#define IOCTL_HFP_SCO_RING_MAP			CTL_CODE (FILE_DEVICE_TRANSPORT, 2054, METHOD_BUFFERED, FILE_ANY_ACCESS)	// HFP_SCO_RING_MAP_IN -> HFP_SCO_RING_MAP_OUT, see scoshm.h
+#define IOCTL_HFP_SCO_RING_UNMAP		CTL_CODE (FILE_DEVICE_TRANSPORT, 2055, METHOD_BUFFERED, FILE_ANY_ACCESS)	// Stops streaming, the mapping stays till the handle is closed
+#define IOCTL_HFP_CONT_READER_START		CTL_CODE (FILE_DEVICE_TRANSPORT, 2056, METHOD_BUFFERED, FILE_ANY_ACCESS)	// HFP_CONT_READER_START, see contread.h
+#define IOCTL_HFP_CONT_READER_STOP		CTL_CODE (FILE_DEVICE_TRANSPORT, 2057, METHOD_BUFFERED, FILE_ANY_ACCESS)	// -> FRAME_RING_STATS (optional)
+#define IOCTL_HFP_SCO_STATS				CTL_CODE (FILE_DEVICE_TRANSPORT, 2058, METHOD_BUFFERED, FILE_ANY_ACCESS)	// -> SCO_STATS of the file's (last) SCO connection, see scostats.h
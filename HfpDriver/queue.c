@@ -15,6 +15,9 @@
 #include "queue.h"
 #include "client.h"
 #include "server.h"
+#include "scobatch.h"
+#include "shmring.h"
+#include "contread.h"
 
 #if defined(EVENT_TRACING)
 #include "queue.tmh"
@@ -36,18 +39,100 @@ void HfpReadWriteCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET  Target,
 		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "I/O completion, Status %X, size = %d", Params->IoStatus.Status, bufsize);
 	}
 
+    HfpConnectionObjectTransferDone (brb, Params->IoStatus.Status);
+
     // Complete the request
     WdfRequestCompleteWithInformation(Request, Params->IoStatus.Status, bufsize);
 }
 
 
 
+void HfpPooledReadWriteCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET  Target, _In_ PWDF_REQUEST_COMPLETION_PARAMS Params, _In_ WDFCONTEXT  Context)
+{
+    HFP_SCO_XFER* xfer = (HFP_SCO_XFER*) Context;
+    size_t bufsize;
+
+    UNREFERENCED_PARAMETER(Target);
+    NT_ASSERT (xfer);
+
+    bufsize = xfer->Brb.BufferSize;  // bytes read/written
+
+    if (Params->IoStatus.Status) {
+		// Print only when error happened 
+		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "I/O completion, Status %X, size = %d", Params->IoStatus.Status, bufsize);
+	}
+
+    // Account and recycle the transfer context, complete the request
+    HfpConnectionObjectTransferDone (&xfer->Brb, Params->IoStatus.Status);
+    HfpConnectionObjectPutXfer (xfer);
+    WdfRequestCompleteWithInformation(Request, Params->IoStatus.Status, bufsize);
+}
+
+
+
+/*
+ Sends Read/Write request as SCO transfer: with a pooled transfer context if available,
+ otherwise with the request context BRB. Completes the request if it fails.
+*/
+static void HfpScoTransferSend (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* connection, _In_ WDFREQUEST Request, _In_ WDFMEMORY memory, _In_ ULONG direction)
+{
+    NTSTATUS					status;
+    HFP_SCO_XFER*				xfer = NULL;
+    struct _BRB_SCO_TRANSFER*	brb = NULL;
+
+    // Lock free connected check: the reference holds the disconnect off till the transfer completes
+    if (!HfpConnectionObjectAcquireTransfer (connection)) {
+		WdfRequestComplete(Request, STATUS_CONNECTION_DISCONNECTED);
+		return;
+	}
+
+    xfer = HfpConnectionObjectGetXfer (connection);
+
+    if (xfer) {
+		// Hot path: no allocations, the BRB and its memory object are preallocated
+		status = HfpConnectionObjectFormatRequestForPooledScoTransfer (connection, Request, xfer, memory, direction);
+		if (!NT_SUCCESS(status))
+			goto exit;
+
+		WdfRequestSetCompletionRoutine (Request, HfpPooledReadWriteCompletion, xfer);
+		brb = &xfer->Brb;
+	}
+    else {
+		// The pool is exhausted: get the BRB from request context and initialize it as BRB_SCO_TRANSFER BRB
+		brb = (struct _BRB_SCO_TRANSFER*) GetRequestContext(Request);
+		devCtx->ProfileDrvInterface.BthReuseBrb ((PBRB)brb, BRB_SCO_TRANSFER);
+
+		status = HfpConnectionObjectFormatRequestForScoTransfer (connection, Request, &brb, memory, direction);
+		if (!NT_SUCCESS(status))
+			goto exit;
+
+		WdfRequestSetCompletionRoutine (Request, HfpReadWriteCompletion, brb);
+	}
+
+    // Send the request down the stack
+    if (!WdfRequestSend (Request, devCtx->IoTarget, NULL))  {
+        status = WdfRequestGetStatus(Request);
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_UTIL, "Request send failed for request 0x%p, Brb 0x%p, Status %X", Request, brb, status);
+        goto exit;
+    }
+
+    // The sent transfer keeps the reference, its completion releases it
+    return;
+
+	exit:
+    HfpConnectionObjectReleaseTransfer (connection);
+    if (xfer)
+		HfpConnectionObjectPutXfer (xfer);
+    WdfRequestComplete(Request, status);
+}
+
+
+
 void HfpEvtQueueIoWrite (_In_ WDFQUEUE Queue, _In_ WDFREQUEST Request, _In_ size_t Length)
 {
     NTSTATUS			status;
     HFPDEVICE_CONTEXT*	devCtx;
     WDFMEMORY			memory;
-    struct _BRB_SCO_TRANSFER * brb = NULL;    
     HFP_CONNECTION*		connection;
     
     UNREFERENCED_PARAMETER(Length);
@@ -67,30 +152,12 @@ void HfpEvtQueueIoWrite (_In_ WDFQUEUE Queue, _In_ WDFREQUEST Request, _In_ size
         goto exit;        
     }
 
-    // Get the BRB from request context and initialize it as BRB_SCO_TRANSFER BRB
-    brb = (struct _BRB_SCO_TRANSFER*) GetRequestContext(Request);
-    devCtx->ProfileDrvInterface.BthReuseBrb ((PBRB)brb, BRB_SCO_TRANSFER);
-
-    // Format the Write request for SCO OUT transfer. This routine allocates a BRB which is returned to us in brb parameter.
-    // This BRB is freed by the completion routine is we send the request successfully, else it is freed by this routine.
-    status = HfpConnectionObjectFormatRequestForScoTransfer (connection, Request, &brb, memory, SCO_TRANSFER_DIRECTION_OUT);
-
-    if (!NT_SUCCESS(status))
-        goto exit;
-
-    // Set a CompletionRoutine callback function.
-    WdfRequestSetCompletionRoutine(Request, HfpReadWriteCompletion, brb);
-
-    // Send the request down the stack
-    if (!WdfRequestSend(Request, devCtx->IoTarget, NULL))  {
-        status = WdfRequestGetStatus(Request);
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_UTIL, "Request send failed for request 0x%p, BRB %p, Status %X", Request, brb, status);
-        goto exit;
-    }    
+    // Format the Write request for SCO OUT transfer and send it, it's completed by the completion routine
+    HfpScoTransferSend (devCtx, connection, Request, memory, SCO_TRANSFER_DIRECTION_OUT);
+    return;
 
 	exit:
-    if (!NT_SUCCESS(status))
-        WdfRequestComplete(Request, status);
+    WdfRequestComplete(Request, status);
 }
 
 
@@ -100,7 +167,6 @@ void HfpEvtQueueIoRead (_In_ WDFQUEUE  Queue, _In_ WDFREQUEST  Request, _In_ siz
     NTSTATUS			status;
     HFPDEVICE_CONTEXT*	devCtx;
     WDFMEMORY			memory;
-    struct _BRB_SCO_TRANSFER* brb = NULL;    
     HFP_CONNECTION*		connection;
     
     UNREFERENCED_PARAMETER(Length);
@@ -114,36 +180,243 @@ void HfpEvtQueueIoRead (_In_ WDFQUEUE  Queue, _In_ WDFREQUEST  Request, _In_ siz
 		goto exit;
 	}
 
+    // With the continuous reader running the Read is served from its ring
+    if (HfpContReaderRead (connection, Request))
+		return;
+
     status = WdfRequestRetrieveOutputMemory (Request, &memory);
     if (!NT_SUCCESS(status)) {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "WdfRequestRetrieveInputMemory failed, request 0x%p, Status %X", Request, status);
         goto exit;        
     }
 
-    // Get the BRB from request context and initialize it as BRB_SCO_TRANSFER BRB
-    brb = (struct _BRB_SCO_TRANSFER*) GetRequestContext(Request);
-    devCtx->ProfileDrvInterface.BthReuseBrb ((PBRB)brb,  BRB_SCO_TRANSFER);
+    // Format the Read request for SCO IN transfer and send it, it's completed by the completion routine
+    HfpScoTransferSend (devCtx, connection, Request, memory, SCO_TRANSFER_DIRECTION_IN);
+    return;
+
+	exit:
+    WdfRequestComplete(Request, status);
+}
+
+
+
+/*
+  IOCTL_HFP_SCO_BATCH context. The frames are sent with the pooled transfer contexts' requests,
+  so nothing is allocated per frame. The transfer contexts are returned to the pool when the
+  batch completes: till then the cancel routine may cancel their requests.
+*/
+typedef struct
+{
+    SCO_BATCH		Batch;
+    HFP_SCO_XFER*	Xfer[HFP_SCO_BATCH_MAX_FRAMES];	// Frame transfer context or NULL
+    volatile LONG	Sent[HFP_SCO_BATCH_MAX_FRAMES];	// The frame request is sent down
+} HFP_SCO_BATCH;
+
+
+
+static void HfpScoBatchFinish (HFP_SCO_BATCH* hb)
+{
+    NTSTATUS	status;
+    size_t		info;
+    ULONG		i;
+
+    for (i = 0; i < hb->Batch.FrameCount; i++) {
+		if (hb->Xfer[i])
+			HfpConnectionObjectPutXfer (hb->Xfer[i]);
+	}
+
+    info = ScoBatchComplete (&hb->Batch, &status);
+    WdfRequestCompleteWithInformation ((WDFREQUEST) hb->Batch.Owner, status, info);
+    ExFreePoolWithTag (hb, POOLTAG_HFPDRIVER);
+}
+
+
+
+/*
+ All the frames are done: completes the batch, unless the cancel routine is running or is to be
+ called, then the last of the two completes it
+*/
+static void HfpScoBatchFramesDone (HFP_SCO_BATCH* hb)
+{
+    if (WdfRequestUnmarkCancelable ((WDFREQUEST) hb->Batch.Owner) == STATUS_CANCELLED  &&  ScoBatchCompleterDone (&hb->Batch) != 0)
+		return;
+
+    HfpScoBatchFinish (hb);
+}
+
+
+
+void HfpScoBatchCancel (_In_ WDFREQUEST Request)
+{
+    HFP_SCO_BATCH*	hb = (HFP_SCO_BATCH*) ((struct _BRB_HEADER*) GetRequestContext(Request))->ClientContext[0];
+    ULONG			i;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_UTIL, "Batch 0x%p cancelled", Request);
 
-    // Format the Read request for SCO IN transfer. This routine allocates a BRB which is returned to us in brb parameter.
-    // This BRB is freed by the completion routine is we send the request successfully, else it is freed by this routine.
-    status = HfpConnectionObjectFormatRequestForScoTransfer (connection, Request, &brb, memory, SCO_TRANSFER_DIRECTION_IN);
+    // The frame requests are not reused till our completer reference is released
+    InterlockedExchange (&hb->Batch.Cancelled, 1);
+    for (i = 0; i < hb->Batch.FrameCount; i++) {
+		if (hb->Sent[i])
+			WdfRequestCancelSentRequest (hb->Xfer[i]->Request);
+	}
 
+    if (ScoBatchCompleterDone (&hb->Batch) == 0)
+		HfpScoBatchFinish (hb);
+}
+
+
+
+void HfpScoBatchFrameCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Target, _In_ PWDF_REQUEST_COMPLETION_PARAMS Params, _In_ WDFCONTEXT Context)
+{
+    HFP_SCO_XFER*	xfer = (HFP_SCO_XFER*) Context;
+    HFP_SCO_BATCH*	hb	 = (HFP_SCO_BATCH*) xfer->Brb.Hdr.ClientContext[0];
+    ULONG			idx	 = (ULONG)(ULONG_PTR) xfer->Brb.Hdr.ClientContext[1];
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    if (Params->IoStatus.Status)
+		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Batch frame %d completion, Status %X", idx, Params->IoStatus.Status);
+
+    HfpConnectionObjectTransferDone (&xfer->Brb, Params->IoStatus.Status);
+
+    if (ScoBatchFrameDone (&hb->Batch, idx, Params->IoStatus.Status, xfer->Brb.BufferSize) == 0)
+		HfpScoBatchFramesDone (hb);
+}
+
+
+
+/*
+ Sends the batch frame with a pooled transfer context and its own submission reference, which
+ the frame completion releases.
+ Returns an error if the frame is not sent (its completion routine is not called).
+*/
+static NTSTATUS HfpScoBatchSendFrame (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_CONNECTION* connection, _In_ HFP_SCO_BATCH* hb, _In_ ULONG idx, _In_ ULONG direction)
+{
+    NTSTATUS					status;
+    HFP_SCO_XFER*				xfer;
+    WDF_REQUEST_REUSE_PARAMS	params;
+
+    xfer = HfpConnectionObjectGetXfer (connection);
+    if (!xfer)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+    // Kept till the batch completes, even if the frame is not sent
+    hb->Xfer[idx] = xfer;
+
+    if (!HfpConnectionObjectAcquireTransfer (connection))
+		return STATUS_CONNECTION_DISCONNECTED;
+
+    WDF_REQUEST_REUSE_PARAMS_INIT (&params, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+    status = WdfRequestReuse (xfer->Request, &params);
     if (!NT_SUCCESS(status))
-        goto exit;
+		goto exit;
 
-    // Set a CompletionRoutine callback function.
-    WdfRequestSetCompletionRoutine (Request, HfpReadWriteCompletion, brb);
+    status = WdfMemoryAssignBuffer (xfer->DataMemory, (UCHAR*)hb->Batch.Buffer + hb->Batch.Offset[idx], hb->Batch.Size[idx]);
+    if (!NT_SUCCESS(status))
+		goto exit;
 
-    // Send the request down the stack
-    if (!WdfRequestSend (Request, devCtx->IoTarget, NULL))  {
-        status = WdfRequestGetStatus(Request);
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_UTIL, "Request send failed for request 0x%p, Brb 0x%p, Status %X", Request, brb, status);
+    status = HfpConnectionObjectFormatRequestForPooledScoTransfer (connection, xfer->Request, xfer, xfer->DataMemory, direction);
+    if (!NT_SUCCESS(status))
+		goto exit;
+
+    // BthReuseBrb in the formatting clears the header, so the context is set after it
+    xfer->Brb.Hdr.ClientContext[0] = hb;
+    xfer->Brb.Hdr.ClientContext[1] = (PVOID)(ULONG_PTR) idx;
+
+    WdfRequestSetCompletionRoutine (xfer->Request, HfpScoBatchFrameCompletion, xfer);
+
+    if (!WdfRequestSend (xfer->Request, devCtx->IoTarget, NULL)) {
+		status = WdfRequestGetStatus(xfer->Request);
+		goto exit;
+	}
+
+    InterlockedExchange (&hb->Sent[idx], 1);
+    return STATUS_SUCCESS;
+
+	exit:
+    HfpConnectionObjectReleaseTransfer (connection);
+    return status;
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS HfpScoBatchSubmit (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFREQUEST Request, _In_ size_t OutBufferLen, _In_ size_t InBufferLen)
+{
+    NTSTATUS				status;
+    HFP_CONNECTION*			connection;
+    HFP_SCO_BATCH*			hb = NULL;
+    PVOID					buffer;
+    size_t					size;
+    ULONG					i;
+    ULONG					direction;
+
+    connection = GetFileContext(WdfRequestGetFileObject(Request))->Connection;
+	if (!connection) {
+		status = STATUS_INVALID_DEVICE_REQUEST;
+		goto exit;
+	}
+
+	// For buffered IOCTLs input & output buffers are the same system buffer
+    status = WdfRequestRetrieveInputBuffer (Request, sizeof(HFP_SCO_BATCH_IN), &buffer, &size);
+    if (!NT_SUCCESS(status))
+        goto exit;
+
+    hb = (HFP_SCO_BATCH*) ExAllocatePoolWithTag (NonPagedPool, sizeof(HFP_SCO_BATCH), POOLTAG_HFPDRIVER);
+    if (!hb) {
+        status = STATUS_INSUFFICIENT_RESOURCES;
         goto exit;
     }
+    RtlZeroMemory (hb, sizeof(HFP_SCO_BATCH));
 
-	exit:
+    switch (ScoBatchSplit (&hb->Batch, buffer, InBufferLen, OutBufferLen))
+	{
+		case SCO_BATCH_OK:
+			break;
+		case SCO_BATCH_E_BUFFER_SMALL:
+			status = STATUS_BUFFER_TOO_SMALL;
+			goto exit;
+		default:
+			status = STATUS_INVALID_PARAMETER;
+			goto exit;
+	}
+
+    // Lock free connected check, each frame takes its own submission reference
+    if (ConnStateGet (&connection->State) != ConnectionStateConnected) {
+		status = STATUS_CONNECTION_DISCONNECTED;
+		goto exit;
+	}
+
+    // The cancel routine finds the batch in the request context
+    hb->Batch.Owner = Request;
+    ((struct _BRB_HEADER*) GetRequestContext(Request))->ClientContext[0] = hb;
+
+    status = WdfRequestMarkCancelableEx (Request, HfpScoBatchCancel);
     if (!NT_SUCCESS(status))
-        WdfRequestComplete(Request, status);
+		goto exit;
+
+    direction = (hb->Batch.Direction == HFP_SCO_BATCH_READ) ? SCO_TRANSFER_DIRECTION_IN : SCO_TRANSFER_DIRECTION_OUT;
+
+    for (i = 0; i < hb->Batch.FrameCount; i++) {
+		// After the cancel the rest of frames is not sent
+		status = hb->Batch.Cancelled ? STATUS_CANCELLED : HfpScoBatchSendFrame (devCtx, connection, hb, i, direction);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, DBG_UTIL, "Batch frame %d submit failed, Status %X", i, status);
+			ScoBatchFrameDone (&hb->Batch, i, status, 0);
+		}
+	}
+
+	// Release the submitter reference: the last completed frame (or we) completes the IOCTL
+    if (ScoBatchFrameDone (&hb->Batch, SCO_BATCH_NO_FRAME, 0, 0) == 0)
+		HfpScoBatchFramesDone (hb);
+
+    return STATUS_SUCCESS;
+
+	exit:
+    if (hb)
+		ExFreePoolWithTag (hb, POOLTAG_HFPDRIVER);
+    return status;
 }
 
 
@@ -187,21 +460,18 @@ void HfpEvtQueueIoDeviceControl (WDFQUEUE Queue, WDFREQUEST Request, size_t OutB
 				status = STATUS_INVALID_PARAMETER;
 				break;
 			}
-			// HfpSrvRegisterScoServer uses another Request (our devCtx->Request), but this is also ok
-			status = HfpSrvRegisterScoServer (devCtx, (HFP_REG_SERVER*)inbuf);
+			// HfpSrvRegisterScoServer uses another Request (the server's one), but this is also ok
+			status = HfpSrvRegisterScoServer (devCtx, WdfRequestGetFileObject(Request), (HFP_REG_SERVER*)inbuf);
             break;
 
         case IOCTL_HFP_UNREG_SERVER:
 			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: UNREG_SERVER");
-			if (!devCtx->ScoServerHandle) {
-				status = STATUS_INVALID_DEVICE_REQUEST;
-				break;
-			}
-			status = HfpSrvUnregisterScoServer (devCtx, 0);
+			status = HfpSrvUnregisterScoServer (devCtx, WdfRequestGetFileObject(Request));
             break;
 
         case IOCTL_HFP_OPEN_SCO:
 			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: OPEN_SCO");
+			HfpConnectionObjectDeleteClosed (WdfRequestGetFileObject(Request));
 			status = HfpOpenRemoteConnection(devCtx, WdfRequestGetFileObject(Request), Request);
 			// if it succeeds RemoteConnectCompletion will complete the request; so return here
 			if (NT_SUCCESS(status))
@@ -210,12 +480,88 @@ void HfpEvtQueueIoDeviceControl (WDFQUEUE Queue, WDFREQUEST Request, size_t OutB
 
         case IOCTL_HFP_CLOSE_SCO:
 			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: CLOSE_SCO");
+			HfpConnectionObjectDeleteClosed (WdfRequestGetFileObject(Request));
 			connection = GetFileContext(WdfRequestGetFileObject(Request))->Connection;
-			if (connection)
-				HfpConnectionObjectRemoteDisconnectSynchronously (devCtx, connection);
+			HfpShmRingStop (WdfRequestGetFileObject(Request));
+			if (GetFileContext(WdfRequestGetFileObject(Request))->ContReader)
+				HfpContReaderStop (GetFileContext(WdfRequestGetFileObject(Request))->ContReader, NULL);
+			// if the disconnect is started the request is completed when it completes; so return here
+			if (connection  &&  HfpConnectionObjectDisconnectAsync (devCtx, connection, Request))
+				return;
+            status = STATUS_SUCCESS;
+            break;
+
+        case IOCTL_HFP_SCO_BATCH:
+			status = HfpScoBatchSubmit (devCtx, Request, OutBufferLen, InBufferLen);
+			// if it succeeds the last frame completion will complete the request; so return here
+			if (NT_SUCCESS(status))
+				return;
+            break;
+
+        // IOCTL_HFP_SCO_RING_MAP is handled in the caller context (HfpEvtIoInCallerContext)
+
+        case IOCTL_HFP_SCO_RING_UNMAP:
+			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: SCO_RING_UNMAP");
+			// Only stops the streaming: the mapping belongs to the process and lives till the file cleanup
+			HfpShmRingStop (WdfRequestGetFileObject(Request));
             status = STATUS_SUCCESS;
             break;
 
+        case IOCTL_HFP_CONT_READER_START:
+			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: CONT_READER_START");
+			connection = GetFileContext(WdfRequestGetFileObject(Request))->Connection;
+			// The shared memory ring streams the SCO IN itself
+			if (!connection || HfpShmRingStreaming(WdfRequestGetFileObject(Request)) || GetFileContext(WdfRequestGetFileObject(Request))->ContReader) {
+				status = STATUS_INVALID_DEVICE_STATE;
+				break;
+			}
+			status = WdfRequestRetrieveInputBuffer(Request, sizeof(HFP_CONT_READER_START), &inbuf, &size);
+			if (!NT_SUCCESS(status))
+				break;
+
+			status = HfpContReaderStart (devCtx, connection, (HFP_CONT_READER_START*)inbuf);
+            break;
+
+        case IOCTL_HFP_CONT_READER_STOP:
+			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: CONT_READER_STOP");
+			{
+			// The reader may outlive the file's Connection after a disconnect
+			HFP_CONNECTION*	 reader = GetFileContext(WdfRequestGetFileObject(Request))->ContReader;
+			FRAME_RING_STATS stats;
+
+			RtlZeroMemory (&stats, sizeof(stats));
+			if (reader)
+				HfpContReaderStop (reader, &stats);
+
+			if (OutBufferLen >= sizeof(FRAME_RING_STATS)) {
+				status = WdfRequestRetrieveOutputBuffer(Request, sizeof(FRAME_RING_STATS), &inbuf, &size);
+				if (!NT_SUCCESS(status))
+					break;
+				*(FRAME_RING_STATS*)inbuf = stats;
+				WdfRequestCompleteWithInformation (Request, STATUS_SUCCESS, sizeof(FRAME_RING_STATS));
+				return;
+			}
+			}
+            status = STATUS_SUCCESS;
+            break;
+
+        case IOCTL_HFP_SCO_STATS:
+			// Polled while the voice passes, so no trace here. After CLOSE_SCO the closed connection's statistics are returned.
+			connection = GetFileContext(WdfRequestGetFileObject(Request))->Connection;
+			if (!connection)
+				connection = GetFileContext(WdfRequestGetFileObject(Request))->Closed;
+			if (!connection) {
+				status = STATUS_INVALID_DEVICE_STATE;
+				break;
+			}
+			status = WdfRequestRetrieveOutputBuffer(Request, sizeof(SCO_STATS), &inbuf, &size);
+			if (!NT_SUCCESS(status))
+				break;
+
+			HfpConnectionObjectGetStats (connection, (SCO_STATS*)inbuf);
+			WdfRequestCompleteWithInformation (Request, STATUS_SUCCESS, sizeof(SCO_STATS));
+			return;
+
         case IOCTL_HFP_INCOMING_READINESS:
 			status = WdfRequestRetrieveInputBuffer(Request, 0, &inbuf, &size);
 			if (!NT_SUCCESS(status))
@@ -229,8 +575,7 @@ void HfpEvtQueueIoDeviceControl (WDFQUEUE Queue, WDFREQUEST Request, size_t OutB
 			}
 
 			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "HfpEvtQueueIoDeviceControl: INCOMING_READINESS = %d", *(BOOLEAN*)inbuf);
-			devCtx->ConnectReadiness = *(BOOLEAN*)inbuf;
-            status = STATUS_SUCCESS;
+			status = HfpSrvSetConnectReadiness (devCtx, WdfRequestGetFileObject(Request), *(BOOLEAN*)inbuf);
             break;
 
 		default:
@@ -71,3 +71,56 @@ Arguments:
     Context - We receive BRB as the context
 */
 EVT_WDF_REQUEST_COMPLETION_ROUTINE	HfpReadWriteCompletion;
+
+
+/*
+ Completion routine for Read/Write requests sent with a pooled transfer context:
+ the same as HfpReadWriteCompletion, and the context is returned to the connection pool.
+
+Arguments:
+    Request - Request completed
+    Target  - Target to which request was sent
+    Params  - Completion parameters for the request
+    Context - We receive HFP_SCO_XFER as the context
+*/
+EVT_WDF_REQUEST_COMPLETION_ROUTINE	HfpPooledReadWriteCompletion;
+
+
+/*
+ Handles IOCTL_HFP_SCO_BATCH: splits the batch into per-frame SCO transfers, each one is sent 
+ with a pooled transfer context (its preallocated request and BRB). The IOCTL request is cancelable
+ and is completed once, when all frames are completed.
+
+ Arguments:
+    devCtx		- Device context
+    Request		- IOCTL request
+    OutBufferLen, InBufferLen - IOCTL buffers length
+
+ Return Value:
+    NTSTATUS Status code: if it is success, the request is completed asynchronously.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS HfpScoBatchSubmit (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFREQUEST Request, _In_ size_t OutBufferLen, _In_ size_t InBufferLen);
+
+
+/*
+ Completion routine for one frame of a batch, the batch request is completed by the last frame.
+ The frame transfer context is returned to the pool with the batch completion.
+
+Arguments:
+    Request - Frame request
+    Target  - Target to which request was sent
+    Params  - Completion parameters for the request
+    Context - We receive HFP_SCO_XFER as the context
+*/
+EVT_WDF_REQUEST_COMPLETION_ROUTINE	HfpScoBatchFrameCompletion;
+
+
+/*
+ Cancel routine of the batch request: cancels the sent frames, the rest of them is not sent.
+ The request is completed when all frames are done.
+
+Arguments:
+    Request - IOCTL_HFP_SCO_BATCH request
+*/
+EVT_WDF_REQUEST_CANCEL	HfpScoBatchCancel;
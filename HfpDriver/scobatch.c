@@ -0,0 +1,119 @@
+/*++
+
+Module Name:
+    scobatch.c
+
+Abstract:
+    Portable request splitting and completion aggregation for batched SCO transfers.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#define ScoBatchAtomicDec(p)	InterlockedDecrement(p)
+#elif defined(_WIN32)
+#include <windows.h>
+#define ScoBatchAtomicDec(p)	InterlockedDecrement(p)
+#else
+#include <stddef.h>
+#define ScoBatchAtomicDec(p)	__sync_sub_and_fetch(p,1)
+#endif
+
+#include "scobatch.h"
+
+
+LONG ScoBatchSplit (SCO_BATCH* batch, void* buffer, size_t inlen, size_t outlen)
+{
+	HFP_SCO_BATCH_IN*	in = (HFP_SCO_BATCH_IN*) buffer;
+	size_t				offset, limit;
+	ULONG				i;
+
+	if (inlen < sizeof(HFP_SCO_BATCH_IN) || outlen < sizeof(HFP_SCO_BATCH_OUT))
+		return SCO_BATCH_E_BUFFER_SMALL;
+
+	if ((in->Direction != HFP_SCO_BATCH_READ && in->Direction != HFP_SCO_BATCH_WRITE) ||
+		in->FrameCount == 0 || in->FrameCount > HFP_SCO_BATCH_MAX_FRAMES)
+		return SCO_BATCH_E_INVALID;
+
+	// Read frames are placed after the output header, write frames after the input header
+	if (in->Direction == HFP_SCO_BATCH_READ) {
+		offset = sizeof(HFP_SCO_BATCH_OUT);
+		limit  = outlen;
+	}
+	else {
+		offset = sizeof(HFP_SCO_BATCH_IN);
+		limit  = inlen;
+	}
+
+	batch->Buffer	  = buffer;
+	batch->Direction  = in->Direction;
+	batch->FrameCount = in->FrameCount;
+
+	for (i = 0; i < batch->FrameCount; i++) {
+		ULONG size = in->FrameSize[i];
+		if (size == 0)
+			return SCO_BATCH_E_INVALID;
+		if (size > limit || offset > limit - size)
+			return SCO_BATCH_E_BUFFER_SMALL;
+
+		batch->Offset[i]	  = (ULONG) offset;
+		batch->Size[i]		  = size;
+		batch->Status[i]	  = 0;
+		batch->Transferred[i] = 0;
+		offset += size;
+	}
+
+	batch->Pending	  = (LONG) batch->FrameCount + 1;
+	batch->Completers = 2;
+	batch->Cancelled  = 0;
+	return SCO_BATCH_OK;
+}
+
+
+LONG ScoBatchFrameDone (SCO_BATCH* batch, ULONG idx, LONG status, ULONG transferred)
+{
+	if (idx != SCO_BATCH_NO_FRAME && idx < batch->FrameCount) {
+		batch->Status[idx]		= status;
+		batch->Transferred[idx] = (transferred <= batch->Size[idx]) ? transferred : batch->Size[idx];
+	}
+	return ScoBatchAtomicDec (&batch->Pending);
+}
+
+
+LONG ScoBatchCompleterDone (SCO_BATCH* batch)
+{
+	return ScoBatchAtomicDec (&batch->Completers);
+}
+
+
+size_t ScoBatchComplete (SCO_BATCH* batch, LONG* status)
+{
+	HFP_SCO_BATCH_OUT*	out = (HFP_SCO_BATCH_OUT*) batch->Buffer;
+	size_t				info;
+	ULONG				i, nok = 0;
+
+	// Note, for writes the output header overlaps the already sent write data: it's fine after completion
+	out->FrameCount = batch->FrameCount;
+	for (i = 0; i < HFP_SCO_BATCH_MAX_FRAMES; i++) {
+		if (i < batch->FrameCount) {
+			out->Status[i]		= batch->Status[i];
+			out->Transferred[i] = batch->Transferred[i];
+			if (batch->Status[i] >= 0)	// NT_SUCCESS
+				nok++;
+		}
+		else {
+			out->Status[i]		= 0;
+			out->Transferred[i] = 0;
+		}
+	}
+
+	*status = nok ? 0 : batch->Status[0];
+
+	info = sizeof(HFP_SCO_BATCH_OUT);
+	if (batch->Direction == HFP_SCO_BATCH_READ)
+		info = batch->Offset[batch->FrameCount-1] + batch->Size[batch->FrameCount-1];
+
+	return info;
+}
@@ -0,0 +1,156 @@
+/*++
+
+Module Name:
+    scobatch.h
+
+Abstract:
+    Batched SCO transfers (IOCTL_HFP_SCO_BATCH): the request layout shared with applications,
+    and the portable request splitting and completion aggregation logic.
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+    The driver part (sending per-frame BRBs) is in queue.c.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define HFP_SCO_BATCH_MAX_FRAMES	16
+
+#define HFP_SCO_BATCH_READ			0		// SCO IN transfers
+#define HFP_SCO_BATCH_WRITE			1		// SCO OUT transfers
+
+
+/*
+  IOCTL_HFP_SCO_BATCH input (METHOD_BUFFERED).
+  For writes the frames data follows the structure, back to back.
+*/
+typedef struct
+{
+	ULONG	Direction;								// HFP_SCO_BATCH_READ/WRITE
+	ULONG	FrameCount;								// 1..HFP_SCO_BATCH_MAX_FRAMES
+	ULONG	FrameSize[HFP_SCO_BATCH_MAX_FRAMES];	// Bytes per frame
+} HFP_SCO_BATCH_IN;
+
+
+/*
+  IOCTL_HFP_SCO_BATCH output.
+  For reads the frames data follows the structure, frame i starts at the sum of FrameSize[0..i-1]
+  (i.e. in the frame slot, Transferred[i] bytes of it are valid).
+*/
+typedef struct
+{
+	ULONG	FrameCount;
+	LONG	Status[HFP_SCO_BATCH_MAX_FRAMES];		// NTSTATUS per frame
+	ULONG	Transferred[HFP_SCO_BATCH_MAX_FRAMES];	// Bytes transferred per frame
+} HFP_SCO_BATCH_OUT;
+
+
+
+/*
+  Batch tracking context
+*/
+typedef struct
+{
+	void*			Buffer;		// System buffer of the request (input & output)
+	void*			Owner;		// Opaque owner data, e.g. the user request
+	ULONG			Direction;
+	ULONG			FrameCount;
+	ULONG			Offset[HFP_SCO_BATCH_MAX_FRAMES];		// Frame data offset in Buffer
+	ULONG			Size[HFP_SCO_BATCH_MAX_FRAMES];
+	LONG			Status[HFP_SCO_BATCH_MAX_FRAMES];
+	ULONG			Transferred[HFP_SCO_BATCH_MAX_FRAMES];
+	volatile LONG	Pending;	// Frames not completed yet, plus 1 for the submitter
+	volatile LONG	Completers;	// Cancelable batch: the frames done path and the cancel routine, the last of them completes
+	volatile LONG	Cancelled;	// Set by the cancel routine: the not yet sent frames are not sent
+} SCO_BATCH;
+
+
+#define SCO_BATCH_NO_FRAME		((ULONG)-1)
+
+// ScoBatchSplit errors
+#define SCO_BATCH_OK				0
+#define SCO_BATCH_E_INVALID			(-1)	// Bad header: direction, frame count or frame size
+#define SCO_BATCH_E_BUFFER_SMALL	(-2)	// Input or output buffer is too small for the frames
+
+
+
+/*
+ Validates the batch request and computes frames placement in the buffer.
+ After success, Pending is FrameCount+1: the submitter holds one reference to prevent the
+ completion before all frames are sent; it releases it by ScoBatchFrameDone(SCO_BATCH_NO_FRAME).
+
+ Arguments:
+    batch	- Batch context to be initialized
+    buffer	- Request system buffer, containing HFP_SCO_BATCH_IN on input
+    inlen	- Input buffer length
+    outlen	- Output buffer length
+
+ Return Value:
+    SCO_BATCH_OK or SCO_BATCH_E_xxx
+*/
+LONG ScoBatchSplit (SCO_BATCH* batch, void* buffer, size_t inlen, size_t outlen);
+
+
+/*
+ Records a frame completion (may be called concurrently for different frames).
+
+ Arguments:
+    batch		- Batch context
+    idx			- Frame index or SCO_BATCH_NO_FRAME to release the submitter reference
+    status		- Frame NTSTATUS
+    transferred - Bytes transferred
+
+ Return Value:
+    Number of still pending references: the caller which gets 0 must complete the batch
+*/
+LONG ScoBatchFrameDone (SCO_BATCH* batch, ULONG idx, LONG status, ULONG transferred);
+
+
+/*
+ Releases a completer reference of the cancelable batch. While the request is cancelable two parties
+ may complete it: the path which gets all the frames done (ScoBatchFrameDone returned 0) and the
+ cancel routine. If the frames done path fails to make the request not cancelable (the cancel
+ routine is running or is to be called), both of them call this, and the last one completes
+ the batch. The cancel routine may access the frames till it calls this.
+
+ Return Value:
+    Number of still pending completers: the caller which gets 0 must complete the batch
+*/
+LONG ScoBatchCompleterDone (SCO_BATCH* batch);
+
+
+/*
+ Aggregates the frames results into HFP_SCO_BATCH_OUT at the start of the buffer.
+ The aggregated status is success if at least one frame succeeded, otherwise the status
+ of the first frame.
+
+ Arguments:
+    batch	- Completed batch context
+    status	- Receives the aggregated status
+
+ Return Value:
+    Number of output bytes (the request Information)
+*/
+size_t ScoBatchComplete (SCO_BATCH* batch, LONG* status);
+
+
+#ifdef __cplusplus
+}
+#endif
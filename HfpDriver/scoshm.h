@@ -0,0 +1,268 @@
+/*++
+
+Module Name:
+    scoshm.h
+
+Abstract:
+    Shared memory SCO audio ring (IOCTL_HFP_SCO_RING_MAP): the memory layout, index math and
+    overflow handling, shared by the driver and applications.
+
+    The ring memory is allocated by the driver and mapped to the application. It contains
+    two single producer/single consumer rings of fixed size slots:
+      Rx - filled by the driver from SCO IN completions, drained by the application (speaker)
+      Tx - filled by the application (microphone), drained by the driver with SCO OUT transfers
+    The driver keeps a few transfers posted on each direction and reposts them from the
+    completions, so no IRP per chunk is needed. It signals the Rx doorbell event when it
+    publishes Rx slots; the Tx direction needs no doorbell, the SCO link clocks it.
+
+    Overflow handling:
+      Rx full  - the driver receives into a private scratch slot, the frame is dropped and
+                 RxOverruns is incremented (indices stay single-writer)
+      Tx empty - the driver sends a silence slot and increments TxUnderruns, so the SCO link
+                 is continuously fed
+
+    This header doesn't depend on WDF/WDM, so the ring logic may be built and tested in user mode.
+    Each side must keep its own copy of the geometry (SCO_SHM_VIEW) and of its own ring index,
+    and never trust the values in the shared header after the mapping: the other side may
+    corrupt them.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+#if defined(_KERNEL_MODE)
+#define SCO_SHM_BARRIER()	KeMemoryBarrier()
+#elif defined(_WIN32)
+#define SCO_SHM_BARRIER()	MemoryBarrier()
+#else
+#define SCO_SHM_BARRIER()	__sync_synchronize()
+#endif
+
+#if defined(__cplusplus)
+#define SCO_SHM_INLINE	inline
+#elif defined(_MSC_VER)
+#define SCO_SHM_INLINE	static __inline
+#else
+#define SCO_SHM_INLINE	static inline
+#endif
+
+
+#define SCO_SHM_MAGIC			0x52435348		// "HSCR"
+#define SCO_SHM_VERSION			1
+#define SCO_SHM_LINE			64				// Cache line, the producer and consumer indices are on separate lines
+
+#define SCO_SHM_MAX_SLOTS		256				// Per direction, must be a power of 2
+#define SCO_SHM_MAX_SLOT_SIZE	4096			// Data bytes per slot
+
+
+/*
+  Ring indices: free-running, the slot is (index & (SlotCount-1))
+*/
+typedef struct
+{
+	volatile ULONG	Head;							// Written by the producer only
+	UCHAR			Pad1 [SCO_SHM_LINE - sizeof(ULONG)];
+	volatile ULONG	Tail;							// Written by the consumer only
+	UCHAR			Pad2 [SCO_SHM_LINE - sizeof(ULONG)];
+} SCO_SHM_INDEX;
+
+
+/*
+  Slot header, SlotSize data bytes follow it
+*/
+typedef struct
+{
+	ULONG	Length;			// Valid data bytes
+	ULONG	Reserved;
+} SCO_SHM_SLOT;
+
+
+/*
+  Shared memory header, it is at the start of the mapped memory
+*/
+typedef struct
+{
+	ULONG			Magic;
+	ULONG			Version;
+	ULONG			SlotCount;		// Slots per direction
+	ULONG			SlotSize;		// Data bytes per slot
+	ULONG			SlotStride;		// Bytes between slots
+	ULONG			RxOffset;		// Rx slots offset from the header start
+	ULONG			TxOffset;		// Tx slots offset from the header start
+	ULONG			Size;			// Total bytes
+	UCHAR			Pad [SCO_SHM_LINE - 8*sizeof(ULONG)];
+
+	SCO_SHM_INDEX	Rx;				// Driver -> application
+	SCO_SHM_INDEX	Tx;				// Application -> driver
+
+	// Statistics, written by the driver only
+	volatile ULONG	RxFrames;
+	volatile ULONG	RxOverruns;
+	volatile ULONG	TxFrames;
+	volatile ULONG	TxUnderruns;
+} SCO_SHM_HEADER;
+
+
+/*
+  Private (trusted) view of the shared memory, one for each side
+*/
+typedef struct
+{
+	SCO_SHM_HEADER*	Header;
+	ULONG			SlotCount;
+	ULONG			SlotSize;
+	ULONG			SlotStride;
+	ULONG			RxOffset;
+	ULONG			TxOffset;
+	ULONG			Size;
+} SCO_SHM_VIEW;
+
+
+
+/*
+ Computes the memory layout for the geometry.
+ Returns the total size in bytes, or 0 if the geometry is invalid.
+*/
+SCO_SHM_INLINE ULONG ScoShmLayout (SCO_SHM_VIEW* view, ULONG slotcount, ULONG slotsize)
+{
+	if (slotcount < 2 || slotcount > SCO_SHM_MAX_SLOTS || (slotcount & (slotcount-1)) ||
+		slotsize == 0 || slotsize > SCO_SHM_MAX_SLOT_SIZE)
+		return 0;
+
+	view->SlotCount  = slotcount;
+	view->SlotSize	 = slotsize;
+	view->SlotStride = (sizeof(SCO_SHM_SLOT) + slotsize + SCO_SHM_LINE-1) & ~(SCO_SHM_LINE-1);
+	view->RxOffset	 = (sizeof(SCO_SHM_HEADER) + SCO_SHM_LINE-1) & ~(SCO_SHM_LINE-1);
+	view->TxOffset	 = view->RxOffset + slotcount * view->SlotStride;
+	view->Size		 = view->TxOffset + slotcount * view->SlotStride;
+	return view->Size;
+}
+
+
+/*
+ Producer side (driver): initializes the zeroed memory of view->Size bytes for the layout
+ computed by ScoShmLayout
+*/
+SCO_SHM_INLINE void ScoShmInit (SCO_SHM_VIEW* view, void* mem)
+{
+	SCO_SHM_HEADER* hdr = (SCO_SHM_HEADER*) mem;
+
+	view->Header	= hdr;
+	hdr->SlotCount	= view->SlotCount;
+	hdr->SlotSize	= view->SlotSize;
+	hdr->SlotStride	= view->SlotStride;
+	hdr->RxOffset	= view->RxOffset;
+	hdr->TxOffset	= view->TxOffset;
+	hdr->Size		= view->Size;
+	hdr->Version	= SCO_SHM_VERSION;
+	SCO_SHM_BARRIER();
+	hdr->Magic		= SCO_SHM_MAGIC;
+}
+
+
+/*
+ Application side: validates the mapped memory of the size bytes and fills the view.
+ Returns 0 if the header is not consistent.
+*/
+SCO_SHM_INLINE int ScoShmAttach (SCO_SHM_VIEW* view, void* mem, ULONG size)
+{
+	SCO_SHM_HEADER* hdr = (SCO_SHM_HEADER*) mem;
+
+	if (size < sizeof(SCO_SHM_HEADER) || hdr->Magic != SCO_SHM_MAGIC || hdr->Version != SCO_SHM_VERSION)
+		return 0;
+	if (!ScoShmLayout (view, hdr->SlotCount, hdr->SlotSize) || view->Size > size ||
+		view->SlotStride != hdr->SlotStride || view->RxOffset != hdr->RxOffset || view->TxOffset != hdr->TxOffset)
+		return 0;
+
+	view->Header = hdr;
+	return 1;
+}
+
+
+SCO_SHM_INLINE SCO_SHM_SLOT* ScoShmSlot (SCO_SHM_VIEW* view, ULONG offset, ULONG index)
+{
+	return (SCO_SHM_SLOT*) ((UCHAR*)view->Header + offset + (index & (view->SlotCount-1)) * view->SlotStride);
+}
+
+SCO_SHM_INLINE UCHAR* ScoShmSlotData (SCO_SHM_SLOT* slot)
+{
+	return (UCHAR*)(slot + 1);
+}
+
+
+/*
+ Each side keeps its own index (the producer - Head, the consumer - Tail) in private memory
+ and only publishes it to the shared header: the remote index is the only value it reads.
+ A corrupted distance (more than SlotCount) makes the ring look full for the producer and
+ empty for the consumer.
+*/
+
+
+/*
+ Producer: returns the slot at head+ahead if it is free, otherwise 0.
+ ahead > 0 lets the producer fill several slots (e.g. posted transfers) before publishing them.
+*/
+SCO_SHM_INLINE SCO_SHM_SLOT* ScoShmProduceSlot (SCO_SHM_VIEW* view, SCO_SHM_INDEX* ring, ULONG offset, ULONG head, ULONG ahead)
+{
+	ULONG tail = ring->Tail;
+	SCO_SHM_BARRIER();	// the slot is written after the Tail is observed (acquire)
+
+	if (head - tail > view->SlotCount || head + ahead - tail >= view->SlotCount)
+		return 0;
+	return ScoShmSlot (view, offset, head + ahead);
+}
+
+
+/*
+ Producer: publishes n filled slots
+*/
+SCO_SHM_INLINE void ScoShmProduce (SCO_SHM_INDEX* ring, ULONG* head, ULONG n)
+{
+	*head += n;
+	SCO_SHM_BARRIER();	// the slots data is visible before the Head (release)
+	ring->Head = *head;
+}
+
+
+/*
+ Consumer: returns the published slot at tail+ahead, or 0 if there is no such slot.
+ length receives the slot Length clamped to SlotSize: it's read once, the shared copy
+ may be changed by the other side at any time.
+*/
+SCO_SHM_INLINE SCO_SHM_SLOT* ScoShmConsumeSlot (SCO_SHM_VIEW* view, SCO_SHM_INDEX* ring, ULONG offset, ULONG tail, ULONG ahead, ULONG* length)
+{
+	ULONG head = ring->Head;
+	SCO_SHM_SLOT* slot;
+	SCO_SHM_BARRIER();	// the slot is read after the Head is observed (acquire)
+
+	if (head - tail > view->SlotCount || head - tail <= ahead)
+		return 0;
+
+	slot = ScoShmSlot (view, offset, tail + ahead);
+	*length = *(volatile ULONG*) &slot->Length;
+	if (*length > view->SlotSize)
+		*length = view->SlotSize;
+	return slot;
+}
+
+
+/*
+ Consumer: releases n consumed slots
+*/
+SCO_SHM_INLINE void ScoShmConsume (SCO_SHM_INDEX* ring, ULONG* tail, ULONG n)
+{
+	*tail += n;
+	SCO_SHM_BARRIER();	// the slots are read before they are given back (release)
+	ring->Tail = *tail;
+}
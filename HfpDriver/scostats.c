@@ -0,0 +1,113 @@
+/*++
+
+Module Name:
+    scostats.c
+
+Abstract:
+    SCO link statistics of a connection: the portable bookkeeping.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "scostats.h"
+
+
+#if defined(_WIN32)
+#define SCO_STATS_INC(p)			InterlockedIncrement ((volatile LONG*)(p))
+#define SCO_STATS_ADD64(p, v)		InterlockedAdd64 ((volatile LONG64*)(p), (LONG64)(v))
+#define SCO_STATS_READ64(p)			((unsigned long long) InterlockedCompareExchange64 ((volatile LONG64*)(p), 0, 0))
+#define SCO_STATS_XCHG(p, v)		InterlockedExchange ((volatile LONG*)(p), (v))
+#define SCO_STATS_CAS(p, exchange, comparand)	((ULONG) InterlockedCompareExchange ((volatile LONG*)(p), (LONG)(exchange), (LONG)(comparand)))
+#else
+#define SCO_STATS_INC(p)			__sync_add_and_fetch ((p), 1)
+#define SCO_STATS_ADD64(p, v)		__sync_add_and_fetch ((p), (unsigned long long)(v))
+#define SCO_STATS_READ64(p)			__sync_add_and_fetch ((p), 0)
+#define SCO_STATS_XCHG(p, v)		__sync_lock_test_and_set ((p), (v))
+#define SCO_STATS_CAS(p, exchange, comparand)	__sync_val_compare_and_swap ((p), (comparand), (exchange))
+#endif
+
+
+void ScoStatsInit (SCO_STATS* stats, ULONG packettypes)
+{
+	ULONG i;
+
+	stats->BytesIn	   = 0;
+	stats->BytesOut	   = 0;
+	stats->FramesIn	   = 0;
+	stats->FramesOut   = 0;
+	stats->ErrorsIn	   = 0;
+	stats->ErrorsOut   = 0;
+	stats->LastError   = 0;
+	stats->PacketTypes = packettypes;
+	stats->LatencyMax  = 0;
+	for (i = 0; i < SCO_STATS_LATENCY_BUCKETS; i++)
+		stats->Latency[i] = 0;
+}
+
+
+ULONG ScoStatsLatencyBucket (ULONG latency_us)
+{
+	ULONG ms = latency_us / 1000;
+	ULONG bucket = 0;
+
+	// Bucket i holds [2^(i-1), 2^i) ms, the first one < 1 ms and the last one the rest
+	while (ms  &&  bucket < SCO_STATS_LATENCY_BUCKETS-1) {
+		ms >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+
+void ScoStatsAccount (SCO_STATS* stats, int in, ULONG bytes, LONG status, ULONG latency_us)
+{
+	ULONG max;
+
+	if (status < 0) {
+		SCO_STATS_INC (in ? &stats->ErrorsIn : &stats->ErrorsOut);
+		SCO_STATS_XCHG (&stats->LastError, status);
+	}
+	else if (in) {
+		SCO_STATS_INC (&stats->FramesIn);
+		SCO_STATS_ADD64 (&stats->BytesIn, bytes);
+	}
+	else {
+		SCO_STATS_INC (&stats->FramesOut);
+		SCO_STATS_ADD64 (&stats->BytesOut, bytes);
+	}
+
+	SCO_STATS_INC (&stats->Latency[ScoStatsLatencyBucket(latency_us)]);
+
+	// Raised only, so a lost race is retried with the newer max
+	do {
+		max = stats->LatencyMax;
+		if (latency_us <= max)
+			break;
+	} while (SCO_STATS_CAS(&stats->LatencyMax, latency_us, max) != max);
+}
+
+
+void ScoStatsSnapshot (SCO_STATS* dst, SCO_STATS* src)
+{
+	ULONG i;
+
+	// 32 bit reads are atomic, the 64 bit ones are not on x86
+	dst->BytesIn	 = SCO_STATS_READ64 (&src->BytesIn);
+	dst->BytesOut	 = SCO_STATS_READ64 (&src->BytesOut);
+	dst->FramesIn	 = *(volatile ULONG*) &src->FramesIn;
+	dst->FramesOut	 = *(volatile ULONG*) &src->FramesOut;
+	dst->ErrorsIn	 = *(volatile ULONG*) &src->ErrorsIn;
+	dst->ErrorsOut	 = *(volatile ULONG*) &src->ErrorsOut;
+	dst->LastError	 = *(volatile LONG*)  &src->LastError;
+	dst->PacketTypes = src->PacketTypes;
+	dst->LatencyMax	 = *(volatile ULONG*) &src->LatencyMax;
+	for (i = 0; i < SCO_STATS_LATENCY_BUCKETS; i++)
+		dst->Latency[i] = *(volatile ULONG*) &src->Latency[i];
+}
@@ -0,0 +1,95 @@
+/*++
+
+Module Name:
+    scostats.h
+
+Abstract:
+    SCO link statistics of a connection: the portable bookkeeping.
+
+    Every completed SCO transfer is accounted by its direction: frames and bytes of the
+    successful ones, the failed ones with the last failure status, and the time from the
+    request formatting to its completion in a power of 2 milliseconds histogram.
+    Every counter is updated by an interlocked operation, so the transfer completions account
+    concurrently with no lock. IOCTL_HFP_SCO_STATS returns a snapshot of them: each counter is
+    read atomically, but the counters may be a few transfers apart.
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define SCO_STATS_LATENCY_BUCKETS	8		// <1, <2, <4, <8, <16, <32, <64, >=64 ms
+
+
+/*
+  SCO connection statistics, returned by IOCTL_HFP_SCO_STATS.
+  The layout is the same for 32 and 64 bit processes.
+*/
+typedef struct
+{
+	unsigned long long	BytesIn;		// Received bytes
+	unsigned long long	BytesOut;		// Sent bytes
+	ULONG	FramesIn;					// Successful SCO IN transfers
+	ULONG	FramesOut;					// Successful SCO OUT transfers
+	ULONG	ErrorsIn;					// Failed SCO IN transfers
+	ULONG	ErrorsOut;					// Failed SCO OUT transfers
+	LONG	LastError;					// Status of the last failed transfer or 0
+	ULONG	PacketTypes;				// (e)SCO packet types requested for the channel (SCO_PKT_xxx)
+	ULONG	LatencyMax;					// Max request to completion time, in microseconds
+	ULONG	Latency[SCO_STATS_LATENCY_BUCKETS];	// Request to completion time histogram, all transfers
+} SCO_STATS;
+
+
+
+/*
+ Zeroes the statistics and sets the channel packet types
+*/
+void ScoStatsInit (SCO_STATS* stats, ULONG packettypes);
+
+
+/*
+ Histogram bucket for the latency
+*/
+ULONG ScoStatsLatencyBucket (ULONG latency_us);
+
+
+/*
+ Accounts a completed transfer, may be called concurrently
+
+ Arguments:
+    stats	   - Statistics
+    in		   - Nonzero for SCO IN transfer
+    bytes	   - Transferred bytes
+    status	   - Completion status, NTSTATUS (negative on failure)
+    latency_us - Time from the request formatting to its completion
+*/
+void ScoStatsAccount (SCO_STATS* stats, int in, ULONG bytes, LONG status, ULONG latency_us);
+
+
+/*
+ Copies the statistics while they are accounted
+*/
+void ScoStatsSnapshot (SCO_STATS* dst, SCO_STATS* src);
+
+
+#ifdef __cplusplus
+}
+#endif
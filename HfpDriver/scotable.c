@@ -0,0 +1,153 @@
+/*++
+
+Module Name:
+    scotable.c
+
+Abstract:
+    Table of per-remote SCO servers and connections: the portable bookkeeping.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "scotable.h"
+
+
+void ScoTableInit (SCO_TABLE* table)
+{
+	ULONG i;
+
+	table->Count = 0;
+	for (i = 0; i < SCO_TABLE_MAX; i++) {
+		table->Entry[i].Addr	   = 0;
+		table->Entry[i].Owner	   = 0;
+		table->Entry[i].Connection = 0;
+	}
+}
+
+
+SCO_TABLE_RESULT ScoTableAdd (SCO_TABLE* table, SCO_TABLE_ADDR addr, void* owner, ULONG* idx, int* existing)
+{
+	ULONG i, freeidx = SCO_TABLE_NONE;
+
+	*idx	  = SCO_TABLE_NONE;
+	*existing = 0;
+
+	if (!addr || !owner)
+		return SCO_TABLE_E_INVALID;
+
+	for (i = 0; i < SCO_TABLE_MAX; i++)
+	{
+		SCO_TABLE_ENTRY* e = &table->Entry[i];
+
+		if (e->Addr == addr) {
+			if (e->Owner != owner)
+				return SCO_TABLE_E_BUSY;
+			*idx	  = i;
+			*existing = 1;
+			return SCO_TABLE_OK;
+		}
+		if (!e->Addr && freeidx == SCO_TABLE_NONE)
+			freeidx = i;
+	}
+
+	if (freeidx == SCO_TABLE_NONE)
+		return SCO_TABLE_E_FULL;
+
+	table->Entry[freeidx].Addr		 = addr;
+	table->Entry[freeidx].Owner		 = owner;
+	table->Entry[freeidx].Connection = 0;
+	table->Count++;
+
+	*idx = freeidx;
+	return SCO_TABLE_OK;
+}
+
+
+void ScoTableRemove (SCO_TABLE* table, ULONG idx)
+{
+	SCO_TABLE_ENTRY* e;
+
+	if (idx >= SCO_TABLE_MAX || !table->Entry[idx].Addr)
+		return;
+
+	e = &table->Entry[idx];
+	e->Addr		  = 0;
+	e->Owner	  = 0;
+	e->Connection = 0;
+	table->Count--;
+}
+
+
+ULONG ScoTableFind (SCO_TABLE* table, SCO_TABLE_ADDR addr)
+{
+	ULONG i;
+
+	if (addr) {
+		for (i = 0; i < SCO_TABLE_MAX; i++) {
+			if (table->Entry[i].Addr == addr)
+				return i;
+		}
+	}
+	return SCO_TABLE_NONE;
+}
+
+
+ULONG ScoTableFindOwner (SCO_TABLE* table, void* owner)
+{
+	ULONG i;
+
+	if (owner) {
+		for (i = 0; i < SCO_TABLE_MAX; i++) {
+			if (table->Entry[i].Addr && table->Entry[i].Owner == owner)
+				return i;
+		}
+	}
+	return SCO_TABLE_NONE;
+}
+
+
+ULONG ScoTableFindConnection (SCO_TABLE* table, void* connection)
+{
+	ULONG i;
+
+	if (connection) {
+		for (i = 0; i < SCO_TABLE_MAX; i++) {
+			if (table->Entry[i].Addr && table->Entry[i].Connection == connection)
+				return i;
+		}
+	}
+	return SCO_TABLE_NONE;
+}
+
+
+SCO_TABLE_RESULT ScoTableAttach (SCO_TABLE* table, ULONG idx, void* connection)
+{
+	SCO_TABLE_ENTRY* e;
+
+	if (idx >= SCO_TABLE_MAX || !table->Entry[idx].Addr || !connection)
+		return SCO_TABLE_E_INVALID;
+
+	e = &table->Entry[idx];
+	if (e->Connection && e->Connection != connection)
+		return SCO_TABLE_E_BUSY;
+
+	e->Connection = connection;
+	return SCO_TABLE_OK;
+}
+
+
+ULONG ScoTableDetach (SCO_TABLE* table, void* connection)
+{
+	ULONG idx = ScoTableFindConnection (table, connection);
+
+	if (idx != SCO_TABLE_NONE)
+		table->Entry[idx].Connection = 0;
+	return idx;
+}
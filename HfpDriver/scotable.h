@@ -0,0 +1,118 @@
+/*++
+
+Module Name:
+    scotable.h
+
+Abstract:
+    Table of per-remote SCO servers and connections: the portable bookkeeping.
+
+    Each entry is keyed by the remote Bluetooth address and ties together the file object
+    which registered the SCO server for this remote (its owner) and the SCO connection to this
+    remote (at most one per remote). The driver keeps its per-entry data (server handle, events)
+    in an array parallel to the entries. The entries of a closed file are removed with its
+    servers, a remote registered by a file can't be taken by another one.
+
+    The table is not thread safe: the caller serializes the calls (the driver uses its
+    ScoTableLock).
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define SCO_TABLE_MAX		8					// Remote devices served simultaneously
+#define SCO_TABLE_NONE		((ULONG)-1)
+
+typedef unsigned long long	SCO_TABLE_ADDR;		// BTH_ADDR
+
+
+typedef enum {
+	SCO_TABLE_OK = 0,
+	SCO_TABLE_E_INVALID,		// Null address or owner
+	SCO_TABLE_E_BUSY,			// The remote is registered by another owner, or already has a connection
+	SCO_TABLE_E_FULL			// No free entries
+} SCO_TABLE_RESULT;
+
+
+typedef struct
+{
+	SCO_TABLE_ADDR	Addr;			// Remote address, 0 if the entry is free
+	void*			Owner;			// Owner file object
+	void*			Connection;		// Connection to the remote or 0
+} SCO_TABLE_ENTRY;
+
+
+typedef struct
+{
+	ULONG			Count;			// Used entries
+	SCO_TABLE_ENTRY	Entry[SCO_TABLE_MAX];
+} SCO_TABLE;
+
+
+
+void ScoTableInit (SCO_TABLE* table);
+
+
+/*
+ Adds the entry for the remote address, or finds the existing one of the same owner
+
+ Arguments:
+    table	 - Table
+    addr	 - Remote address
+    owner	 - Owner file object
+    idx		 - Receives the entry index
+    existing - Receives nonzero if the entry existed
+
+ Return Value:
+    SCO_TABLE_OK, SCO_TABLE_E_BUSY if another owner has registered the remote, SCO_TABLE_E_FULL, SCO_TABLE_E_INVALID
+*/
+SCO_TABLE_RESULT ScoTableAdd (SCO_TABLE* table, SCO_TABLE_ADDR addr, void* owner, ULONG* idx, int* existing);
+
+
+/*
+ Frees the entry
+*/
+void ScoTableRemove (SCO_TABLE* table, ULONG idx);
+
+
+/*
+ Lookups, return the entry index or SCO_TABLE_NONE
+*/
+ULONG ScoTableFind			 (SCO_TABLE* table, SCO_TABLE_ADDR addr);
+ULONG ScoTableFindOwner		 (SCO_TABLE* table, void* owner);
+ULONG ScoTableFindConnection (SCO_TABLE* table, void* connection);
+
+
+/*
+ Ties the connection to the entry: SCO_TABLE_E_BUSY if the remote already has another connection
+*/
+SCO_TABLE_RESULT ScoTableAttach (SCO_TABLE* table, ULONG idx, void* connection);
+
+
+/*
+ Unties the connection from its entry, returns the entry index or SCO_TABLE_NONE
+*/
+ULONG ScoTableDetach (SCO_TABLE* table, void* connection);
+
+
+#ifdef __cplusplus
+}
+#endif
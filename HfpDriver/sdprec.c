@@ -0,0 +1,128 @@
+/*++
+
+Module Name:
+    sdprec.c
+
+Abstract:
+    Server SDP record as a precomputed byte stream: the portable encoder and the prebuilt record.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "sdprec.h"
+
+
+// SDP data element headers: type << 3 | size index
+#define SDP_EL_UINT16		0x09		// Unsigned integer, 2 bytes
+#define SDP_EL_UUID16		0x19		// UUID, 2 bytes
+#define SDP_EL_TEXT8		0x25		// Text string, 8-bit length follows
+#define SDP_EL_SEQ8			0x35		// Data element sequence, 8-bit length follows
+#define SDP_EL_SEQ16		0x36		// Data element sequence, 16-bit length follows
+
+#define SDP_ATTRIB_CLASS_IDS		0x0001
+#define SDP_ATTRIB_NAME				0x0100		// LANG_DEFAULT_ID + STRING_NAME_OFFSET
+#define SDP_ATTRIB_DESCRIPTION		0x0101		// LANG_DEFAULT_ID + STRING_DESCRIPTION_OFFSET
+
+
+// Generated by SdpRecBuild (SDP_REC_CLASS_ID, SDP_REC_NAME), see sdprec.h
+const UCHAR SdpRecHfp[] = {
+	0x35, 0x24, 0x09, 0x00, 0x01, 0x35, 0x03, 0x19, 0x11, 0x1E, 0x09, 0x01, 0x00, 0x25, 0x09, 0x48,
+	0x66, 0x70, 0x44, 0x72, 0x69, 0x76, 0x65, 0x72, 0x09, 0x01, 0x01, 0x25, 0x09, 0x48, 0x66, 0x70,
+	0x44, 0x72, 0x69, 0x76, 0x65, 0x72
+};
+const ULONG SdpRecHfpLength = sizeof(SdpRecHfp);
+
+
+
+static UCHAR* SdpRecPut16 (UCHAR* p, UCHAR header, unsigned short value)
+{
+	p[0] = header;
+	p[1] = (UCHAR)(value >> 8);		// SDP is big endian
+	p[2] = (UCHAR) value;
+	return p + 3;
+}
+
+
+static UCHAR* SdpRecPutText (UCHAR* p, unsigned short attrib, const char* text, ULONG len)
+{
+	ULONG i;
+
+	p	 = SdpRecPut16 (p, SDP_EL_UINT16, attrib);
+	p[0] = SDP_EL_TEXT8;
+	p[1] = (UCHAR) len;
+	for (i = 0; i < len; i++)
+		p[2+i] = (UCHAR) text[i];
+	return p + 2 + len;
+}
+
+
+ULONG SdpRecBuild (UCHAR* buf, ULONG size, unsigned short classid, const char* name)
+{
+	ULONG	namelen = 0, body, hdr;
+	UCHAR*	p = buf;
+
+	while (name[namelen]) {
+		if (++namelen > SDP_REC_MAX_NAME)
+			return 0;
+	}
+
+	// ClassIdList attribute, then the name and the description attributes
+	body = (3 + 2 + 3) + 2*(3 + 2 + namelen);
+	hdr	 = (body > 0xFF) ? 3 : 2;
+
+	if (!buf)
+		return hdr + body;
+	if (size < hdr + body)
+		return 0;
+
+	if (hdr == 2) {
+		*p++ = SDP_EL_SEQ8;
+		*p++ = (UCHAR) body;
+	}
+	else
+		p = SdpRecPut16 (p, SDP_EL_SEQ16, (unsigned short) body);
+
+	p	 = SdpRecPut16 (p, SDP_EL_UINT16, SDP_ATTRIB_CLASS_IDS);
+	*p++ = SDP_EL_SEQ8;
+	*p++ = 3;
+	p	 = SdpRecPut16 (p, SDP_EL_UUID16, classid);
+
+	p = SdpRecPutText (p, SDP_ATTRIB_NAME,		  name, namelen);
+	p = SdpRecPutText (p, SDP_ATTRIB_DESCRIPTION, name, namelen);
+
+	return (ULONG)(p - buf);
+}
+
+
+
+#if defined(SDP_REC_GENERATOR)
+
+#include <stdio.h>
+#include <string.h>
+
+int main ()
+{
+	UCHAR buf[2*SDP_REC_MAX_NAME + 32];
+	ULONG len = SdpRecBuild (buf, sizeof(buf), SDP_REC_CLASS_ID, SDP_REC_NAME);
+	ULONG i;
+
+	printf ("const UCHAR SdpRecHfp[] = {");
+	for (i = 0; i < len; i++)
+		printf ("%s0x%02X%s", (i % 16) ? " " : "\n\t", buf[i], (i + 1 < len) ? "," : "");
+	printf ("\n};\n");
+
+	if (len != SdpRecHfpLength  ||  memcmp (buf, SdpRecHfp, len)) {
+		fprintf (stderr, "SdpRecHfp is out of date\n");
+		return 1;
+	}
+	return 0;
+}
+
+#endif
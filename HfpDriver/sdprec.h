@@ -0,0 +1,65 @@
+/*++
+
+Module Name:
+    sdprec.h
+
+Abstract:
+    Server SDP record as a precomputed byte stream: the portable encoder and the prebuilt record.
+
+    The record has the same attributes as the driver built before from the bth stack node tree:
+        0x0001  ServiceClassIDList		{ UUID16 HFP_CLASS_ID }
+        0x0100  ServiceName				"HfpDriver"
+        0x0101  ServiceDescription		"HfpDriver"
+    Attributes are in ascending order, the element sizes are the shortest ones, the strings are
+    not NUL terminated.
+
+    SdpRecHfp is the output of SdpRecBuild for these values, so the driver publishes it as is,
+    with no tree, allocations or string conversions. To regenerate it after changing the record,
+    build this module as a tool and paste its output into sdprec.c:
+        cc -DSDP_REC_GENERATOR sdprec.c -o sdprecgen && ./sdprecgen
+    The generator also checks that SdpRecHfp matches the encoder.
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#define SDP_REC_CLASS_ID	0x111E			// HFP_CLASS_ID
+#define SDP_REC_NAME		"HfpDriver"		// BthHfpDriverName
+#define SDP_REC_MAX_NAME	255
+
+
+/*
+  Prebuilt record of SDP_REC_CLASS_ID and SDP_REC_NAME
+*/
+extern const UCHAR	SdpRecHfp[];
+extern const ULONG	SdpRecHfpLength;
+
+
+
+/*
+ Encodes the server record
+
+ Arguments:
+    buf		- Output buffer, may be 0 to get the length
+    size	- Buffer size
+    classid	- Service Class ID (UUID16)
+    name	- Service name and description, up to SDP_REC_MAX_NAME characters
+
+ Return Value:
+    Record length, or 0 if the name is too long or the buffer is too small
+*/
+ULONG SdpRecBuild (UCHAR* buf, ULONG size, unsigned short classid, const char* name);
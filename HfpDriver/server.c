@@ -16,9 +16,11 @@ Environment:
 #include "connection.h"
 #include "clisrv.h"
 #include "server.h"
-#include "sdp.h"
+#include "sdprec.h"
 
 
+C_ASSERT (SDP_REC_CLASS_ID == HFP_CLASS_ID);
+
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text (PAGE, HfpSrvPublishSdpRecord)
 #pragma alloc_text (PAGE, HfpSrvRemoveSdpRecord)
@@ -35,59 +37,6 @@ NTSTATUS HfpSrvPublishSdpRecord (_In_ WDFDEVICE Device)
 	HANDLE_SDP sdpRecordHandle;
 	HFPDEVICE_CONTEXT* devCtx = GetClientDeviceContext(Device);
 
-	// -----------------------------------------------------------------------------------------------
-	// Preparing sdpRecordStream, sdpRecordLength 
-
-	BTHDDI_SDP_NODE_INTERFACE  sdpNodeInterface;
-	BTHDDI_SDP_PARSE_INTERFACE sdpParseInterface;
-	UCHAR* sdpRecordStream = NULL;	// SDP record to publish
-	ULONG  sdpRecordLength = 0;		// SDP record length
-
-	status = WdfFdoQueryForInterface(
-		Device,
-		&GUID_BTHDDI_SDP_PARSE_INTERFACE, 
-		(PINTERFACE) (&sdpParseInterface),
-		sizeof(sdpParseInterface), 
-		BTHDDI_SDP_PARSE_INTERFACE_VERSION_FOR_QI, 
-		NULL
-		);
-				
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "QueryInterface failed for Interface SDP parse, Status %X", status);
-		goto exit;
-	}
-
-	status = WdfFdoQueryForInterface(
-		Device,
-		&GUID_BTHDDI_SDP_NODE_INTERFACE, 
-		(PINTERFACE) (&sdpNodeInterface),
-		sizeof(sdpNodeInterface), 
-		BTHDDI_SDP_NODE_INTERFACE_VERSION_FOR_QI, 
-		NULL
-		);
-				
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "QueryInterface failed for Interface SDP node, Status %X", status);
-		goto exit;
-	}
-
-	status = CreateSdpRecord(
-		&sdpNodeInterface,
-		&sdpParseInterface,
-		HFP_CLASS_ID,
-		BthHfpDriverName,
-		&sdpRecordStream,
-		&sdpRecordLength
-		);
-
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "CreateSdpRecord failed, Status %X", status);
-		goto exit;
-	}
-	
-	// -----------------------------------------------------------------------------------------------
-	// -----------------------------------------------------------------------------------------------
-
 	PAGED_CODE();
 
 	WDF_REQUEST_REUSE_PARAMS_INIT(&ReuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_NOT_SUPPORTED);
@@ -95,7 +44,8 @@ NTSTATUS HfpSrvPublishSdpRecord (_In_ WDFDEVICE Device)
 	NT_ASSERT(NT_SUCCESS(statusReuse));
 	UNREFERENCED_PARAMETER(statusReuse);
 
-	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER (&inMemDesc, sdpRecordStream, sdpRecordLength);
+	// The record is prebuilt (sdprec.h): the framework copies it into the system buffer of the buffered IOCTL, the only copy
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER (&inMemDesc, (PVOID) SdpRecHfp, SdpRecHfpLength);
 	RtlZeroMemory( &sdpRecordHandle, sizeof(HANDLE_SDP) );
 	
 	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER (&outMemDesc, &sdpRecordHandle, sizeof(HANDLE_SDP));
@@ -119,9 +69,6 @@ NTSTATUS HfpSrvPublishSdpRecord (_In_ WDFDEVICE Device)
 	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "IOCTL_BTH_SDP_SUBMIT_RECORD completed, handle = %X", sdpRecordHandle);
 
 	exit:
-	if (sdpRecordStream)
-		FreeSdpRecord(sdpRecordStream);
-	
 	return status;
 }
 
@@ -170,125 +117,277 @@ void HfpSrvRemoveSdpRecord (_In_ HFPDEVICE_CONTEXT* devCtx)
 }
 
 
-NTSTATUS HfpSrvRegisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_REG_SERVER* regparams)
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpSrvSignal (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ HFP_SCO_EVENT event)
 {
-	NTSTATUS status = STATUS_SUCCESS;
-	struct _BRB_SCO_REGISTER_SERVER* brb;
+	ULONG idx;
 
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFindOwner(&devCtx->ScoTable, fileObject);
+	if (idx != SCO_TABLE_NONE  &&  devCtx->Servers[idx].Kev[event])
+		KeSetEvent(devCtx->Servers[idx].Kev[event],0,FALSE);
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+}
 
-	// First to create Events and only then to register Server
 
-	if (devCtx->ScoServerHandle)
-		HfpSrvUnregisterScoServer (devCtx, regparams->DestAddr);
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpSrvConnectReadiness (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject)
+{
+	ULONG	idx;
+	BOOLEAN ready = FALSE;
 
-	// disable warning C4305: 'type cast' : truncation from 'UINT64' to 'HANDLE'
-	#pragma warning (disable:4305)
-	status = ObReferenceObjectByHandle((HANDLE)regparams->EvHandleScoConnect, EVENT_MODIFY_STATE, *ExEventObjectType, UserMode, (PVOID*)&devCtx->KevScoConnect, 0);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ObReferenceObjectByHandle failed, Status %X", status);
-		goto exit;
-	}
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFindOwner(&devCtx->ScoTable, fileObject);
+	if (idx != SCO_TABLE_NONE)
+		ready = devCtx->Servers[idx].ConnectReadiness;
+	WdfSpinLockRelease(devCtx->ScoTableLock);
 
-	status = ObReferenceObjectByHandle((HANDLE)regparams->EvHandleScoDisconnect, EVENT_MODIFY_STATE, *ExEventObjectType, UserMode, (PVOID*)&devCtx->KevScoDisconnect, 0);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ObReferenceObjectByHandle failed, Status %X", status);
-		goto exit;
-	}
+	return ready;
+}
 
-	status = ObReferenceObjectByHandle((HANDLE)regparams->EvHandleScoCritError, EVENT_MODIFY_STATE, *ExEventObjectType, UserMode, (PVOID*)&devCtx->KevScoCritError, 0);
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ObReferenceObjectByHandle failed, Status %X", status);
-		goto exit;
-	}
-	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "ObReferenceObjectByHandle returned KevScoCritError = %X", devCtx->KevScoCritError);
-	#pragma warning (default:4305)
 
-	devCtx->ConnectReadiness = regparams->ConnectReadiness;
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS HfpSrvSetConnectReadiness (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ BOOLEAN ready)
+{
+	ULONG idx;
 
-	if (devCtx->ScoServerHandle) {
-		// See the description at HfpSrvUnregisterScoServer prototype
-		goto exit_with_reg;
-	}
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFindOwner(&devCtx->ScoTable, fileObject);
+	if (idx != SCO_TABLE_NONE)
+		devCtx->Servers[idx].ConnectReadiness = ready;
+	WdfSpinLockRelease(devCtx->ScoTableLock);
 
-	// Registers SCO server
-	devCtx->ProfileDrvInterface.BthReuseBrb(&(devCtx->RegisterUnregisterBrb), BRB_SCO_REGISTER_SERVER);
+	return idx != SCO_TABLE_NONE ? STATUS_SUCCESS : STATUS_INVALID_DEVICE_REQUEST;
+}
 
-	brb = (struct _BRB_SCO_REGISTER_SERVER*) &(devCtx->RegisterUnregisterBrb);
 
-	// Format BRB
-	brb->BtAddress					= regparams->DestAddr;		// cannot be BTH_ADDR_NULL: SCO doesn't support it, opposite to L2CAP
-	brb->IndicationCallback			= &HfpSrvIndicationCallback;
-	brb->IndicationCallbackContext	= devCtx;
-	brb->IndicationFlags			= SCO_INDICATION_SCO_REQUEST;
-	brb->ReferenceObject			= WdfDeviceWdmGetDeviceObject(devCtx->Device);
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BTH_ADDR HfpSrvAttachConnection (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ HFP_CONNECTION* connection)
+{
+	ULONG	 idx;
+	BTH_ADDR addr = 0;
 
-	status = HfpSharedSendBrbSynchronously (devCtx->IoTarget, devCtx->Request, (PBRB)brb, sizeof(*brb));
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFindOwner(&devCtx->ScoTable, fileObject);
+	if (idx != SCO_TABLE_NONE  &&  ScoTableAttach(&devCtx->ScoTable, idx, connection) == SCO_TABLE_OK)
+		addr = devCtx->ScoTable.Entry[idx].Addr;
+	WdfSpinLockRelease(devCtx->ScoTableLock);
 
-	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "BRB_SCO_REGISTER_SERVER failed, Status %X", status);
-		goto exit;
-	}
+	return addr;
+}
 
-	// Store server handles
-	devCtx->RemoteBthAddress = regparams->DestAddr;
-	devCtx->ScoServerHandle  = brb->ServerHandle;
 
-	exit_with_reg:
-	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "BRB_SCO_REGISTER_SERVER completed, handle = %X, RemoteBthAddress = %llX", devCtx->ScoServerHandle, devCtx->RemoteBthAddress);
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpSrvDetachConnection (_In_ HFP_CONNECTION* connection)
+{
+	HFPDEVICE_CONTEXT* devCtx = connection->DevCtx;
 
-	exit:
-	return status;
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	ScoTableDetach(&devCtx->ScoTable, connection);
+	WdfSpinLockRelease(devCtx->ScoTableLock);
 }
 
 
-NTSTATUS HfpSrvUnregisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _Inout_ UINT64 destaddr)
+
+/*
+ Unregisters the server of the table entry idx, then removes the entry and dereferences its events.
+ The caller holds ScoServerLock, so the entry found by the caller is not removed or reused meanwhile.
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+static NTSTATUS HfpSrvUnregisterEntry (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ ULONG idx)
 {
 	NTSTATUS status;
 	struct _BRB_SCO_UNREGISTER_SERVER *brb;
+	HFP_SCO_SERVER* server = &devCtx->Servers[idx];
+	PKEVENT kev[HfpScoEventCount];
+	ULONG i;
 
 
 	// First to unregister Server and only then to delete Events 
 
-	if (destaddr  &&  (destaddr == devCtx->RemoteBthAddress)) {
-		// See the description at HfpSrvUnregisterScoServer prototype
-		status = STATUS_SUCCESS;
-		goto skip_unregistration;
+	if (server->ScoServerHandle) {
+		devCtx->ProfileDrvInterface.BthReuseBrb (&(server->RegisterUnregisterBrb), BRB_SCO_UNREGISTER_SERVER);
+
+		brb = (struct _BRB_SCO_UNREGISTER_SERVER*) &(server->RegisterUnregisterBrb);
+
+		brb->BtAddress	  = devCtx->ScoTable.Entry[idx].Addr;
+		brb->ServerHandle = server->ScoServerHandle;
+
+		status = HfpSharedSendBrbSynchronously (devCtx->IoTarget, server->Request, (PBRB)brb, sizeof(*brb));
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "BRB_SCO_UNREGISTER_SERVER failed, Status=%X", status);
+			// Send does not fail for resource reasons
+			NT_ASSERT(FALSE);
+			goto exit;
+		}
 	}
 
-	devCtx->ProfileDrvInterface.BthReuseBrb (&(devCtx->RegisterUnregisterBrb), BRB_SCO_UNREGISTER_SERVER);
+	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "BRB_SCO_UNREGISTER_SERVER completed, RemoteBthAddress = %llX", devCtx->ScoTable.Entry[idx].Addr);
 
-	brb = (struct _BRB_SCO_UNREGISTER_SERVER*) &(devCtx->RegisterUnregisterBrb);
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	for (i = 0; i < HfpScoEventCount; i++) {
+		kev[i] = server->Kev[i];
+		server->Kev[i] = 0;
+	}
+	server->ScoServerHandle  = 0;
+	server->ConnectReadiness = FALSE;
+	ScoTableRemove(&devCtx->ScoTable, idx);
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+
+	for (i = 0; i < HfpScoEventCount; i++) {
+		if (kev[i])
+			ObDereferenceObject (kev[i]);
+	}
+	status = STATUS_SUCCESS;
 
-	brb->BtAddress	  = devCtx->RemoteBthAddress;
-	brb->ServerHandle = devCtx->ScoServerHandle;
+	exit:
+	return status;
+}
+
+
+NTSTATUS HfpSrvRegisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ HFP_REG_SERVER* regparams)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	struct _BRB_SCO_REGISTER_SERVER* brb = NULL;
+	HFP_SCO_SERVER*  server;
+	SCO_TABLE_RESULT res;
+	PKEVENT	kev[HfpScoEventCount] = {0};
+	UINT64	evhandles[HfpScoEventCount];
+	ULONG	idx, i;
+	int		existing;
+	BTH_ADDR prevaddr = 0;
+
+
+	// A file serves one remote device: registering another device replaces the previous one,
+	// registering the same device just updates the events.
+	// The server lock keeps the found entry till it's unregistered, and the lookup and the add atomic
 
-	status = HfpSharedSendBrbSynchronously (devCtx->IoTarget, devCtx->Request, (PBRB)brb, sizeof(*brb));
+	WdfWaitLockAcquire(devCtx->ScoServerLock, NULL);
 
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFindOwner(&devCtx->ScoTable, fileObject);
+	if (idx != SCO_TABLE_NONE)
+		prevaddr = devCtx->ScoTable.Entry[idx].Addr;
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+
+	if (prevaddr  &&  prevaddr != regparams->DestAddr)
+		HfpSrvUnregisterEntry (devCtx, idx);
+
+	// First to reference Events and only then to register Server
+	evhandles[HfpScoEventConnect]	 = regparams->EvHandleScoConnect;
+	evhandles[HfpScoEventDisconnect] = regparams->EvHandleScoDisconnect;
+	evhandles[HfpScoEventCritError]	 = regparams->EvHandleScoCritError;
+
+	// disable warning C4305: 'type cast' : truncation from 'UINT64' to 'HANDLE'
+	#pragma warning (disable:4305)
+	for (i = 0; i < HfpScoEventCount; i++) {
+		status = ObReferenceObjectByHandle((HANDLE)evhandles[i], EVENT_MODIFY_STATE, *ExEventObjectType, UserMode, (PVOID*)&kev[i], 0);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ObReferenceObjectByHandle failed, Status %X", status);
+			goto exit;
+		}
+	}
+	#pragma warning (default:4305)
+
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	res = ScoTableAdd(&devCtx->ScoTable, regparams->DestAddr, fileObject, &idx, &existing);
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+
+	switch (res)
+	{
+		case SCO_TABLE_OK:		status = STATUS_SUCCESS;					break;
+		case SCO_TABLE_E_BUSY:	status = STATUS_DEVICE_BUSY;				break;
+		case SCO_TABLE_E_FULL:	status = STATUS_INSUFFICIENT_RESOURCES;		break;
+		default:				status = STATUS_INVALID_PARAMETER;
+	}
 	if (!NT_SUCCESS(status)) {
-		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "BRB_SCO_UNREGISTER_SERVER failed, Status=%X", status);
-		// Send does not fail for resource reasons
-		NT_ASSERT(FALSE);
+		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "SCO table: cannot add RemoteBthAddress = %llX, Status %X", regparams->DestAddr, status);
 		goto exit;
 	}
 
-	devCtx->ScoServerHandle  = 0;
-	devCtx->RemoteBthAddress = 0;
+	server = &devCtx->Servers[idx];
+
+	if (!existing) {
+		// Registers SCO server
+		devCtx->ProfileDrvInterface.BthReuseBrb(&(server->RegisterUnregisterBrb), BRB_SCO_REGISTER_SERVER);
+
+		brb = (struct _BRB_SCO_REGISTER_SERVER*) &(server->RegisterUnregisterBrb);
 
-	skip_unregistration:
-	ObDereferenceObject (devCtx->KevScoConnect);
-	ObDereferenceObject (devCtx->KevScoDisconnect);
-	ObDereferenceObject (devCtx->KevScoCritError);
+		// Format BRB
+		brb->BtAddress					= regparams->DestAddr;		// cannot be BTH_ADDR_NULL: SCO doesn't support it, opposite to L2CAP
+		brb->IndicationCallback			= &HfpSrvIndicationCallback;
+		brb->IndicationCallbackContext	= devCtx;					// the remote is found by the indication's address
+		brb->IndicationFlags			= SCO_INDICATION_SCO_REQUEST;
+		brb->ReferenceObject			= WdfDeviceWdmGetDeviceObject(devCtx->Device);
 
-	devCtx->KevScoConnect    = 0;
-	devCtx->KevScoDisconnect = 0;
-	devCtx->KevScoCritError  = 0;
+		status = HfpSharedSendBrbSynchronously (devCtx->IoTarget, server->Request, (PBRB)brb, sizeof(*brb));
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "BRB_SCO_REGISTER_SERVER failed, Status %X", status);
+			WdfSpinLockAcquire(devCtx->ScoTableLock);
+			ScoTableRemove(&devCtx->ScoTable, idx);
+			WdfSpinLockRelease(devCtx->ScoTableLock);
+			goto exit;
+		}
+	}
+
+	// Store server handle and the new events, the previous events are released
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	if (!existing)
+		server->ScoServerHandle = brb->ServerHandle;
+	server->ConnectReadiness = regparams->ConnectReadiness;
+	for (i = 0; i < HfpScoEventCount; i++) {
+		PKEVENT old = server->Kev[i];
+		server->Kev[i] = kev[i];
+		kev[i] = old;
+	}
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "BRB_SCO_REGISTER_SERVER completed, handle = %X, RemoteBthAddress = %llX", server->ScoServerHandle, regparams->DestAddr);
 
-	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "BRB_SCO_UNREGISTER_SERVER completed");
 	exit:
+	WdfWaitLockRelease(devCtx->ScoServerLock);
+	for (i = 0; i < HfpScoEventCount; i++) {
+		if (kev[i])
+			ObDereferenceObject (kev[i]);
+	}
 	return status;
 }
 
 
+NTSTATUS HfpSrvUnregisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject)
+{
+	NTSTATUS status = STATUS_INVALID_DEVICE_REQUEST;
+	ULONG	 idx;
+
+	WdfWaitLockAcquire(devCtx->ScoServerLock, NULL);
+
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFindOwner(&devCtx->ScoTable, fileObject);
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+
+	if (idx != SCO_TABLE_NONE)
+		status = HfpSrvUnregisterEntry (devCtx, idx);
+
+	WdfWaitLockRelease(devCtx->ScoServerLock);
+	return status;
+}
+
+
+void HfpSrvUnregisterAllScoServers (_In_ HFPDEVICE_CONTEXT* devCtx)
+{
+	ULONG idx;
+
+	WdfWaitLockAcquire(devCtx->ScoServerLock, NULL);
+	for (idx = 0; idx < SCO_TABLE_MAX; idx++) {
+		if (devCtx->ScoTable.Entry[idx].Addr)
+			HfpSrvUnregisterEntry (devCtx, idx);
+	}
+	WdfWaitLockRelease(devCtx->ScoServerLock);
+}
+
+
 
 void HfpSrvRemoteConnectCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Target, _In_ PWDF_REQUEST_COMPLETION_PARAMS Params, _In_ WDFCONTEXT Context)
 {
@@ -307,38 +406,21 @@ void HfpSrvRemoteConnectCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Ta
 		connection->ChannelHandle = brb->ChannelHandle;
 		connection->RemoteAddress = brb->BtAddress;
 
-		// Check if we already received a disconnect request and if so disconnect
-		WdfSpinLockAcquire(connection->ConnectionLock);
-
-		if (connection->ConnectionState == ConnectionStateDisconnecting) 
+		// Connecting -> Connected. If we already received a disconnect request, this means that 
+		// we were waiting for connect to complete before we can send disconnect down: 
+		// CLOSE_CHANNEL is sent now (or by the disconnect initiator when it's done)
+		if (!HfpConnectionObjectConnectDone (connection, TRUE))
 		{
 			TraceEvents(TRACE_LEVEL_WARNING, DBG_CONNECT, "HfpSrvRemoteConnectCompletion: disconnect while connecting");
-			// We allow transition to disconnected state only from connected state. If we are in disconnection state 
-			// this means that we were waiting for connect to complete before we can send disconnect down.
-			// Set the state to Connected and call HfpConnectionObjectRemoteDisconnect
-			connection->ConnectionState = ConnectionStateConnected;
-			WdfSpinLockRelease(connection->ConnectionLock);
-			HfpConnectionObjectRemoteDisconnect(connection->DevCtx, connection);
 		}
 		else {
-			connection->ConnectionState = ConnectionStateConnected;
-			WdfSpinLockRelease(connection->ConnectionLock);
-
-			// Set the file context to the connection passed in
-			// KS: Because of we are opening incoming connection, we do not have the associated File object set 
-			// for it (i think), so this thing, like in outgoing connection creation, can not be used: 
-			// GetFileContext(WdfRequestGetFileObject(Request))->Connection = connection;
-			// So, take our global file object from the Device context (TODO: this code must be locked)
 
-			// It was set in HfpSrvSendConnectResponse:
-			// NT_ASSERT (connection->FileObject);
-			// GetFileContext(connection->FileObject)->Connection = connection;
-
-			if (connection->DevCtx->ConnectReadiness)
+			// The file context was set in HfpSrvSendConnectResponse: the connection's file object
+			// is the owner of the remote device's SCO server
+			if (HfpSrvConnectReadiness (connection->DevCtx, connection->FileObject))
 			{
 				// Notify User mode app about new connection
-				if (connection->DevCtx->KevScoConnect)
-					KeSetEvent(connection->DevCtx->KevScoConnect,0,FALSE);
+				HfpSrvSignal (connection->DevCtx, connection->FileObject, HfpScoEventConnect);
 			}
 			else {
 				TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Not ready, rejecting SCO");
@@ -348,23 +430,15 @@ void HfpSrvRemoteConnectCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Ta
 	}
 	else
 	{
-		BOOLEAN discon = FALSE;
-
-		WdfSpinLockAcquire(connection->ConnectionLock);
-		if (connection->ConnectionState == ConnectionStateDisconnecting)
-			discon = TRUE;
+		HfpSrvSignal (connection->DevCtx, connection->FileObject, HfpScoEventCritError);
 
-		if (connection->DevCtx->KevScoCritError)
-			KeSetEvent(connection->DevCtx->KevScoCritError,0,FALSE);
-
-		connection->ConnectionState = ConnectionStateConnectFailed;
-		WdfSpinLockRelease(connection->ConnectionLock);
-
-		if (discon)
-			KeSetEvent (&connection->DisconnectEvent,0,FALSE);
+		// Connecting -> ConnectFailed. If a disconnect is waiting, its event is set now 
+		// (or by the disconnect initiator when it's done)
+		HfpConnectionObjectConnectDone (connection, FALSE);
 
 		NT_ASSERT (connection->FileObject);
 		GetFileContext(connection->FileObject)->Connection = 0;
+		HfpSrvDetachConnection (connection);
 
 		WdfObjectDelete(connectionObject);
 	}
@@ -383,31 +457,52 @@ NTSTATUS HfpSrvSendConnectResponse(_In_ HFPDEVICE_CONTEXT* devCtx, _In_ SCO_INDI
 	WDFOBJECT						connectionObject = 0;
 	HFP_CONNECTION*					connection = 0;
 	HFP_FILE_CONTEXT*				fileCtx;
+	WDFFILEOBJECT					fileObject = 0;
 	struct _BRB_SCO_OPEN_CHANNEL*	brb;
+	ULONG							idx;
 
 
-	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Incoming SCO connect request, LinkType = %X", ConnectParams->Parameters.Connect.Request.LinkType);
-	if (!devCtx->FileObject)	{
-		TraceEvents(TRACE_LEVEL_WARNING, DBG_CONNECT, "Application not ready");
+	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Incoming SCO connect request from %llX, LinkType = %X", ConnectParams->BtAddress, ConnectParams->Parameters.Connect.Request.LinkType);
+
+	// The remote's SCO server gives the file object the connection belongs to,
+	// it is referenced till the connection is its child
+	WdfSpinLockAcquire(devCtx->ScoTableLock);
+	idx = ScoTableFind(&devCtx->ScoTable, ConnectParams->BtAddress);
+	if (idx != SCO_TABLE_NONE  &&  !devCtx->ScoTable.Entry[idx].Connection) {
+		fileObject = (WDFFILEOBJECT) devCtx->ScoTable.Entry[idx].Owner;
+		if (fileObject)
+			WdfObjectReference(fileObject);
+	}
+	WdfSpinLockRelease(devCtx->ScoTableLock);
+
+	if (!fileObject)	{
+		TraceEvents(TRACE_LEVEL_WARNING, DBG_CONNECT, "Application not ready or the remote is already connected");
 		status = STATUS_SUCCESS;
 		goto exit_ret;
 	}
 
-	fileCtx = GetFileContext(devCtx->FileObject);
+	fileCtx = GetFileContext(fileObject);
 	if (fileCtx->Connection) {
-		TraceEvents(TRACE_LEVEL_WARNING, DBG_CONNECT, "Only one SCO connection supported, aborting");
+		TraceEvents(TRACE_LEVEL_WARNING, DBG_CONNECT, "Only one SCO connection per file supported, aborting");
 		status = STATUS_SUCCESS;
-		goto exit_ret;
+		goto exit_deref;
 	}
 
 	// We create the connection object as the first step so that if we receive 
 	// remove before connect response is completed we can wait for connection and disconnect.
-	status = HfpConnectionObjectCreate(devCtx, devCtx->FileObject, &connectionObject);
+	status = HfpConnectionObjectCreate(devCtx, fileObject, &connectionObject);
 	if (!NT_SUCCESS(status))
 		goto exit;
 
 	connection = GetConnectionObjectContext(connectionObject);
-	connection->ConnectionState = ConnectionStateConnecting;
+	ConnStateSet (&connection->State, ConnectionStateConnecting);
+
+	if (!HfpSrvAttachConnection (devCtx, fileObject, connection)) {
+		TraceEvents(TRACE_LEVEL_WARNING, DBG_CONNECT, "The remote is already connected, aborting");
+		WdfObjectDelete(connectionObject);
+		status = STATUS_SUCCESS;
+		goto exit_deref;
+	}
 	fileCtx->Connection = connection;
 
 	WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_NOT_SUPPORTED);
@@ -448,16 +543,19 @@ NTSTATUS HfpSrvSendConnectResponse(_In_ HFPDEVICE_CONTEXT* devCtx, _In_ SCO_INDI
 		NT_ASSERT (connection);
 		
 		//KS: this doesn't have a sense
-		//connection->ConnectionState = ConnectionStateConnectFailed;
+		//ConnStateSet (&connection->State, ConnectionStateConnectFailed);
 
-		if (connection->DevCtx->KevScoCritError)
-			KeSetEvent(connection->DevCtx->KevScoCritError,0,FALSE);
+		HfpSrvSignal (devCtx, fileObject, HfpScoEventCritError);
 
 		fileCtx->Connection = 0;
+		HfpSrvDetachConnection (connection);
 
 		WdfObjectDelete(connectionObject);
 	}
 
+	exit_deref:
+	WdfObjectDereference(fileObject);
+
 	exit_ret:
 	return status;
 }
@@ -497,8 +595,7 @@ void HfpSrvIndicationCallback(_In_ void* Context, _In_ SCO_INDICATION_CODE Indic
 		case ScoIndicationRemoteDisconnect:
 			TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "HfpSrvIndicationCallback - Disconnect");
 			connection = GetConnectionObjectContext((WDFOBJECT)Context /*connectionObject*/);
-			if (connection->DevCtx->KevScoDisconnect)
-				KeSetEvent(connection->DevCtx->KevScoDisconnect,0,FALSE);
+			HfpSrvSignal (connection->DevCtx, connection->FileObject, HfpScoEventDisconnect);
 			HfpSrvDisconnectConnection(connection);
 			break;
 	}
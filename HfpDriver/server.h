@@ -17,7 +17,7 @@ Environment:
  We receive connect and disconnect notifications in this callback.
 
  Arguments:
-    Context		- server device context
+    Context		- server device context (the remote device is found by the address)
     Indication	- type of indication
     Parameters	- parameters of indication
 */
@@ -27,13 +27,10 @@ void HfpSrvIndicationCallback(_In_ void* Context, _In_ SCO_INDICATION_CODE Indic
 
 
 /*
- Publishes server SDP record. We first build SDP record using CreateSdpRecord in sdp.c 
- and call this function to publish the record.
+ Publishes server SDP record: the prebuilt SdpRecHfp stream (sdprec.h) is submitted as is.
 
  Arguments:
-    devCtx			- Device context of the server
-    SdpRecord		- SDP record to publish
-    SdpRecordLength - SDP record length
+    Device - The server device
 */
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS HfpSrvPublishSdpRecord (_In_ WDFDEVICE Device);
@@ -51,34 +48,77 @@ void HfpSrvRemoveSdpRecord (_In_ HFPDEVICE_CONTEXT* devCtx);
 
 
 /*
- Registers SCO server.
+ Registers SCO server for the remote device on behalf of the file. A file serves one remote device:
+ if the file has registered another device, that one is unregistered first; if it is the same device,
+ only the events and the readiness are replaced. A device registered by another file fails with
+ STATUS_DEVICE_BUSY till that file unregisters it or is closed.
 
  Arguments:
-    devCtx	  - Device context
-	regparams - Server parameters (Address of the remote Bluetooth device to receive notifications for, User mode handles)
+    devCtx	   - Device context
+    fileObject - File object registering the server, it becomes the owner of the remote device's connections
+	regparams  - Server parameters (Address of the remote Bluetooth device to receive notifications for, User mode handles)
 
 Return Value:
     NTSTATUS Status code.
 */
 _IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS HfpSrvRegisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ HFP_REG_SERVER* regparams);
+NTSTATUS HfpSrvRegisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ HFP_REG_SERVER* regparams);
 
 
 /*
- Unregisters SCO server.
+ Unregisters SCO server registered by the file. Also called on the file cleanup.
 
  Arguments:
-    devCtx	 - Device context
-	destaddr - optional destination address that was registered before. If not 0, the caller wants 
-	           actually do unregister+register new device. The referenced address will be compared 
-			   with previously one registered: if it is the same - no unregistering action will be 
-			   performed. The caller may then test devCtx->ScoServerHandle, if it's not cleared
-			   it means no unregister/register needed.
+    devCtx	   - Device context
+    fileObject - File object that has registered the server
+
  Return Value:
-    NTSTATUS Status code.
+    NTSTATUS Status code, STATUS_INVALID_DEVICE_REQUEST if the file has no server.
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS HfpSrvUnregisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject);
+
+
+/*
+ Unregisters all SCO servers. Called on device cleanup.
 */
 _IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS HfpSrvUnregisterScoServer (_In_ HFPDEVICE_CONTEXT* devCtx, _Inout_ UINT64 destaddr);
+void HfpSrvUnregisterAllScoServers (_In_ HFPDEVICE_CONTEXT* devCtx);
+
+
+/*
+ Sets the User-mode event of the remote device served by the file, if any.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpSrvSignal (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ HFP_SCO_EVENT event);
+
+
+/*
+ Incoming SCO connection readiness of the remote device served by the file.
+ The setter returns STATUS_INVALID_DEVICE_REQUEST if the file has no server.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpSrvConnectReadiness (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS HfpSrvSetConnectReadiness (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ BOOLEAN ready);
+
+
+/*
+ Ties the connection to the remote device served by the file.
+
+ Return Value:
+    The remote address, or 0 if the file has no server or the remote already has a connection.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BTH_ADDR HfpSrvAttachConnection (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFFILEOBJECT fileObject, _In_ HFP_CONNECTION* connection);
+
+
+/*
+ Unties the connection from its remote device (no-op if it isn't tied), so the remote may be connected again.
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+void HfpSrvDetachConnection (_In_ HFP_CONNECTION* connection);
 
 
 /*
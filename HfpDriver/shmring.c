@@ -0,0 +1,625 @@
+/*++
+
+Module Name:
+    shmring.c
+
+Abstract:
+    Shared memory SCO audio ring: mapping and the transfers engine
+
+Environment:
+    Kernel mode only
+--*/
+
+#include "driver.h"
+#include "device.h"
+#include "connection.h"
+#include "shmring.h"
+
+#if defined(EVENT_TRACING)
+#include "shmring.tmh"
+#endif
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HfpShmRingMapRequest)
+#pragma alloc_text (PAGE, HfpShmRingStop)
+#pragma alloc_text (PAGE, HfpShmRingUnmap)
+#pragma alloc_text (PAGE, HfpShmRingDetach)
+#endif
+
+
+
+static void HfpShmRingFree (_In_ HFP_SHM_RING* ring)
+{
+    ULONG i;
+
+    NT_ASSERT (!ring->UserAddress && !ring->Connection);
+
+    for (i = 0; i < 2*SHM_RING_DEPTH; i++) {
+		if (ring->Xfer[i].Request)
+			WdfObjectDelete (ring->Xfer[i].Request);	// deletes its BrbMemory also
+	}
+
+    if (ring->Lock)
+		WdfObjectDelete (ring->Lock);
+    if (ring->KevRx)
+		ObDereferenceObject (ring->KevRx);
+    if (ring->Scratch)
+		ExFreePoolWithTag (ring->Scratch, POOLTAG_HFPDRIVER);
+
+    if (ring->Memory)
+		MmUnmapLockedPages (ring->Memory, ring->Mdl);
+    if (ring->Mdl) {
+		MmFreePagesFromMdl (ring->Mdl);
+		ExFreePool (ring->Mdl);
+	}
+
+    ExFreePoolWithTag (ring, POOLTAG_HFPDRIVER);
+}
+
+
+
+static void HfpShmRingDereference (_In_ HFP_SHM_RING* ring)
+{
+    if (InterlockedDecrement (&ring->Refs) == 0)
+		HfpShmRingFree (ring);
+}
+
+
+
+/*
+ Must be called under the ring Lock: the transfer stops being active
+*/
+static void HfpShmRingRelease (_In_ HFP_SHM_RING* ring)
+{
+    if (--ring->Active == 0)
+		KeSetEvent (&ring->IdleEvent, 0, FALSE);
+}
+
+
+
+/*
+ Accounts the transfer completion. Returns TRUE if the transfer has to be reposted,
+ otherwise the transfer is not active anymore.
+*/
+static BOOLEAN HfpShmRingDone (_In_ HFP_SHM_XFER* xfer, _In_ NTSTATUS status, _In_ ULONG transferred)
+{
+    HFP_SHM_RING*	ring = xfer->Ring;
+    SCO_SHM_HEADER*	hdr  = ring->View.Header;
+    BOOLEAN			repost;
+
+    WdfSpinLockAcquire (ring->Lock);
+
+    if (xfer->Direction == SCO_TRANSFER_DIRECTION_IN)
+	{
+		if (xfer->Slot) {
+			// SCO transfers of the channel complete in order, so this is the oldest reserved slot
+			NT_ASSERT (xfer->Slot == ScoShmSlot(&ring->View, ring->View.RxOffset, ring->RxHead));
+			xfer->Slot->Length = NT_SUCCESS(status) ? transferred : 0;
+			ScoShmProduce (&hdr->Rx, &ring->RxHead, 1);
+			ring->RxAhead--;
+			KeSetEvent (ring->KevRx, 0, FALSE);
+		}
+		else if (NT_SUCCESS(status))
+			hdr->RxOverruns++;
+
+		if (NT_SUCCESS(status))
+			hdr->RxFrames++;
+	}
+    else
+	{
+		if (xfer->Slot) {
+			ScoShmConsume (&hdr->Tx, &ring->TxTail, 1);
+			ring->TxAhead--;
+		}
+		else if (NT_SUCCESS(status))
+			hdr->TxUnderruns++;
+
+		if (NT_SUCCESS(status))
+			hdr->TxFrames++;
+	}
+
+    xfer->Slot	 = 0;
+    xfer->Posted = FALSE;
+
+    // A failed transfer is not reposted: it means the connection is closed or broken
+    repost = NT_SUCCESS(status) && !ring->Stopping;
+    if (!repost)
+		HfpShmRingRelease (ring);
+
+    WdfSpinLockRelease (ring->Lock);
+    return repost;
+}
+
+
+
+/*
+ Posts the active transfer on the next slot (or on the scratch/silence buffer)
+*/
+static void HfpShmRingPost (_In_ HFP_SHM_XFER* xfer)
+{
+    HFP_SHM_RING*				ring = xfer->Ring;
+    HFP_CONNECTION*				connection;
+    struct _BRB_SCO_TRANSFER*	brb = &xfer->Brb;
+    WDF_REQUEST_REUSE_PARAMS	reuseParams;
+    NTSTATUS					status;
+    PVOID						buffer;
+    ULONG						length;
+
+    WdfSpinLockAcquire (ring->Lock);
+
+    // The connection stays referenced till the ring is idle
+    connection = ring->Connection;
+    if (ring->Stopping || !connection) {
+		HfpShmRingRelease (ring);
+		WdfSpinLockRelease (ring->Lock);
+		return;
+	}
+
+    length = ring->View.SlotSize;
+
+    if (xfer->Direction == SCO_TRANSFER_DIRECTION_IN)
+	{
+		xfer->Slot = ScoShmProduceSlot (&ring->View, &ring->View.Header->Rx, ring->View.RxOffset, ring->RxHead, ring->RxAhead);
+		if (xfer->Slot) {
+			ring->RxAhead++;
+			buffer = ScoShmSlotData (xfer->Slot);
+		}
+		else
+			buffer = ring->Scratch;		// overrun: the application doesn't drain Rx
+	}
+    else
+	{
+		ULONG n = 0;
+		xfer->Slot = ScoShmConsumeSlot (&ring->View, &ring->View.Header->Tx, ring->View.TxOffset, ring->TxTail, ring->TxAhead, &n);
+		if (xfer->Slot) {
+			ring->TxAhead++;
+			if (n)
+				length = n;
+			buffer = n ? ScoShmSlotData(xfer->Slot) : ring->Silence;
+		}
+		else
+			buffer = ring->Silence;		// underrun: the application doesn't fill Tx
+	}
+
+    xfer->Posted = TRUE;
+    WdfSpinLockRelease (ring->Lock);
+
+    WDF_REQUEST_REUSE_PARAMS_INIT (&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+    status = WdfRequestReuse (xfer->Request, &reuseParams);
+    if (!NT_SUCCESS(status))
+		goto exit;
+
+    // The same as HfpConnectionObjectFormatRequestForScoTransfer does, but without creating
+    // new memory objects for the reused request
+    if (!HfpConnectionObjectAcquireTransfer (connection)) {
+		status = STATUS_CONNECTION_DISCONNECTED;
+		goto exit;
+	}
+
+    ring->DevCtx->ProfileDrvInterface.BthReuseBrb ((PBRB)brb, BRB_SCO_TRANSFER);
+    brb->BtAddress	   = connection->RemoteAddress;
+    brb->ChannelHandle = connection->ChannelHandle;
+    brb->TransferFlags = xfer->Direction;
+    brb->BufferMDL	   = NULL;
+    brb->Buffer		   = buffer;
+    brb->BufferSize	   = length;
+    HfpConnectionObjectStampTransfer (connection, brb);
+
+    status = WdfIoTargetFormatRequestForInternalIoctlOthers (ring->DevCtx->IoTarget, xfer->Request, IOCTL_INTERNAL_BTH_SUBMIT_BRB,
+															 xfer->BrbMemory, NULL, NULL, NULL, NULL, NULL);
+    if (NT_SUCCESS(status)) {
+		WdfRequestSetCompletionRoutine (xfer->Request, HfpShmRingCompletion, xfer);
+		if (!WdfRequestSend (xfer->Request, ring->DevCtx->IoTarget, NULL))
+			status = WdfRequestGetStatus (xfer->Request);
+	}
+
+    // The sent transfer keeps the reference, its completion releases it
+    if (NT_SUCCESS(status))
+		return;
+    HfpConnectionObjectReleaseTransfer (connection);
+
+	exit:
+    TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, "Ring transfer (direction %d) post failed, Status %X", xfer->Direction, status);
+    HfpShmRingDone (xfer, status, 0);
+}
+
+
+
+void HfpShmRingCompletion (_In_ WDFREQUEST Request, _In_ WDFIOTARGET Target, _In_ PWDF_REQUEST_COMPLETION_PARAMS Params, _In_ WDFCONTEXT Context)
+{
+    HFP_SHM_XFER* xfer = (HFP_SHM_XFER*) Context;
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    if (Params->IoStatus.Status)
+		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "Ring transfer (direction %d) completion, Status %X", xfer->Direction, Params->IoStatus.Status);
+
+    HfpConnectionObjectTransferDone (&xfer->Brb, Params->IoStatus.Status);
+
+    if (HfpShmRingDone (xfer, Params->IoStatus.Status, xfer->Brb.BufferSize))
+		HfpShmRingPost (xfer);
+}
+
+
+
+/*
+ Releases the connection link: stops the streaming, waits for the transfers and dereferences
+ the connection and the ring. The caller owns the link: it has taken connection->ShmRing.
+*/
+static void HfpShmRingUnlink (_In_ HFP_SHM_RING* ring)
+{
+    HFP_CONNECTION*	connection;
+    BOOLEAN			posted[2*SHM_RING_DEPTH];
+    ULONG			i;
+
+    WdfSpinLockAcquire (ring->Lock);
+    connection		 = ring->Connection;
+    ring->Connection = 0;
+    ring->Stopping	 = TRUE;
+    for (i = 0; i < 2*SHM_RING_DEPTH; i++)
+		posted[i] = ring->Xfer[i].Posted;
+    WdfSpinLockRelease (ring->Lock);
+
+    NT_ASSERT (connection);
+
+    // Cancellation only speeds up the stop: a transfer which is just being reposted is not
+    // cancelled, it completes in one slot time and is not reposted anymore
+    for (i = 0; i < 2*SHM_RING_DEPTH; i++) {
+		if (posted[i])
+			WdfRequestCancelSentRequest (ring->Xfer[i].Request);
+	}
+
+    KeWaitForSingleObject (&ring->IdleEvent, Executive, KernelMode, FALSE, NULL);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "SCO ring stopped: Rx %d (overruns %d), Tx %d (underruns %d)",
+				ring->View.Header->RxFrames, ring->View.Header->RxOverruns, ring->View.Header->TxFrames, ring->View.Header->TxUnderruns);
+
+    WdfObjectDereference (WdfObjectContextGetObject(connection));
+    HfpShmRingDereference (ring);
+}
+
+
+
+/*
+ File side: takes the connection link if it's not taken by the connection cleanup yet.
+ The connection is valid while ring->Connection is set: the link owner clears it under the Lock
+ before the dereference.
+*/
+static BOOLEAN HfpShmRingTakeLink (_In_ HFP_SHM_RING* ring)
+{
+    BOOLEAN taken = FALSE;
+
+    WdfSpinLockAcquire (ring->Lock);
+    if (ring->Connection)
+		taken = (InterlockedCompareExchangePointer ((PVOID*)&ring->Connection->ShmRing, NULL, ring) == ring);
+    WdfSpinLockRelease (ring->Lock);
+
+    return taken;
+}
+
+
+
+/*
+ Allocates the ring for the geometry: the shared pages are allocated by MmAllocatePagesForMdlEx,
+ so they are whole pages not shared with other allocations. The ring is not mapped to user mode.
+*/
+static NTSTATUS HfpShmRingCreate (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ SCO_SHM_VIEW* view, _Out_ HFP_SHM_RING** pring)
+{
+    NTSTATUS				status;
+    HFP_SHM_RING*			ring;
+    WDF_OBJECT_ATTRIBUTES	attributes;
+    PHYSICAL_ADDRESS		low, high, skip;
+    ULONG					i;
+
+    *pring = NULL;
+
+    ring = (HFP_SHM_RING*) ExAllocatePoolWithTag (NonPagedPool, sizeof(HFP_SHM_RING), POOLTAG_HFPDRIVER);
+    if (!ring)
+		return STATUS_INSUFFICIENT_RESOURCES;
+    RtlZeroMemory (ring, sizeof(HFP_SHM_RING));
+
+    ring->DevCtx = devCtx;
+    ring->Refs	 = 1;	// the file's
+    ring->View	 = *view;
+    KeInitializeEvent (&ring->IdleEvent, NotificationEvent, TRUE);
+
+    // Zeroed pages, any physical address
+    low.QuadPart  = 0;
+    high.QuadPart = -1;
+    skip.QuadPart = 0;
+    ring->Mdl = MmAllocatePagesForMdlEx (low, high, skip, ROUND_TO_PAGES(view->Size), MmCached, MM_ALLOCATE_FULLY_REQUIRED);
+    if (!ring->Mdl) {
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+    ring->Memory  = MmGetSystemAddressForMdlSafe (ring->Mdl, NormalPagePriority);
+    ring->Scratch = (UCHAR*) ExAllocatePoolWithTag (NonPagedPool, 2*view->SlotSize, POOLTAG_HFPDRIVER);
+    if (!ring->Memory || !ring->Scratch) {
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+    RtlZeroMemory (ring->Scratch, 2*view->SlotSize);
+    ring->Silence = ring->Scratch + view->SlotSize;
+
+    // The ring may outlive the file object (till its connection cleanup), so its objects belong to the device
+    WDF_OBJECT_ATTRIBUTES_INIT (&attributes);
+    attributes.ParentObject = devCtx->Device;
+    status = WdfSpinLockCreate (&attributes, &ring->Lock);
+    if (!NT_SUCCESS(status))
+		goto exit;
+
+    for (i = 0; i < 2*SHM_RING_DEPTH; i++)
+	{
+		HFP_SHM_XFER* xfer = &ring->Xfer[i];
+
+		xfer->Ring		= ring;
+		xfer->Direction = (i < SHM_RING_DEPTH) ? SCO_TRANSFER_DIRECTION_IN : SCO_TRANSFER_DIRECTION_OUT;
+
+		WDF_OBJECT_ATTRIBUTES_INIT (&attributes);
+		attributes.ParentObject = devCtx->Device;
+		status = WdfRequestCreate (&attributes, devCtx->IoTarget, &xfer->Request);
+		if (!NT_SUCCESS(status))
+			goto exit;
+
+		WDF_OBJECT_ATTRIBUTES_INIT (&attributes);
+		attributes.ParentObject = xfer->Request;
+		status = WdfMemoryCreatePreallocated (&attributes, &xfer->Brb, sizeof(xfer->Brb), &xfer->BrbMemory);
+		if (!NT_SUCCESS(status))
+			goto exit;
+	}
+
+    *pring = ring;
+    return STATUS_SUCCESS;
+
+	exit:
+    HfpShmRingFree (ring);
+    return status;
+}
+
+
+
+/*
+ Maps the ring to the current process, which becomes its owner
+*/
+static NTSTATUS HfpShmRingMapUser (_In_ HFP_SHM_RING* ring)
+{
+    __try {
+		ring->UserAddress = MmMapLockedPagesSpecifyCache (ring->Mdl, UserMode, MmCached, NULL, FALSE, NormalPagePriority);
+	}
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+		ring->UserAddress = NULL;
+	}
+
+    if (!ring->UserAddress) {
+		TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, "Mapping of the SCO ring failed");
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+    ring->Owner = PsGetCurrentProcess();
+    ObReferenceObject (ring->Owner);
+    return STATUS_SUCCESS;
+}
+
+
+
+/*
+ Unmaps the ring from its owner process. The file cleanup may run in another process (the last
+ handle may be a duplicated one), then we attach to the owner.
+*/
+static void HfpShmRingUnmapUser (_In_ HFP_SHM_RING* ring)
+{
+    KAPC_STATE	apcState;
+    BOOLEAN		attached = FALSE;
+
+    if (!ring->UserAddress)
+		return;
+
+    if (PsGetCurrentProcess() != ring->Owner) {
+		KeStackAttachProcess ((PRKPROCESS) ring->Owner, &apcState);
+		attached = TRUE;
+	}
+
+    MmUnmapLockedPages (ring->UserAddress, ring->Mdl);
+
+    if (attached)
+		KeUnstackDetachProcess (&apcState);
+
+    ObDereferenceObject (ring->Owner);
+    ring->UserAddress = NULL;
+    ring->Owner		  = NULL;
+}
+
+
+
+/*
+ Links the stopped ring to the connection and starts the streaming from the empty rings.
+ The doorbell event is referenced in the context of the calling process.
+*/
+static NTSTATUS HfpShmRingStart (_In_ HFP_SHM_RING* ring, _In_ HFP_CONNECTION* connection, _In_ UINT64 evHandleRx)
+{
+    NTSTATUS	status;
+    PKEVENT		kev = NULL, oldkev;
+    ULONG		i;
+
+	// disable warning C4305: 'type cast' : truncation from 'UINT64' to 'HANDLE'
+	#pragma warning (disable:4305)
+    status = ObReferenceObjectByHandle ((HANDLE)evHandleRx, EVENT_MODIFY_STATE, *ExEventObjectType, UserMode, (PVOID*)&kev, 0);
+	#pragma warning (default:4305)
+    if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ObReferenceObjectByHandle failed, Status %X", status);
+		return status;
+	}
+
+    WdfSpinLockAcquire (ring->Lock);
+
+    // Still streaming, or being stopped by the connection cleanup
+    if (ring->Connection || ring->Active  ||  InterlockedCompareExchangePointer ((PVOID*)&connection->ShmRing, ring, NULL) != NULL) {
+		WdfSpinLockRelease (ring->Lock);
+		ObDereferenceObject (kev);
+		return STATUS_INVALID_DEVICE_STATE;
+	}
+
+    // The link: the connection object and the ring references, released by HfpShmRingUnlink
+    WdfObjectReference (WdfObjectContextGetObject(connection));
+    InterlockedIncrement (&ring->Refs);
+    ring->Connection = connection;
+
+    oldkev		= ring->KevRx;
+    ring->KevRx = kev;
+
+    // The application maps (or takes the mapping again) when the ring is stopped, so the memory is not in use
+    RtlZeroMemory (ring->Memory, ring->View.Size);
+    ScoShmInit (&ring->View, ring->Memory);
+    ring->RxHead = ring->RxAhead = ring->TxTail = ring->TxAhead = 0;
+
+    ring->Stopping = FALSE;
+    ring->Active   = 2*SHM_RING_DEPTH;
+    KeClearEvent (&ring->IdleEvent);
+
+    WdfSpinLockRelease (ring->Lock);
+
+    if (oldkev)
+		ObDereferenceObject (oldkev);
+
+    for (i = 0; i < 2*SHM_RING_DEPTH; i++)
+		HfpShmRingPost (&ring->Xfer[i]);
+
+    return STATUS_SUCCESS;
+}
+
+
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingMapRequest (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFREQUEST Request, _In_ size_t OutBufferLen, _In_ size_t InBufferLen)
+{
+    NTSTATUS				status;
+    WDFFILEOBJECT			fileObject = WdfRequestGetFileObject(Request);
+    HFP_FILE_CONTEXT*		fileCtx	   = GetFileContext(fileObject);
+    HFP_SHM_RING*			ring	   = fileCtx->ShmRing;
+    HFP_SCO_RING_MAP_IN		in;
+    HFP_SCO_RING_MAP_OUT*	out;
+    SCO_SHM_VIEW			view;
+    PVOID					buffer;
+
+    PAGED_CODE();
+
+    if (InBufferLen < sizeof(HFP_SCO_RING_MAP_IN) || OutBufferLen < sizeof(HFP_SCO_RING_MAP_OUT)) {
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+    // The input & output structures share the same system buffer, so the input is copied
+    status = WdfRequestRetrieveInputBuffer (Request, sizeof(HFP_SCO_RING_MAP_IN), &buffer, NULL);
+    if (!NT_SUCCESS(status))
+		goto exit;
+    in = *(HFP_SCO_RING_MAP_IN*) buffer;
+
+    if (!fileCtx->Connection || fileCtx->ContReader) {
+		status = STATUS_INVALID_DEVICE_STATE;
+		goto exit;
+	}
+
+    if (!ScoShmLayout (&view, in.SlotCount, in.SlotSize)) {
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+    if (ring) {
+		// Mapped by the previous call: the same memory is streamed again
+		if (ring->Owner != PsGetCurrentProcess()) {
+			status = STATUS_ACCESS_DENIED;
+			goto exit;
+		}
+		if (view.SlotCount != ring->View.SlotCount || view.SlotSize != ring->View.SlotSize) {
+			status = STATUS_INVALID_PARAMETER;
+			goto exit;
+		}
+	}
+    else {
+		status = HfpShmRingCreate (devCtx, &view, &ring);
+		if (!NT_SUCCESS(status))
+			goto exit;
+
+		status = HfpShmRingMapUser (ring);
+		if (!NT_SUCCESS(status)) {
+			HfpShmRingDereference (ring);
+			goto exit;
+		}
+
+		fileCtx->ShmRing = ring;
+		TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, "SCO ring mapped: %d slots x %d bytes", view.SlotCount, view.SlotSize);
+	}
+
+    status = HfpShmRingStart (ring, fileCtx->Connection, in.EvHandleRx);
+    if (!NT_SUCCESS(status))
+		goto exit;
+
+    out = (HFP_SCO_RING_MAP_OUT*) buffer;
+    out->Address = (UINT64)(ULONG_PTR) ring->UserAddress;
+    out->Size	 = ring->View.Size;
+    WdfRequestCompleteWithInformation (Request, STATUS_SUCCESS, sizeof(HFP_SCO_RING_MAP_OUT));
+    return;
+
+	exit:
+    WdfRequestComplete (Request, status);
+}
+
+
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingStop (_In_ WDFFILEOBJECT fileObject)
+{
+    HFP_SHM_RING* ring = GetFileContext(fileObject)->ShmRing;
+
+    PAGED_CODE();
+
+    // If the connection cleanup has taken the link, it stops the ring itself
+    if (ring  &&  HfpShmRingTakeLink (ring))
+		HfpShmRingUnlink (ring);
+}
+
+
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpShmRingStreaming (_In_ WDFFILEOBJECT fileObject)
+{
+    HFP_SHM_RING* ring = GetFileContext(fileObject)->ShmRing;
+
+    return (ring && ring->Connection);
+}
+
+
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingUnmap (_In_ WDFFILEOBJECT fileObject)
+{
+    HFP_FILE_CONTEXT*	fileCtx = GetFileContext(fileObject);
+    HFP_SHM_RING*		ring	= fileCtx->ShmRing;
+
+    PAGED_CODE();
+
+    if (!ring)
+		return;
+
+    HfpShmRingStop (fileObject);
+    fileCtx->ShmRing = 0;
+
+    // The transfers of a link taken by the connection cleanup may still use the system address
+    HfpShmRingUnmapUser (ring);
+    HfpShmRingDereference (ring);
+}
+
+
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingDetach (_In_ HFP_CONNECTION* Connection)
+{
+    HFP_SHM_RING* ring = (HFP_SHM_RING*) InterlockedExchangePointer ((PVOID*)&Connection->ShmRing, NULL);
+
+    PAGED_CODE();
+
+    if (ring)
+		HfpShmRingUnlink (ring);
+}
@@ -0,0 +1,135 @@
+/*++
+
+Module Name:
+    shmring.h
+
+Abstract:
+    Shared memory SCO audio ring: the driver part.
+    The ring memory layout and index math are in scoshm.h.
+
+    The ring is owned by the file object and mapped to the process which called
+    IOCTL_HFP_SCO_RING_MAP, the mapping lives till the file cleanup. While the ring is linked
+    to the file's SCO connection, the driver keeps SHM_RING_DEPTH transfers posted on each
+    direction, directly on the ring slots (no copy), and reposts them from the completions.
+    IOCTL_HFP_SCO_RING_UNMAP, CLOSE_SCO and the connection deletion only stop the streaming;
+    the next IOCTL_HFP_SCO_RING_MAP restarts it on the same memory.
+
+    The connection link holds a reference to the connection object and one to the ring.
+    It is released by the one who takes connection->ShmRing: the file (stop/cleanup) or the
+    connection cleanup callback, after the ring transfers are drained.
+
+Environment:
+    Kernel mode only
+--*/
+
+
+#define SHM_RING_DEPTH		2		// SCO transfers kept posted per direction
+
+
+typedef struct HFP_SHM_XFER
+{
+    struct HFP_SHM_RING*		Ring;
+    WDFREQUEST					Request;		// Reused for every transfer
+    WDFMEMORY					BrbMemory;		// Preallocated memory for Brb, the request argument
+    struct _BRB_SCO_TRANSFER	Brb;
+    ULONG						Direction;		// SCO_TRANSFER_DIRECTION_IN/OUT
+    SCO_SHM_SLOT*				Slot;			// Slot of the current transfer, 0 if it's on the scratch/silence buffer
+    BOOLEAN						Posted;			// Protected by the ring Lock
+} HFP_SHM_XFER;
+
+
+typedef struct HFP_SHM_RING
+{
+    HFPDEVICE_CONTEXT*			DevCtx;
+    struct HFP_CONNECTION*		Connection;		// Linked (streamed) connection or 0, protected by Lock
+    SCO_SHM_VIEW				View;			// Trusted geometry, the shared header copy is never read back
+    PMDL						Mdl;			// Shared pages, allocated by MmAllocatePagesForMdlEx
+    PVOID						Memory;			// Shared memory, system address
+    PVOID						UserAddress;	// Shared memory, address in the owner process
+    PEPROCESS					Owner;			// The process the memory is mapped to, referenced
+    PKEVENT						KevRx;			// Rx doorbell: User-mode Event set when Rx slots are published
+    WDFSPINLOCK					Lock;			// Protects the indices, the transfers state and Connection
+    ULONG						RxHead;			// Rx producer index (private copy)
+    ULONG						RxAhead;		// Rx slots under posted transfers
+    ULONG						TxTail;			// Tx consumer index (private copy)
+    ULONG						TxAhead;		// Tx slots under posted transfers
+    UCHAR*						Scratch;		// Rx overrun sink, SlotSize bytes
+    UCHAR*						Silence;		// Tx underrun source, SlotSize zero bytes
+    BOOLEAN						Stopping;		// No more reposts
+    ULONG						Active;			// Transfers posted or being reposted
+    KEVENT						IdleEvent;		// Signaled when Active is 0
+    volatile LONG				Refs;			// The file's and the connection link's
+    HFP_SHM_XFER				Xfer[2*SHM_RING_DEPTH];
+} HFP_SHM_RING;
+
+
+
+/*
+ Handles IOCTL_HFP_SCO_RING_MAP in the context of the calling process (EvtIoInCallerContext):
+ maps the ring to the process, or takes the existing mapping of the file, and starts streaming
+ of the file's SCO connection. Completes the request.
+
+ Arguments:
+    devCtx			- Device context
+    Request			- IOCTL_HFP_SCO_RING_MAP request: HFP_SCO_RING_MAP_IN -> HFP_SCO_RING_MAP_OUT
+    OutBufferLen, InBufferLen - IOCTL buffers length
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingMapRequest (_In_ HFPDEVICE_CONTEXT* devCtx, _In_ WDFREQUEST Request, _In_ size_t OutBufferLen, _In_ size_t InBufferLen);
+
+
+
+/*
+ Handles IOCTL_HFP_SCO_RING_UNMAP and CLOSE_SCO: stops the streaming and waits for the transfers,
+ the memory stays mapped. Does nothing if the file has no ring or it's not streaming.
+
+ Arguments:
+    fileObject	- File object which owns the ring
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingStop (_In_ WDFFILEOBJECT fileObject);
+
+
+
+/*
+ Returns TRUE if the file's ring is linked to a connection (a hint, it may be stopped concurrently)
+*/
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN HfpShmRingStreaming (_In_ WDFFILEOBJECT fileObject);
+
+
+
+/*
+ File cleanup: stops the streaming and unmaps the memory from the owner process (attaching
+ to it if the last handle is closed by another process). Does nothing if the file has no ring.
+
+ Arguments:
+    fileObject	- File object which owns the ring
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingUnmap (_In_ WDFFILEOBJECT fileObject);
+
+
+
+/*
+ Connection cleanup: stops the ring streaming the connection, if any, and waits for its transfers.
+ After it the ring doesn't access the connection.
+
+ Arguments:
+    Connection	- Connection being deleted
+*/
+_IRQL_requires_max_(PASSIVE_LEVEL)
+void HfpShmRingDetach (_In_ struct HFP_CONNECTION* Connection);
+
+
+
+/*
+ Completion routine for the ring transfers: publishes/releases the slot and reposts the transfer.
+
+Arguments:
+    Request - Transfer request
+    Target  - Target to which request was sent
+    Params  - Completion parameters for the request
+    Context - We receive HFP_SHM_XFER as the context
+*/
+EVT_WDF_REQUEST_COMPLETION_ROUTINE	HfpShmRingCompletion;
@@ -0,0 +1,122 @@
+/*++
+
+Module Name:
+    xferpool.c
+
+Abstract:
+    Pool of preallocated SCO transfer contexts: the portable free-list management.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#if defined(_KERNEL_MODE)
+#include <ntddk.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "xferpool.h"
+
+
+#if defined(_WIN32)
+#define XFER_POOL_CAS(p, exchange, comparand)	InterlockedCompareExchange ((p), (exchange), (comparand))
+#define XFER_POOL_INC(p)						InterlockedIncrement (p)
+#else
+#define XFER_POOL_CAS(p, exchange, comparand)	__sync_val_compare_and_swap ((p), (comparand), (exchange))
+#define XFER_POOL_INC(p)						__sync_add_and_fetch ((p), 1)
+#endif
+
+
+// Index of the lowest set bit of the non zero word
+static ULONG XferPoolLowBit (ULONG w)
+{
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward (&idx, w);
+	return idx;
+#else
+	return (ULONG) __builtin_ctz (w);
+#endif
+}
+
+
+// Number of the set bits
+static ULONG XferPoolBits (ULONG w)
+{
+	w = w - ((w >> 1) & 0x55555555);
+	w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+	return (((w + (w >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+
+
+void XferPoolInit (XFER_POOL* pool, ULONG size)
+{
+	if (size > XFER_POOL_MAX)
+		size = XFER_POOL_MAX;
+
+	pool->Size		= size;
+	pool->Free		= (LONG) ((size == 32) ? 0xFFFFFFFF : (1u << size) - 1);
+	pool->Hits		= 0;
+	pool->Misses	= 0;
+	pool->InUseMax	= 0;
+	pool->Errors	= 0;
+}
+
+
+ULONG XferPoolGet (XFER_POOL* pool)
+{
+	LONG  free, taken, inuse, max;
+	ULONG idx;
+
+	for (;;) {
+		free = pool->Free;
+		if (free == 0) {
+			XFER_POOL_INC (&pool->Misses);
+			return XFER_POOL_NONE;
+		}
+
+		idx	  = XferPoolLowBit ((ULONG) free);
+		taken = (LONG) ((ULONG) free & ~(1u << idx));
+		if (XFER_POOL_CAS (&pool->Free, taken, free) == free)
+			break;
+	}
+
+	XFER_POOL_INC (&pool->Hits);
+
+	// The number in use right after the take, the watermark is only raised
+	inuse = (LONG) (pool->Size - XferPoolBits ((ULONG) taken));
+	do {
+		max = pool->InUseMax;
+	} while (inuse > max  &&  XFER_POOL_CAS (&pool->InUseMax, inuse, max) != max);
+
+	return idx;
+}
+
+
+int XferPoolPut (XFER_POOL* pool, ULONG idx)
+{
+	LONG free;
+
+	if (idx >= pool->Size) {
+		XFER_POOL_INC (&pool->Errors);
+		return 0;
+	}
+
+	do {
+		free = pool->Free;
+		if ((ULONG) free & (1u << idx)) {
+			XFER_POOL_INC (&pool->Errors);
+			return 0;
+		}
+	} while (XFER_POOL_CAS (&pool->Free, (LONG) ((ULONG) free | (1u << idx)), free) != free);
+
+	return 1;
+}
+
+
+ULONG XferPoolInUse (XFER_POOL* pool)
+{
+	return pool->Size - XferPoolBits ((ULONG) pool->Free);
+}
@@ -0,0 +1,90 @@
+/*++
+
+Module Name:
+    xferpool.h
+
+Abstract:
+    Pool of preallocated SCO transfer contexts: the portable free-list management.
+
+    The pool hands out indices of caller's preallocated entries (BRB, its WDFMEMORY wrapper
+    and the completion context in the driver), so the transfer hot path doesn't allocate.
+    The free entries are a bitmap word, taken and returned by interlocked compare-exchange,
+    so the pool is lock free and callable at any IRQL <= DISPATCH_LEVEL. A bitmap has no ABA
+    problem of a linked free list. The lowest free index is taken, so the same few (cache warm)
+    entries are in use when the load is low.
+
+    This module doesn't depend on WDF/WDM, so it may be built and tested in user mode.
+
+Environment:
+    Kernel mode, User mode
+--*/
+
+#pragma once
+
+
+#if !defined(_WIN32) && !defined(HFP_PORTABLE_TYPES)
+#define HFP_PORTABLE_TYPES
+#include <stddef.h>
+typedef unsigned int	ULONG;
+typedef int				LONG;
+typedef unsigned char	UCHAR;
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define XFER_POOL_MAX		32
+#define XFER_POOL_NONE		((ULONG)-1)
+
+
+typedef struct
+{
+	ULONG			Size;				// Number of entries
+	volatile LONG	Free;				// Bit i is set if entry i is free
+
+	// Statistics, interlocked
+	volatile LONG	Hits;				// XferPoolGet served from the pool
+	volatile LONG	Misses;				// XferPoolGet found the pool empty
+	volatile LONG	InUseMax;			// High watermark of the given out entries
+	volatile LONG	Errors;				// Invalid or double XferPoolPut
+} XFER_POOL;
+
+
+
+/*
+ Initializes the pool of size entries (up to XFER_POOL_MAX), all of them are free.
+ Not thread safe, the rest of the functions are.
+*/
+void XferPoolInit (XFER_POOL* pool, ULONG size);
+
+
+/*
+ Takes a free entry.
+
+ Return Value:
+    Entry index or XFER_POOL_NONE if the pool is exhausted (a miss)
+*/
+ULONG XferPoolGet (XFER_POOL* pool);
+
+
+/*
+ Returns the entry taken by XferPoolGet.
+
+ Return Value:
+    0 if the index is invalid or the entry is already free (counted in Errors), otherwise 1
+*/
+int XferPoolPut (XFER_POOL* pool, ULONG idx);
+
+
+/*
+ Number of the given out entries
+*/
+ULONG XferPoolInUse (XFER_POOL* pool);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,180 @@
+/*******************************************************************\
+ Filename    :  AudioEndpointTest.cpp
+ Purpose     :  Null and WAV file audio endpoints
+\*******************************************************************/
+
+/*
+ Checks the endpoints which replace the sound card when the voice runs without audio devices
+ (AUDIO_BACKEND_NULL and AUDIO_BACKEND_WAVFILE): the null microphone produces silence, the
+ endpoints are paced in real time or free-running, a WAV file written by the speaker endpoint
+ is read back by the microphone one (looped), and the open errors: a missing or not WAV file,
+ a format mismatch. The free-running null endpoints pass the given audio time as WaveOut and
+ WaveIn do, by chunks, and must be much faster than real time.
+ Args: [seconds], default 3600.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "HfpTest.h"
+#include "AudioEndpoint.h"
+
+
+static const AudioEndpoint::FORMAT	Voice = { 8000, 1, 16 };	// Wave::VoiceSampleRate...
+static const int					Chunk = 4096;				// Wave::ChunkSize
+static const char *					WavFile = "hfptest_ep.wav";
+
+
+static void TestNull (double seconds)
+{
+	AudioEndpoint *	spk = AudioEndpoint::Create (AudioEndpoint::TYPE_NULL, false, false);
+	AudioEndpoint *	mic = AudioEndpoint::Create (AudioEndpoint::TYPE_NULL, true,  false);
+	static char		buf[Chunk];
+	int				silent = 1;
+
+	TEST_CHECK (!spk->IsCapture()  &&  mic->IsCapture());
+	TEST_CHECK (!spk->IsDeviceClock()  &&  !mic->IsDeviceClock());
+	TEST_CHECK (spk->GetQueueFill() == -1);
+
+	spk->Open (Voice);
+	mic->Open (Voice);
+	spk->Start ();
+	mic->Start ();
+
+	// Free-running: the given audio time passes at once
+	double t = TestTime();
+	long   nchunks = long(seconds * Voice.BytesPerSec() / Chunk);
+	for (long i = 0; i < nchunks; i++) {
+		memset (buf, 0x55, sizeof(buf));
+		if (mic->Read (buf, Chunk) != Chunk)
+			silent = 0;
+		for (int j = 0; j < Chunk; j += 512)
+			silent &= (buf[j] == 0  &&  buf[Chunk - 1] == 0);
+		spk->Write (buf, Chunk);
+	}
+	t = TestTime() - t;
+	TestLog ("free-running: %.0f s of audio in %.3f s", seconds, t);
+	TEST_CHECK (silent);
+	TEST_CHECK (t < seconds / 100);
+
+	spk->Stop ();
+	mic->Stop ();
+	spk->Close ();
+	mic->Close ();
+	delete spk;
+	delete mic;
+
+	// Real time: 300 ms of audio by 30 ms chunks (SCO frames), the first chunk is due after 30 ms
+	spk = AudioEndpoint::Create (AudioEndpoint::TYPE_NULL, false, true);
+	spk->Open (Voice);
+	spk->Start ();
+	t = TestTime();
+	for (int i = 0; i < 10; i++)
+		spk->Write (buf, 480);
+	t = TestTime() - t;
+	TestLog ("real time: 300 ms of audio in %.0f ms", t * 1000);
+	TEST_CHECK (t > 0.290  &&  t < 0.600);
+	spk->Close ();
+	delete spk;
+}
+
+
+static void TestWavFile ()
+{
+	enum { Samples = 3000 };	// Not a multiple of the read size: the loop is checked
+	AudioEndpoint *	ep;
+	short			data[Samples];
+	short			rd[2 * Samples];
+	int				err;
+
+	for (int i = 0; i < Samples; i++)
+		data[i] = short((i * 37) % 20000 - 10000);
+
+	// No file name
+	err = 0;
+	try {
+		AudioEndpoint::Create (AudioEndpoint::TYPE_WAVFILE, false, false, 0);
+	}
+	catch (int e) {
+		err = e;
+	}
+	TEST_CHECK (err == DialAppError_InternalError);
+	remove (WavFile);
+
+	// Speaker: written by parts, the header is completed on close
+	ep = AudioEndpoint::Create (AudioEndpoint::TYPE_WAVFILE, false, false, WavFile);
+	ep->Open (Voice);
+	ep->Start ();
+	ep->Write (data, 1000 * sizeof(short));
+	ep->Write (data + 1000, (Samples - 1000) * sizeof(short));
+	ep->Stop ();
+	ep->Close ();
+	delete ep;
+
+	// Microphone: reads the file in a loop
+	ep = AudioEndpoint::Create (AudioEndpoint::TYPE_WAVFILE, true, false, WavFile);
+	ep->Open (Voice);
+	ep->Start ();
+	int n1 = ep->Read (rd, 2000 * sizeof(short));
+	int n2 = ep->Read (rd + 2000, 4000 * sizeof(short));
+	TEST_CHECK (n1 == 2000 * sizeof(short)  &&  n2 == 4000 * sizeof(short));
+	int diff = 0;
+	for (int i = 0; i < 2 * Samples; i++)
+		diff += (rd[i] != data[i % Samples]);
+	TEST_CHECK (diff == 0);
+	ep->Close ();
+	delete ep;
+
+	// Another format
+	AudioEndpoint::FORMAT wide = { 16000, 1, 16 };
+	ep  = AudioEndpoint::Create (AudioEndpoint::TYPE_WAVFILE, true, false, WavFile);
+	err = 0;
+	try {
+		ep->Open (wide);
+	}
+	catch (int e) {
+		err = e;
+	}
+	TestLog ("format mismatch: %s", ep->GetError());
+	TEST_CHECK (err == DialAppError_InitMediaDeviceError  &&  strstr (ep->GetError(), "unsupported format"));
+	delete ep;
+
+	// Not a WAV file
+	FILE * f = fopen (WavFile, "wb");
+	fputs ("RIFX and some text", f);
+	fclose (f);
+	ep	= AudioEndpoint::Create (AudioEndpoint::TYPE_WAVFILE, true, false, WavFile);
+	err = 0;
+	try {
+		ep->Open (Voice);
+	}
+	catch (int e) {
+		err = e;
+	}
+	TEST_CHECK (err == DialAppError_InitMediaDeviceError  &&  strstr (ep->GetError(), "not a WAV file"));
+	delete ep;
+
+	// Missing file
+	remove (WavFile);
+	ep	= AudioEndpoint::Create (AudioEndpoint::TYPE_WAVFILE, true, false, WavFile);
+	err = 0;
+	try {
+		ep->Open (Voice);
+	}
+	catch (int e) {
+		err = e;
+	}
+	TEST_CHECK (err == DialAppError_InitMediaDeviceError  &&  strstr (ep->GetError(), "Cannot open"));
+	delete ep;
+}
+
+
+
+void TestAudioEndpoint (int argc, char ** argv)
+{
+	double seconds = (argc > 0) ? atof (argv[0]) : 3600;
+
+	TestNull (seconds);
+	TestWavFile ();
+}
@@ -0,0 +1,398 @@
+/*******************************************************************\
+ Filename    :  ConnStateTest.cpp
+ Purpose     :  Connection state word: connect/disconnect handshake with submission references
+\*******************************************************************/
+
+/*
+ Checks the driver's connection state word (connstate.c) as the connection object uses it:
+ the connect completion, SCO transfers holding a submission reference from the formatting till
+ their completion, a disconnect and the CLOSE_CHANNEL completion.
+
+ Every ConnState call is one atomic step (a CAS), so all the interleavings of the actors' steps
+ are explored exhaustively (depth first, each reachable model state once). Checked on each step:
+ no transfer is sent or in flight when CLOSE_CHANNEL is sent, no reference is taken after the
+ disconnect has started, the close (or the signal) is performed at most once; and at the end
+ exactly once if the disconnect has started. Then the same actors run as threads.
+ Args: [submitters [transfers per submitter [iterations]]], default 3 2 20000.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <set>
+#include <string>
+
+#include "HfpTest.h"
+#include "connstate.h"
+
+
+#define MAX_SUBMITTERS	4
+
+enum {
+    SubIdle = 0,	// next transfer: acquire
+    SubAcquired,	// formatting: sent or failed
+    SubInFlight,	// sent: the completion releases
+    SubDone
+};
+
+
+struct MODEL
+{
+	CONN_STATE	Word;
+	UCHAR		Connector;					// 0 - connect pending, 1 - done
+	UCHAR		Disconnector;				// 0 - begin, 1 - release, 2 - done
+	UCHAR		Sub[MAX_SUBMITTERS];		// Sub*
+	UCHAR		Xfers[MAX_SUBMITTERS];		// transfers started
+	UCHAR		InFlight;
+	UCHAR		Closes;						// CLOSE_CHANNEL sent
+	UCHAR		Signals;
+	UCHAR		Closed;						// the close completed
+	UCHAR		ChannelOpen;
+	UCHAR		DisconnectBegun;
+};
+
+
+struct EXPLORE
+{
+	int						Submitters;
+	int						Transfers;
+	bool					ConnectSuccess;
+	std::set<std::string>	Seen;
+	long					Steps;
+	long					Terminals;
+	int						Errors;
+	int						FirstError;		// line of the first failed invariant
+};
+
+#define MODEL_CHECK(cond)	((cond) ? (void)0 : (void)(ex->Errors++ == 0 ? ex->FirstError = __LINE__ : 0))
+
+
+static std::string ModelKey (const MODEL & m)
+{
+	return std::string ((const char*) &m, sizeof(m));
+}
+
+
+static void PerformAction (EXPLORE * ex, MODEL & m, CONN_ACTION action)
+{
+	if (action == ConnActionClose) {
+		MODEL_CHECK (m.ChannelOpen);
+		MODEL_CHECK (m.InFlight == 0);
+		MODEL_CHECK (m.Closes == 0 && m.Signals == 0);
+		m.Closes++;
+	}
+	else if (action == ConnActionSignal) {
+		MODEL_CHECK (!m.ChannelOpen);
+		MODEL_CHECK (m.InFlight == 0);
+		MODEL_CHECK (m.Closes == 0 && m.Signals == 0);
+		m.Signals++;
+	}
+}
+
+
+/*
+ Makes one step of the actor, choice selects the branch of a nondeterministic step.
+ Returns false if the actor (or the choice) is not enabled.
+*/
+static bool Step (EXPLORE * ex, MODEL & m, int actor, int choice)
+{
+	CONN_ACTION action;
+
+	if (actor == 0) {
+		// Connect completion
+		if (m.Connector || choice)
+			return false;
+		m.Connector = 1;
+		ConnStateConnectDone (&m.Word, ex->ConnectSuccess, &action);
+		m.ChannelOpen = ex->ConnectSuccess;
+		PerformAction (ex, m, action);
+		return true;
+	}
+
+	if (actor == 1) {
+		// Disconnect: begin, then release its reference
+		if (m.Disconnector == 2 || choice)
+			return false;
+		if (m.Disconnector == 0) {
+			if (ConnStateBeginDisconnect (&m.Word)) {
+				MODEL_CHECK (!m.DisconnectBegun);
+				m.DisconnectBegun = 1;
+				m.Disconnector	  = 1;
+			}
+			else
+				m.Disconnector = 2;
+		}
+		else {
+			m.Disconnector = 2;
+			PerformAction (ex, m, ConnStateRelease (&m.Word));
+		}
+		return true;
+	}
+
+	if (actor == 2) {
+		// CLOSE_CHANNEL completion
+		if (!m.Closes || m.Closed || choice)
+			return false;
+		m.Closed = 1;
+		MODEL_CHECK (ConnStateRefs (&m.Word) == 0);
+		ConnStateSet (&m.Word, ConnectionStateDisconnected);
+		return true;
+	}
+
+	int s = actor - 3;
+	switch (m.Sub[s])
+	{
+		case SubIdle:
+			if (choice)
+				return false;
+			m.Xfers[s]++;
+			if (ConnStateAcquire (&m.Word)) {
+				MODEL_CHECK (m.ChannelOpen && !m.DisconnectBegun && !m.Closes);
+				m.Sub[s] = SubAcquired;
+			}
+			else
+				m.Sub[s] = (m.Xfers[s] < ex->Transfers) ? SubIdle : SubDone;
+			return true;
+
+		case SubAcquired:
+			// Sent (choice 0): the channel handle must be still valid; or failed (choice 1): released now
+			if (choice == 0) {
+				MODEL_CHECK (m.ChannelOpen && !m.Closes);
+				m.InFlight++;
+				m.Sub[s] = SubInFlight;
+			}
+			else if (choice == 1) {
+				m.Sub[s] = (m.Xfers[s] < ex->Transfers) ? SubIdle : SubDone;
+				PerformAction (ex, m, ConnStateRelease (&m.Word));
+			}
+			else
+				return false;
+			return true;
+
+		case SubInFlight:
+			// The completion releases the reference
+			if (choice)
+				return false;
+			MODEL_CHECK (!m.Closes);
+			m.InFlight--;
+			m.Sub[s] = (m.Xfers[s] < ex->Transfers) ? SubIdle : SubDone;
+			PerformAction (ex, m, ConnStateRelease (&m.Word));
+			return true;
+	}
+
+	return false;
+}
+
+
+static void CheckTerminal (EXPLORE * ex, const MODEL & m)
+{
+	MODEL_CHECK (m.InFlight == 0);
+	MODEL_CHECK (ConnStateRefs ((CONN_STATE*) &m.Word) == 0);
+	MODEL_CHECK ((m.Word & (CONN_STATE_CLOSE | CONN_STATE_SIGNAL)) == 0);
+
+	if (m.DisconnectBegun) {
+		MODEL_CHECK (m.Closes + m.Signals == 1);
+		MODEL_CHECK (m.Closes == (ex->ConnectSuccess ? 1 : 0));
+		if (m.Closes)
+			MODEL_CHECK (ConnStateGet ((CONN_STATE*) &m.Word) == ConnectionStateDisconnected);
+	}
+	else
+		MODEL_CHECK (m.Closes == 0 && m.Signals == 0);
+}
+
+
+static void Explore (EXPLORE * ex, const MODEL & m)
+{
+	if (!ex->Seen.insert (ModelKey (m)).second)
+		return;
+
+	bool terminal = true;
+	for (int actor = 0; actor < 3 + ex->Submitters; actor++)
+		for (int choice = 0; choice < 2; choice++) {
+			MODEL next = m;
+			if (Step (ex, next, actor, choice)) {
+				terminal = false;
+				ex->Steps++;
+				Explore (ex, next);
+			}
+		}
+
+	if (terminal) {
+		ex->Terminals++;
+		CheckTerminal (ex, m);
+	}
+}
+
+
+static void TestExhaustive (int submitters, int transfers, bool success)
+{
+	EXPLORE	ex;
+	MODEL	m;
+
+	ex.Submitters		= submitters;
+	ex.Transfers		= transfers;
+	ex.ConnectSuccess	= success;
+	ex.Steps			= 0;
+	ex.Terminals		= 0;
+	ex.Errors			= 0;
+	ex.FirstError		= 0;
+
+	// The connection object sets Connecting before sending OPEN_CHANNEL
+	memset (&m, 0, sizeof(m));
+	ConnStateInit (&m.Word, ConnectionStateInitialized);
+	ConnStateSet (&m.Word, ConnectionStateConnecting);
+
+	Explore (&ex, m);
+
+	TestLog ("%d submitters x %d transfers, connect %s: %u states, %ld steps, %ld final states",
+			 submitters, transfers, success ? "succeeds" : "fails", unsigned(ex.Seen.size()), ex.Steps, ex.Terminals);
+	if (ex.Errors)
+		TestLog ("%d invariant violations, the first at line %d", ex.Errors, ex.FirstError);
+	TEST_CHECK (ex.Errors == 0);
+}
+
+
+
+struct STATE_RUN
+{
+	CONN_STATE			Word;
+	std::atomic<int>	InFlight;
+	std::atomic<int>	Closes;
+	std::atomic<int>	Signals;
+	std::atomic<int>	Disconnecting;		// set before BeginDisconnect is called
+	std::atomic<int>	Errors;
+	std::atomic<long>	Sent;
+};
+
+
+static void RunAction (STATE_RUN * run, CONN_ACTION action)
+{
+	if (action == ConnActionClose) {
+		if (run->InFlight != 0)
+			run->Errors++;
+		run->Closes++;
+	}
+	else if (action == ConnActionSignal)
+		run->Signals++;
+}
+
+
+static void RunSubmitter (STATE_RUN * run, unsigned seed)
+{
+	int late = 0;	// transfers acquired after the disconnect was about to start
+
+	while (true)
+	{
+		if (run->Disconnecting)
+			late++;
+		if (!ConnStateAcquire (&run->Word)) {
+			if (late || ConnStateGet (&run->Word) != ConnectionStateConnecting)
+				break;
+			continue;
+		}
+
+		// Only a few may slip in before BeginDisconnect, a broken Acquire would never stop
+		if (late > 1000) {
+			run->Errors++;
+			RunAction (run, ConnStateRelease (&run->Word));
+			break;
+		}
+
+		if (run->Closes)
+			run->Errors++;
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) & 7) {
+			run->InFlight++;
+			run->Sent++;
+			if ((seed >> 20) & 1)
+				std::this_thread::yield();
+			run->InFlight--;
+		}
+		RunAction (run, ConnStateRelease (&run->Word));
+	}
+}
+
+
+static void TestThreads (int submitters, int iterations)
+{
+	STATE_RUN *	run = new STATE_RUN;
+	long		sent = 0;
+	int			closes = 0, signals = 0;
+
+	for (int it = 0; it < iterations; it++)
+	{
+		std::vector<std::thread>	threads;
+		CONN_ACTION					action;
+		bool						success = (TestRand() & 3) != 0;
+
+		ConnStateInit (&run->Word, ConnectionStateInitialized);
+		ConnStateSet (&run->Word, ConnectionStateConnecting);
+		run->InFlight		= 0;
+		run->Closes			= 0;
+		run->Signals		= 0;
+		run->Disconnecting	= 0;
+		run->Errors			= 0;
+		run->Sent			= 0;
+
+		for (int t = 0; t < submitters; t++)
+			threads.push_back (std::thread (RunSubmitter, run, TestRand()));
+
+		// The disconnect starts before, during or after the connect completion
+		unsigned order = TestRand() % 3;
+		if (order != 0) {
+			ConnStateConnectDone (&run->Word, success, &action);
+			RunAction (run, action);
+		}
+		if (order == 2)
+			std::this_thread::yield();
+
+		run->Disconnecting = 1;
+		bool begun = ConnStateBeginDisconnect (&run->Word) != 0;
+		if (order == 0) {
+			ConnStateConnectDone (&run->Word, success, &action);
+			RunAction (run, action);
+		}
+		if (begun)
+			RunAction (run, ConnStateRelease (&run->Word));
+
+		for (int t = 0; t < submitters; t++)
+			threads[t].join();
+
+		if (run->Closes)
+			ConnStateSet (&run->Word, ConnectionStateDisconnected);
+
+		TEST_CHECK (run->Errors == 0);
+		TEST_CHECK (run->InFlight == 0 && ConnStateRefs (&run->Word) == 0);
+		TEST_CHECK (run->Closes + run->Signals == (begun ? 1 : 0));
+		TEST_CHECK (run->Closes == ((begun && success) ? 1 : 0));
+		if (run->Errors || run->Closes + run->Signals != (begun ? 1 : 0))
+			break;
+
+		sent	+= run->Sent;
+		closes	+= run->Closes;
+		signals += run->Signals;
+	}
+
+	TestLog ("%d submitter threads, %d connections: %ld transfers, %d closes, %d signals", submitters, iterations, sent, closes, signals);
+	delete run;
+}
+
+
+
+void TestConnState (int argc, char ** argv)
+{
+	int submitters = (argc > 0) ? atoi (argv[0]) : 3;
+	int transfers  = (argc > 1) ? atoi (argv[1]) : 2;
+	int iterations = (argc > 2) ? atoi (argv[2]) : 20000;
+
+	if (submitters < 1 || submitters > MAX_SUBMITTERS)
+		submitters = 3;
+
+	TestExhaustive (1, 1, true);
+	TestExhaustive (submitters, transfers, true);
+	TestExhaustive (submitters, transfers, false);
+
+	TestThreads (submitters, iterations);
+}
@@ -0,0 +1,146 @@
+/*******************************************************************\
+ Filename    :  DriftCompTest.cpp
+ Purpose     :  DriftComp simulation: SCO vs sound card clocks
+\*******************************************************************/
+
+/*
+ Simulates the WaveOut downlink of a long call: the SCO voice arrives in blocks clocked by the
+ Bluetooth controller, the speaker consumes it clocked by the sound card, the clocks differ by
+ the given ppm. As in WaveOut::RunBody, every block the queue fill is measured (with the playback
+ position granularity and the SCO arrival jitter), DriftEstimator updates the ratio and
+ FracResampler converts the block. The signal is a sine, so the resampler output is checked for
+ clicks as well. The checks:
+	- the speaker queue never underruns or overflows after the lock-in
+	- the estimated ratio converges to the real clocks ratio
+	- the filtered fill stays near the target
+	- no output discontinuities over the whole call
+ Default: one hour at -200, 0 and +200 ppm. Args: [seconds [ppm]].
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "HfpTest.h"
+#include "DriftComp.h"
+
+
+static const int	SampleRate	= 8000;
+static const int	BlockIn		= 1792;			// Samples per SCO read: (ChunkSize - DriftMargin)/2 in WaveOut
+static const int	BlockOut	= 2048;			// WAVEBLOCK capacity in samples
+static const int	QueueBlocks	= 8;			// WaveOutEndpoint::NumBlocks
+static const int	PosGranule	= 80;			// waveOutGetPosition granularity, 10 ms
+static const double	Jitter		= 0.010;		// SCO read completion jitter, sec
+static const double	Latency		= 0.150;		// The speaker starts playing after the first block is written
+static const double Amplitude	= 10000;
+static const double Freq		= 440;
+
+
+struct DRIFT_RESULT {
+	int		Underruns;
+	int		Overflows;
+	double	RatioPpm;		// Estimated at the end
+	double	ExpectedPpm;	// Real clocks ratio
+	double	FillError;		// Filtered fill - target at the end, samples
+	int		FillMin;		// After the lock-in
+	int		FillMax;
+	int		MaxStep;		// Max output sample to sample difference
+};
+
+
+static void Simulate (double seconds, double ppm, DRIFT_RESULT & r)
+{
+	const double rateSco  = SampleRate * (1 + ppm * 1e-6);	// SCO clock runs by ppm against the card
+	const double rateCard = SampleRate;
+	const int	 nblocks  = int(seconds * rateSco / BlockIn);
+
+	DriftEstimator	est;
+	FracResampler	rs;
+	short			in[BlockIn];
+	short			out[BlockOut];
+	double			written = 0, played = 0, tcard = 0;
+	double			phase = 0;
+	int				prev = 0;
+	bool			first = true;
+
+	est.Init (0, SampleRate);
+	r.Underruns = r.Overflows = r.MaxStep = 0;
+	r.FillMin	= 0x7FFFFFFF;
+	r.FillMax	= 0;
+
+	for (int b = 0; b < nblocks; b++) {
+		double t = (b + 1) * BlockIn / rateSco + Jitter * (double(TestRand()) / 0x1000000);
+
+		// SCO samples of the sine sampled by the SCO clock
+		for (int i = 0; i < BlockIn; i++) {
+			in[i]  = short(Amplitude * sin (phase));
+			phase += 2 * 3.14159265358979 * Freq / rateSco;
+		}
+
+		// Speaker position, stalls on underrun
+		if (first)
+			tcard = t + Latency;
+		else if (t > tcard) {
+			played += (t - tcard) * rateCard;
+			tcard	= t;
+			if (played > written) {
+				played = written;
+				if (est.GetStats().Updates > DriftEstimator::LockUpdates)
+					r.Underruns++;
+			}
+		}
+
+		int fill = int(written - floor (played / PosGranule) * PosGranule);
+		double ratio = first ? 1.0 : est.Update (fill);
+
+		int n = rs.Process (in, BlockIn, out, BlockOut, ratio);
+		for (int i = 0; i < n; i++) {
+			int step = abs (out[i] - prev);
+			if (!first || i)
+				r.MaxStep = step > r.MaxStep ? step : r.MaxStep;
+			prev = out[i];
+		}
+		written += n;
+		first	 = false;
+
+		if (written - played > QueueBlocks * BlockOut)
+			r.Overflows++;
+
+		if (est.GetStats().Updates > DriftEstimator::LockUpdates) {
+			if (fill < r.FillMin) r.FillMin = fill;
+			if (fill > r.FillMax) r.FillMax = fill;
+		}
+	}
+
+	const DriftEstimator::Stats & st = est.GetStats();
+	r.RatioPpm	  = st.RatioPpm;
+	r.ExpectedPpm = (rateCard / rateSco - 1) * 1e6;
+	r.FillError	  = st.FillFiltered - st.FillTarget;
+}
+
+
+void TestDriftComp (int argc, char ** argv)
+{
+	double seconds = argc > 0 ? atof (argv[0]) : 3600;
+	double ppms[]  = {-200, 0, 200};
+	int	   n	   = 3;
+
+	if (argc > 1) {
+		ppms[0] = atof (argv[1]);
+		n = 1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		DRIFT_RESULT r;
+		double t0 = TestTime();
+		Simulate (seconds, ppms[i], r);
+
+		TestLog ("%+.0f ppm, %.0f sec: ratio %+.1f ppm (real %+.1f), fill %d..%d, error %.0f, underruns %d, overflows %d, max step %d (%.2f sec)",
+				 ppms[i], seconds, r.RatioPpm, r.ExpectedPpm, r.FillMin, r.FillMax, r.FillError, r.Underruns, r.Overflows, r.MaxStep, TestTime() - t0);
+
+		TEST_CHECK (r.Underruns == 0);
+		TEST_CHECK (r.Overflows == 0);
+		TEST_CHECK (fabs (r.RatioPpm - r.ExpectedPpm) < 20);
+		TEST_CHECK (fabs (r.FillError) < BlockIn / 4);
+		TEST_CHECK (r.MaxStep < Amplitude * 2 * 3.15 * Freq / SampleRate + 100);
+	}
+}
@@ -0,0 +1,209 @@
+/*******************************************************************\
+ Filename    :  FixedContTest.cpp
+ Purpose     :  Fixed capacity containers and their times vs. the FIFOs
+\*******************************************************************/
+
+/*
+ Checks STATIC_VECTOR and RING_BUFFER (Utils/fixed_cont.h): the full and empty limits, Append
+ of contiguous elements, the free running indices over the wrap point, the spans and the
+ zero-copy access. Then the times vs. FIFO_ALLOC and FIFO_SIMPLE_ALLOC on the SM queue load:
+ a burst of events of the SMEVENT size is put, then the whole burst is taken out, the queue
+ fill wanders over the wrap point.
+ Utils depend on windows.h (def.h), so the test is built by HfpTest.vcxproj only.
+ Args: [iterations], default 1000000.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "HfpTest.h"
+
+
+#ifdef _WIN32
+
+#include "def.h"
+#include "fifo_cse.h"
+#include "fixed_cont.h"
+
+
+// An element of the SMEVENT size
+struct TEST_EV
+{
+	int		Ev, SmId;
+	int64	Param[3];
+};
+
+
+static inline double Elapsed (double start, int n)
+{
+	return (TestTime() - start) * 1e9 / n;		// ns per iteration
+}
+
+
+static void TestVector ()
+{
+	STATIC_VECTOR <int,8>	v;
+	int						i, sum;
+
+	TEST_CHECK (v.IsEmpty()  &&  !v.PopBack()  &&  v.GetMaxElements() == 8);
+	for (i = 0; i < 5; i++)
+		TEST_CHECK (v.PushBack (i));
+
+	// Contiguous elements: only when they fit
+	int * p = v.Append (3);
+	TEST_CHECK (p == &v[5]  &&  v.IsFull()  &&  !v.PushBack (8)  &&  v.Append (1) == 0);
+	p[0] = 5;  p[1] = 6;  p[2] = 7;
+
+	for (sum = 0, p = v.begin(); p != v.end(); p++)
+		sum += *p;
+	TEST_CHECK (sum == 28  &&  v.GetSpan().Count == 8);
+
+	// The last element takes the erased place
+	v.EraseUnordered (2);
+	TEST_CHECK (v.GetCount() == 7  &&  v[2] == 7);
+	TEST_CHECK (v.PopBack()  &&  v.GetCount() == 6);
+	v.Clear ();
+	TEST_CHECK (v.IsEmpty()  &&  v.Append (0) == v.begin());
+}
+
+
+static void TestRing ()
+{
+	RING_BUFFER_ALLOC <int,8>	r;
+	int							src[6] = { 8, 9, 10, 11, 12, 13 };
+	int							buf[8];
+	int							i, v, diff;
+
+	TEST_CHECK (r.IsEmpty()  &&  !r.GetFirst()  &&  !r.ReleaseFirst()  &&  r.GetSpan (SPAN<int> (buf, 8)) == 0);
+	for (i = 0; i < 8; i++)
+		TEST_CHECK (r.PutElement (i));
+	TEST_CHECK (r.IsFull()  &&  !r.PutElement (8)  &&  !r.FetchNext()  &&  r.GetCount() == 8);
+	for (i = 0; i < 5; i++)
+		TEST_CHECK (r.GetElement (v)  &&  v == i);
+	TEST_CHECK (r[0] == 5  &&  *r.GetFirst() == 5);
+
+	// Spans over the wrap point: only the free part is put
+	TEST_CHECK (r.PutSpan (SPAN<int> (src, 6)) == 5);
+	TEST_CHECK (r.GetSpan (SPAN<int> (buf, 8)) == 8);
+	for (diff = 0, i = 0; i < 8; i++)
+		diff += (buf[i] != i + 5);
+	TEST_CHECK (diff == 0  &&  r.IsEmpty());
+
+	// Zero-copy: the contiguous part only, up to the buffer end
+	SPAN<int> w = r.AcquireWrite ();
+	TEST_CHECK (w.Count == 3);
+	w[0] = 20;  w[1] = 21;  w[2] = 22;
+	r.CommitWrite (3);
+	w = r.AcquireWrite ();
+	TEST_CHECK (w.Count == 5);
+	w[0] = 23;
+	r.CommitWrite (1);
+
+	SPAN<int> rd = r.AcquireRead ();
+	TEST_CHECK (rd.Count == 3  &&  rd[0] == 20  &&  rd[2] == 22);
+	r.CommitRead (3);
+	rd = r.AcquireRead ();
+	TEST_CHECK (rd.Count == 1  &&  rd[0] == 23);
+	r.CommitRead (1);
+	TEST_CHECK (r.IsEmpty());
+}
+
+
+static void TestTimes (int iterations)
+{
+	enum { QueueSize = 16, Burst = 5 };
+
+	static FIFO_ALLOC <TEST_EV,QueueSize>		 fifo;
+	static RING_BUFFER_ALLOC <TEST_EV,QueueSize> ring;
+	TEST_EV		ev, burst[Burst];
+	int			i, j, sum;
+	double		start, t1, t2, t3;
+
+	memset (&ev, 0, sizeof(ev));
+	memset (burst, 0, sizeof(burst));
+
+	// Put/take by elements
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < Burst; j++) {
+			ev.Ev = j;
+			fifo.PutElement (ev);
+		}
+		while (TEST_EV* p = fifo.GetFirst()) {
+			sum += p->Ev;
+			fifo.ReleaseFirst();
+		}
+	}
+	t1 = Elapsed (start, iterations);
+
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < Burst; j++) {
+			ev.Ev = j;
+			ring.PutElement (ev);
+		}
+		while (TEST_EV* p = ring.GetFirst()) {
+			sum -= p->Ev;
+			ring.ReleaseFirst();
+		}
+	}
+	t2 = Elapsed (start, iterations);
+
+	// Put/take by spans
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < Burst; j++)
+			burst[j].Ev = j;
+		ring.PutSpan (SPAN<TEST_EV> (burst, Burst));
+		ring.GetSpan (SPAN<TEST_EV> (burst, Burst));
+		for (j = 0; j < Burst; j++)
+			sum += burst[j].Ev;
+	}
+	t3 = Elapsed (start, iterations);
+	TestLog ("queue %d events: FIFO_ALLOC %.1f ns, RING_BUFFER %.1f ns, spans %.1f ns", Burst, t1, t2, t3);
+	TEST_CHECK (sum == iterations * (Burst-1)*Burst/2);
+
+	// Contiguous blocks allocation
+	static FIFO_SIMPLE_ALLOC <TEST_EV,QueueSize>	simple;
+	static STATIC_VECTOR <TEST_EV,QueueSize>		vect;
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		sum += simple.FetchNext (Burst)->Ev;
+	t1 = Elapsed (start, iterations);
+
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		TEST_EV* p = vect.Append (Burst);
+		if (!p) {
+			vect.Clear();
+			p = vect.Append (Burst);
+		}
+		sum -= p->Ev;
+	}
+	t2 = Elapsed (start, iterations);
+	TestLog ("alloc %d elements: FIFO_SIMPLE_ALLOC %.1f ns, STATIC_VECTOR %.1f ns", Burst, t1, t2);
+	TEST_CHECK (sum == 0);
+}
+
+
+
+void TestFixedCont (int argc, char ** argv)
+{
+	int iterations = (argc > 0) ? atoi (argv[0]) : 1000000;
+
+	TestVector ();
+	TestRing ();
+	TestTimes (iterations);
+}
+
+
+#else
+
+void TestFixedCont (int argc, char ** argv)
+{
+	TestLog ("skipped: Utils need windows.h");
+}
+
+#endif
@@ -0,0 +1,224 @@
+/*******************************************************************\
+ Filename    :  FrameRingTest.cpp
+ Purpose     :  Continuous reader frame ring: model check and simulation
+\*******************************************************************/
+
+/*
+ Checks the continuous reader's frame ring (framering.c). Random pushes and drains are compared
+ with a straightforward model (a queue of frames which drops the oldest when full): the drained
+ bytes, the frame boundaries and the statistics must match. A drain smaller than the next frame
+ must take nothing and keep the frame (that's why contread.c fails such a Read).
+
+ Then a call is simulated: SCO IN frames arrive every 30 ms with jitter, a reader served by the
+ contread.c policy (a Read waits for the frames to fill it) reads chunks with random delays and
+ stalls. Checks: no overruns while the stalls fit into the ring, the overruns are counted exactly
+ otherwise, and the frames after an overrun are the freshest ones.
+ Args: [seconds], default 3600.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+#include "HfpTest.h"
+#include "framering.h"
+
+
+typedef std::vector<UCHAR> FRAME;
+
+
+static FRAME MakeFrame (unsigned seq, ULONG len)
+{
+	FRAME f (len);
+	for (ULONG i = 0; i < len; i++)
+		f[i] = UCHAR(seq * 7 + i);
+	return f;
+}
+
+
+static void TestModel (ULONG slotcount, ULONG framesize, int steps)
+{
+	std::vector<UCHAR>	mem (FrameRingMemSize (slotcount, framesize));
+	std::vector<UCHAR>	buf (3 * framesize + 1);
+	std::deque<FRAME>	model;
+	FRAME_RING			ring;
+	FRAME_RING_STATS	stat = { 0 };
+	int					errors = 0;
+	unsigned			seq = 0;
+
+	TEST_CHECK (mem.size() != 0);
+	FrameRingInit (&ring, &mem[0], slotcount, framesize);
+
+	for (int step = 0; step < steps; step++)
+	{
+		if (TestRand() % 3) {
+			ULONG len = TestRand() % (framesize + 20);		// some are truncated
+			FRAME f = MakeFrame (++seq, len);
+			int overrun = FrameRingPush (&ring, len ? &f[0] : 0, len);
+
+			if (len > framesize)
+				f.resize (framesize);
+			errors += (overrun != (model.size() == slotcount));
+			if (model.size() == slotcount) {
+				model.pop_front();
+				stat.Overruns++;
+			}
+			model.push_back (f);
+			stat.Frames++;
+			stat.Bytes += ULONG(f.size());
+			if (model.size() > stat.MaxFill)
+				stat.MaxFill = ULONG(model.size());
+		}
+		else {
+			ULONG buflen = TestRand() % buf.size(), frames, n = 0, nframes = 0;
+			ULONG got = FrameRingDrain (&ring, &buf[0], buflen, &frames);
+
+			// The model takes the whole frames which fit
+			while (!model.empty() && n + model.front().size() <= buflen) {
+				errors += (model.front().size() && memcmp (&buf[n], &model.front()[0], model.front().size()) != 0);
+				n += ULONG(model.front().size());
+				nframes++;
+				model.pop_front();
+			}
+			stat.Drained += nframes;
+			errors += (got != n || frames != nframes);
+		}
+
+		errors += (FrameRingCount(&ring) != model.size());
+	}
+
+	TestLog ("%u slots x %u bytes, %d steps: %u frames, %u overruns, %u drained, max fill %u",
+			 slotcount, framesize, steps, ring.Stat.Frames, ring.Stat.Overruns, ring.Stat.Drained, ring.Stat.MaxFill);
+	TEST_CHECK (errors == 0);
+	TEST_CHECK (ring.Stat.Frames == stat.Frames && ring.Stat.Bytes == stat.Bytes && ring.Stat.Overruns == stat.Overruns);
+	TEST_CHECK (ring.Stat.Drained == stat.Drained && ring.Stat.MaxFill == stat.MaxFill);
+	TEST_CHECK (stat.Overruns > 0);
+}
+
+
+static void TestSmallDrain ()
+{
+	UCHAR		mem[4 * sizeof(ULONG) + 4 * 480], buf[480];
+	FRAME_RING	ring;
+	FRAME		f = MakeFrame (1, 480);
+	ULONG		frames;
+
+	TEST_CHECK (FrameRingMemSize (4, 480) == sizeof(mem));
+	FrameRingInit (&ring, mem, 4, 480);
+	FrameRingPush (&ring, &f[0], 480);
+
+	TEST_CHECK (FrameRingDrain (&ring, buf, 479, &frames) == 0 && frames == 0);
+	TEST_CHECK (FrameRingCount (&ring) == 1);
+	TEST_CHECK (FrameRingDrain (&ring, buf, 480, &frames) == 480 && frames == 1);
+	TEST_CHECK (memcmp (buf, &f[0], 480) == 0);
+}
+
+
+
+/*
+ ************************************************************************************************
+ The call simulation, 1 ms steps
+ ************************************************************************************************
+ */
+struct SIM_RESULT
+{
+	ULONG		Overruns;		// Counted by the ring
+	ULONG		Lost;			// Sequence gaps seen by the reader
+	ULONG		Reads;
+	ULONG		MaxWait;		// ms, the longest Read wait
+	bool		Ordered;
+};
+
+
+// stall - the reader stops for stall ms every stallPeriod ms
+static SIM_RESULT Simulate (int seconds, ULONG slotcount, int stall, int stallPeriod)
+{
+	const ULONG			FrameSize = 480, FrameTime = 30, ReadSize = 4096;
+	std::vector<UCHAR>	mem (FrameRingMemSize (slotcount, FrameSize));
+	UCHAR				buf[ReadSize];
+	FRAME_RING			ring;
+	SIM_RESULT			res = { 0, 0, 0, 0, true };
+	unsigned			seq = 0, lastseq = 0;
+	int					nextFrame = FrameTime, readStart = -1, nextRead = 0, nextStall = stallPeriod;
+
+	FrameRingInit (&ring, &mem[0], slotcount, FrameSize);
+
+	for (int t = 0; t < seconds * 1000; t++)
+	{
+		// SCO IN completions with +-3 ms jitter, the frame carries its sequence number
+		if (t >= nextFrame) {
+			UCHAR frame[FrameSize];
+			memset (frame, 0, sizeof(frame));
+			++seq;
+			memcpy (frame, &seq, sizeof(seq));
+			FrameRingPush (&ring, frame, FrameSize);
+			nextFrame += FrameTime - 3 + TestRand() % 7;
+		}
+
+		// The reader: a Read is issued, it's completed when the ring fills it (contread.c)
+		if (t < nextRead)
+			continue;
+		if (readStart < 0)
+			readStart = t;
+
+		ULONG need = ReadSize / FrameSize;
+		if (need > slotcount)
+			need = slotcount;
+		if (FrameRingCount (&ring) < need)
+			continue;
+
+		ULONG frames, n = FrameRingDrain (&ring, buf, ReadSize, &frames);
+		for (ULONG i = 0; i < frames; i++) {
+			unsigned s;
+			memcpy (&s, buf + i * FrameSize, sizeof(s));
+			if (s <= lastseq)
+				res.Ordered = false;
+			else
+				res.Lost += s - lastseq - 1;
+			lastseq = s;
+		}
+		if (n != frames * FrameSize)
+			res.Ordered = false;
+
+		if (ULONG(t - readStart) > res.MaxWait)
+			res.MaxWait = t - readStart;
+		res.Reads++;
+		readStart = -1;
+
+		// Playback of the chunk, then the next Read; a stall sometimes
+		nextRead = t + TestRand() % 20;
+		if (stall  &&  nextRead >= nextStall) {
+			nextRead  += stall;
+			nextStall += stallPeriod;
+		}
+	}
+
+	// The frames left in the ring are not lost
+	res.Lost += seq - lastseq - FrameRingCount (&ring);
+	res.Overruns = ring.Stat.Overruns;
+	return res;
+}
+
+
+void TestFrameRing (int argc, char ** argv)
+{
+	int seconds = (argc > 0) ? atoi (argv[0]) : 3600;
+
+	TestModel (4, 60, 200000);
+	TestModel (64, 480, 200000);
+	TestSmallDrain ();
+
+	// ScoApp's reader: 64 frames of 30 ms, ~1.9 s
+	SIM_RESULT r = Simulate (seconds, 64, 0, 1);
+	TestLog ("%d sec, no stalls: %u reads, max wait %u ms, %u overruns, %u lost", seconds, r.Reads, r.MaxWait, r.Overruns, r.Lost);
+	TEST_CHECK (r.Ordered && r.Overruns == 0 && r.Lost == 0);
+
+	r = Simulate (seconds, 64, 1500, 60000);
+	TestLog ("%d sec, 1.5 s stall a minute: %u reads, %u overruns, %u lost", seconds, r.Reads, r.Overruns, r.Lost);
+	TEST_CHECK (r.Ordered && r.Overruns == 0 && r.Lost == 0);
+
+	r = Simulate (seconds, 64, 3000, 60000);
+	TestLog ("%d sec, 3 s stall a minute: %u reads, %u overruns, %u lost", seconds, r.Reads, r.Overruns, r.Lost);
+	TEST_CHECK (r.Ordered && r.Overruns > 0 && r.Lost == r.Overruns);
+}
@@ -0,0 +1,145 @@
+/*******************************************************************\
+ Filename    :  HfpTest.cpp
+ Purpose     :  Unit tests and offline simulations runner
+\*******************************************************************/
+
+/*
+ Runs the tests of the OS independent modules: the driver parts which don't depend on WDF/WDM
+ and the ScoApp voice processing.
+
+ Usage:
+	HfpTest					- runs all the tests with their default (synthetic) inputs
+	HfpTest <test> [args]	- runs one test, e.g. "HfpTest voiceproc far.wav mic.wav out.wav"
+ The exit code is the number of failed checks.
+
+ Besides HfpTest.vcxproj, the tests may be built by gcc, e.g. on Linux from this directory (the driver
+ modules are compiled as C, as the driver does; the Utils tests need windows.h and are skipped):
+	gcc -O2 -c ../HfpDriver/scobatch.c ../HfpDriver/xferpool.c ../HfpDriver/framering.c ../HfpDriver/connstate.c ../HfpDriver/scotable.c \
+		../HfpDriver/scostats.c
+	g++ -O2 -I../HfpDriver -I../ScoApp -I../DialApp *.cpp ../ScoApp/VoiceProc.cpp ../ScoApp/DriftComp.cpp ../ScoApp/ScoBatch.cpp ../ScoApp/AudioEndpoint.cpp \
+		*.o -lpthread -o hfptest
+*/
+
+#include <stdarg.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "HfpTest.h"
+
+
+struct TEST {
+	const char *	Name;
+	TestFunc		Func;
+	const char *	Descr;
+};
+
+static const TEST Tests[] = {
+	{ "voiceproc",	TestVoiceProc,	"VoiceProc AEC/NS/AGC: ERLE and CPU load on synthetic echo or [far.wav mic.wav [out.wav]]" },
+	{ "scobatch",	TestScoBatch,	"SCO batch: request layout, validation and the cancelable completion with threads [iterations]" },
+	{ "scoshm",		TestScoShm,		"SCO shared memory ring: driver and application threads, overruns, restarts and corruption [frames]" },
+	{ "xferpool",	TestXferPool,	"Transfer contexts pool: single thread semantics and the lock free Get/Put with threads [iterations]" },
+	{ "framering",	TestFrameRing,	"Continuous reader frame ring: model check and a call with reader stalls [seconds], default 1 hour" },
+	{ "connstate",	TestConnState,	"Connection state word: all the interleavings of connect, transfers and disconnect, then threads [submitters [transfers [iterations]]]" },
+	{ "scotable",	TestScoTable,	"SCO servers table: owners, connections and the register/unregister/cleanup locking with threads [iterations]" },
+	{ "scostats",	TestScoStats,	"SCO statistics: accounting and the lock free completions of both directions with threads [transfers]" },
+	{ "endpoint",	TestAudioEndpoint,	"Null and WAV file audio endpoints: silence, real time pacing and the WAV round trip [seconds of free-running audio]" },
+	{ "spscring",	TestSpscRing,	"SPSC_RING: limits, spans, zero-copy access and two threads, the times vs. FIFO_ALLOC [iterations] (Windows only)" },
+	{ "strscan",	TestStrScan,	"String scan kernels vs. the CRT, SeekInt and the int overflow; the times on AT responses [iterations] (Windows only)" },
+	{ "fixedcont",	TestFixedCont,	"STATIC_VECTOR and RING_BUFFER: limits, wrap, spans and zero-copy access, the times vs. the FIFOs [iterations] (Windows only)" },
+	{ "phonenumber",	TestPhoneNumber,	"PhoneNumber keys: the forms of one number, collisions, service codes; the times vs. strcmp [count] (Windows only)" },
+	{ "driftcomp",	TestDriftComp,	"DriftComp: SCO vs sound card clocks over a call [seconds [ppm]], default 1 hour at -200/0/+200 ppm" },
+};
+
+static int		Failures;
+static unsigned	RandState = 1;
+
+
+
+void TestFail (const char * cond, const char * file, int line)
+{
+	printf ("  FAILED: %s (%s:%d)\n", cond, file, line);
+	Failures++;
+}
+
+
+void TestLog (const char * format, ...)
+{
+	va_list args;
+	va_start (args, format);
+	printf ("  ");
+	vprintf (format, args);
+	printf ("\n");
+	va_end (args);
+}
+
+
+double TestTime ()
+{
+	#ifdef _WIN32
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency (&freq);
+	QueryPerformanceCounter (&cnt);
+	return double(cnt.QuadPart) / double(freq.QuadPart);
+	#else
+	timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+	#endif
+}
+
+
+unsigned TestRand ()
+{
+	RandState = RandState * 1103515245 + 12345;
+	return (RandState >> 8) & 0xFFFFFF;
+}
+
+
+void TestSeed (unsigned seed)
+{
+	RandState = seed;
+}
+
+
+static void Usage ()
+{
+	printf ("Usage: HfpTest [test [args]]\n");
+	for (int i = 0; i < int(sizeof(Tests)/sizeof(Tests[0])); i++)
+		printf ("  %-12s %s\n", Tests[i].Name, Tests[i].Descr);
+}
+
+
+int main (int argc, char ** argv)
+{
+	int n = int(sizeof(Tests)/sizeof(Tests[0]));
+	int run = 0;
+
+	for (int i = 0; i < n; i++) {
+		if (argc > 1 && strcmp (argv[1], Tests[i].Name) != 0)
+			continue;
+
+		int before = Failures;
+		printf ("%s:\n", Tests[i].Name);
+		TestSeed (1);
+		if (argc > 1)
+			Tests[i].Func (argc - 2, argv + 2);
+		else
+			Tests[i].Func (0, 0);
+		printf ("%s: %s\n", Tests[i].Name, (Failures == before) ? "OK" : "FAILED");
+		run++;
+	}
+
+	if (!run) {
+		Usage();
+		return -1;
+	}
+
+	if (argc <= 1)
+		printf ("%d tests, %d failed checks\n", run, Failures);
+	return Failures;
+}
@@ -0,0 +1,43 @@
+/*******************************************************************\
+ Filename    :  HfpTest.h
+ Purpose     :  Unit tests and offline simulations of the portable modules
+\*******************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+
+
+/*
+ ************************************************************************************************
+ Minimal test harness. A test is a function which checks its results by TEST_CHECK: a failed
+ check is printed and counted, the test goes on. The runner (HfpTest.cpp) returns the number of
+ failed checks as the process exit code.
+ ************************************************************************************************
+ */
+typedef void (*TestFunc) (int argc, char ** argv);	// argv - the test's own arguments (after its name)
+
+#define TEST_CHECK(cond)	((cond) ? (void)0 : TestFail (#cond, __FILE__, __LINE__))
+
+void		TestFail (const char * cond, const char * file, int line);
+void		TestLog	 (const char * format, ...);
+double		TestTime ();				// Monotonic time in seconds
+unsigned	TestRand ();				// Deterministic pseudo random numbers (LCG), the same sequence on all platforms
+void		TestSeed (unsigned seed);
+
+
+// Tests
+void TestVoiceProc (int argc, char ** argv);
+void TestDriftComp (int argc, char ** argv);
+void TestScoBatch  (int argc, char ** argv);
+void TestScoShm    (int argc, char ** argv);
+void TestXferPool  (int argc, char ** argv);
+void TestFrameRing (int argc, char ** argv);
+void TestConnState (int argc, char ** argv);
+void TestScoTable  (int argc, char ** argv);
+void TestScoStats  (int argc, char ** argv);
+void TestAudioEndpoint (int argc, char ** argv);
+void TestSpscRing  (int argc, char ** argv);
+void TestPhoneNumber (int argc, char ** argv);
+void TestStrScan   (int argc, char ** argv);
+void TestFixedCont (int argc, char ** argv);
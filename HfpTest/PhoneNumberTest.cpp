@@ -0,0 +1,138 @@
+/*******************************************************************\
+ Filename    :  PhoneNumberTest.cpp
+ Purpose     :  Phone number keys and their times vs. strcmp
+\*******************************************************************/
+
+/*
+ Checks PhoneNumber::Key (DialApp/PhoneNumber.h): the forms the AGs send of one number give one
+ key (international, national with the trunk prefix, with separators and the post-dial part),
+ the different numbers do not collide, the service codes are kept as dialed. Then the
+ normalization and the comparison times over a generated corpus: count subscriber numbers,
+ each in two random forms; the pairs are compared (as CallInfo::Compare does on each AT+CLCC
+ refresh) by strcmp of the raw strings and by the keys.
+ PhoneNumber.h depends on windows.h (def.h), so the test is built by HfpTest.vcxproj only.
+ Args: [count], default 100000.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "HfpTest.h"
+
+
+#ifdef _WIN32
+
+#include "def.h"
+#include "PhoneNumber.h"
+
+
+#define SAME(a,b)	(PhoneNumber::Key(a) == PhoneNumber::Key(b))
+
+
+static void TestKeys ()
+{
+	PhoneNumber::SetCountryCode ("972");
+	TEST_CHECK (SAME ("+972501234567", "0501234567"));
+	TEST_CHECK (SAME ("+972501234567", "050-123-4567"));
+	TEST_CHECK (SAME ("+972501234567", "00972 50 123 4567"));
+	TEST_CHECK (SAME ("+972501234567", "+972 (50) 123-4567,,123#"));
+	TEST_CHECK (PhoneNumber::Key ("0501234567") == 0xC000972501234567ULL  &&  PhoneNumber::KeyDigits (PhoneNumber::Key ("0501234567")) == 12);
+	TEST_CHECK (!SAME ("0501234567", "0521234567"));
+	TEST_CHECK (!SAME ("+972501234567", "+973501234567"));
+	TEST_CHECK (!SAME ("+972501234567", "+1501234567"));
+
+	// Local numbers and service codes are kept as dialed
+	TEST_CHECK (SAME ("1-800-555", "1800555")  &&  !SAME ("1800555", "01800555"));
+	TEST_CHECK (!SAME ("*100#", "100")  &&  !SAME ("*100#", "#100*"));
+	TEST_CHECK (PhoneNumber::Key ("*100#") == 0x50000000000A100BULL);
+
+	// NANP: 10 digits, the trunk and the international prefixes
+	PhoneNumber::SetCountryCode ("1");
+	TEST_CHECK (!SAME ("212-555-1234", "312-555-1234"));
+	TEST_CHECK (SAME ("212-555-1234", "+1 212 555 1234"));
+	TEST_CHECK (SAME ("212-555-1234", "1-212-555-1234"));
+	TEST_CHECK (SAME ("011 972 50 123 4567", "+972501234567"));
+
+	// 15 digits are kept, the longer numbers keep the last ones
+	TEST_CHECK (PhoneNumber::KeyDigits (PhoneNumber::Key ("+123456789012345")) == 15);
+	TEST_CHECK (!SAME ("+123456789012345", "+223456789012345"));
+	TEST_CHECK (SAME ("+99123456789012345", "+88123456789012345"));
+
+	// Hidden number, unknown country code: only the trunk prefix is dropped
+	TEST_CHECK (PhoneNumber::Key ("") == 0  &&  PhoneNumber::Key ("Unknown") == 0  &&  PhoneNumber::Key (0) == 0);
+	PhoneNumber::SetCountryCode ("9720");
+	TEST_CHECK (SAME ("0501234567", "501234567")  &&  !SAME ("0501234567", "+972501234567"));
+	PhoneNumber::SetCountryCode (0);
+	TEST_CHECK (SAME ("0501234567", "501234567"));
+}
+
+
+static void TestTimes (int count)
+{
+	const int Len = 24;
+	char*		numbers = new char   [count * 2 * Len];
+	uint64*		keys	= new uint64 [count * 2];
+	unsigned	sub		= 0;
+	int			i, same;
+	double		t;
+
+	PhoneNumber::SetCountryCode ("972");
+	for (i = 0; i < count * 2; i++)
+	{
+		if ((i & 1) == 0)
+			sub = 500000000 + TestRand() % 10000 * 10000 + TestRand() % 10000;	// a new subscriber for the pair
+		char* s = numbers + i * Len;
+
+		switch (TestRand() & 3) {
+			case 0:	 sprintf (s, "+972%u", sub);										break;
+			case 1:	 sprintf (s, "0%u", sub);											break;
+			case 2:	 sprintf (s, "00972 %u %04u", sub / 10000, sub % 10000);			break;
+			default: sprintf (s, "0%u-%03u-%04u", sub / 10000000, sub / 10000 % 1000, sub % 10000);	break;
+		}
+	}
+
+	t = TestTime();
+	for (i = 0; i < count * 2; i++)
+		keys[i] = PhoneNumber::Key (numbers + i * Len);
+	t = TestTime() - t;
+	TestLog ("PhoneNumber::Key: %d numbers, %.1f ns per number", count * 2, t * 1e9 / (count * 2));
+
+	same = 0;
+	t = TestTime();
+	for (i = 0; i < count; i++)
+		same += (strcmp (numbers + 2*i*Len, numbers + (2*i+1)*Len) == 0);
+	t = TestTime() - t;
+	TestLog ("strcmp: %d pairs, %.1f ns per pair, %d equal", count, t * 1e9 / count, same);
+
+	same = 0;
+	t = TestTime();
+	for (i = 0; i < count; i++)
+		same += (keys[2*i] == keys[2*i+1]);
+	t = TestTime() - t;
+	TestLog ("Key ==: %d pairs, %.1f ns per pair, %d equal", count, t * 1e9 / count, same);
+	TEST_CHECK (same == count);
+
+	delete[] keys;
+	delete[] numbers;
+}
+
+
+
+void TestPhoneNumber (int argc, char ** argv)
+{
+	int count = (argc > 0) ? atoi (argv[0]) : 100000;
+
+	TestKeys ();
+	TestTimes (count);
+}
+
+
+#else
+
+void TestPhoneNumber (int argc, char ** argv)
+{
+	TestLog ("skipped: Utils need windows.h");
+}
+
+#endif
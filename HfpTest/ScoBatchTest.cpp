@@ -0,0 +1,302 @@
+/*******************************************************************\
+ Filename    :  ScoBatchTest.cpp
+ Purpose     :  Batched SCO transfers: request layout and completion
+\*******************************************************************/
+
+/*
+ Checks IOCTL_HFP_SCO_BATCH end to end without the driver: ScoBatch (the application side) lays
+ out a request, the driver's portable part (scobatch.c) splits it in a copy of the buffer as
+ METHOD_BUFFERED does, the frames are completed, and the results are copied back and gathered.
+ The request validation is checked as well.
+
+ Then the completion protocol of the cancelable batch (queue.c) is run with real threads: the
+ frames complete concurrently, the submitter releases its reference in between, and a cancel may
+ come at any moment. The cancelable request state is modelled as in WDF: either the frames done
+ path makes the request not cancelable, or the cancel routine is called. The checks:
+	- the batch is completed exactly once, after all the frames are done
+	- the cancel routine doesn't access the frames after the batch completion
+	- after the cancel the rest of the frames is not sent
+ Args: [iterations], default 1000.
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "HfpTest.h"
+#include "ScoBatch.h"
+
+
+static const LONG StatusCancelled = LONG(0xC0000120);	// STATUS_CANCELLED
+static const LONG StatusFailed	  = LONG(0xC0000001);	// STATUS_UNSUCCESSFUL
+
+static UCHAR SysBuf[sizeof(HFP_SCO_BATCH_OUT) + ScoBatch::MaxSize];	// The system buffer of METHOD_BUFFERED
+
+
+
+static void TestLayoutRead ()
+{
+	ScoBatch	app;
+	SCO_BATCH	batch;
+	UCHAR		expect[1000], data[1000];
+	ULONG		outlen, inlen, n = 0, i;
+	LONG		status;
+
+	// 480 + 480 + 40 bytes, the second frame is short
+	inlen = app.PrepareRead (sizeof(data), &outlen);
+	TEST_CHECK (inlen == sizeof(HFP_SCO_BATCH_IN) && outlen == sizeof(HFP_SCO_BATCH_OUT) + sizeof(data));
+
+	memcpy (SysBuf, app.GetBuffer(), inlen);
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, inlen, outlen) == SCO_BATCH_OK);
+	TEST_CHECK (batch.FrameCount == 3 && batch.Size[0] == 480 && batch.Size[1] == 480 && batch.Size[2] == 40);
+
+	for (i = 0; i < batch.FrameCount; i++) {
+		ULONG len = (i == 1) ? 300 : batch.Size[i];
+		for (ULONG k = 0; k < len; k++)
+			expect[n++] = SysBuf[batch.Offset[i] + k] = UCHAR(TestRand());
+		TEST_CHECK (ScoBatchFrameDone (&batch, i, 0, len) > 0);
+	}
+	TEST_CHECK (ScoBatchFrameDone (&batch, SCO_BATCH_NO_FRAME, 0, 0) == 0);
+
+	size_t info = ScoBatchComplete (&batch, &status);
+	TEST_CHECK (status == 0 && info == outlen);
+	memcpy (app.GetBuffer(), SysBuf, info);
+
+	TEST_CHECK (app.Transferred() == n && app.FailedFrames() == 0);
+	TEST_CHECK (app.GatherRead (data, sizeof(data)) == n);
+	TEST_CHECK (memcmp (data, expect, n) == 0);
+}
+
+
+static void TestLayoutWrite ()
+{
+	ScoBatch	app;
+	SCO_BATCH	batch;
+	UCHAR		data[1500];
+	ULONG		outlen, inlen, i;
+	LONG		status;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = UCHAR(TestRand());
+
+	// 3 x 480 + 60 bytes
+	inlen = app.PrepareWrite (data, sizeof(data), &outlen);
+	TEST_CHECK (inlen == sizeof(HFP_SCO_BATCH_IN) + sizeof(data) && outlen == sizeof(HFP_SCO_BATCH_OUT));
+
+	memcpy (SysBuf, app.GetBuffer(), inlen);
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, inlen, outlen) == SCO_BATCH_OK);
+	TEST_CHECK (batch.FrameCount == 4 && batch.Size[3] == 60);
+
+	for (i = 0; i < batch.FrameCount; i++) {
+		TEST_CHECK (memcmp (SysBuf + batch.Offset[i], data + i * ScoBatch::FrameSize, batch.Size[i]) == 0);
+		ScoBatchFrameDone (&batch, i, (i == 2) ? StatusFailed : 0, (i == 2) ? 0 : batch.Size[i]);
+	}
+	TEST_CHECK (ScoBatchFrameDone (&batch, SCO_BATCH_NO_FRAME, 0, 0) == 0);
+
+	size_t info = ScoBatchComplete (&batch, &status);
+	TEST_CHECK (status == 0 && info == outlen);
+	memcpy (app.GetBuffer(), SysBuf, info);
+	TEST_CHECK (app.Transferred() == sizeof(data) - 480 && app.FailedFrames() == 1);
+}
+
+
+static void TestValidation ()
+{
+	ScoBatch			app;
+	SCO_BATCH			batch;
+	HFP_SCO_BATCH_IN	in;
+	ULONG				outlen, i;
+	LONG				status;
+
+	TEST_CHECK (app.PrepareRead (0, &outlen) == 0);
+	TEST_CHECK (app.PrepareRead (ScoBatch::MaxSize + 1, &outlen) == 0);
+	TEST_CHECK (app.PrepareWrite (SysBuf, ScoBatch::MaxSize + 1, &outlen) == 0);
+
+	memset (&in, 0, sizeof(in));
+	in.Direction  = HFP_SCO_BATCH_READ;
+	in.FrameCount = 2;
+	in.FrameSize[0] = in.FrameSize[1] = 100;
+	memcpy (SysBuf, &in, sizeof(in));
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in), sizeof(HFP_SCO_BATCH_OUT) + 200) == SCO_BATCH_OK);
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in), sizeof(HFP_SCO_BATCH_OUT) + 199) == SCO_BATCH_E_BUFFER_SMALL);
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in) - 1, sizeof(HFP_SCO_BATCH_OUT) + 200) == SCO_BATCH_E_BUFFER_SMALL);
+
+	// Write frames must be in the input
+	((HFP_SCO_BATCH_IN*)SysBuf)->Direction = HFP_SCO_BATCH_WRITE;
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in) + 199, sizeof(HFP_SCO_BATCH_OUT)) == SCO_BATCH_E_BUFFER_SMALL);
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in) + 200, sizeof(HFP_SCO_BATCH_OUT)) == SCO_BATCH_OK);
+
+	((HFP_SCO_BATCH_IN*)SysBuf)->Direction = 2;
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in) + 200, sizeof(HFP_SCO_BATCH_OUT)) == SCO_BATCH_E_INVALID);
+
+	((HFP_SCO_BATCH_IN*)SysBuf)->Direction  = HFP_SCO_BATCH_WRITE;
+	((HFP_SCO_BATCH_IN*)SysBuf)->FrameCount = HFP_SCO_BATCH_MAX_FRAMES + 1;
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(SysBuf), sizeof(SysBuf)) == SCO_BATCH_E_INVALID);
+
+	((HFP_SCO_BATCH_IN*)SysBuf)->FrameCount   = 2;
+	((HFP_SCO_BATCH_IN*)SysBuf)->FrameSize[1] = 0;
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(SysBuf), sizeof(SysBuf)) == SCO_BATCH_E_INVALID);
+
+	// All frames failed: the batch fails with the first frame status
+	in.FrameCount = 3;
+	in.FrameSize[2] = 100;
+	memcpy (SysBuf, &in, sizeof(in));
+	TEST_CHECK (ScoBatchSplit (&batch, SysBuf, sizeof(in), sizeof(SysBuf)) == SCO_BATCH_OK);
+	for (i = 0; i < 3; i++)
+		ScoBatchFrameDone (&batch, i, (i == 0) ? StatusCancelled : StatusFailed, 0);
+	TEST_CHECK (ScoBatchFrameDone (&batch, SCO_BATCH_NO_FRAME, 0, 0) == 0);
+	ScoBatchComplete (&batch, &status);
+	TEST_CHECK (status == StatusCancelled);
+}
+
+
+
+/*
+ The cancelable batch completion, as in queue.c
+*/
+enum { CANCELABLE, UNMARKED, CANCELLED };	// The request state
+
+struct BATCH_RUN
+{
+	SCO_BATCH			Batch;
+	std::atomic<int>	Request;		// CANCELABLE/UNMARKED/CANCELLED
+	std::atomic<int>	Completed;		// Number of completions
+	std::atomic<int>	InCancel;		// The cancel routine accesses the frames
+	std::atomic<int>	Errors;
+	std::atomic<int>	Sent;			// Frames sent
+};
+
+
+static void Spin (unsigned n)
+{
+	for (volatile unsigned i = 0; i < n; i++)
+		;
+}
+
+
+// HfpScoBatchFinish
+static void RunFinish (BATCH_RUN * run)
+{
+	if (run->Batch.Pending != 0 || run->InCancel)
+		run->Errors++;
+	run->Completed++;
+}
+
+
+// HfpScoBatchFramesDone: WdfRequestUnmarkCancelable
+static void RunFramesDone (BATCH_RUN * run)
+{
+	int state = CANCELABLE;
+	if (!run->Request.compare_exchange_strong (state, UNMARKED)  &&  ScoBatchCompleterDone (&run->Batch) != 0)
+		return;
+	RunFinish (run);
+}
+
+
+// HfpScoBatchFrameCompletion
+static void RunFrame (BATCH_RUN * run, ULONG idx, unsigned delay)
+{
+	Spin (delay);
+	if (run->Completed)
+		run->Errors++;
+	if (ScoBatchFrameDone (&run->Batch, idx, run->Batch.Cancelled ? StatusCancelled : 0, run->Batch.Size[idx]) == 0)
+		RunFramesDone (run);
+}
+
+
+// The I/O manager cancel and HfpScoBatchCancel
+static void RunCancel (BATCH_RUN * run, unsigned delay)
+{
+	Spin (delay);
+
+	int state = CANCELABLE;
+	if (!run->Request.compare_exchange_strong (state, CANCELLED))
+		return;
+
+	run->InCancel = 1;
+	run->Batch.Cancelled = 1;
+	if (run->Completed)
+		run->Errors++;
+	run->InCancel = 0;
+
+	if (ScoBatchCompleterDone (&run->Batch) == 0)
+		RunFinish (run);
+}
+
+
+static void TestCompletion (int iterations)
+{
+	HFP_SCO_BATCH_IN	in;
+	int					errors = 0, completions = 0, cancelled = 0, notsent = 0;
+
+	for (int it = 0; it < iterations; it++) {
+		BATCH_RUN					run;
+		std::vector<std::thread>	threads;
+		ULONG						frames = 1 + TestRand() % HFP_SCO_BATCH_MAX_FRAMES;
+		bool						cancel = (TestRand() & 1) != 0;
+		unsigned					delays[HFP_SCO_BATCH_MAX_FRAMES + 2];
+
+		for (ULONG i = 0; i < frames + 2; i++)
+			delays[i] = TestRand() % 20000;
+
+		memset (&in, 0, sizeof(in));
+		in.Direction  = HFP_SCO_BATCH_READ;
+		in.FrameCount = frames;
+		for (ULONG i = 0; i < frames; i++)
+			in.FrameSize[i] = 60;
+		memcpy (SysBuf, &in, sizeof(in));
+
+		TEST_CHECK (ScoBatchSplit (&run.Batch, SysBuf, sizeof(in), sizeof(SysBuf)) == SCO_BATCH_OK);
+		run.Request	  = CANCELABLE;
+		run.Completed = 0;
+		run.InCancel  = 0;
+		run.Errors	  = 0;
+		run.Sent	  = 0;
+
+		if (cancel)
+			threads.push_back (std::thread (RunCancel, &run, delays[frames]));
+
+		// HfpScoBatchSubmit: after the cancel the rest of frames is not sent
+		for (ULONG i = 0; i < frames; i++) {
+			if (run.Batch.Cancelled) {
+				ScoBatchFrameDone (&run.Batch, i, StatusCancelled, 0);
+				continue;
+			}
+			run.Sent++;
+			threads.push_back (std::thread (RunFrame, &run, i, delays[i]));
+			Spin (delays[frames + 1] / 8);
+		}
+		if (ScoBatchFrameDone (&run.Batch, SCO_BATCH_NO_FRAME, 0, 0) == 0)
+			RunFramesDone (&run);
+
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+
+		errors		+= run.Errors;
+		completions += (run.Completed == 1);
+		cancelled	+= (run.Request == CANCELLED);
+		notsent		+= frames - run.Sent;
+	}
+
+	TestLog ("%d batches: %d completed once, %d cancelled, %d frames not sent after the cancel", iterations, completions, cancelled, notsent);
+	TEST_CHECK (completions == iterations);
+	TEST_CHECK (errors == 0);
+	TEST_CHECK (cancelled > 0);
+}
+
+
+
+void TestScoBatch (int argc, char ** argv)
+{
+	int iterations = (argc > 0) ? atoi (argv[0]) : 1000;
+
+	TestLayoutRead ();
+	TestLayoutWrite ();
+	TestValidation ();
+	TestCompletion (iterations);
+}
@@ -0,0 +1,502 @@
+/*******************************************************************\
+ Filename    :  ScoShmTest.cpp
+ Purpose     :  Shared memory SCO ring: stress test with threads
+\*******************************************************************/
+
+/*
+ Runs the shared memory ring (scoshm.h) with real threads on both sides. The driver side is a
+ user mode model of the shmring.c transfers engine: SHM_RING_DEPTH transfers per direction are
+ kept posted on the ring slots (or on the scratch/silence buffer), the SCO channel completes them
+ in order and they are reposted from the completion, under the ring lock. The application side
+ reads Rx and writes Tx as ScoRing does, each direction in its own thread, with random pauses
+ so the rings overrun and underrun.
+
+ The checks:
+	- Rx frames come in order, the lost frames are exactly the RxOverruns
+	- Tx frames are sent in order, all the frames written by the application are sent
+	- RxFrames/TxFrames/TxUnderruns match the completions
+	- the stop (no reposts, cancelled transfers) drains the transfers, and the streaming is
+	  restarted on the same memory
+ Then the application side is replaced by a thread scribbling the shared indices, slot lengths
+ and the header: the driver must keep the slots inside the memory and the lengths clamped.
+ Args: [frames per cycle], default 20000.
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <chrono>
+
+#include "HfpTest.h"
+#include "scoshm.h"
+
+
+#define SHM_RING_DEPTH		2		// As in shmring.h
+
+enum { DIR_IN, DIR_OUT };
+
+
+struct SHM_XFER
+{
+	int				Direction;
+	SCO_SHM_SLOT *	Slot;
+	UCHAR *			Buffer;
+	ULONG			Length;
+	bool			Posted;
+};
+
+
+struct SHM_RUN
+{
+	// The driver ring (HFP_SHM_RING)
+	std::mutex			Lock;
+	SCO_SHM_VIEW		View;
+	UCHAR *				Memory;
+	ULONG				RxHead, RxAhead, TxTail, TxAhead;
+	UCHAR				Scratch[SCO_SHM_MAX_SLOT_SIZE];
+	UCHAR				Silence[SCO_SHM_MAX_SLOT_SIZE];
+	std::atomic<bool>	Stopping;
+	int					Active;
+	SHM_XFER			Xfer[2*SHM_RING_DEPTH];
+	std::deque<int>		Channel[2];			// Posted transfers of the direction, in the completion order
+
+	// The test
+	bool				Corrupt;			// The application side scribbles the shared memory
+	std::atomic<int>	Errors;
+	std::atomic<int>	DriverDone;			// The driver threads are finished
+	std::atomic<int>	AppTxDone;
+	std::atomic<int>	Cancelled;			// Transfers failed by the stop
+	unsigned			RxSeq;				// The last Rx frame generated by the channel
+	unsigned			RxFrames;			// Frames to generate before the stop
+	unsigned			TxSent;				// Tx frames received by the channel from the slots
+	unsigned			TxLast;
+	unsigned			AppRx, AppRxLast, AppRxGaps;
+	unsigned			AppTx, AppTxDrops;
+	unsigned			Overruns, Underruns, Drops;		// Totals of the cycles
+};
+
+
+#define RUN_CHECK(run, cond)	((cond) ? (void)0 : (void)(run)->Errors++)
+
+
+static void Spin (unsigned n)
+{
+	for (volatile unsigned i = 0; i < n; i++)
+		;
+}
+
+
+// Thread safe pseudo random numbers: TestRand is for the main thread only
+static unsigned ThreadRand (unsigned * state)
+{
+	*state = *state * 1103515245 + 12345;
+	return (*state >> 8) & 0xFFFFFF;
+}
+
+
+static void FrameWrite (UCHAR * data, unsigned seq, ULONG length)
+{
+	memcpy (data, &seq, 4);
+	memcpy (data + 4, &length, 4);
+	for (ULONG i = 8; i < length; i++)
+		data[i] = UCHAR(seq + i);
+}
+
+
+static bool FrameCheck (const UCHAR * data, ULONG length, unsigned * seq)
+{
+	ULONG len;
+	memcpy (seq, data, 4);
+	memcpy (&len, data + 4, 4);
+	if (len != length)
+		return false;
+	for (ULONG i = 8; i < length; i++)
+		if (data[i] != UCHAR(*seq + i))
+			return false;
+	return true;
+}
+
+
+static bool SlotInside (SHM_RUN * run, SCO_SHM_SLOT * slot)
+{
+	UCHAR * p = (UCHAR*) slot;
+	return p >= run->Memory + run->View.RxOffset  &&  p + run->View.SlotStride <= run->Memory + run->View.Size  &&
+		   (p - run->Memory - run->View.RxOffset) % run->View.SlotStride == 0;
+}
+
+
+
+/*
+ ************************************************************************************************
+ The driver model, as in shmring.c
+ ************************************************************************************************
+ */
+
+// HfpShmRingRelease, under the lock
+static void ShmRelease (SHM_RUN * run)
+{
+	run->Active--;
+}
+
+
+// HfpShmRingDone
+static bool ShmDone (SHM_RUN * run, SHM_XFER * xfer, bool ok, ULONG transferred)
+{
+	std::lock_guard<std::mutex> lock (run->Lock);
+	SCO_SHM_HEADER * hdr = run->View.Header;
+
+	if (xfer->Direction == DIR_IN) {
+		if (xfer->Slot) {
+			RUN_CHECK (run, xfer->Slot == ScoShmSlot(&run->View, run->View.RxOffset, run->RxHead));
+			xfer->Slot->Length = ok ? transferred : 0;
+			ScoShmProduce (&hdr->Rx, &run->RxHead, 1);
+			run->RxAhead--;
+		}
+		else if (ok)
+			hdr->RxOverruns++;
+		if (ok)
+			hdr->RxFrames++;
+	}
+	else {
+		if (xfer->Slot) {
+			ScoShmConsume (&hdr->Tx, &run->TxTail, 1);
+			run->TxAhead--;
+		}
+		else if (ok)
+			hdr->TxUnderruns++;
+		if (ok)
+			hdr->TxFrames++;
+	}
+
+	xfer->Slot	 = 0;
+	xfer->Posted = false;
+
+	bool repost = ok && !run->Stopping;
+	if (!repost)
+		ShmRelease (run);
+	return repost;
+}
+
+
+// HfpShmRingPost: the transfer is queued to the channel
+static void ShmPost (SHM_RUN * run, int idx)
+{
+	SHM_XFER * xfer = &run->Xfer[idx];
+	std::lock_guard<std::mutex> lock (run->Lock);
+
+	if (run->Stopping) {
+		ShmRelease (run);
+		return;
+	}
+
+	xfer->Length = run->View.SlotSize;
+	if (xfer->Direction == DIR_IN) {
+		xfer->Slot = ScoShmProduceSlot (&run->View, &run->View.Header->Rx, run->View.RxOffset, run->RxHead, run->RxAhead);
+		if (xfer->Slot) {
+			run->RxAhead++;
+			xfer->Buffer = ScoShmSlotData (xfer->Slot);
+		}
+		else
+			xfer->Buffer = run->Scratch;
+	}
+	else {
+		ULONG n = 0;
+		xfer->Slot = ScoShmConsumeSlot (&run->View, &run->View.Header->Tx, run->View.TxOffset, run->TxTail, run->TxAhead, &n);
+		if (xfer->Slot) {
+			run->TxAhead++;
+			if (n)
+				xfer->Length = n;
+			xfer->Buffer = n ? ScoShmSlotData(xfer->Slot) : run->Silence;
+		}
+		else
+			xfer->Buffer = run->Silence;
+	}
+
+	if (xfer->Slot) {
+		RUN_CHECK (run, SlotInside (run, xfer->Slot));
+		RUN_CHECK (run, xfer->Length <= run->View.SlotSize);
+	}
+	RUN_CHECK (run, run->RxAhead <= SHM_RING_DEPTH && run->TxAhead <= SHM_RING_DEPTH);
+
+	xfer->Posted = true;
+	run->Channel[xfer->Direction].push_back (idx);
+}
+
+
+// The SCO channel of one direction: completes the transfers in order, HfpShmRingCompletion reposts them
+static void ShmChannel (SHM_RUN * run, int dir, unsigned seed)
+{
+	for (;;)
+	{
+		int idx;
+		{
+			std::lock_guard<std::mutex> lock (run->Lock);
+			if (run->Channel[dir].empty())
+				break;
+			idx = run->Channel[dir].front();
+			run->Channel[dir].pop_front();
+		}
+
+		SHM_XFER *	xfer = &run->Xfer[idx];
+		bool		ok	 = true;
+		ULONG		transferred = 0;
+
+		// The SCO link clock: the other threads run meanwhile. The Tx link pauses sometimes, so the writer drops.
+		Spin (ThreadRand(&seed) % 2000);
+		if (dir == DIR_OUT  &&  (ThreadRand(&seed) & 0xFF) == 0)
+			std::this_thread::sleep_for (std::chrono::microseconds (ThreadRand(&seed) % 2000));
+		else
+			std::this_thread::yield();
+
+		// The stop cancels some of the posted transfers
+		if (run->Stopping  &&  (ThreadRand(&seed) & 1)) {
+			ok = false;
+			run->Cancelled++;
+		}
+		else if (dir == DIR_IN) {
+			transferred = 8 + ThreadRand(&seed) % (run->View.SlotSize - 7);
+			FrameWrite (xfer->Buffer, ++run->RxSeq, transferred);
+			if (run->RxSeq == run->RxFrames)
+				run->DriverDone = 1;		// asks for the stop
+		}
+		else if (xfer->Buffer != run->Silence) {
+			unsigned seq = 0;
+			transferred = xfer->Length;
+			if (!run->Corrupt) {
+				RUN_CHECK (run, FrameCheck (xfer->Buffer, xfer->Length, &seq));
+				RUN_CHECK (run, seq == run->TxLast + 1);	// the application drops, the driver doesn't
+				run->TxLast = seq;
+			}
+			run->TxSent++;
+		}
+		else
+			transferred = xfer->Length;
+
+		if (ShmDone (run, xfer, ok, transferred))
+			ShmPost (run, idx);
+	}
+}
+
+
+
+/*
+ ************************************************************************************************
+ The application side, as in ScoRing
+ ************************************************************************************************
+ */
+
+static void AppRx (SHM_RUN * run, unsigned seed)
+{
+	SCO_SHM_VIEW	view = {};
+	ULONG			tail = 0;
+
+	RUN_CHECK (run, ScoShmAttach (&view, run->Memory, run->View.Size));
+
+	for (;;)
+	{
+		ULONG length;
+		SCO_SHM_SLOT * slot = ScoShmConsumeSlot (&view, &view.Header->Rx, view.RxOffset, tail, 0, &length);
+		if (!slot) {
+			if (run->DriverDone == 2)
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+
+		// A cancelled transfer publishes an empty slot
+		if (length) {
+			unsigned seq = 0;
+			RUN_CHECK (run, FrameCheck (ScoShmSlotData(slot), length, &seq));
+			RUN_CHECK (run, seq > run->AppRxLast);
+			run->AppRxGaps += seq - run->AppRxLast - 1;
+			run->AppRxLast	= seq;
+			run->AppRx++;
+		}
+		ScoShmConsume (&view.Header->Rx, &tail, 1);
+
+		// Pauses of the reader overrun the ring
+		if ((ThreadRand(&seed) & 0xFF) == 0)
+			std::this_thread::sleep_for (std::chrono::microseconds (ThreadRand(&seed) % 2000));
+	}
+}
+
+
+static void AppTx (SHM_RUN * run, unsigned seed, unsigned frames)
+{
+	SCO_SHM_VIEW	view = {};
+	ULONG			head = 0;
+
+	RUN_CHECK (run, ScoShmAttach (&view, run->Memory, run->View.Size));
+
+	while (run->AppTx < frames)
+	{
+		SCO_SHM_SLOT * slot = ScoShmProduceSlot (&view, &view.Header->Tx, view.TxOffset, head, 0);
+		if (slot) {
+			ULONG length = 8 + ThreadRand(&seed) % (view.SlotSize - 7);
+			FrameWrite (ScoShmSlotData(slot), run->AppTx + 1 - run->AppTxDrops, length);
+			slot->Length = length;
+			ScoShmProduce (&view.Header->Tx, &head, 1);
+		}
+		else
+			run->AppTxDrops++;		// full: the frame is dropped, as ScoRing::Write does
+		run->AppTx++;
+
+		// Pauses of the writer underrun the ring
+		if ((ThreadRand(&seed) & 0xFF) == 0)
+			std::this_thread::sleep_for (std::chrono::microseconds (ThreadRand(&seed) % 2000));
+		else {
+			Spin (ThreadRand(&seed) % 3000);
+			std::this_thread::yield();
+		}
+	}
+	run->AppTxDone = 1;
+}
+
+
+// The application which corrupts the shared memory
+static void AppCorrupt (SHM_RUN * run, unsigned seed)
+{
+	SCO_SHM_HEADER * hdr = run->View.Header;
+
+	while (run->DriverDone != 2)
+	{
+		unsigned r = ThreadRand(&seed);
+		switch (r % 6) {
+		case 0: hdr->Rx.Tail = (r & 0x100) ? ThreadRand(&seed) << 8 : run->RxHead - r % 16;	break;	// anything or near the driver's index
+		case 1: hdr->Tx.Head = (r & 0x100) ? ThreadRand(&seed) << 8 : run->TxTail + r % 16;	break;
+		case 2: hdr->Tx.Head += r % 4;									break;
+		case 3: ScoShmSlot(&run->View, run->View.TxOffset, r)->Length = ThreadRand(&seed) << 8;	break;
+		case 4: hdr->SlotCount = hdr->SlotStride = hdr->TxOffset = ThreadRand(&seed);			break;
+		case 5: hdr->Rx.Head = hdr->Tx.Tail = ThreadRand(&seed);		break;	// the driver's indices
+		}
+		Spin (ThreadRand(&seed) % 500);
+	}
+}
+
+
+
+/*
+ ************************************************************************************************
+ One streaming cycle: HfpShmRingStart, streaming, HfpShmRingUnlink
+ ************************************************************************************************
+ */
+static void RunCycle (SHM_RUN * run, unsigned frames)
+{
+	std::thread	app[2], channel[2];
+	int			i;
+
+	// HfpShmRingStart: the same memory, zeroed and initialized again
+	memset (run->Memory, 0, run->View.Size);
+	ScoShmInit (&run->View, run->Memory);
+	run->RxHead = run->RxAhead = run->TxTail = run->TxAhead = 0;
+	run->Stopping = false;
+	run->Active	  = 2*SHM_RING_DEPTH;
+	for (i = 0; i < 2*SHM_RING_DEPTH; i++) {
+		run->Xfer[i].Direction = (i < SHM_RING_DEPTH) ? DIR_IN : DIR_OUT;
+		ShmPost (run, i);
+	}
+
+	run->DriverDone = run->AppTxDone = run->Cancelled = 0;
+	run->RxSeq = run->TxSent = run->TxLast = 0;
+	run->RxFrames = frames;
+	run->AppRx = run->AppRxLast = run->AppRxGaps = run->AppTx = run->AppTxDrops = 0;
+
+	if (run->Corrupt)
+		app[0] = std::thread (AppCorrupt, run, TestRand());
+	else {
+		app[0] = std::thread (AppRx, run, TestRand());
+		app[1] = std::thread (AppTx, run, TestRand(), frames);
+	}
+	channel[DIR_IN]  = std::thread (ShmChannel, run, int(DIR_IN),  TestRand());
+	channel[DIR_OUT] = std::thread (ShmChannel, run, int(DIR_OUT), TestRand());
+
+	// The stop comes when the Rx frames are generated and the Tx frames are sent, a lost Tx slot never drains
+	double deadline = TestTime() + 10 + frames / 1000;
+	for (;;) {
+		bool drained;
+		{
+			std::lock_guard<std::mutex> lock (run->Lock);
+			drained = run->Corrupt  ||  (run->AppTxDone && run->View.Header->Tx.Head == run->TxTail && run->TxAhead == 0);
+		}
+		if (run->DriverDone && drained)
+			break;
+		if (TestTime() > deadline) {
+			TEST_CHECK (!"the ring is drained");
+			break;
+		}
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+	}
+
+	// HfpShmRingUnlink: no more reposts, wait for the transfers
+	{
+		std::lock_guard<std::mutex> lock (run->Lock);
+		run->Stopping = true;
+	}
+	channel[DIR_IN].join();
+	channel[DIR_OUT].join();
+	run->DriverDone = 2;
+	for (i = 0; i < 2; i++)
+		if (app[i].joinable())
+			app[i].join();
+
+	TEST_CHECK (run->Active == 0);
+	for (i = 0; i < 2*SHM_RING_DEPTH; i++)
+		TEST_CHECK (!run->Xfer[i].Posted);
+	TEST_CHECK (run->RxAhead == 0 && run->TxAhead == 0);
+	TEST_CHECK (run->Errors == 0);
+
+	if (run->Corrupt) {
+		TestLog ("corrupted: Rx %u frames, overruns %u; Tx %u frames, underruns %u; %d cancelled",
+				 run->View.Header->RxFrames, run->View.Header->RxOverruns, run->View.Header->TxFrames, run->View.Header->TxUnderruns, int(run->Cancelled));
+		return;
+	}
+
+	SCO_SHM_HEADER * hdr = run->View.Header;
+	TestLog ("Rx %u frames, %u received, overruns %u; Tx %u written, %u dropped, %u sent, underruns %u; %d cancelled",
+			 hdr->RxFrames, run->AppRx, hdr->RxOverruns, run->AppTx, run->AppTxDrops, run->TxSent, hdr->TxUnderruns, int(run->Cancelled));
+
+	TEST_CHECK (hdr->RxFrames == run->RxSeq);
+	TEST_CHECK (run->AppRx + hdr->RxOverruns == hdr->RxFrames);
+	TEST_CHECK (run->AppRxGaps + (run->RxSeq - run->AppRxLast) == hdr->RxOverruns);
+	TEST_CHECK (run->AppTx - run->AppTxDrops == run->TxSent);
+	TEST_CHECK (hdr->TxFrames == run->TxSent + hdr->TxUnderruns);
+
+	run->Overruns  += hdr->RxOverruns;
+	run->Underruns += hdr->TxUnderruns;
+	run->Drops	   += run->AppTxDrops;
+}
+
+
+
+void TestScoShm (int argc, char ** argv)
+{
+	unsigned	frames = (argc > 0) ? atoi (argv[0]) : 20000;
+	SHM_RUN *	run	   = new SHM_RUN;
+	int			i;
+
+	// Small ring, so it overruns and underruns often
+	TEST_CHECK (ScoShmLayout (&run->View, 8, 60) != 0);
+	run->Memory = (UCHAR*) malloc (run->View.Size);
+	memset (run->Silence, 0, sizeof(run->Silence));
+	run->Errors = 0;
+	run->Overruns = run->Underruns = run->Drops = 0;
+
+	run->Corrupt = false;
+	for (i = 0; i < 3; i++)
+		RunCycle (run, frames);
+
+	// The overflow paths must be exercised
+	TEST_CHECK (run->Overruns > 0 && run->Underruns > 0 && run->Drops > 0);
+
+	run->Corrupt = true;
+	RunCycle (run, frames);
+
+	free (run->Memory);
+	delete run;
+}
@@ -0,0 +1,143 @@
+/*******************************************************************\
+ Filename    :  ScoStatsTest.cpp
+ Purpose     :  SCO link statistics of a connection
+\*******************************************************************/
+
+/*
+ Checks the driver's SCO statistics (scostats.c): the latency buckets and the accounting of
+ successful and failed transfers, then threads completing transfers of both directions
+ concurrently (as the completion routines do with no lock) while a snapshot is taken: no count
+ may be lost and the snapshot never goes back. Lost updates show up on a multiprocessor only.
+ Args: [transfers per thread], default 200000.
+*/
+
+#include <stdlib.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "HfpTest.h"
+#include "scostats.h"
+
+
+static void TestSingle ()
+{
+	SCO_STATS	stats;
+	ULONG		i;
+
+	TEST_CHECK (ScoStatsLatencyBucket (0) == 0  &&  ScoStatsLatencyBucket (999) == 0);
+	TEST_CHECK (ScoStatsLatencyBucket (1000) == 1  &&  ScoStatsLatencyBucket (1999) == 1);
+	TEST_CHECK (ScoStatsLatencyBucket (2000) == 2  &&  ScoStatsLatencyBucket (7999) == 3);
+	TEST_CHECK (ScoStatsLatencyBucket (63999) == 6  &&  ScoStatsLatencyBucket (64000) == 7);
+	TEST_CHECK (ScoStatsLatencyBucket (0xFFFFFFFF) == SCO_STATS_LATENCY_BUCKETS-1);
+
+	ScoStatsInit (&stats, 0x3F);
+	ScoStatsAccount (&stats, 1, 60, 0, 500);
+	ScoStatsAccount (&stats, 1, 60, 0, 3000);
+	ScoStatsAccount (&stats, 0, 48, 0, 1500);
+	ScoStatsAccount (&stats, 0, 48, (LONG)0xC0000120, 100000);		// STATUS_CANCELLED
+	ScoStatsAccount (&stats, 1, 60, (LONG)0xC000020C, 200);			// STATUS_CONNECTION_DISCONNECTED
+
+	TEST_CHECK (stats.PacketTypes == 0x3F);
+	TEST_CHECK (stats.FramesIn == 2  &&  stats.BytesIn == 120  &&  stats.ErrorsIn == 1);
+	TEST_CHECK (stats.FramesOut == 1  &&  stats.BytesOut == 48  &&  stats.ErrorsOut == 1);
+	TEST_CHECK (stats.LastError == (LONG)0xC000020C);
+	TEST_CHECK (stats.LatencyMax == 100000);
+	TEST_CHECK (stats.Latency[0] == 2  &&  stats.Latency[1] == 1  &&  stats.Latency[2] == 1  &&  stats.Latency[7] == 1);
+	for (i = 3; i < 7; i++)
+		TEST_CHECK (stats.Latency[i] == 0);
+}
+
+
+
+struct STATS_RUN
+{
+	SCO_STATS			Stats;
+	std::atomic<int>	Running;
+	std::atomic<int>	Errors;
+	ULONG				MaxLatency[8];		// Per thread
+};
+
+
+static void RunCompletions (STATS_RUN * run, int id, int transfers, unsigned seed)
+{
+	ULONG max = 0;
+
+	for (int i = 0; i < transfers; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		ULONG latency = (seed >> 12) % 70000;
+		if (latency > max)
+			max = latency;
+
+		// Even threads read, odd ones write; every 16th transfer fails
+		ScoStatsAccount (&run->Stats, !(id & 1), 60, (i % 16 == 15) ? (LONG)0xC0000120 : 0, latency);
+	}
+	run->MaxLatency[id] = max;
+}
+
+
+static void RunSnapshots (STATS_RUN * run)
+{
+	SCO_STATS prev, cur;
+
+	ScoStatsSnapshot (&prev, &run->Stats);
+	while (run->Running)
+	{
+		ScoStatsSnapshot (&cur, &run->Stats);
+		if (cur.FramesIn < prev.FramesIn || cur.FramesOut < prev.FramesOut || cur.BytesIn < prev.BytesIn ||
+			cur.BytesOut < prev.BytesOut || cur.ErrorsIn < prev.ErrorsIn || cur.LatencyMax < prev.LatencyMax)
+			run->Errors++;
+		prev = cur;
+		std::this_thread::yield();
+	}
+}
+
+
+static void TestThreads (int nthreads, int transfers)
+{
+	STATS_RUN *					run = new STATS_RUN;
+	std::vector<std::thread>	threads;
+	ULONG						i, sum = 0, max = 0;
+
+	ScoStatsInit (&run->Stats, 0);
+	run->Running = 1;
+	run->Errors	 = 0;
+
+	std::thread snapshots (RunSnapshots, run);
+	for (int t = 0; t < nthreads; t++)
+		threads.push_back (std::thread (RunCompletions, run, t, transfers, TestRand()));
+	for (int t = 0; t < nthreads; t++)
+		threads[t].join();
+	run->Running = 0;
+	snapshots.join();
+
+	// transfers per thread, nthreads/2 threads per direction
+	ULONG perdir = ULONG(transfers) * (nthreads / 2);
+	ULONG errors = ULONG(transfers / 16) * (nthreads / 2);
+
+	TestLog ("%d threads x %d transfers: in %u/%u, out %u/%u, max latency %u us",
+			 nthreads, transfers, run->Stats.FramesIn, run->Stats.ErrorsIn, run->Stats.FramesOut, run->Stats.ErrorsOut, run->Stats.LatencyMax);
+
+	TEST_CHECK (run->Errors == 0);
+	TEST_CHECK (run->Stats.FramesIn == perdir - errors  &&  run->Stats.ErrorsIn == errors);
+	TEST_CHECK (run->Stats.FramesOut == perdir - errors  &&  run->Stats.ErrorsOut == errors);
+	TEST_CHECK (run->Stats.BytesIn == 60ull * (perdir - errors)  &&  run->Stats.BytesOut == 60ull * (perdir - errors));
+	for (i = 0; i < SCO_STATS_LATENCY_BUCKETS; i++)
+		sum += run->Stats.Latency[i];
+	TEST_CHECK (sum == 2 * perdir);
+	for (int t = 0; t < nthreads; t++)
+		max = (run->MaxLatency[t] > max) ? run->MaxLatency[t] : max;
+	TEST_CHECK (run->Stats.LatencyMax == max);
+	delete run;
+}
+
+
+
+void TestScoStats (int argc, char ** argv)
+{
+	int transfers = (argc > 0) ? atoi (argv[0]) : 200000;
+
+	TestSingle ();
+	TestThreads (4, transfers);
+}
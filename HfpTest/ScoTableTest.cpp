@@ -0,0 +1,218 @@
+/*******************************************************************\
+ Filename    :  ScoTableTest.cpp
+ Purpose     :  Table of per-remote SCO servers and connections
+\*******************************************************************/
+
+/*
+ Checks the driver's SCO table (scotable.c): one owner per remote, the same owner re-registering,
+ exhaustion, connections attach/detach and the removal of a closed file's entries (a remote is
+ free for another file only after that). Then files register, re-register and close with threads
+ following the server.c locking: the table lock for the lookups and updates, and the server lock
+ held from the lookup of the file's entry till it's unregistered (the BRB is sent without the
+ table lock). An unregistered entry must still belong to the file, a file has one entry at most.
+ Args: [iterations per thread], default 20000.
+*/
+
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#include "HfpTest.h"
+#include "scotable.h"
+
+
+static int Files[SCO_TABLE_MAX + 2];		// Owner file objects
+static int Conns[2];						// Connections
+
+#define FILE_OF(i)	((void*) &Files[i])
+#define CONN_OF(i)	((void*) &Conns[i])
+
+
+static void TestSingle ()
+{
+	SCO_TABLE	table;
+	ULONG		idx, idx2, i;
+	int			existing;
+
+	ScoTableInit (&table);
+	TEST_CHECK (table.Count == 0);
+	TEST_CHECK (ScoTableAdd (&table, 0, FILE_OF(0), &idx, &existing) == SCO_TABLE_E_INVALID);
+	TEST_CHECK (ScoTableAdd (&table, 0x1001, 0, &idx, &existing) == SCO_TABLE_E_INVALID);
+
+	// The owner re-registering its remote finds the existing entry, another owner is refused
+	TEST_CHECK (ScoTableAdd (&table, 0x1001, FILE_OF(0), &idx, &existing) == SCO_TABLE_OK  &&  !existing);
+	TEST_CHECK (ScoTableAdd (&table, 0x1001, FILE_OF(0), &idx2, &existing) == SCO_TABLE_OK  &&  existing  &&  idx2 == idx);
+	TEST_CHECK (ScoTableAdd (&table, 0x1001, FILE_OF(1), &idx2, &existing) == SCO_TABLE_E_BUSY  &&  idx2 == SCO_TABLE_NONE);
+	TEST_CHECK (table.Count == 1);
+	TEST_CHECK (ScoTableFind (&table, 0x1001) == idx  &&  ScoTableFindOwner (&table, FILE_OF(0)) == idx);
+	TEST_CHECK (ScoTableFind (&table, 0x1002) == SCO_TABLE_NONE  &&  ScoTableFindOwner (&table, FILE_OF(1)) == SCO_TABLE_NONE);
+
+	// One connection per remote
+	TEST_CHECK (ScoTableAttach (&table, idx, CONN_OF(0)) == SCO_TABLE_OK);
+	TEST_CHECK (ScoTableAttach (&table, idx, CONN_OF(0)) == SCO_TABLE_OK);
+	TEST_CHECK (ScoTableAttach (&table, idx, CONN_OF(1)) == SCO_TABLE_E_BUSY);
+	TEST_CHECK (ScoTableFindConnection (&table, CONN_OF(0)) == idx);
+	TEST_CHECK (ScoTableDetach (&table, CONN_OF(1)) == SCO_TABLE_NONE);
+	TEST_CHECK (ScoTableDetach (&table, CONN_OF(0)) == idx);
+	TEST_CHECK (ScoTableFindConnection (&table, CONN_OF(0)) == SCO_TABLE_NONE);
+	TEST_CHECK (ScoTableAttach (&table, SCO_TABLE_MAX, CONN_OF(0)) == SCO_TABLE_E_INVALID);
+
+	// The closed file's entry is removed with its server, then the remote is free for another file
+	TEST_CHECK (ScoTableAttach (&table, idx, CONN_OF(0)) == SCO_TABLE_OK);
+	ScoTableRemove (&table, ScoTableFindOwner (&table, FILE_OF(0)));
+	TEST_CHECK (table.Count == 0  &&  ScoTableFind (&table, 0x1001) == SCO_TABLE_NONE);
+	TEST_CHECK (ScoTableFindConnection (&table, CONN_OF(0)) == SCO_TABLE_NONE);
+	TEST_CHECK (ScoTableAdd (&table, 0x1001, FILE_OF(1), &idx, &existing) == SCO_TABLE_OK  &&  !existing);
+	ScoTableRemove (&table, idx);
+	ScoTableRemove (&table, idx);
+	ScoTableRemove (&table, SCO_TABLE_NONE);
+	TEST_CHECK (table.Count == 0);
+
+	// Exhaustion: a free entry is reused
+	for (i = 0; i < SCO_TABLE_MAX; i++)
+		TEST_CHECK (ScoTableAdd (&table, 0x2000 + i, FILE_OF(i), &idx, &existing) == SCO_TABLE_OK  &&  idx == i);
+	TEST_CHECK (ScoTableAdd (&table, 0x3000, FILE_OF(SCO_TABLE_MAX), &idx, &existing) == SCO_TABLE_E_FULL);
+	ScoTableRemove (&table, 3);
+	TEST_CHECK (ScoTableAdd (&table, 0x3000, FILE_OF(SCO_TABLE_MAX), &idx, &existing) == SCO_TABLE_OK  &&  idx == 3);
+	TEST_CHECK (table.Count == SCO_TABLE_MAX);
+}
+
+
+
+struct TABLE_RUN
+{
+	SCO_TABLE			Table;
+	std::mutex			TableLock;		// ScoTableLock
+	std::mutex			ServerLock;		// ScoServerLock
+	std::atomic<int>	Errors;
+	std::atomic<long>	Registered;
+	std::atomic<long>	Busy;
+};
+
+
+// HfpSrvUnregisterEntry: the BRB is sent without the table lock, then the entry is removed
+static void UnregisterEntry (TABLE_RUN * run, ULONG idx, void* owner)
+{
+	std::this_thread::yield();
+
+	std::lock_guard<std::mutex> lock (run->TableLock);
+	if (run->Table.Entry[idx].Owner != owner)
+		run->Errors++;			// another file's server would be unregistered
+	ScoTableRemove (&run->Table, idx);
+}
+
+
+// HfpSrvRegisterScoServer
+static bool Register (TABLE_RUN * run, void* owner, SCO_TABLE_ADDR addr)
+{
+	std::lock_guard<std::mutex> server (run->ServerLock);
+	SCO_TABLE_RESULT	res;
+	ULONG				idx;
+	SCO_TABLE_ADDR		prevaddr = 0;
+	int					existing;
+
+	{
+		std::lock_guard<std::mutex> lock (run->TableLock);
+		idx = ScoTableFindOwner (&run->Table, owner);
+		if (idx != SCO_TABLE_NONE)
+			prevaddr = run->Table.Entry[idx].Addr;
+	}
+
+	if (prevaddr  &&  prevaddr != addr)
+		UnregisterEntry (run, idx, owner);
+
+	std::this_thread::yield();		// the events are referenced
+
+	std::lock_guard<std::mutex> lock (run->TableLock);
+	res = ScoTableAdd (&run->Table, addr, owner, &idx, &existing);
+	if (res == SCO_TABLE_E_BUSY)
+		run->Busy++;
+	else if (res != SCO_TABLE_OK)
+		run->Errors++;
+	return res == SCO_TABLE_OK;
+}
+
+
+// HfpSrvUnregisterScoServer, also the file cleanup
+static void Unregister (TABLE_RUN * run, void* owner)
+{
+	std::lock_guard<std::mutex> server (run->ServerLock);
+	ULONG idx;
+
+	{
+		std::lock_guard<std::mutex> lock (run->TableLock);
+		idx = ScoTableFindOwner (&run->Table, owner);
+	}
+	if (idx != SCO_TABLE_NONE)
+		UnregisterEntry (run, idx, owner);
+}
+
+
+static void RunFile (TABLE_RUN * run, int id, int iterations, unsigned seed)
+{
+	void* owner = FILE_OF(id);
+
+	for (int it = 0; it < iterations; it++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		// Three remotes for more files than that: the files compete for them
+		if ((seed >> 16) % 8 < 5) {
+			if (Register (run, owner, 0x5000 + (seed >> 20) % 3))
+				run->Registered++;
+		}
+		else
+			Unregister (run, owner);
+
+		// A file has one entry at most
+		std::lock_guard<std::mutex> lock (run->TableLock);
+		int n = 0;
+		for (ULONG i = 0; i < SCO_TABLE_MAX; i++)
+			n += (run->Table.Entry[i].Addr && run->Table.Entry[i].Owner == owner);
+		if (n > 1)
+			run->Errors++;
+	}
+}
+
+
+/*
+ Two threads per file: an application may send the IOCTLs of a file from several threads
+*/
+static void TestThreads (int nfiles, int iterations)
+{
+	TABLE_RUN *					run = new TABLE_RUN;
+	std::vector<std::thread>	threads;
+
+	ScoTableInit (&run->Table);
+	run->Errors		= 0;
+	run->Registered	= 0;
+	run->Busy		= 0;
+
+	for (int t = 0; t < 2 * nfiles; t++)
+		threads.push_back (std::thread (RunFile, run, t / 2, iterations, TestRand()));
+	for (int t = 0; t < 2 * nfiles; t++)
+		threads[t].join();
+
+	// File cleanup
+	for (int f = 0; f < nfiles; f++)
+		Unregister (run, FILE_OF(f));
+
+	TestLog ("%d files: %ld registered, %ld busy", nfiles, long(run->Registered), long(run->Busy));
+
+	TEST_CHECK (run->Errors == 0);
+	TEST_CHECK (run->Table.Count == 0);
+	TEST_CHECK (run->Registered > 0  &&  run->Busy > 0);
+	delete run;
+}
+
+
+
+void TestScoTable (int argc, char ** argv)
+{
+	int iterations = (argc > 0) ? atoi (argv[0]) : 20000;
+
+	TestSingle ();
+	TestThreads (4, iterations);
+}
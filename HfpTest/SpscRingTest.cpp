@@ -0,0 +1,211 @@
+/*******************************************************************\
+ Filename    :  SpscRingTest.cpp
+ Purpose     :  Lock-free SPSC ring and its times vs. FIFO_ALLOC
+\*******************************************************************/
+
+/*
+ Checks SPSC_RING (Utils/spsc_ring.h): the full and empty limits, the spans and the zero-copy
+ access over the wrap point, then a producer and a consumer thread passing a numbered sequence.
+ The times are compared with FIFO_ALLOC in one thread and between two threads (the FIFO is not
+ thread safe, there it is guarded by a mutex). The load is the FarEndTap one: voice samples in
+ spans of Span, the ring is a few chunks long.
+ Utils depend on windows.h (def.h), so the test is built by HfpTest.vcxproj only.
+ Args: [iterations], default 100000.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+
+#include "HfpTest.h"
+
+
+#ifdef _WIN32
+
+#include "def.h"
+#include "fifo_cse.h"
+#include "spsc_ring.h"
+
+
+enum { RingSize = 8192, Span = 128 };
+
+static SPSC_RING <short,RingSize>	Ring;
+static FIFO_ALLOC <short,RingSize>	Fifo;
+static std::mutex					FifoLock;
+
+
+static double Elapsed (double start, int n)
+{
+	return (TestTime() - start) * 1e9 / n;		// ns per element
+}
+
+
+static void TestSingle ()
+{
+	SPSC_RING <int,8>	r;
+	int					src[6] = { 8, 9, 10, 11, 12, 13 };
+	int					buf[8];
+	int					i, n, v, diff;
+
+	TEST_CHECK (r.IsEmpty()  &&  !r.Pop (v)  &&  r.PopSpan (buf, 8) == 0);
+	for (i = 0; i < 8; i++)
+		TEST_CHECK (r.Push (i));
+	TEST_CHECK (!r.Push (8)  &&  r.GetCount() == 8);
+	for (i = 0; i < 5; i++)
+		TEST_CHECK (r.Pop (v)  &&  v == i);
+
+	// Spans over the wrap point: only the free part is pushed
+	TEST_CHECK (r.PushSpan (src, 6) == 5);
+	TEST_CHECK (r.PopSpan (buf, 8) == 8);
+	for (diff = 0, i = 0; i < 8; i++)
+		diff += (buf[i] != i + 5);
+	TEST_CHECK (diff == 0  &&  r.IsEmpty());
+
+	// Zero-copy: the contiguous part only, up to the buffer end
+	int * w = r.AcquireWrite (n);
+	TEST_CHECK (n == 3);
+	w[0] = 20;  w[1] = 21;  w[2] = 22;
+	r.CommitWrite (3);
+	w = r.AcquireWrite (n);
+	TEST_CHECK (n == 5);
+	w[0] = 23;
+	r.CommitWrite (1);
+
+	const int * rd = r.AcquireRead (n);
+	TEST_CHECK (n == 3  &&  rd[0] == 20  &&  rd[2] == 22);
+	r.CommitRead (3);
+	rd = r.AcquireRead (n);
+	TEST_CHECK (n == 1  &&  rd[0] == 23);
+	r.CommitRead (1);
+
+	r.Push (1);
+	r.Drain ();
+	TEST_CHECK (r.IsEmpty());
+}
+
+
+static void Produce (bool lockfree, int count)
+{
+	short	buf[Span];
+	int		sent = 0, n, done, i;
+
+	while (sent < count) {
+		n = MIN(Span, count - sent);
+		for (i = 0; i < n; i++)
+			buf[i] = short(sent + i);
+		if (lockfree)
+			done = Ring.PushSpan (buf, n);
+		else {
+			std::lock_guard<std::mutex> lock (FifoLock);
+			for (done = 0; done < n && Fifo.PutElement (buf[done]); done++);
+		}
+		sent += done;
+		if (!done)
+			std::this_thread::yield();
+	}
+}
+
+
+// Consumes count samples produced by the other thread, returns ns per sample
+static double Consume (bool lockfree, int count, int & errors)
+{
+	short		buf[Span];
+	int			got = 0, n, i;
+	double		start = TestTime();
+	std::thread	producer (Produce, lockfree, count);
+
+	while (got < count) {
+		if (lockfree)
+			n = Ring.PopSpan (buf, Span);
+		else {
+			std::lock_guard<std::mutex> lock (FifoLock);
+			for (n = 0; n < Span && Fifo.GetElement (buf[n]); n++);
+		}
+		for (i = 0; i < n; i++)
+			errors += (buf[i] != short(got + i));
+		got += n;
+		if (!n)
+			std::this_thread::yield();
+	}
+
+	producer.join();
+	return Elapsed (start, count);
+}
+
+
+static void TestTimes (int iterations)
+{
+	short	v, buf[Span];
+	int		i, j, sum;
+	double	start, t1, t2, t3;
+
+	memset (buf, 0, sizeof(buf));
+	Ring.Clear();
+	Fifo.Clear();
+
+	// One thread, by elements: the bare index and the barriers costs
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < Span; j++)
+			Fifo.PutElement (short(j));
+		while (Fifo.GetElement (v))
+			sum += v;
+	}
+	t1 = Elapsed (start, iterations * Span);
+
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < Span; j++)
+			Ring.Push (short(j));
+		while (Ring.Pop (v))
+			sum -= v;
+	}
+	t2 = Elapsed (start, iterations * Span);
+
+	// One thread, by spans
+	start = TestTime();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < Span; j++)
+			buf[j] = short(j);
+		Ring.PushSpan (buf, Span);
+		Ring.PopSpan (buf, Span);
+		for (j = 0; j < Span; j++)
+			sum += buf[j];
+	}
+	t3 = Elapsed (start, iterations * Span);
+	TestLog ("one thread, %d samples: FIFO %.2f ns, SPSC_RING %.2f ns, spans %.2f ns per sample", Span, t1, t2, t3);
+	TEST_CHECK (sum == iterations * (Span-1)*Span/2);
+
+	// Producer and consumer threads, by spans
+	int count = iterations * Span;
+	int errors1 = 0, errors2 = 0;
+	Ring.Clear();
+	Fifo.Clear();
+	t1 = Consume (false, count, errors1);
+	t2 = Consume (true,  count, errors2);
+	TestLog ("two threads, %d samples: FIFO+mutex %.2f ns, SPSC_RING %.2f ns per sample", count, t1, t2);
+	TEST_CHECK (errors1 == 0  &&  errors2 == 0);
+	TEST_CHECK (Ring.IsEmpty());
+}
+
+
+
+void TestSpscRing (int argc, char ** argv)
+{
+	int iterations = (argc > 0) ? atoi (argv[0]) : 100000;
+
+	TestSingle ();
+	TestTimes (iterations);
+}
+
+
+#else
+
+void TestSpscRing (int argc, char ** argv)
+{
+	TestLog ("skipped: Utils need windows.h");
+}
+
+#endif
@@ -0,0 +1,192 @@
+/*******************************************************************\
+ Filename    :  StrScanTest.cpp
+ Purpose     :  String scan kernels and their times vs. the CRT ones
+\*******************************************************************/
+
+/*
+ Checks the strscan.h kernels against strchr, strpbrk and strlen at all the offsets of a string
+ within the 16-byte blocks, strscanInt and STRB::SeekInt on the AG responses as sscanf reads
+ them (the spaces of the format match any whitespace) and the int overflow. Then the times vs.
+ the CRT and sscanf on the AT responses the parsers get: +CIND statuses (SeekInt), +CLCC lines
+ (the quotes scan), +CPBR lines (the separators scan) and the +CIND mapping (strlen).
+ Utils depend on windows.h (def.h), so the test is built by HfpTest.vcxproj only.
+ Args: [iterations], default 1000000.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "HfpTest.h"
+
+
+#ifdef _WIN32
+
+#include "def.h"
+#include "str.h"
+
+
+static void TestKernels ()
+{
+	static char	buf[64 + 16];
+	const char*	text = "1,1,4,0,0,\"+972501234567\",145";
+	int			off, i, diff = 0;
+
+	for (off = 0; off < 16; off++)
+	{
+		char* s = buf + off;
+		strcpy (s, text);
+		for (i = 0;  s[i];  i++) {
+			diff += (strscanChar (s + i, '\"') != strchr (s + i, '\"'));
+			diff += (strscanAny (s + i, "\",") != strpbrk (s + i, "\","));
+			diff += (strscanLen (s + i) != int(strlen (s + i)));
+		}
+		diff += (strscanChar (s, 'x') != 0  ||  strscanChar (s, '\0') != s + strlen (s));
+		diff += (strscanAny (s, "xyz") != 0);
+	}
+	TEST_CHECK (diff == 0);
+
+	// More chars than STRSCAN_MAXSET: the CRT one
+	TEST_CHECK (strscanAny (text, "abcdefghij+") == strchr (text, '+'));
+}
+
+
+static void TestInt ()
+{
+	int x;
+
+	TEST_CHECK (strscanInt (" \t-12,", &x)  &&  x == -12);
+	TEST_CHECK (strscanInt ("+7", &x)  &&  x == 7);
+	TEST_CHECK (!strscanInt ("-", &x)  &&  !strscanInt (",1", &x)  &&  x == 0);
+
+	// int limits, the overflow is not a number
+	TEST_CHECK (strscanInt ("2147483647", &x)  &&  x == 2147483647);
+	TEST_CHECK (strscanInt ("-2147483648", &x)  &&  x == -2147483647 - 1);
+	TEST_CHECK (!strscanInt ("2147483648", &x)  &&  x == 0);
+	TEST_CHECK (!strscanInt ("-2147483649", &x)  &&  !strscanInt ("99999999999", &x));
+
+	// SeekInt: a space of the format matches any whitespace, none too
+	STR<64> s;
+	s = "0, 1 ,  4";
+	s.SeekStart ();
+	TEST_CHECK (s.SeekInt (&x, "%d ,")  &&  x == 0);
+	TEST_CHECK (s.SeekInt (&x, "%d ,")  &&  x == 1);
+	TEST_CHECK (s.SeekInt (&x, "%d ,")  &&  x == 4  &&  *s.GetSeekPos() == '\0');
+
+	s = "+CIND:  3";
+	s.SeekStart ();
+	TEST_CHECK (s.SeekInt (&x, "+CIND: %d")  &&  x == 3);
+	s.SeekStart ();
+	TEST_CHECK (!s.SeekInt (&x, "+CIEV: %d")  &&  x == 0  &&  s.GetSeekPos() == (char*)s);
+	s = "+CIND:3";
+	s.SeekStart ();
+	TEST_CHECK (s.SeekInt (&x, "+CIND: %d")  &&  x == 3);
+}
+
+
+static inline double Elapsed (double start, int n)
+{
+	return (TestTime() - start) * 1e9 / n;		// ns per iteration
+}
+
+
+// The former STRB::SeekInt: sscanf, then the advance by the printed value length
+static cchar* SeekIntSscanf (cchar* s, int* x)
+{
+	char buf[16];
+	if (sscanf (s, "%d", x) != 1)
+		return 0;
+	return s + sprintf (buf, "%d", *x);
+}
+
+
+static void TestTimes (int iterations)
+{
+	static cchar* Cind = "0,0,1,4,0,3,0";
+	static cchar* Clcc = "1,1,4,0,0,\"+972501234567\",145,\"Alice Cooper\"";
+	static cchar* Cpbr = "117,\"+972501234567\",145,\"Alice Cooper (work)\"";
+	static cchar* Map  = "(\"call\",(0,1)),(\"callsetup\",(0-3)),(\"service\",(0-1)),(\"signal\",(0-5)),"
+						 "(\"roam\",(0,1)),(\"battchg\",(0-5)),(\"callheld\",(0-2))";
+	cchar*	s;
+	int		i, x, sum;
+	double	start, t1, t2;
+
+	// +CIND statuses: "%d," loop
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		for (s = Cind;  s && (s = SeekIntSscanf (s, &x));  s = *s ? s + 1 : 0)
+			sum += x;
+	t1 = Elapsed (start, iterations);
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		for (s = Cind;  s && (s = strscanInt (s, &x));  s = *s ? s + 1 : 0)
+			sum -= x;
+	t2 = Elapsed (start, iterations);
+	TestLog ("SeekInt  +CIND:   sscanf %.1f ns, strscanInt %.1f ns", t1, t2);
+	TEST_CHECK (sum == 0);
+
+	// +CLCC quotes
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		for (s = Clcc;  (s = strchr (s, '\"'));  s++)
+			sum++;
+	t1 = Elapsed (start, iterations);
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		for (s = Clcc;  (s = strscanChar (s, '\"'));  s++)
+			sum--;
+	t2 = Elapsed (start, iterations);
+	TestLog ("ScanChar +CLCC:   strchr %.1f ns, strscanChar %.1f ns", t1, t2);
+	TEST_CHECK (sum == 0);
+
+	// +CPBR separators
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		for (s = Cpbr;  (s = strpbrk (s, ",\""));  s++)
+			sum++;
+	t1 = Elapsed (start, iterations);
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		for (s = Cpbr;  (s = strscanAny (s, ",\""));  s++)
+			sum--;
+	t2 = Elapsed (start, iterations);
+	TestLog ("ScanAny  +CPBR:   strpbrk %.1f ns, strscanAny %.1f ns", t1, t2);
+	TEST_CHECK (sum == 0);
+
+	// +CIND mapping length
+	sum = 0;
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		sum += (int) strlen (Map + (i & 7));
+	t1 = Elapsed (start, iterations);
+	start = TestTime();
+	for (i = 0; i < iterations; i++)
+		sum -= strscanLen (Map + (i & 7));
+	t2 = Elapsed (start, iterations);
+	TestLog ("Strlen   +CIND=?: strlen %.1f ns, strscanLen %.1f ns", t1, t2);
+	TEST_CHECK (sum == 0);
+}
+
+
+
+void TestStrScan (int argc, char ** argv)
+{
+	int iterations = (argc > 0) ? atoi (argv[0]) : 1000000;
+
+	TestKernels ();
+	TestInt ();
+	TestTimes (iterations);
+}
+
+
+#else
+
+void TestStrScan (int argc, char ** argv)
+{
+	TestLog ("skipped: Utils need windows.h");
+}
+
+#endif
@@ -0,0 +1,276 @@
+/*******************************************************************\
+ Filename    :  VoiceProcTest.cpp
+ Purpose     :  VoiceProc offline test: ERLE and CPU load
+\*******************************************************************/
+
+/*
+ Without arguments, the echo scenario is synthesized: the far-end voice is speech-like noise bursts,
+ the microphone gets it through a decaying echo path plus the background noise, and in the middle
+ the near-end talker joins (double talk). The checks:
+	- ERLE after convergence, before and after the double talk (the filter must not diverge)
+	- double talk is detected while the near-end talks
+	- the processing is many times faster than real time
+ With far.wav mic.wav [out.wav] (8 kHz 16-bit mono PCM), the recorded pair is processed the same
+ way as WaveIn does and ERLE/CPU are reported without checks.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "HfpTest.h"
+#include "VoiceProc.h"
+
+
+static const int SampleRate = 8000;
+static const int FrameSize	= 128;		// The same as WaveIn::VoiceProcFrame
+
+
+/*
+ ************************************************************************************************
+ WAV files: 16-bit mono PCM only
+ ************************************************************************************************
+ */
+static short * WavRead (const char * name, int & nsamples)
+{
+	FILE * f = fopen (name, "rb");
+	if (!f)
+		return 0;
+
+	unsigned char hdr[12], ck[8];
+	short * data = 0;
+	bool	pcm16 = false;
+
+	nsamples = 0;
+	if (fread (hdr, 1, 12, f) == 12 && !memcmp (hdr, "RIFF", 4) && !memcmp (hdr + 8, "WAVE", 4)) {
+		while (fread (ck, 1, 8, f) == 8) {
+			long size = ck[4] | (ck[5] << 8) | (ck[6] << 16) | (long(ck[7]) << 24);
+			if (!memcmp (ck, "fmt ", 4)) {
+				unsigned char fmt[16];
+				if (size < 16 || fread (fmt, 1, 16, f) != 16)
+					break;
+				pcm16 = (fmt[0] | (fmt[1] << 8)) == 1 && (fmt[2] | (fmt[3] << 8)) == 1 && (fmt[14] | (fmt[15] << 8)) == 16;
+				fseek (f, size - 16 + (size & 1), SEEK_CUR);
+			}
+			else if (!memcmp (ck, "data", 4) && pcm16) {
+				nsamples = int(size / 2);
+				data = (short*) malloc (nsamples * sizeof(short) + 1);
+				if (data)
+					nsamples = int(fread (data, sizeof(short), nsamples, f));	// little endian hosts
+				break;
+			}
+			else
+				fseek (f, size + (size & 1), SEEK_CUR);
+		}
+	}
+
+	fclose (f);
+	return data;
+}
+
+
+static void Put32 (unsigned char * p, unsigned v)	{ p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static void Put16 (unsigned char * p, unsigned v)	{ p[0] = v; p[1] = v >> 8; }
+
+
+static bool WavWrite (const char * name, const short * data, int nsamples)
+{
+	FILE * f = fopen (name, "wb");
+	if (!f)
+		return false;
+
+	unsigned char h[44];
+	memcpy (h, "RIFF", 4);		Put32 (h + 4, 36 + nsamples * 2);
+	memcpy (h + 8, "WAVEfmt ", 8);
+	Put32 (h + 16, 16);			Put16 (h + 20, 1);				Put16 (h + 22, 1);
+	Put32 (h + 24, SampleRate);	Put32 (h + 28, SampleRate * 2);	Put16 (h + 32, 2);	Put16 (h + 34, 16);
+	memcpy (h + 36, "data", 4);	Put32 (h + 40, nsamples * 2);
+
+	bool ok = fwrite (h, 1, 44, f) == 44 && int(fwrite (data, sizeof(short), nsamples, f)) == nsamples;
+	fclose (f);
+	return ok;
+}
+
+
+/*
+ ************************************************************************************************
+ Synthetic signals
+ ************************************************************************************************
+ */
+static float Noise ()		// uniform -1..1
+{
+	return float(TestRand()) / float(0x800000) - 1.f;
+}
+
+
+// Speech-like voice: low-pass colored noise in 200..600 ms bursts with pauses
+static void Voice (float * out, int n, float level)
+{
+	float lp = 0, env = 0;
+	int	  burst = 0;
+	bool  on = false;
+
+	for (int i = 0; i < n; i++) {
+		if (--burst <= 0) {
+			on	  = !on;
+			burst = (on ? 200 + TestRand() % 400 : 100 + TestRand() % 300) * SampleRate / 1000;
+		}
+		env += ((on ? 1.f : 0.f) - env) * 0.005f;
+		lp	+= (Noise() - lp) * 0.5f;
+		out[i] = lp * env * level;
+	}
+}
+
+
+// Echo path: the speaker to microphone impulse response with a bulk delay and an exponential decay
+static void EchoPath (float * h, int n, int delay, float gain)
+{
+	float sum = 0;
+	for (int i = 0; i < n; i++) {
+		h[i] = (i < delay) ? 0 : Noise() * expf (-float(i - delay) / 40.f);
+		sum += h[i] * h[i];
+	}
+	float norm = gain / sqrtf (sum);
+	for (int i = 0; i < n; i++)
+		h[i] *= norm;
+}
+
+
+static short Sat (float v)
+{
+	return short(v > 32767.f ? 32767.f : (v < -32768.f ? -32768.f : v));
+}
+
+
+// Stats measurement period: [From, To) frames
+struct SEGMENT {
+	int					From;
+	int					To;
+	VoiceProc::Stats	St;
+};
+
+
+/*
+ Processes the whole recording in FrameSize steps, collects the stats of the segments (ascending,
+ not overlapped). Returns the processing time in seconds.
+*/
+static double Process (VoiceProc & vp, const short * far, const short * mic, short * out, int nframes, SEGMENT * seg, int nseg)
+{
+	double t = 0;
+	int	   s = 0;
+
+	for (int i = 0; i < nframes; i++) {
+		if (s < nseg && i == seg[s].From)
+			vp.ResetStats();
+
+		double t0 = TestTime();
+		vp.Process (mic + i*FrameSize, far + i*FrameSize, out + i*FrameSize);
+		t += TestTime() - t0;
+
+		if (s < nseg && i == seg[s].To - 1)
+			seg[s++].St = vp.GetStats();
+	}
+	return t;
+}
+
+
+static void TestFiles (int argc, char ** argv)
+{
+	int		nfar, nmic;
+	short * far = WavRead (argv[0], nfar);
+	short * mic = WavRead (argv[1], nmic);
+
+	TEST_CHECK (far != 0);
+	TEST_CHECK (mic != 0);
+	if (far && mic) {
+		int		n	= (nfar < nmic ? nfar : nmic) / FrameSize;
+		short * out = (short*) malloc (n * FrameSize * sizeof(short) + 1);
+
+		VoiceProc::Config cfg;
+		cfg.SampleRate = SampleRate;
+		cfg.FrameSize  = FrameSize;
+
+		VoiceProc vp;
+		SEGMENT	  all = {0, n};
+		TEST_CHECK (vp.Init (cfg));
+
+		double t = Process (vp, far, mic, out, n, &all, 1);
+		const VoiceProc::Stats & st = all.St;
+		double audio = double(n) * FrameSize / SampleRate;
+		TestLog ("%.1f sec: ERLE %.1f dB, double talk %u/%u frames, noise floor %.0f, AGC gain %.2f", audio, st.ErleDb(), st.DoubleTalkFrames, st.Frames, st.NoiseFloor, st.AgcGain);
+		TestLog ("CPU %.1f ms, %.0fx real time", t * 1000, audio / t);
+
+		if (argc > 2)
+			TEST_CHECK (WavWrite (argv[2], out, n * FrameSize));
+		free (out);
+	}
+	free (far);
+	free (mic);
+}
+
+
+void TestVoiceProc (int argc, char ** argv)
+{
+	if (argc >= 2) {
+		TestFiles (argc, argv);
+		return;
+	}
+
+	// 0..12 s echo only, 12..16 s double talk, 16..24 s echo only again
+	const int nframes = 24 * SampleRate / FrameSize;
+	const int dtFrom  = 12 * SampleRate / FrameSize;
+	const int dtTo	  = 16 * SampleRate / FrameSize;
+	const int n		  = nframes * FrameSize;
+	const int taps	  = 320;
+
+	float * farv = (float*) malloc (n * sizeof(float));
+	float * nearv= (float*) malloc (n * sizeof(float));
+	float	h[taps];
+	short * far = (short*) malloc (n * sizeof(short));
+	short * mic = (short*) malloc (n * sizeof(short));
+	short * out = (short*) malloc (n * sizeof(short));
+
+	Voice (farv, n, 8000);
+	Voice (nearv, n, 6000);
+	EchoPath (h, taps, 24, 0.3f);
+
+	for (int i = 0; i < n; i++) {
+		float e = 0;
+		for (int k = 0; k < taps && k <= i; k++)
+			e += h[k] * farv[i-k];
+		if (i >= dtFrom*FrameSize && i < dtTo*FrameSize)
+			e += nearv[i];
+		far[i] = Sat (farv[i]);
+		mic[i] = Sat (e + Noise() * 10);
+	}
+
+	VoiceProc::Config cfg;
+	cfg.SampleRate = SampleRate;
+	cfg.FrameSize  = FrameSize;
+
+	VoiceProc vp;
+	TEST_CHECK (vp.Init (cfg));
+
+	// Echo only after 4 s of convergence, the double talk, and the echo only 2 s after it
+	const int fps = SampleRate / FrameSize;
+	SEGMENT	  seg[3] = {{4*fps, dtFrom}, {dtFrom, dtTo}, {dtTo + 2*fps, nframes}};
+
+	double t	 = Process (vp, far, mic, out, nframes, seg, 3);
+	double audio = double(n) / SampleRate;
+
+	TestLog ("echo only: ERLE %.1f dB, double talk %u/%u frames", seg[0].St.ErleDb(), seg[0].St.DoubleTalkFrames, seg[0].St.Frames);
+	TestLog ("near-end talks: double talk %u/%u frames", seg[1].St.DoubleTalkFrames, seg[1].St.Frames);
+	TestLog ("after double talk: ERLE %.1f dB", seg[2].St.ErleDb());
+	TestLog ("CPU %.1f ms per %.0f sec, %.0fx real time", t * 1000, audio, audio / t);
+
+	TEST_CHECK (seg[0].St.ErleDb() > 12);
+	TEST_CHECK (seg[1].St.DoubleTalkFrames > seg[1].St.Frames / 4);
+	TEST_CHECK (seg[2].St.ErleDb() > 12);
+	TEST_CHECK (audio / t > 10);
+
+	free (farv);
+	free (nearv);
+	free (far);
+	free (mic);
+	free (out);
+}
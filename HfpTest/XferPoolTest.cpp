@@ -0,0 +1,160 @@
+/*******************************************************************\
+ Filename    :  XferPoolTest.cpp
+ Purpose     :  Lock free pool of SCO transfer contexts
+\*******************************************************************/
+
+/*
+ Checks the driver's transfer contexts pool (xferpool.c): the single thread semantics (distinct
+ entries, exhaustion, invalid and double returns, the statistics), then the lock free Get/Put
+ with threads hammering one pool. Each taken entry is claimed in an ownership table, so an entry
+ given out twice is detected; at the end all the entries must be free again.
+ Args: [iterations per thread], default 200000.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "HfpTest.h"
+#include "xferpool.h"
+
+
+static void TestSingle (ULONG size)
+{
+	XFER_POOL	pool;
+	ULONG		idx[XFER_POOL_MAX], i;
+	bool		seen[XFER_POOL_MAX] = { false };
+
+	XferPoolInit (&pool, size);
+	TEST_CHECK (XferPoolInUse(&pool) == 0);
+
+	// All the entries are distinct, the lowest free one is taken first
+	for (i = 0; i < size; i++) {
+		idx[i] = XferPoolGet (&pool);
+		TEST_CHECK (idx[i] == i);
+		if (idx[i] < size) {
+			TEST_CHECK (!seen[idx[i]]);
+			seen[idx[i]] = true;
+		}
+	}
+	TEST_CHECK (XferPoolInUse(&pool) == size);
+	TEST_CHECK (XferPoolGet(&pool) == XFER_POOL_NONE);
+	TEST_CHECK (pool.Misses == 1 && pool.Hits == LONG(size) && pool.InUseMax == LONG(size));
+
+	// The returned entry is the next one taken
+	TEST_CHECK (XferPoolPut (&pool, size / 2) == 1);
+	TEST_CHECK (XferPoolGet (&pool) == size / 2);
+
+	// Invalid and double returns
+	TEST_CHECK (XferPoolPut (&pool, size) == 0);
+	TEST_CHECK (XferPoolPut (&pool, XFER_POOL_NONE) == 0);
+	TEST_CHECK (XferPoolPut (&pool, 0) == 1);
+	TEST_CHECK (XferPoolPut (&pool, 0) == 0);
+	TEST_CHECK (pool.Errors == 3);
+
+	for (i = 1; i < size; i++)
+		TEST_CHECK (XferPoolPut (&pool, i) == 1);
+	TEST_CHECK (XferPoolInUse(&pool) == 0);
+	TEST_CHECK (ULONG(pool.Free) == ((size == 32) ? 0xFFFFFFFF : (1u << size) - 1));
+	TEST_CHECK (pool.InUseMax == LONG(size));
+}
+
+
+
+struct POOL_RUN
+{
+	XFER_POOL			Pool;
+	std::atomic<int>	Owner[XFER_POOL_MAX];	// 0 - free, otherwise the thread number
+	std::atomic<int>	Errors;
+	std::atomic<long>	Gets;
+	std::atomic<long>	Misses;
+};
+
+
+static void RunThread (POOL_RUN * run, int id, int iterations, unsigned seed)
+{
+	ULONG	held[4];
+	int		nheld = 0;
+
+	for (int it = 0; it < iterations; it++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		// Holds up to 4 entries, so the pool is exhausted by the threads together
+		if (nheld < 4  &&  (nheld == 0 || (seed >> 16) & 1)) {
+			ULONG idx = XferPoolGet (&run->Pool);
+			if (idx == XFER_POOL_NONE) {
+				run->Misses++;
+				continue;
+			}
+			int free = 0;
+			if (idx >= run->Pool.Size || !run->Owner[idx].compare_exchange_strong (free, id))
+				run->Errors++;
+			held[nheld++] = idx;
+			run->Gets++;
+		}
+		else {
+			ULONG k = (seed >> 17) % nheld;
+			ULONG idx = held[k];
+			held[k] = held[--nheld];
+			int owner = id;
+			if (!run->Owner[idx].compare_exchange_strong (owner, 0))
+				run->Errors++;
+			if (!XferPoolPut (&run->Pool, idx))
+				run->Errors++;
+		}
+	}
+
+	while (nheld) {
+		ULONG idx = held[--nheld];
+		run->Owner[idx] = 0;
+		if (!XferPoolPut (&run->Pool, idx))
+			run->Errors++;
+	}
+}
+
+
+static void TestThreads (ULONG size, int nthreads, int iterations)
+{
+	POOL_RUN *					run = new POOL_RUN;
+	std::vector<std::thread>	threads;
+
+	XferPoolInit (&run->Pool, size);
+	for (ULONG i = 0; i < XFER_POOL_MAX; i++)
+		run->Owner[i] = 0;
+	run->Errors = 0;
+	run->Gets	= 0;
+	run->Misses = 0;
+
+	for (int t = 0; t < nthreads; t++)
+		threads.push_back (std::thread (RunThread, run, t + 1, iterations, TestRand()));
+	for (int t = 0; t < nthreads; t++)
+		threads[t].join();
+
+	TestLog ("%u entries, %d threads: %ld gets, %ld misses, max in use %d",
+			 size, nthreads, long(run->Gets), long(run->Misses), int(run->Pool.InUseMax));
+
+	TEST_CHECK (run->Errors == 0);
+	TEST_CHECK (run->Pool.Errors == 0);
+	TEST_CHECK (XferPoolInUse(&run->Pool) == 0);
+	TEST_CHECK (ULONG(run->Pool.Free) == ((size == 32) ? 0xFFFFFFFF : (1u << size) - 1));
+	TEST_CHECK (run->Pool.Hits == run->Gets && run->Pool.Misses == run->Misses);
+	TEST_CHECK (run->Pool.InUseMax <= LONG(size));
+	delete run;
+}
+
+
+
+void TestXferPool (int argc, char ** argv)
+{
+	int iterations = (argc > 0) ? atoi (argv[0]) : 200000;
+
+	TestSingle (1);
+	TestSingle (7);
+	TestSingle (XFER_POOL_MAX);
+
+	TestThreads (XFER_POOL_MAX, 4, iterations);		// mostly hits
+	TestThreads (8, 4, iterations);					// the threads exhaust the pool
+}
@@ -33,6 +33,7 @@ void InHand::Init ()
 
 void InHand::End ()
 {
+	FreeIndicators();
 	InHandMng::FreeDevices(Devices,NumDevices);
 	InHandMng::End();
 }
@@ -64,17 +65,10 @@ DialAppBthDev* InHand::FindDevice (uint64 address, bool rescan)
 }
 
 
-void InHand::ClearIndicatorsNumbers ()
+void InHand::FreeIndicators ()
 {
-	InHandLog.LogMsg("ClearIndicatorsNumbers");
-	InHandMng::ClearIndicatorsNumbers ();
-}
-
-
-void InHand::SetIndicatorsNumbers (int call, int callsetup, int callheld)
-{
-	InHandLog.LogMsg("SetIndicatorsNumbers: call=%d, callsetup=%d, callheld=%d", call, callsetup, callheld);
-	InHandMng::SetIndicatorsNumbers (call, callsetup, callheld);
+	delete CurIndicators;
+	CurIndicators = 0;
 }
 
 
@@ -92,10 +86,10 @@ void InHand::Disconnect()
 }
 
 
-int InHand::BeginHfpConnect()
+int InHand::BeginHfpConnect (bool warm)
 {
-	InHandLog.LogMsg("About to BeginHfpConnect");
-	return InHandMng::BeginHfpConnect();
+	InHandLog.LogMsg("About to BeginHfpConnect (warm=%d)", warm);
+	return InHandMng::BeginHfpConnect(warm);
 }
 
 
@@ -138,3 +132,15 @@ void InHand::ListCurrentCalls()
 	InHandMng::ListCurrentCalls();
 }
 
+
+void InHand::PhonebookSelect (cchar* storage)
+{
+	InHandMng::PhonebookSelect(%System::String(storage));
+}
+
+
+void InHand::PhonebookRead (int first, int last)
+{
+	InHandMng::PhonebookRead(first, last);
+}
+
@@ -33,11 +33,10 @@ class InHand
 	static void RescanDevices ();
 	static DialAppBthDev* FindDevice (uint64 address, bool rescan = false);
 
-	static void ClearIndicatorsNumbers();
-	static void SetIndicatorsNumbers(int call, int callsetup, int callheld);
+	static void FreeIndicators();	// forgets the AG indicators mapping, "+CIEV" events are ignored till the next one
 
 	static void BeginConnect	(uint64 devaddr);
-	static int  BeginHfpConnect	();
+	static int  BeginHfpConnect	(bool warm = false);
 	static void Disconnect		();
 	static void StartCall		(cchar* dialnumber);
 	static void SendDtmf		(cchar* dialchar);
@@ -45,11 +44,13 @@ class InHand
 	static void EndCall			();
 	static void PutOnHold		();
 	static void ListCurrentCalls();
+	static void PhonebookSelect	(cchar* storage);
+	static void PhonebookRead	(int first, int last);	// first = 0: the range (AT+CPBR=?)
 
   public:
 	static DialAppBthDev  *Devices;
 	static int			   NumDevices;
-	static HfpIndicators  *CurIndicators;
+	static HfpIndicators  *CurIndicators;	// AG indicators mapping (AT+CIND=?), kept till the next mapping or FreeIndicators
 };
 
 
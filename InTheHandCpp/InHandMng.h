@@ -50,11 +50,8 @@ public ref class InHandMng
 	static int	GetDevices (DialAppBthDev* &devices);
 	static void	FreeDevices(DialAppBthDev* &devices, int n);
 
-	static void ClearIndicatorsNumbers();
-	static void SetIndicatorsNumbers(int call, int callsetup, int callheld);
-
 	static void BeginConnect (BluetoothAddress^ bthaddr);
-	static int  BeginHfpConnect ();
+	static int  BeginHfpConnect (bool warm);
 	static void Disconnect ();
 	static void StartCall (String ^number);
 	static void SendDtmf (String^ dialchar);
@@ -62,7 +59,10 @@ public ref class InHandMng
 	static void EndCall ();
 	static void PutOnHold();
 	static void SendAtCommand (String ^at);
+	static void SendAtCommand (String ^at, AtCmd cmd);
 	static void ListCurrentCalls();
+	static void PhonebookSelect (String ^storage);
+	static void PhonebookRead (int first, int last);
 
 	/*
 	  Handsfree Supported Features
@@ -78,6 +78,8 @@ public ref class InHandMng
 	static UInt16 HandsfreeSupportedFeatures = 116;
 
   protected:
+	static bool SdpAdded = false;	// The records are built and published once per process
+
 	static void AddSdp(Guid svc);
 	static void ProcessIoException (IOException ^ex);
 	
@@ -100,22 +102,13 @@ public ref class InHandMng
 		FreePchar(chstr);
 	}
 
+	static void RecvIndicatorEvent (cchar* ciev);
+	static void RecvFinalResult (bool ok);
+
   protected:
 	static NetworkStream^	StreamNet;
 	static StreamWriter^	StreamWtr;
 
-  protected:
-	// "+CIEV: x,y"	AT strings
-	static String^	CievCall_0;
-	static String^	CievCall_1;
-	static String^	CievCallsetup_0;
-	static String^	CievCallsetup_1;
-	static String^	CievCallsetup_2;
-	static String^	CievCallsetup_3;
-	static String^	CievCallHeld_0;
-	static String^	CievCallHeld_1;
-	static String^	CievCallHeld_2;
-
   protected:
 	static array<String^> ^CrLf = gcnew array<String^> {"\r\n"};	// for RecvAtCommands()
 };
@@ -124,8 +117,12 @@ public ref class InHandMng
 void InHandMng::Init ()
 {
     try {
-		AddSdp(BluetoothService::Headset  );
-		AddSdp(BluetoothService::Handsfree);
+		// Re-init (dialappEnd/dialappInit) doesn't rebuild the records nor bind the RFCOMM sockets again
+		if (!SdpAdded) {
+			AddSdp(BluetoothService::Headset  );
+			AddSdp(BluetoothService::Handsfree);
+			SdpAdded = true;
+		}
 		BthCli = gcnew BluetoothClient();
 	}
 	catch (Exception^ ex) {
@@ -214,38 +211,90 @@ void InHandMng::ProcessIoException (IOException ^ex)
 
 void InHandMng::SendAtCommand (String ^at)
 {
+	SendAtCommand (at, AtCmd_Other);
+}
+
+
+void InHandMng::SendAtCommand (String ^at, AtCmd cmd)
+{
+	// Queued before sending: the response may come before Write returns
+	HfpSmObj.AtCommands.Sent (cmd);
 	StreamWtr->Write(at + "\r");
 	StreamWtr->Flush();
 	LogMsg("HF Sent: " + at);
 }
 
 
-void InHandMng::ClearIndicatorsNumbers ()
+void InHandMng::RecvIndicatorEvent (cchar* ciev)
 {
-	// Put undefined char
-	CievCall_0		= "$";
-	CievCall_1		= "$";
-	CievCallsetup_0	= "$";
-	CievCallsetup_1	= "$";
-	CievCallsetup_2	= "$";
-	CievCallsetup_3	= "$";
-	CievCallHeld_0	= "$";
-	CievCallHeld_1	= "$";
-	CievCallHeld_2	= "$";
+	int idx, val;
+
+	// Ignored till the mapping (AT+CIND=?) is known
+	if (!InHand::CurIndicators  ||  !HfpIndicators::ParseEvent (ciev, &idx, &val))
+		return;
+
+	int serv = InHand::CurIndicators->Update (idx, val);
+	HfpSmObj.Indicators.Set (serv, val);
+
+	switch (serv)
+	{
+		case HfpIndicators::CALL:
+			if (val == 0) {
+				// HfpSm::PutEvent_CallEnd();
+				// In order to differ CallEnd initiated by a user and this AT command it's introduced new CallEnded event 
+				// In general it is unnecessary, but because of iPhone's problem, when being in 3-way call, it stops to send
+				// callsetup and callheld commands. As result we need this event in order to terminate the call
+				HfpSm::PutEvent_CallEnded();
+			}
+			else if (val == 1)
+				HfpSm::PutEvent_CallStart ();
+			break;
+
+		case HfpIndicators::CALLSETUP:
+			if (val == 0)
+				HfpSm::PutEvent_AtResponse(SMEV_AtResponse_CallSetup_None);
+			else if (val == 1)
+				HfpSm::PutEvent_AtResponse(SMEV_AtResponse_CallSetup_Incoming);
+			else if (val == 2)
+				HfpSm::PutEvent_AtResponse(SMEV_AtResponse_CallSetup_Outgoing);
+			break;
+
+		case HfpIndicators::CALLHELD:
+			if (val == 0)
+				HfpSm::PutEvent_CallHeld (SMEV_AtResponse_CallHeld_None);
+			else if (val == 1)
+				HfpSm::PutEvent_CallHeld (SMEV_AtResponse_CallHeld_HeldAndActive);
+			else if (val == 2)
+				HfpSm::PutEvent_CallHeld (SMEV_AtResponse_CallHeld_HeldOnly);
+			break;
+
+		default:
+			// service, signal, roam, battchg: the host is notified by the cache
+			break;
+	}
 }
 
 
-void InHandMng::SetIndicatorsNumbers (int call, int callsetup, int callheld)
+void InHandMng::RecvFinalResult (bool ok)
 {
-	CievCall_0		= "+CIEV: " + call + ",0";
-	CievCall_1		= "+CIEV: " + call + ",1";
-	CievCallsetup_0	= "+CIEV: " + callsetup + ",0";		// not currently in call set up
-	CievCallsetup_1	= "+CIEV: " + callsetup + ",1";		// incoming call process ongoing
-	CievCallsetup_2	= "+CIEV: " + callsetup + ",2";		// outgoing call set up is ongoing
-	CievCallsetup_3	= "+CIEV: " + callsetup + ",3";		// remote party being alerted in an outgoing call
-	CievCallHeld_0	= "+CIEV: " + callheld + ",0";
-	CievCallHeld_1	= "+CIEV: " + callheld + ",1";
-	CievCallHeld_2	= "+CIEV: " + callheld + ",2";
+	AtCmd cmd = HfpSmObj.AtCommands.Final();
+
+	switch (cmd)
+	{
+		case AtCmd_Clcc:
+			if (HfpSmObj.Calls.ListDone (ok))
+				HfpSm::PutEvent_AtResponse (SMEV_AtResponse_ListCurrentCalls);
+			break;
+
+		case AtCmd_Cpbs:
+		case AtCmd_CpbrRange:
+		case AtCmd_Cpbr:
+			PhonebookObj.CommandDone (cmd, ok);
+			break;
+
+		default:
+			break;
+	}
 }
 
 
@@ -256,11 +305,17 @@ void InHandMng::RecvAtCommand (String ^str)
 	InHandLog.LogMsg (sinfo);
 
 	if (str->IndexOf("OK") == 0) {
+		RecvFinalResult (true);
 		HfpSm::PutEvent_AtResponse (SMEV_AtResponse_Ok);
 	} 
 	else if (str->IndexOf("ERROR") == 0) {
+		RecvFinalResult (false);
 		HfpSm::PutEvent_AtResponse (SMEV_AtResponse_Error);
 	} 
+	else if (str->IndexOf("+CME ERROR") == 0) {
+		// Final result too (AT+CMEE=1), it only completes its command
+		RecvFinalResult (false);
+	} 
 	else if (str->IndexOf("+CIND: (") == 0) {
 		if (InHand::CurIndicators)
 			delete InHand::CurIndicators;
@@ -268,31 +323,19 @@ void InHandMng::RecvAtCommand (String ^str)
 		InHand::CurIndicators->Construct (sinfo + 7);
 	} 
 	else if (str->IndexOf("+CIND: ") == 0) {
-		InHand::CurIndicators->SetStatuses (sinfo + 7);
-		int x = InHand::CurIndicators->GetCurrentState();
+		// The mapping is kept for the warm reconnect
+		int x = -1;
+		if (InHand::CurIndicators) {
+			InHand::CurIndicators->SetStatuses (sinfo + 7);
+			x = InHand::CurIndicators->GetCurrentState();
+			if (InHand::CurIndicators->Constructed)
+				HfpSmObj.Indicators.Set (InHand::CurIndicators->GetPresent(), InHand::CurIndicators->GetStatuses());
+		}
 		LogMsg("HfpIndicators::GetCurrentState returned " + x);
 		HfpSm::PutEvent_AtResponse (SMEV_AtResponse_CurrentPhoneIndicators, x);
-		delete InHand::CurIndicators;
-		InHand::CurIndicators = 0;
-	} 
-	else if (str->IndexOf(CievCallsetup_0) == 0) {
-		HfpSm::PutEvent_AtResponse(SMEV_AtResponse_CallSetup_None);
 	} 
-	else if (str->IndexOf(CievCallsetup_1) == 0) {
-		HfpSm::PutEvent_AtResponse(SMEV_AtResponse_CallSetup_Incoming);
-	}
-	else if (str->IndexOf(CievCallsetup_2) == 0) {
-		HfpSm::PutEvent_AtResponse(SMEV_AtResponse_CallSetup_Outgoing);
-	}
-	else if (str->IndexOf(CievCall_0) == 0) {
-		// HfpSm::PutEvent_CallEnd();
-		// In order to differ CallEnd initiated by a user and this AT command it's introduced new CallEnded event 
-		// In general it is unnecessary, but because of iPhone's problem, when being in 3-way call, it stops to send
-		// callsetup and callheld commands. As result we need this event in order to terminate the call
-		HfpSm::PutEvent_CallEnded();
-	}
-	else if (str->IndexOf(CievCall_1) == 0) {
-		HfpSm::PutEvent_CallStart ();
+	else if (str->IndexOf("+CIEV:") == 0) {
+		RecvIndicatorEvent (sinfo + 6);
 	}
 	else if (str->IndexOf("+CCWA:") == 0) {
 		//3-way call notification event bringing participator's number
@@ -302,16 +345,13 @@ void InHandMng::RecvAtCommand (String ^str)
 		HfpSm::PutEvent_AtResponse (SMEV_AtResponse_CallingLineId, sinfo+7);
 	}
 	else if (str->IndexOf("+CLCC:") == 0) {
-		HfpSm::PutEvent_AtResponse (SMEV_AtResponse_ListCurrentCalls, sinfo+7);
-	}
-	else if (str->IndexOf(CievCallHeld_0) == 0) {
-		HfpSm::PutEvent_CallHeld (SMEV_AtResponse_CallHeld_None);
+		// Collected till the AT+CLCC final result
+		if (HfpSmObj.AtCommands.Current() == AtCmd_Clcc)
+			HfpSmObj.Calls.AddLine (sinfo + 6);
 	}
-	else if (str->IndexOf(CievCallHeld_1) == 0) {
-		HfpSm::PutEvent_CallHeld (SMEV_AtResponse_CallHeld_HeldAndActive);
-	}
-	else if (str->IndexOf(CievCallHeld_2) == 0) {
-		HfpSm::PutEvent_CallHeld (SMEV_AtResponse_CallHeld_HeldOnly);
+	else if (str->IndexOf("+CPBR:") == 0) {
+		// Streamed to the phone book raw file
+		PhonebookObj.AddLine (HfpSmObj.AtCommands.Current(), sinfo + 6);
 	}
 
 	/* 
@@ -427,18 +467,22 @@ void InHandMng::ConnectCallback (IAsyncResult ^ar)
 }
 
 
-int InHandMng::BeginHfpConnect ()
+int InHandMng::BeginHfpConnect (bool warm)
 {
 	try
 	{
+		// Warm reconnect to the same AG: its indicators mapping is known already
+		bool mapping = !warm || !InHand::CurIndicators || !InHand::CurIndicators->Constructed;
+
 		SendAtCommand("AT+BRSF=" + HandsfreeSupportedFeatures); // Used In HF SDP, according to HF Spec 4.2.1
-		SendAtCommand("AT+CIND=?");			// The mapping of the indicators 
+		if (mapping)
+			SendAtCommand("AT+CIND=?");		// The mapping of the indicators 
 		SendAtCommand("AT+CMER=3,0,0,1");	// Indicators status update: 3,0,0,1 activates "indicator events reporting".
 		SendAtCommand("AT+CMEE=1");			// Enable the use of result code +CME ERROR
 		SendAtCommand("AT+CCWA=1");			// Call Waiting Notification Activation
 		SendAtCommand("AT+CLIP=1");			// Calling Line Identification notification HF Spec 4.23 (sending incoming call info along with RING)
 		SendAtCommand("AT+CIND?");			// Get current indicators
-		return 7; // number of sent AT commands
+		return mapping ? 7 : 6; // number of sent AT commands
 	}
 	catch (IOException ^ex) {
 		ProcessIoException (ex);
@@ -573,7 +617,49 @@ void InHandMng::PutOnHold()
 void InHandMng::ListCurrentCalls()
 {
 	try	{
-		SendAtCommand("AT+CLCC;");
+		SendAtCommand("AT+CLCC;", AtCmd_Clcc);
+	}
+	catch (IOException ^ex) {
+		ProcessIoException (ex);
+		HfpSm::PutEvent_Disconnect();
+	}
+	catch (Exception ^ex) {
+		LogMsg(ex->Message);
+		HfpSm::PutEvent_Failure (DialAppError_ConnectFailure);
+	}
+}
+
+
+/*
+  AT+CPBS="<storage>": ME - the phone memory, SM - the SIM
+*/
+void InHandMng::PhonebookSelect (String ^storage)
+{
+	try	{
+		SendAtCommand("AT+CPBS=\"" + storage + "\"", AtCmd_Cpbs);
+	}
+	catch (IOException ^ex) {
+		ProcessIoException (ex);
+		HfpSm::PutEvent_Disconnect();
+	}
+	catch (Exception ^ex) {
+		LogMsg(ex->Message);
+		HfpSm::PutEvent_Failure (DialAppError_ConnectFailure);
+	}
+}
+
+
+/*
+  AT+CPBR=? +CPBR: (<first>-<last>),<nlength>,<tlength>
+  AT+CPBR=<first>,<last> +CPBR: <index>,"<number>",<type>,"<text>" per entry
+*/
+void InHandMng::PhonebookRead (int first, int last)
+{
+	try	{
+		if (first == 0)
+			SendAtCommand("AT+CPBR=?", AtCmd_CpbrRange);
+		else
+			SendAtCommand("AT+CPBR=" + first + "," + last, AtCmd_Cpbr);
 	}
 	catch (IOException ^ex) {
 		ProcessIoException (ex);
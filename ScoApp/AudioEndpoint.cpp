@@ -0,0 +1,287 @@
+/*******************************************************************\
+ Filename    :  AudioEndpoint.cpp
+ Purpose     :  Audio endpoints (WinMM devices, WAV file, null) for Wave
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#include <stdarg.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "AudioEndpoint.h"
+
+
+
+/****************************************************************************************\
+									Class AudioPacer
+\****************************************************************************************/
+
+uint64 AudioPacer::Now ()
+{
+	#ifdef _WIN32
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter (&t);
+	QueryPerformanceFrequency (&f);
+	return uint64(t.QuadPart / f.QuadPart * 1000000 + t.QuadPart % f.QuadPart * 1000000 / f.QuadPart);
+	#else
+	timespec t;
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return uint64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+	#endif
+}
+
+
+void AudioPacer::Start ()
+{
+	StartTime  = Now();
+	TotalBytes = 0;
+}
+
+
+void AudioPacer::Pace (int nbytes)
+{
+	TotalBytes += nbytes;
+	if (!RealTime || !BytesPerSec)
+		return;
+
+	// The moment (us from start) when the accounted data is completely played
+	uint64 due = TotalBytes * 1000000 / BytesPerSec;
+	uint64 now = Now() - StartTime;
+
+	if (due > now) {
+		#ifdef _WIN32
+		Sleep (DWORD((due - now) / 1000));
+		#else
+		timespec t = { time_t((due - now) / 1000000), long((due - now) % 1000000 * 1000) };
+		nanosleep (&t, 0);
+		#endif
+	}
+}
+
+
+
+/****************************************************************************************\
+									Class AudioEndpoint
+\****************************************************************************************/
+
+AudioEndpoint* AudioEndpoint::Create (TYPE type, bool capture, bool realtime, cchar * filename)
+{
+	switch (type)
+	{
+		case TYPE_NULL:
+			return new NullEndpoint (capture, realtime);
+
+		case TYPE_WAVFILE:
+			if (!filename)
+				throw int(DialAppError_InternalError);
+			return new WavFileEndpoint (filename, capture, realtime);
+	}
+
+	throw int(DialAppError_InternalError);
+}
+
+
+int AudioEndpoint::Fail (int error, cchar * msg, ...)
+{
+	va_list args;
+	va_start (args, msg);
+	vsnprintf (ErrorText, sizeof(ErrorText), msg, args);
+	va_end (args);
+	return error;
+}
+
+
+
+/****************************************************************************************\
+									Class NullEndpoint
+\****************************************************************************************/
+
+void NullEndpoint::Write (const void * data, int nbytes)
+{
+	Pacer.Pace(nbytes);
+}
+
+
+int NullEndpoint::Read (void * data, int nbytes)
+{
+	memset (data, 0, nbytes);
+	Pacer.Pace(nbytes);
+	return nbytes;
+}
+
+
+
+/****************************************************************************************\
+									Class WavFileEndpoint
+\****************************************************************************************/
+
+typedef unsigned short uint16;
+
+enum { WavFormatPcm = 1 };	// WAVE_FORMAT_PCM
+
+#pragma pack(push,1)
+struct WAVFILEHDR {
+	char	Riff[4];		// "RIFF"
+	uint32	RiffSize;
+	char	Wave[4];		// "WAVE"
+	char	Fmt[4];			// "fmt "
+	uint32	FmtSize;		// 16
+	uint16	FormatTag;		// WavFormatPcm
+	uint16	Nchan;
+	uint32	SampleRate;
+	uint32	BytesPerSec;
+	uint16	BlockAlign;
+	uint16	BitsPerSample;
+	char	Data[4];		// "data"
+	uint32	DataSize;
+};
+
+struct WAVCHUNKHDR {
+	char	Id[4];
+	uint32	Size;
+};
+#pragma pack(pop)
+
+
+WavFileEndpoint::WavFileEndpoint (cchar * filename, bool capture, bool realtime) :
+	AudioEndpoint("WavFile", capture, realtime), File(0), DataOffset(0), DataSize(0), DataPos(0)
+{
+	strncpy (FileName, filename, sizeof(FileName)-1);
+	FileName[sizeof(FileName)-1] = 0;
+}
+
+
+WavFileEndpoint::~WavFileEndpoint ()
+{
+	Close();
+}
+
+
+void WavFileEndpoint::Open (const FORMAT & fmt)
+{
+	AudioEndpoint::Open(fmt);
+
+	File = fopen (FileName, Capture ? "rb" : "wb");
+	if (!File)
+		throw Fail (DialAppError_InitMediaDeviceError, "Cannot open '%s'", FileName);
+
+	if (Capture)
+		ReadHeader();
+	else
+		WriteHeader();
+}
+
+
+void WavFileEndpoint::Close ()
+{
+	if (File) {
+		if (!Capture)
+			WriteHeader();	// update the sizes
+		fclose (File);
+		File = 0;
+	}
+}
+
+
+void WavFileEndpoint::ReadHeader ()
+{
+	WAVCHUNKHDR ch;
+	char		wave[4];
+	bool		fmtok = false;
+
+	if (fread (&ch, sizeof(ch), 1, File) != 1 || memcmp(ch.Id, "RIFF", 4) || fread (wave, 4, 1, File) != 1 || memcmp(wave, "WAVE", 4))
+		throw Fail (DialAppError_InitMediaDeviceError, "'%s' is not a WAV file", FileName);
+
+	while (fread (&ch, sizeof(ch), 1, File) == 1)
+	{
+		if (!memcmp(ch.Id, "fmt ", 4)) {
+			WAVFILEHDR h;
+			if (ch.Size < 16 || fread (&h.FormatTag, 16, 1, File) != 1)
+				break;
+			if (h.FormatTag != WavFormatPcm || h.Nchan != Format.Nchan || h.SampleRate != uint32(Format.SampleRate) || h.BitsPerSample != Format.BitsPerSample)
+				throw Fail (DialAppError_InitMediaDeviceError, "'%s': unsupported format (%d, %d ch, %d Hz, %d bit)", FileName, h.FormatTag, h.Nchan, h.SampleRate, h.BitsPerSample);
+			fseek (File, ch.Size - 16 + (ch.Size & 1), SEEK_CUR);
+			fmtok = true;
+		}
+		else if (!memcmp(ch.Id, "data", 4)) {
+			if (!fmtok)
+				break;
+			DataOffset = ftell(File);
+			DataSize   = ch.Size;
+			DataPos	   = 0;
+			return;
+		}
+		else
+			fseek (File, ch.Size + (ch.Size & 1), SEEK_CUR);
+	}
+
+	throw Fail (DialAppError_InitMediaDeviceError, "'%s': no PCM data found", FileName);
+}
+
+
+void WavFileEndpoint::WriteHeader ()
+{
+	uint32	   datasize = uint32(Pacer.GetTotalBytes());
+	WAVFILEHDR h;
+
+	memcpy (h.Riff, "RIFF", 4);
+	memcpy (h.Wave, "WAVE", 4);
+	memcpy (h.Fmt,  "fmt ", 4);
+	memcpy (h.Data, "data", 4);
+	h.RiffSize		= sizeof(h) - 8 + datasize;
+	h.FmtSize		= 16;
+	h.FormatTag		= WavFormatPcm;
+	h.Nchan			= uint16(Format.Nchan);
+	h.SampleRate	= Format.SampleRate;
+	h.BytesPerSec	= Format.BytesPerSec();
+	h.BlockAlign	= uint16(Format.BlockAlign());
+	h.BitsPerSample = uint16(Format.BitsPerSample);
+	h.DataSize		= datasize;
+
+	fseek (File, 0, SEEK_SET);
+	fwrite (&h, sizeof(h), 1, File);
+	fseek (File, 0, SEEK_END);
+}
+
+
+void WavFileEndpoint::Write (const void * data, int nbytes)
+{
+	if (fwrite (data, 1, nbytes, File) != size_t(nbytes))
+		throw Fail (DialAppError_WaveApiError, "'%s': write failed", FileName);
+	Pacer.Pace(nbytes);
+}
+
+
+int WavFileEndpoint::Read (void * data, int nbytes)
+{
+	int got = 0;
+
+	while (got < nbytes && DataSize)
+	{
+		if (DataPos >= DataSize) {	// loop the file
+			fseek (File, DataOffset, SEEK_SET);
+			DataPos = 0;
+		}
+		uint32 n = (uint32(nbytes - got) < DataSize - DataPos) ? uint32(nbytes - got) : DataSize - DataPos;
+		n = fread ((char*)data + got, 1, n, File);
+		if (!n)
+			break;
+		got		+= n;
+		DataPos += n;
+	}
+
+	if (got < nbytes)
+		memset ((char*)data + got, 0, nbytes - got);
+
+	Pacer.Pace(nbytes);
+	return nbytes;
+}
+
+
+#pragma managed(pop)
@@ -0,0 +1,152 @@
+/*******************************************************************\
+ Filename    :  AudioEndpoint.h
+ Purpose     :  Audio endpoints (WinMM devices, WAV file, null) for Wave
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+
+#include <stdio.h>
+
+#include "DialAppType.h"
+
+
+/*
+ ************************************************************************************************
+ Real-time pacer. Accounts the passed bytes and sleeps until the moment they would be played
+ (or recorded) by a real audio device. In free-running mode it does not sleep at all, that is
+ used for throughput tests of the SCO<->endpoint pipeline.
+ ************************************************************************************************
+ */
+class AudioPacer
+{
+  public:
+	AudioPacer () : BytesPerSec(0), RealTime(true), TotalBytes(0), StartTime(0) {}
+
+	void Init  (int bytes_per_sec, bool realtime)	{ BytesPerSec = bytes_per_sec; RealTime = realtime; Start(); }
+	void Start ();
+	void Pace  (int nbytes);
+
+	uint64 GetTotalBytes ()	{ return TotalBytes; }
+	bool   IsRealTime ()	{ return RealTime; }
+
+	static uint64 Now ();	// Monotonic time, microseconds
+
+  protected:
+	int		BytesPerSec;
+	bool	RealTime;
+	uint64	TotalBytes;
+	uint64	StartTime;		// Now() at Start
+};
+
+
+
+/*
+ ************************************************************************************************
+ Abstract audio endpoint, the speaker (render) or microphone (capture) side of a Wave object.
+ The sound card devices (WinMmEndpoint.h) are endpoints as well as the WAV file and the null
+ ones; the latter two and this interface have no OS dependencies, so the voice pipeline may
+ run without audio devices (see AUDIO_BACKEND in ScoApp.h) and these endpoints are tested by
+ HfpTest.
+ All methods may throw int exceptions (DialAppError_xxx), the error description is kept in
+ ErrorText then.
+ ************************************************************************************************
+ */
+class AudioEndpoint
+{
+  public:
+	enum TYPE {
+		TYPE_NULL,		// Render: discards data; Capture: produces silence
+		TYPE_WAVFILE	// Render: writes a WAV file; Capture: reads a WAV file (looped)
+	};
+
+	struct FORMAT {
+		int SampleRate;
+		int Nchan;
+		int BitsPerSample;
+
+		int BlockAlign () const	 { return Nchan * BitsPerSample / 8; }
+		int BytesPerSec () const { return SampleRate * BlockAlign(); }
+	};
+
+  public:
+	static AudioEndpoint* Create (TYPE type, bool capture, bool realtime, cchar * filename = 0);
+
+  public:
+	AudioEndpoint (cchar * name, bool capture, bool realtime, bool deviceclock = false) :
+		Name(name), Capture(capture), RealTime(realtime), DeviceClock(deviceclock) { ErrorText[0] = 0; }
+	virtual ~AudioEndpoint () {}
+
+	virtual void Open  (const FORMAT & fmt) { Format = fmt; Pacer.Init(fmt.BytesPerSec(), RealTime); }
+	virtual void Close () {}
+	virtual void Start () { Pacer.Start(); }
+	virtual void Stop  () {}
+
+	// Render side: consumes nbytes
+	virtual void Write (const void * data, int nbytes) = 0;
+	// Capture side: reads up to nbytes, returns the number of bytes read, 0 if the device had nothing in time
+	virtual int  Read  (void * data, int nbytes) = 0;
+
+	// Render side: samples queued to the device and not played yet, -1 if unknown (see DriftEstimator)
+	virtual int  GetQueueFill () { return -1; }
+
+	cchar * GetName ()		{ return Name; }
+	cchar * GetError ()		{ return ErrorText; }
+	bool IsCapture ()		{ return Capture; }
+	bool IsDeviceClock ()	{ return DeviceClock; }
+
+  protected:
+	int Fail (int error, cchar * msg, ...);		// Formats ErrorText, returns the error for throw
+
+  protected:
+	cchar *		Name;
+	bool		Capture;
+	bool		RealTime;
+	bool		DeviceClock;	// Clocked by the sound card, not by the SCO link: the drift is compensated (DriftComp)
+	FORMAT		Format;
+	AudioPacer	Pacer;
+	char		ErrorText[160];
+};
+
+
+
+class NullEndpoint : public AudioEndpoint
+{
+  public:
+	NullEndpoint (bool capture, bool realtime) : AudioEndpoint("NullEp", capture, realtime) {}
+
+	virtual void Write (const void * data, int nbytes);
+	virtual int  Read  (void * data, int nbytes);
+};
+
+
+
+class WavFileEndpoint : public AudioEndpoint
+{
+  public:
+	enum { MaxPath = 260 };
+
+  public:
+	WavFileEndpoint (cchar * filename, bool capture, bool realtime);
+	virtual ~WavFileEndpoint ();
+
+	virtual void Open  (const FORMAT & fmt);
+	virtual void Close ();
+	virtual void Write (const void * data, int nbytes);
+	virtual int  Read  (void * data, int nbytes);
+
+  protected:
+	void ReadHeader ();
+	void WriteHeader ();
+
+  protected:
+	char	FileName[MaxPath];
+	FILE   *File;
+	long	DataOffset;		// Offset of the PCM data in the file
+	uint32	DataSize;		// Size of the PCM data
+	uint32	DataPos;		// Capture: current read position inside the data
+};
+
+
+#pragma managed(pop)
@@ -0,0 +1,123 @@
+/*******************************************************************\
+ Filename    :  DriftComp.cpp
+ Purpose     :  SCO link vs audio device clock drift compensation
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#include <string.h>
+
+#include "DriftComp.h"
+
+
+/****************************************************************************************\
+									Class DriftEstimator
+\****************************************************************************************/
+
+void DriftEstimator::Init (int target_fill, int sample_rate)
+{
+	Target	   = target_fill;
+	SampleRate = sample_rate;
+	AutoTarget = (target_fill == 0);
+	Reset();
+}
+
+
+void DriftEstimator::Reset ()
+{
+	if (AutoTarget)
+		Target = 0;
+	Filtered = Target;
+	Integral = 0;
+	LockSum	 = 0;
+	Ratio	 = 1.0;
+
+	memset (&Stat, 0, sizeof(Stat));
+	Stat.FillTarget	  = Target;
+	Stat.FillFiltered = Target;
+	Stat.FillMin	  = 0x7FFFFFFF;
+}
+
+
+double DriftEstimator::Update (int fill)
+{
+	// Loop constants: filter ~20 updates, 100 ms of the fill error gives 200 ppm proportional correction
+	const double alpha = 0.05;
+	const double kp	   = 2e-3;
+	const double ki	   = 2e-5;
+	const double limit = MaxCorrectionPpm * 1e-6;
+
+	if (AutoTarget && Stat.Updates < LockUpdates) {
+		// Lock-in: the target is the natural queue level after the start
+		LockSum += fill;
+		if (++Stat.Updates == LockUpdates) {
+			Filtered = Target = Stat.FillTarget = int(LockSum / LockUpdates);
+		}
+		Stat.FillLast = fill;
+		return Ratio;
+	}
+
+	Filtered += alpha * (fill - Filtered);
+
+	double err = (Filtered - Target) / SampleRate;	// seconds
+
+	Integral += ki * err;
+	if (Integral > limit)  Integral = limit;
+	if (Integral < -limit) Integral = -limit;
+
+	double corr = kp * err + Integral;
+	if (corr > limit)  corr = limit;
+	if (corr < -limit) corr = -limit;
+
+	// Queue above the target: produce less output samples
+	Ratio = 1.0 - corr;
+
+	Stat.RatioPpm	  = (Ratio - 1.0) * 1e6;
+	Stat.FillFiltered = Filtered;
+	Stat.FillLast	  = fill;
+	if (fill < Stat.FillMin) Stat.FillMin = fill;
+	if (fill > Stat.FillMax) Stat.FillMax = fill;
+	Stat.Updates++;
+
+	return Ratio;
+}
+
+
+
+/****************************************************************************************\
+									Class FracResampler
+\****************************************************************************************/
+
+int FracResampler::Process (const short * in, int nin, short * out, int maxout, double ratio)
+{
+	const double step = 1.0 / ratio;	// input advance per output sample
+	double		 pos  = Phase;
+	int			 n	  = 0;
+
+	if (nin <= 0)
+		return 0;
+
+	while (n < maxout)
+	{
+		int idx = int(pos);				// 0 - Last, k - in[k-1]
+		if (idx >= nin)
+			break;
+
+		double frac = pos - idx;
+		int	   a	= idx ? in[idx-1] : Last;
+		int	   b	= in[idx];
+
+		out[n++] = short(a + (b - a) * frac);
+		pos += step;
+	}
+
+	Last  = in[nin-1];
+	Phase = pos - nin;
+
+	InTotal	 += nin;
+	OutTotal += n;
+	return n;
+}
+
+
+#pragma managed(pop)
@@ -0,0 +1,89 @@
+/*******************************************************************\
+ Filename    :  DriftComp.h
+ Purpose     :  SCO link vs audio device clock drift compensation
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+
+/*
+ ************************************************************************************************
+ The SCO link is clocked by the Bluetooth controller, the speaker and the microphone by the
+ sound card. Their nominal 8000 Hz rates differ by up to a few hundreds ppm, so a long call
+ slowly grows the playback queue or underruns it.
+
+ DriftEstimator is a delay-locked loop on the playback queue fill level: the fill is low-pass
+ filtered and a PI controller produces the rate correction Ratio (output samples per input
+ sample) that keeps the fill on the target level.
+
+ FracResampler applies a varying Ratio continuously with linear interpolation, keeping its
+ phase between blocks, so the correction is free of clicks.
+ ************************************************************************************************
+ */
+class DriftEstimator
+{
+  public:
+	enum {
+		MaxCorrectionPpm = 1000,	// Clamp for the correction, real clocks are within +-300 ppm
+		LockUpdates		 = 8		// With auto target: number of first updates for the target averaging
+	};
+
+	struct Stats {
+		double	RatioPpm;		// Current correction: (Ratio-1)*1e6, negative - the queue is shrunk
+		double	FillFiltered;	// Low-pass filtered fill level, in samples
+		int		FillLast;		// Last measured fill level, in samples
+		int		FillTarget;
+		int		FillMin;
+		int		FillMax;
+		unsigned Updates;
+	};
+
+  public:
+	DriftEstimator ()	{ Init(0, 8000); }
+
+	void   Init (int target_fill, int sample_rate);	// target_fill=0: auto, the average of the first LockUpdates fills
+	void   Reset ();
+	double Update (int fill);		// Call once per block with the queue fill in samples, returns Ratio
+
+	double GetRatio () const		{ return Ratio; }
+	const Stats & GetStats () const	{ return Stat; }
+
+  protected:
+	int		Target;
+	int		SampleRate;
+	bool	AutoTarget;
+	double	LockSum;
+	double	Filtered;
+	double	Integral;
+	volatile double Ratio;			// Read by the other direction (uplink) thread
+	Stats	Stat;
+};
+
+
+
+class FracResampler
+{
+  public:
+	FracResampler ()	{ Reset(); }
+
+	void Reset ()		{ Last = 0; Phase = 1.0; InTotal = OutTotal = 0; }
+
+	/*
+	 Resamples nin input samples to the output by ratio (output/input), returns number of output
+	 samples written. The output must be large enough: maxout >= nin*ratio + 2.
+	*/
+	int Process (const short * in, int nin, short * out, int maxout, double ratio);
+
+	double GetInTotal ()  const	{ return InTotal;  }
+	double GetOutTotal () const	{ return OutTotal; }
+
+  protected:
+	short	Last;		// Last input sample of the previous block
+	double	Phase;		// Position of the next output sample: 0 - at Last, 1 - at in[0], ...
+	double	InTotal;
+	double	OutTotal;
+};
+
+
+#pragma managed(pop)
@@ -9,6 +9,7 @@
 
 #include "def.h"
 #include "ScoApp.h"
+#include "WinMmEndpoint.h"
 #include "hfppublic.h"
 #include "DialAppType.h"
 
@@ -19,6 +20,15 @@
 \***********************************************************************************************/
 
 PSP_DEVICE_INTERFACE_DETAIL_DATA	ScoApp::DeviceInterfaceDetailData;
+AUDIO_BACKEND						ScoApp::AudioBackend  = AUDIO_BACKEND_WINMM;
+bool								ScoApp::AudioRealTime = true;
+char								ScoApp::AudioSpeakerFile[MAX_PATH];
+char								ScoApp::AudioMicFile[MAX_PATH];
+bool								ScoApp::DuplexEngine  = false;
+bool								ScoApp::ScoRingMode	  = false;
+bool								ScoApp::ContReaderMode = false;
+bool								ScoApp::ScoBatchMode   = false;
+VOICE_CAPTURE						ScoApp::VoiceCapture  = VOICE_CAPTURE_DMO;
 
 
 
@@ -77,6 +87,21 @@ void ScoApp::End ()
 }
 
 
+void ScoApp::SetAudioBackend (AUDIO_BACKEND backend, bool realtime, cchar * speaker_file, cchar * mic_file)
+{
+	if (backend == AUDIO_BACKEND_WAVFILE && (!speaker_file || !mic_file))
+		throw ::IntException (DialAppError_InternalError, "WAV file backend requires speaker and microphone file names");
+
+	AudioBackend  = backend;
+	AudioRealTime = realtime;
+	AudioSpeakerFile[0] = AudioMicFile[0] = 0;
+	if (speaker_file)
+		strncpy (AudioSpeakerFile, speaker_file, MAX_PATH-1);
+	if (mic_file)
+		strncpy (AudioMicFile, mic_file, MAX_PATH-1);
+}
+
+
 
 /***********************************************************************************************\
 							Private & protected ScoApp methods
@@ -100,10 +125,53 @@ void ScoApp::OpenDriver()
 }
 
 
-void ScoApp::ReopenDriver ()
+void ScoApp::StartIo (SCO_IO io)
 {
-	CloseHandle(hDevice);
-	OpenDriver();
+	static const DWORD IoCodes[SCO_IO_COUNT] = { IOCTL_HFP_OPEN_SCO, IOCTL_HFP_CLOSE_SCO };
+	static cchar *	   IoNames[SCO_IO_COUNT] = { "open", "close" };
+
+	if (IoPending[io])
+		throw IntException (DialAppError_InternalError, "SCO %s is already in progress", IoNames[io]);
+
+	memset (&IoOverlapped[io], 0, sizeof(OVERLAPPED));
+	IoOverlapped[io].hEvent = (HANDLE) EventIo[io].GetWaitHandle();
+	IoStartTime[io] = GetTickCount();
+	IoPending[io]	= true;
+
+	// Whether the request pends or completes at once, its event is signaled and the thread reports the result
+	if (!DeviceIoControl (hDevice, IoCodes[io], 0, 0, 0, 0, 0, &IoOverlapped[io])  &&  GetLastError() != ERROR_IO_PENDING) {
+		IoPending[io] = false;
+		throw IntException (io == SCO_IO_OPEN ? DialAppError_OpenScoFailure : DialAppError_CoseScoFailure, "Failed to %s SCO, GetLastError %d", IoNames[io], GetLastError());
+	}
+}
+
+
+// Runs in the ScoApp thread
+void ScoApp::IoDone (SCO_IO io)
+{
+	static cchar * IoNames[SCO_IO_COUNT] = { "Open", "Close" };
+	unsigned long  nbytes;
+	int			   error = DialAppError_Ok;
+
+	if (!IoPending[io] || !hDevice)
+		return;
+
+	if (!GetOverlappedResult (hDevice, &IoOverlapped[io], &nbytes, FALSE)) {
+		LogMsg("%s SCO failed, GetLastError %d", IoNames[io], GetLastError());
+		error = (io == SCO_IO_OPEN) ? DialAppError_OpenScoFailure : DialAppError_CoseScoFailure;
+	}
+	else if (io == SCO_IO_OPEN)
+		Open = true;
+
+	LogMsg("%s SCO completed in %u ms", IoNames[io], GetTickCount() - IoStartTime[io]);
+	IoPending[io] = false;
+
+	SCO_STATS stats;
+	if (io == SCO_IO_CLOSE  &&  GetScoStats (stats))
+		LogMsg("SCO stats: in %u frames %I64u bytes %u errors, out %u frames %I64u bytes %u errors, max latency %u us, last error %X",
+			   stats.FramesIn, stats.BytesIn, stats.ErrorsIn, stats.FramesOut, stats.BytesOut, stats.ErrorsOut, stats.LatencyMax, stats.LastError);
+
+	IoCb (io, error);
 }
 
 
@@ -111,7 +179,8 @@ void ScoApp::ReopenDriver ()
 void ScoApp::Run()
 {
 	enum { NumEvents = 3 };
-	HANDLE    waithandles[NumEvents] = { HANDLE(EventScoConnect.GetWaitHandle()), HANDLE(EventScoDisconnect.GetWaitHandle()), HANDLE(EventScoCritError.GetWaitHandle()) };
+	HANDLE    waithandles[NumEvents + SCO_IO_COUNT] = { HANDLE(EventScoConnect.GetWaitHandle()), HANDLE(EventScoDisconnect.GetWaitHandle()), HANDLE(EventScoCritError.GetWaitHandle()),
+												   HANDLE(EventIo[SCO_IO_OPEN].GetWaitHandle()), HANDLE(EventIo[SCO_IO_CLOSE].GetWaitHandle()) };
 	ScoAppCb  callbacks  [NumEvents] = { ConnectCb, DisconnectCb, ErrorCb };
  
  	EventScoConnect.Reset();
@@ -122,7 +191,7 @@ void ScoApp::Run()
 
 	for (;;)
 	{
-		DWORD ret = WaitForMultipleObjects (NumEvents, waithandles, FALSE, INFINITE);
+		DWORD ret = WaitForMultipleObjects (NumEvents + SCO_IO_COUNT, waithandles, FALSE, INFINITE);
 		if (Destructing)
 			break;
 		switch (ret)
@@ -132,6 +201,10 @@ void ScoApp::Run()
 			case WAIT_OBJECT_0 + 2:
 				callbacks [ret - WAIT_OBJECT_0] ();
 				break;
+			case WAIT_OBJECT_0 + NumEvents + SCO_IO_OPEN:
+			case WAIT_OBJECT_0 + NumEvents + SCO_IO_CLOSE:
+				IoDone (SCO_IO(ret - WAIT_OBJECT_0 - NumEvents));
+				break;
 			default:
 				LogMsg("WaitForMultipleObjects returned %X", ret);
 		}
@@ -143,7 +216,7 @@ void ScoApp::Run()
 									Public ScoApp methods
 \***********************************************************************************************/
 
-void ScoApp::Construct (ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb error_cb)
+void ScoApp::Construct (ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb error_cb, ScoAppIoCb io_cb)
 {
     LogMsg("HFP Device path: %s", DeviceInterfaceDetailData->DevicePath);
 
@@ -153,6 +226,8 @@ void ScoApp::Construct (ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb er
 	ConnectCb	 = connect_cb;
 	DisconnectCb = disconnect_cb;
 	ErrorCb		 = error_cb;
+	IoCb		 = io_cb;
+	IoPending[SCO_IO_OPEN] = IoPending[SCO_IO_CLOSE] = false;
 
 	OpenDriver();
 
@@ -165,20 +240,56 @@ void ScoApp::Construct (ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb er
 
 	LogMsg("Thread ID = %d", Thread::GetThreadId());
 
-	WaveOutDev = new WaveOut(this);
-	WaveInDev  = new WaveIn(this);
+	AudioEndpoint *speaker, *mic;
+
+	if (AudioBackend == AUDIO_BACKEND_WINMM) {
+		speaker = new WaveOutEndpoint ();
+		if (DuplexEngine)
+			mic = new WaveInEndpoint (WaveDuplex::MicBlockSize);
+		else if (VoiceCapture == VOICE_CAPTURE_DMO)
+			mic = new DmoEndpoint ();
+		else
+			mic = new WaveInEndpoint (Wave::ChunkSize);
+	}
+	else {
+		AudioEndpoint::TYPE type = (AudioBackend == AUDIO_BACKEND_WAVFILE) ? AudioEndpoint::TYPE_WAVFILE : AudioEndpoint::TYPE_NULL;
+		speaker = AudioEndpoint::Create (type, false, AudioRealTime, AudioSpeakerFile);
+		mic		= AudioEndpoint::Create (type, true,  AudioRealTime, AudioMicFile);
+	}
+	LogMsg("Audio backend %d (realtime=%d): speaker %s, microphone %s", AudioBackend, AudioRealTime, speaker->GetName(), mic->GetName());
+
+	WaveOutDev = 0;
+	WaveInDev  = 0;
+	DuplexDev  = 0;
+	UseRing	   = ScoRingMode;
+	UseContReader = ContReaderMode;
+	UseBatch	  = ScoBatchMode;
+	ContReaderOn  = false;
+
+	if (DuplexEngine)
+		DuplexDev = new WaveDuplex(this, speaker, mic);
+	else {
+		WaveOutDev = new WaveOut(this, speaker);
+		WaveInDev  = new WaveIn(this, mic, VoiceCapture);
+	}
 }
 
 
 void ScoApp::Destruct()
 {
-    if (hDevice && hDevice!=INVALID_HANDLE_VALUE)
+    if (hDevice && hDevice!=INVALID_HANDLE_VALUE) {
+		Ring.Unmap(hDevice);
 		CloseHandle(hDevice);
+	}
 	hDevice = 0;
 
 	// Call Destruct method instead of delete! Actually it deletes. See remarks at Destruct()
-	WaveOutDev->Destruct();
-	WaveInDev->Destruct();
+	if (DuplexDev)
+		DuplexDev->Destruct();
+	else {
+		WaveOutDev->Destruct();
+		WaveInDev->Destruct();
+	}
 
 	Destructing = true;
 	EventScoConnect.Signal();	// no matter which event to signal
@@ -225,16 +336,14 @@ void ScoApp::OpenSco (bool waveonly)
 	if (!IsConstructed())
 		throw IntException (DialAppError_InternalError, "ScoApp::Construct was not called");
 
-	if (IsOpen())
+	if (IsOpen() || IsOpening())
 		throw IntException (DialAppError_InternalError, "ScoApp::CloseSco was not called");
 
-	if (!waveonly) {
-		unsigned long nbytes;
-		if (!DeviceIoControl (hDevice, IOCTL_HFP_OPEN_SCO, 0, 0, 0, 0, &nbytes, 0))
-			throw IntException (DialAppError_OpenScoFailure, "Failed to open SCO, GetLastError %d", GetLastError());
-	}
-
-	Open = true;
+	// The channel is opened by the driver in background, it reports by SCO_IO_OPEN completion
+	if (!waveonly)
+		StartIo (SCO_IO_OPEN);
+	else
+		Open = true;
 }
 
 
@@ -242,26 +351,100 @@ void ScoApp::CloseSco (bool waveonly)
 {
 	if (IsOpen()) {
 		LogMsg("About to Close SCO channel (waveonly=%d)", waveonly);
-		WaveOutDev->Stop();
-		WaveInDev->Stop();
-		if (!waveonly)
-			ReopenDriver();
+		if (DuplexDev)
+			DuplexDev->Stop();
+		else {
+			WaveOutDev->Stop();
+			WaveInDev->Stop();
+		}
+		Ring.Unmap(hDevice);
+		ContReaderStop();
 		Open = false;
-		DestAddr = 0;
+		// The SCO server stays registered, the driver reports the channel close by SCO_IO_CLOSE completion
+		if (!waveonly)
+			StartIo (SCO_IO_CLOSE);
 	}
 }
 
 void ScoApp::CloseScoLowLevel ()
 {
-	unsigned long nbytes;
-	DeviceIoControl (hDevice, IOCTL_HFP_CLOSE_SCO, 0, 0, 0, 0, &nbytes, 0);
+	try {
+		StartIo (SCO_IO_CLOSE);
+	}
+	catch (int) {
+		// Nothing is open in the application, so it's not an error
+	}
 }
 
 void ScoApp::VoiceStart ()
 {
 	LogMsg("About to start passing voice");
-	WaveOutDev->Play();
-	WaveInDev->Play();
+
+	// The SCO connection exists now, so the driver can start streaming it into the ring.
+	// If the driver can't map it, the voice goes through ReadFile/WriteFile as usual.
+	if (UseRing) {
+		try {
+			Ring.Map(hDevice);
+		}
+		catch (...) {
+			LogMsg("SCO ring is not available");
+		}
+	}
+
+	// The ring streams the SCO IN itself, so the continuous reader is for ReadFile mode only
+	if (UseContReader && !Ring.IsMapped())
+		ContReaderStart();
+
+	if (DuplexDev)
+		DuplexDev->Play();
+	else {
+		WaveOutDev->Play();
+		WaveInDev->Play();
+	}
+}
+
+
+void ScoApp::ContReaderStart ()
+{
+	HFP_CONT_READER_START params = { 3, 64, ScoRing::SlotSize };	// 3 transfers posted, ~2 s of 30 ms frames
+	unsigned long nbytes;
+
+	// Not fatal: without the reader each ReadFile is sent as SCO transfer
+	if (!DeviceIoControl (hDevice, IOCTL_HFP_CONT_READER_START, &params, sizeof(params), 0, 0, &nbytes, 0)) {
+		LogMsg("Continuous reader is not available, GetLastError %d", GetLastError());
+		return;
+	}
+
+	ContReaderOn = true;
+	LogMsg("Continuous reader started: depth %d, %d frames x %d bytes", params.Depth, params.SlotCount, params.FrameSize);
+}
+
+
+void ScoApp::ContReaderStop ()
+{
+	FRAME_RING_STATS stats = {};
+	unsigned long nbytes;
+
+	if (!ContReaderOn)
+		return;
+	ContReaderOn = false;
+
+	if (!DeviceIoControl (hDevice, IOCTL_HFP_CONT_READER_STOP, 0, 0, &stats, sizeof(stats), &nbytes, 0)) {
+		LogMsg("Continuous reader stop failed, GetLastError %d", GetLastError());
+		return;
+	}
+
+	LogMsg("Continuous reader stopped: %u frames, overruns %u, max fill %u, errors %u", stats.Frames, stats.Overruns, stats.MaxFill, stats.Errors);
+}
+
+
+bool ScoApp::GetScoStats (SCO_STATS & stats) throw()
+{
+	unsigned long nbytes;
+
+	if (!hDevice)
+		return false;
+	return DeviceIoControl (hDevice, IOCTL_HFP_SCO_STATS, 0, 0, &stats, sizeof(stats), &nbytes, 0)  &&  nbytes == sizeof(stats);
 }
 
 
@@ -9,11 +9,32 @@
 #include "def.h"
 #include "deblog.h"
 #include "Wave.h"
+#include "WaveDuplex.h"
+#include "ScoRing.h"
+#include "scostats.h"
 
 
 typedef void (*ScoAppCb) ();
 
 
+// Asynchronous SCO channel operations, their completion is reported by ScoAppIoCb
+enum SCO_IO {
+	SCO_IO_OPEN,
+	SCO_IO_CLOSE,
+	SCO_IO_COUNT
+};
+
+typedef void (*ScoAppIoCb) (SCO_IO io, int error);	// error is DialAppError_Ok or the failure code
+
+
+// Audio endpoints backends for the voice stream, the values are the DialAppDebug_AudioBackend modes
+enum AUDIO_BACKEND {
+	AUDIO_BACKEND_WINMM,	// WaveOut/WaveIn devices and DMO (default), see WinMmEndpoint.h
+	AUDIO_BACKEND_WAVFILE,	// Speaker voice is written to a WAV file, microphone voice is read from a WAV file
+	AUDIO_BACKEND_NULL		// Speaker voice is discarded, microphone produces silence
+};
+
+
 /*
  ************************************************************************************************
  C++ class for working with HFP Driver.
@@ -27,21 +48,51 @@ typedef void (*ScoAppCb) ();
  2. Create ScoApp object using its simple constructor
  3. Call the real constructor: Construct() method
  4. Call OpenSco() after the high level applications has already established a control connection
+
+ OpenSco() and CloseSco() don't wait for the radio: the driver's OPEN_SCO/CLOSE_SCO requests are 
+ overlapped and their completion is reported from the ScoApp thread by ScoAppIoCb.
  ************************************************************************************************
  */
 class ScoApp : public DebLog, public Thread
 {
   public:
-    HANDLE  hDevice;	// May be tested for detecting the object constructing state
+    HANDLE		hDevice;	// May be tested for detecting the object constructing state
+	FarEndTap	FarEnd;		// Speaker voice reference for the WaveIn echo canceller
+	DriftEstimator	Drift;	// Updated by WaveOut on its queue fill, the ratio is applied by both directions
+	ScoRing		Ring;		// If mapped, the SCO voice goes through it instead of ReadFile/WriteFile
 
   public:
 	static void Init ();
 	static void End  ();
 
+	// Selects the audio backend for ScoApp objects constructed after this call (DialAppDebug_AudioBackend).
+	// realtime=false makes WAVFILE/NULL endpoints free-running (for throughput tests).
+	static void SetAudioBackend (AUDIO_BACKEND backend, bool realtime = true, cchar * speaker_file = 0, cchar * mic_file = 0);
+
+	// Selects the single-thread duplex engine (WaveDuplex) instead of WaveOut/WaveIn pair for ScoApp objects constructed after this call
+	// (DialAppDebug_DuplexEngine)
+	static void SetDuplexEngine (bool duplex)	{ DuplexEngine = duplex; }
+
+	// Selects the driver's shared memory SCO ring (ScoRing) instead of ReadFile/WriteFile per chunk for ScoApp objects constructed after this call
+	// (DialAppDebug_ScoRing)
+	static void SetScoRingMode (bool ring)		{ ScoRingMode = ring; }
+
+	// Makes the driver keep SCO IN transfers posted into its frame ring (continuous reader) while the voice passes,
+	// so incoming audio is not lost between ReadFile calls. For ScoApp objects constructed after this call (DialAppDebug_ContReader).
+	static void SetContReaderMode (bool contreader)	{ ContReaderMode = contreader; }
+
+	// Sends the voice chunks by IOCTL_HFP_SCO_BATCH, split into SCO frames, instead of one ReadFile/WriteFile transfer per chunk.
+	// The shared memory ring takes precedence when it's mapped. For ScoApp objects constructed after this call.
+	static void SetScoBatchMode (bool batch)	{ ScoBatchMode = batch; }
+
+	// Selects the microphone capture of WaveIn: Voice Capture DMO (default) or WaveIn API with the native VoiceProc
+	// processing (the latter applies to AUDIO_BACKEND_WAVFILE/NULL endpoints as well). For ScoApp objects constructed after this call.
+	static void SetVoiceCapture (VOICE_CAPTURE capture)	{ VoiceCapture = capture; }
+
   public:
-	ScoApp(ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb error_cb) : DebLog("ScoApp "), Thread("ScoApp"), hDevice(0)
+	ScoApp(ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb error_cb, ScoAppIoCb io_cb) : DebLog("ScoApp "), Thread("ScoApp"), hDevice(0)
 	{
-		Construct(connect_cb, disconnect_cb, error_cb);
+		Construct(connect_cb, disconnect_cb, error_cb, io_cb);
 	}
 
 	~ScoApp()
@@ -49,14 +100,14 @@ class ScoApp : public DebLog, public Thread
 		Destruct();
 	}
 
-	void Construct (ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb error_cb);
+	void Construct (ScoAppCb connect_cb, ScoAppCb disconnect_cb, ScoAppCb error_cb, ScoAppIoCb io_cb);
 	void Destruct  () throw();
 
 	void StartServer (uint64 destaddr, bool readiness);
 	void StopServer  ();
 
-	void OpenSco   (bool waveonly = false);
-	void CloseSco  (bool waveonly = false);
+	void OpenSco   (bool waveonly = false);	// Not waveonly: the channel is open when ScoAppIoCb(SCO_IO_OPEN) reports it
+	void CloseSco  (bool waveonly = false);	// Not waveonly: the channel close is reported by ScoAppIoCb(SCO_IO_CLOSE)
 	void CloseScoLowLevel ();
 
 	void VoiceStart ();
@@ -66,30 +117,61 @@ class ScoApp : public DebLog, public Thread
 	bool IsConstructed()	{ return (hDevice!=0);	}
 	bool IsStarted ()		{ return (DestAddr!=0); }
 	bool IsOpen ()			{ return Open; }
+	bool IsOpening ()		{ return IoPending[SCO_IO_OPEN]; }
+	bool IsScoBatch ()		{ return UseBatch; }
+
+	// Sound card vs. SCO clock drift estimate, reported by dialappGetScoStats. Updated by the WaveOut thread without a lock.
+	const DriftEstimator::Stats & GetDriftStats ()	{ return Drift.GetStats(); }
+
+	// Driver's statistics of the current (or the last closed) SCO connection: one buffered IOCTL, cheap enough for polling.
+	// Returns false if there is no connection. Doesn't throw.
+	bool GetScoStats (SCO_STATS & stats) throw();
 
   protected:
 	void  OpenDriver ();
-	void  ReopenDriver ();
+	void  StartIo (SCO_IO io);
+	void  IoDone  (SCO_IO io);
+	void  ContReaderStart ();
+	void  ContReaderStop ();
 
   protected:
-	// Separate Thread for waiting on EventScoConnect & EventScoDisconnect & EvHandleScoCritError
+	// Separate Thread for waiting on EventScoConnect & EventScoDisconnect & EvHandleScoCritError & EventIo
     virtual void Run();
 
   protected:
     static PSP_DEVICE_INTERFACE_DETAIL_DATA  DeviceInterfaceDetailData;
+	static AUDIO_BACKEND	AudioBackend;
+	static bool				AudioRealTime;
+	static char				AudioSpeakerFile[MAX_PATH];
+	static char				AudioMicFile[MAX_PATH];
+	static bool				DuplexEngine;
+	static bool				ScoRingMode;
+	static bool				ContReaderMode;
+	static bool				ScoBatchMode;
+	static VOICE_CAPTURE	VoiceCapture;
 
   protected:
 	UINT64		DestAddr;	// Address of a Destination Bluetooth device, it's also started server indication
 	bool		Open;
 	WaveOut	   *WaveOutDev;
 	WaveIn	   *WaveInDev;
+	WaveDuplex *DuplexDev;	// If not 0, used instead of WaveOutDev & WaveInDev
+	bool		UseRing;	// ScoRingMode at the construction
+	bool		UseContReader;	// ContReaderMode at the construction
+	bool		UseBatch;	// ScoBatchMode at the construction
+	bool		ContReaderOn;	// The driver's continuous reader is started
 	Event		EventScoConnect;
 	Event		EventScoDisconnect;
 	Event		EventScoCritError;
+	Event		EventIo[SCO_IO_COUNT];		// Assigned to IoOverlapped
+	OVERLAPPED	IoOverlapped[SCO_IO_COUNT];
+	volatile bool IoPending[SCO_IO_COUNT];
+	DWORD		IoStartTime[SCO_IO_COUNT];	// GetTickCount at the request, for the completion time log
     bool		Destructing;
 	ScoAppCb	ConnectCb;
 	ScoAppCb	DisconnectCb;
 	ScoAppCb	ErrorCb;
+	ScoAppIoCb	IoCb;
 };
 
 
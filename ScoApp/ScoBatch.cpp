@@ -0,0 +1,98 @@
+/*******************************************************************\
+ Filename    :  ScoBatch.cpp
+ Purpose     :  Batched SCO transfers, application side
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <string.h>
+
+#include "ScoBatch.h"
+
+
+ULONG ScoBatch::Split (ULONG direction, ULONG size)
+{
+	ULONG i;
+
+	if (size == 0 || size > MaxSize)
+		return 0;
+
+	FrameCount	  = (size + FrameSize - 1) / FrameSize;
+	In.Direction  = direction;
+	In.FrameCount = FrameCount;
+
+	for (i = 0; i < HFP_SCO_BATCH_MAX_FRAMES; i++)
+		In.FrameSize[i] = (i < FrameCount-1) ? FrameSize : (i == FrameCount-1) ? size - i * FrameSize : 0;
+
+	return FrameCount;
+}
+
+
+ULONG ScoBatch::PrepareRead (ULONG size, ULONG * outlen)
+{
+	if (!Split (HFP_SCO_BATCH_READ, size))
+		return 0;
+
+	// The frames are received after the output header
+	*outlen = sizeof(HFP_SCO_BATCH_OUT) + size;
+	return sizeof(HFP_SCO_BATCH_IN);
+}
+
+
+ULONG ScoBatch::PrepareWrite (const void * data, ULONG size, ULONG * outlen)
+{
+	if (!Split (HFP_SCO_BATCH_WRITE, size))
+		return 0;
+
+	// The frames are sent from after the input header, the output is the results only
+	memcpy (Buf + sizeof(HFP_SCO_BATCH_IN), data, size);
+	*outlen = sizeof(HFP_SCO_BATCH_OUT);
+	return sizeof(HFP_SCO_BATCH_IN) + size;
+}
+
+
+ULONG ScoBatch::GatherRead (void * data, ULONG size) const
+{
+	const UCHAR *frame = Buf + sizeof(HFP_SCO_BATCH_OUT);
+	ULONG		 n = 0, i;
+
+	// A frame is in its FrameSize slot, only Transferred bytes of it are valid
+	for (i = 0; i < FrameCount && i < Out.FrameCount; i++, frame += FrameSize) {
+		ULONG len = Out.Transferred[i];
+		if (Out.Status[i] < 0 || len == 0)
+			continue;
+		if (len > size - n)
+			len = size - n;
+		memcpy ((UCHAR*)data + n, frame, len);
+		n += len;
+	}
+
+	return n;
+}
+
+
+ULONG ScoBatch::Transferred () const
+{
+	ULONG n = 0, i;
+
+	for (i = 0; i < FrameCount && i < Out.FrameCount; i++)
+		n += Out.Transferred[i];
+	return n;
+}
+
+
+ULONG ScoBatch::FailedFrames () const
+{
+	ULONG n = 0, i;
+
+	for (i = 0; i < FrameCount; i++)
+		if (i >= Out.FrameCount || Out.Status[i] < 0)
+			n++;
+	return n;
+}
+
+
+#pragma managed(pop)
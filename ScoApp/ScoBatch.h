@@ -0,0 +1,66 @@
+/*******************************************************************\
+ Filename    :  ScoBatch.h
+ Purpose     :  Batched SCO transfers, application side
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+#include "scobatch.h"
+
+
+/*
+ ************************************************************************************************
+ IOCTL_HFP_SCO_BATCH request buffer (see HfpDriver/scobatch.h) for one voice chunk: the chunk is
+ split into SCO frames which the driver sends by one request, instead of one ReadFile/WriteFile
+ transfer per chunk.
+ The object only lays out the request and gathers its results, without any OS dependencies, 
+ so it may be tested without the driver. The I/O is done by the caller:
+	inlen = batch.PrepareRead(size, &outlen);
+	DeviceIoControl(hdevice, IOCTL_HFP_SCO_BATCH, batch.GetBuffer(), inlen, batch.GetBuffer(), outlen, ...);
+	nbytes = batch.GatherRead(data, size);
+ ************************************************************************************************
+ */
+class ScoBatch
+{
+  public:
+	enum {
+		FrameSize = 480,									// 30 ms of 8 kHz 16-bit mono, the SCO transfer size
+		MaxSize	  = HFP_SCO_BATCH_MAX_FRAMES * FrameSize	// Max chunk size
+	};
+
+  public:
+	ScoBatch () : FrameCount(0)		{}
+
+	// Lays out the read request of size bytes: returns the input length (0 if the size is 0 or more than MaxSize),
+	// outlen receives the output length
+	ULONG PrepareRead (ULONG size, ULONG * outlen);
+
+	// Lays out the write request with the data: returns the input length (0 if the size is 0 or more than MaxSize),
+	// outlen receives the output length
+	ULONG PrepareWrite (const void * data, ULONG size, ULONG * outlen);
+
+	// After the read request completion: copies the received frames back to back, up to size bytes.
+	// Returns the number of copied bytes.
+	ULONG GatherRead (void * data, ULONG size) const;
+
+	// After the request completion: the number of transferred bytes and failed frames
+	ULONG Transferred () const;
+	ULONG FailedFrames () const;
+
+	void * GetBuffer ()		{ return Buf; }
+
+  protected:
+	ULONG Split (ULONG direction, ULONG size);
+
+  protected:
+	ULONG	FrameCount;
+	union {
+		HFP_SCO_BATCH_IN	In;
+		HFP_SCO_BATCH_OUT	Out;
+		UCHAR				Buf[sizeof(HFP_SCO_BATCH_OUT) + MaxSize];	// The output header is the larger one
+	};
+};
+
+
+#pragma managed(pop)
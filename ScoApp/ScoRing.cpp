@@ -0,0 +1,108 @@
+/*******************************************************************\
+ Filename    :  ScoRing.cpp
+ Purpose     :  Shared memory SCO audio ring, application side
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#include "def.h"
+#include "ScoRing.h"
+#include "hfppublic.h"
+#include "DialAppType.h"
+
+
+
+void ScoRing::Map (HANDLE hdevice)
+{
+	HFP_SCO_RING_MAP_IN  in  = { SlotCount, SlotSize, UINT64(EventRx.GetWaitHandle()) };
+	HFP_SCO_RING_MAP_OUT out = { 0, 0 };
+	unsigned long		 nbytes;
+
+	if (IsMapped())
+		return;
+
+	EventRx.Reset();
+	if (!DeviceIoControl (hdevice, IOCTL_HFP_SCO_RING_MAP, &in, sizeof(in), &out, sizeof(out), &nbytes, 0))
+		throw IntException (DialAppError_OpenScoFailure, "SCO ring mapping failed, GetLastError %d", GetLastError());
+
+	if (!ScoShmAttach (&View, (void*) out.Address, out.Size)) {
+		DeviceIoControl (hdevice, IOCTL_HFP_SCO_RING_UNMAP, 0, 0, 0, 0, &nbytes, 0);
+		throw IntException (DialAppError_OpenScoFailure, "SCO ring has invalid header");
+	}
+
+	RxTail = RxPos = TxHead = 0;
+	Header = View.Header;
+	LogMsg("Mapped: %d slots x %d bytes", View.SlotCount, View.SlotSize);
+}
+
+
+void ScoRing::Unmap (HANDLE hdevice)
+{
+	unsigned long nbytes;
+
+	if (!IsMapped())
+		return;
+
+	LogMsg("Rx %u frames (overruns %u), Tx %u frames (underruns %u)", Header->RxFrames, Header->RxOverruns, Header->TxFrames, Header->TxUnderruns);
+	Header = 0;
+
+	if (!DeviceIoControl (hdevice, IOCTL_HFP_SCO_RING_UNMAP, 0, 0, 0, 0, &nbytes, 0))
+		LogMsg("SCO ring unmapping failed, GetLastError %d", GetLastError());
+}
+
+
+DWORD ScoRing::Read (void * data, DWORD size, DWORD timeout)
+{
+	DWORD n = 0;
+	bool  waited = false;
+
+	while (n < size && Header)
+	{
+		ULONG length;
+		SCO_SHM_SLOT * slot = ScoShmConsumeSlot (&View, &Header->Rx, View.RxOffset, RxTail, 0, &length);
+		if (!slot) {
+			if (waited)
+				break;
+			EventRx.Wait (timeout);
+			waited = true;
+			continue;
+		}
+
+		// A slot may be read partially, the rest is taken by the next call
+		DWORD chunk = MIN(length - RxPos, size - n);
+		memcpy ((char*)data + n, ScoShmSlotData(slot) + RxPos, chunk);
+		n	  += chunk;
+		RxPos += chunk;
+
+		if (RxPos >= length) {
+			ScoShmConsume (&Header->Rx, &RxTail, 1);
+			RxPos = 0;
+		}
+	}
+
+	return n;
+}
+
+
+DWORD ScoRing::Write (const void * data, DWORD size)
+{
+	DWORD n = 0;
+
+	while (n < size && Header)
+	{
+		SCO_SHM_SLOT * slot = ScoShmProduceSlot (&View, &Header->Tx, View.TxOffset, TxHead, 0);
+		if (!slot)
+			break;	// full: the driver sends slower than we produce
+
+		DWORD chunk = MIN(View.SlotSize, size - n);
+		memcpy (ScoShmSlotData(slot), (const char*)data + n, chunk);
+		slot->Length = chunk;
+		ScoShmProduce (&Header->Tx, &TxHead, 1);
+		n += chunk;
+	}
+
+	return n;
+}
+
+
+#pragma managed(pop)
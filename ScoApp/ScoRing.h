@@ -0,0 +1,59 @@
+/*******************************************************************\
+ Filename    :  ScoRing.h
+ Purpose     :  Shared memory SCO audio ring, application side
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+#include "def.h"
+#include "deblog.h"
+#include "mutex.h"
+#include "scoshm.h"
+
+
+/*
+ ************************************************************************************************
+ Application side of the driver's shared memory SCO ring (see HfpDriver/scoshm.h).
+ After Map() the driver streams the SCO connection itself, keeping transfers posted on the ring
+ slots: the speaker side drains the Rx slots (woken by the Rx doorbell event) and the microphone
+ side fills the Tx slots, with no ReadFile/WriteFile per chunk.
+
+ Read() is called by one thread (the speaker) and Write() by one thread (the microphone).
+ Map() and Unmap() are called when both are stopped.
+ ************************************************************************************************
+ */
+class ScoRing : public DebLog
+{
+  public:
+	enum {
+		SlotSize  = 480,	// 30 ms of 8 kHz 16-bit mono, the SCO transfer size
+		SlotCount = 32		// ~1 s per direction
+	};
+
+  public:
+	ScoRing () : DebLog("ScoRing "), Header(0)	{}
+
+	void Map   (HANDLE hdevice);	// Throws IntException
+	void Unmap (HANDLE hdevice);
+
+	bool IsMapped ()	{ return Header != 0; }
+
+	// Copies up to size bytes of received voice. Waits up to timeout ms when the ring is empty,
+	// returns the number of copied bytes.
+	DWORD Read (void * data, DWORD size, DWORD timeout);
+
+	// Queues the voice for sending, returns the number of queued bytes: the rest is dropped when the ring is full
+	DWORD Write (const void * data, DWORD size);
+
+  protected:
+	SCO_SHM_VIEW	View;		// Validated geometry
+	SCO_SHM_HEADER *Header;		// Mapped memory or 0
+	ULONG			RxTail;		// Rx consumer index
+	ULONG			RxPos;		// Read position in the current Rx slot
+	ULONG			TxHead;		// Tx producer index
+	Event			EventRx;	// Rx doorbell, set by the driver
+};
+
+
+#pragma managed(pop)
@@ -0,0 +1,280 @@
+/*******************************************************************\
+ Filename    :  VoiceProc.cpp
+ Purpose     :  Native voice processing: AEC + NS + AGC
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "VoiceProc.h"
+
+
+static inline float MaxAbs (float m, float v)
+{
+	v = v < 0 ? -v : v;
+	return v > m ? v : m;
+}
+
+
+/****************************************************************************************\
+									Class VoiceProc
+\****************************************************************************************/
+
+VoiceProc::Config::Config() :
+	SampleRate(DefSampleRate), FrameSize(DefFrameSize), EchoTail(DefEchoTail), StepSize(0.3f), DtdThreshold(0.5f),
+	AecEnabled(true), NsEnabled(true), AgcEnabled(true), NsMinGain(0.15f), AgcTargetLevel(4000.f), AgcMaxGain(8.f)
+{
+}
+
+
+float VoiceProc::Stats::ErleDb() const
+{
+	if (EchoOutEnergy <= 0 || NearEnergy <= 0)
+		return 0;
+	return float(10 * log10(NearEnergy / EchoOutEnergy));
+}
+
+
+VoiceProc::VoiceProc () :
+	Weights(0), FarHist(0), FarPeak(0), Work(0)
+{
+	Init(Config());
+}
+
+
+VoiceProc::~VoiceProc ()
+{
+	Free();
+}
+
+
+void VoiceProc::Free ()
+{
+	free(Weights);	Weights = 0;
+	free(FarHist);	FarHist = 0;
+	free(FarPeak);	FarPeak = 0;
+	free(Work);		Work	= 0;
+}
+
+
+bool VoiceProc::Init (const Config & cfg)
+{
+	if (cfg.FrameSize <= 0 || cfg.FrameSize > MaxFrameSize || cfg.EchoTail <= 0 || cfg.EchoTail > MaxEchoTail)
+		return false;
+
+	Free();
+	Cfg = cfg;
+
+	FarPeakN = (Cfg.EchoTail + Cfg.FrameSize - 1) / Cfg.FrameSize + 1;
+
+	Weights = (float*) malloc (Cfg.EchoTail * sizeof(float));
+	FarHist = (float*) malloc ((Cfg.EchoTail + Cfg.FrameSize) * sizeof(float));
+	FarPeak = (float*) malloc (FarPeakN * sizeof(float));
+	Work	= (float*) malloc (Cfg.FrameSize * sizeof(float));
+
+	if (!Weights || !FarHist || !FarPeak || !Work) {
+		Free();
+		return false;
+	}
+
+	Reset();
+	return true;
+}
+
+
+void VoiceProc::Reset ()
+{
+	memset (Weights, 0, Cfg.EchoTail * sizeof(float));
+	memset (FarHist, 0, (Cfg.EchoTail + Cfg.FrameSize) * sizeof(float));
+	memset (FarPeak, 0, FarPeakN * sizeof(float));
+	FarPeakInd = 0;
+	FarPow	   = 0;
+
+	NoiseEst = NoiseMin = 1e4f;		// ~100 RMS, will be adapted quickly
+	NoiseCnt = 0;
+	NsGain	 = 1;
+	AgcGain	 = 1;
+
+	ResetStats();
+}
+
+
+void VoiceProc::ResetStats ()
+{
+	memset (&Stat, 0, sizeof(Stat));
+	Stat.AgcGain = AgcGain;
+}
+
+
+void VoiceProc::Process (const short * near, const short * far, short * out)
+{
+	const int n = Cfg.FrameSize;
+	float * x = Work;
+	int i;
+
+	for (i = 0; i < n; i++)
+		x[i] = near[i];
+
+	if (Cfg.AecEnabled) {
+		// Shift far history and append the new far frame (zeros if there is no reference)
+		const int tail = Cfg.EchoTail;
+		float * fh = FarHist;
+		memmove (fh, fh + n, tail * sizeof(float));
+		if (far) {
+			for (i = 0; i < n; i++)
+				fh[tail + i] = far[i];
+		}
+		else
+			memset (fh + tail, 0, n * sizeof(float));
+
+		Aec (x, fh + tail);
+	}
+
+	if (Cfg.NsEnabled)
+		Ns (x);
+
+	if (Cfg.AgcEnabled)
+		Agc (x);
+
+	for (i = 0; i < n; i++) {
+		float v = x[i];
+		if (v > 32767.f)  v = 32767.f;
+		if (v < -32768.f) v = -32768.f;
+		out[i] = short(v);
+	}
+
+	Stat.Frames++;
+}
+
+
+void VoiceProc::Aec (float * frame, const float * far)
+{
+	const int n = Cfg.FrameSize;
+	const int L = Cfg.EchoTail;
+	float	  nearPeak = 0, farPeak = 0, nearEn = 0, errEn = 0;
+	int		  i, k;
+
+	// Far-end peaks over the whole tail for Geigel double-talk detection
+	for (i = 0; i < n; i++)
+		farPeak = MaxAbs (farPeak, far[i]);
+	FarPeak[FarPeakInd] = farPeak;
+	if (++FarPeakInd == FarPeakN)
+		FarPeakInd = 0;
+	for (k = 0; k < FarPeakN; k++)
+		farPeak = FarPeak[k] > farPeak ? FarPeak[k] : farPeak;
+
+	for (i = 0; i < n; i++)
+		nearPeak = MaxAbs (nearPeak, frame[i]);
+
+	bool doubletalk = (nearPeak > Cfg.DtdThreshold * farPeak);
+	if (doubletalk)
+		Stat.DoubleTalkFrames++;
+
+	for (i = 0; i < n; i++)
+	{
+		const float * xr = far + i - (L - 1);	// oldest sample in the window, pairs with Weights[L-1]
+		float y = 0;
+
+		// FarPow tracking: sample entering and sample leaving the window
+		float in  = far[i];
+		float out = far[i - L];
+		FarPow += in*in - out*out;
+		if (FarPow < 0)
+			FarPow = 0;
+
+		for (k = 0; k < L; k++)
+			y += Weights[L-1-k] * xr[k];
+
+		float e = frame[i] - y;
+
+		nearEn += frame[i] * frame[i];
+		errEn  += e * e;
+
+		if (!doubletalk && FarPow > 1.f) {
+			float mu = Cfg.StepSize * e / (FarPow + 1e3f);
+			for (k = 0; k < L; k++)
+				Weights[L-1-k] += mu * xr[k];
+		}
+
+		frame[i] = e;
+	}
+
+	if (farPeak > 0) {
+		Stat.NearEnergy	   += nearEn;
+		Stat.EchoOutEnergy += errEn;
+	}
+}
+
+
+void VoiceProc::Ns (float * frame)
+{
+	const int n = Cfg.FrameSize;
+	float	  en = 0;
+	int		  i;
+
+	for (i = 0; i < n; i++)
+		en += frame[i] * frame[i];
+	en /= n;
+
+	// Minimum statistics: track the minimum over ~1.5 sec windows, the estimate is released slowly
+	const int window = 1500 * Cfg.SampleRate / 1000 / n;
+	if (en < NoiseMin)
+		NoiseMin = en;
+	if (++NoiseCnt >= window) {
+		NoiseEst = NoiseMin;
+		NoiseMin = en;
+		NoiseCnt = 0;
+	}
+	if (en < NoiseEst)
+		NoiseEst = en;
+
+	float snr  = en / (NoiseEst + 1.f);
+	float gain = 1.f - 1.f / (snr + 1e-3f);
+	if (gain < Cfg.NsMinGain)
+		gain = Cfg.NsMinGain;
+
+	// Fast attack on speech onset, slow release
+	NsGain += (gain > NsGain ? 0.5f : 0.1f) * (gain - NsGain);
+
+	for (i = 0; i < n; i++)
+		frame[i] *= NsGain;
+
+	Stat.NoiseFloor = sqrtf(NoiseEst);
+}
+
+
+void VoiceProc::Agc (float * frame)
+{
+	const int n = Cfg.FrameSize;
+	float	  en = 0, peak = 0;
+	int		  i;
+
+	for (i = 0; i < n; i++) {
+		en += frame[i] * frame[i];
+		peak = MaxAbs (peak, frame[i]);
+	}
+	float rms = sqrtf(en / n);
+
+	// Adapt only on voice frames, i.e. clearly above the noise floor
+	if (rms > 3.f * Stat.NoiseFloor && rms > 1.f) {
+		float target = Cfg.AgcTargetLevel / rms;
+		if (target > Cfg.AgcMaxGain)
+			target = Cfg.AgcMaxGain;
+		AgcGain += (target < AgcGain ? 0.3f : 0.02f) * (target - AgcGain);
+	}
+
+	float gain = AgcGain;
+	if (peak * gain > 32000.f)		// limiter
+		gain = 32000.f / peak;
+
+	for (i = 0; i < n; i++)
+		frame[i] *= gain;
+
+	Stat.AgcGain = AgcGain;
+}
+
+
+#pragma managed(pop)
@@ -0,0 +1,109 @@
+/*******************************************************************\
+ Filename    :  VoiceProc.h
+ Purpose     :  Native voice processing: AEC + NS + AGC
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+
+/*
+ ************************************************************************************************
+ Block-based voice processing stage for the microphone (near-end) stream, independent of the
+ Windows Voice Capture DMO. It is a pure computational object without any OS dependencies,
+ so it may be fed from WAV files offline as well as from the real WaveIn stream.
+
+ Processing chain per frame:
+	1. AEC - time-domain NLMS echo canceller with a Geigel double-talk detector. The far-end
+	   reference is the voice received from SCO and sent to the speaker (see FarEndTap in Wave.h).
+	2. NS  - noise suppression: minimum-statistics noise floor tracking with a smoothed
+	   Wiener-like frame gain.
+	3. AGC - automatic gain control towards the target RMS level with attack/release smoothing
+	   and hard limiting.
+
+ The inner loops are written as plain contiguous float loops without dependencies between
+ iterations, so the compiler auto-vectorizes them for both SSE/AVX and NEON targets.
+
+ Usage:
+	VoiceProc vp;
+	vp.Init(cfg);						// may be called again for re-configuration
+	vp.Process(near, far, out);			// cfg.FrameSize samples each, far may be 0
+ ************************************************************************************************
+ */
+class VoiceProc
+{
+  public:
+	enum {
+		DefSampleRate	= 8000,		// Voice rate samples/sec
+		DefFrameSize	= 80,		// 10 ms at 8000
+		DefEchoTail		= 512,		// 64 ms at 8000
+		MaxFrameSize	= 1024,
+		MaxEchoTail		= 4096
+	};
+
+	struct Config {
+		int		SampleRate;
+		int		FrameSize;			// Samples per Process() call
+		int		EchoTail;			// AEC filter length in samples
+		float	StepSize;			// NLMS step size (0..1]
+		float	DtdThreshold;		// Double-talk when near peak > DtdThreshold * far peak over the tail
+		bool	AecEnabled;
+		bool	NsEnabled;
+		bool	AgcEnabled;
+		float	NsMinGain;			// Lowest NS gain, limits the suppression depth
+		float	AgcTargetLevel;		// Target output RMS, in 16-bit PCM units
+		float	AgcMaxGain;
+
+		Config();
+	};
+
+	struct Stats {
+		unsigned	Frames;				// Processed frames
+		unsigned	DoubleTalkFrames;	// Frames when AEC adaptation was frozen
+		double		NearEnergy;			// Accumulated near-end (mic) energy
+		double		EchoOutEnergy;		// Accumulated AEC output energy
+		float		NoiseFloor;			// Current NS noise floor (RMS)
+		float		AgcGain;			// Current AGC gain
+
+		float ErleDb() const;			// Echo Return Loss Enhancement over the accumulation period
+	};
+
+  public:
+	VoiceProc ();
+	~VoiceProc ();
+
+	bool Init (const Config & cfg);
+	void Reset ();
+	void Process (const short * near, const short * far, short * out);
+
+	const Config &	GetConfig() const	{ return Cfg;  }
+	const Stats  &	GetStats () const	{ return Stat; }
+	void			ResetStats ();
+
+  protected:
+	void  Free ();
+	void  Aec (float * frame, const float * far);
+	void  Ns  (float * frame);
+	void  Agc (float * frame);
+
+  protected:
+	Config	Cfg;
+	Stats	Stat;
+
+	float  *Weights;	// EchoTail NLMS coefficients, Weights[0] corresponds to the newest far sample
+	float  *FarHist;	// EchoTail+FrameSize far samples, oldest first
+	float  *FarPeak;	// Per-frame far-end abs peaks over the tail, used by double-talk detector
+	int		FarPeakN;
+	int		FarPeakInd;
+	float	FarPow;		// Running sum of squares over the EchoTail window
+	float  *Work;		// FrameSize work buffer
+
+	float	NoiseEst;	// NS noise floor (mean square)
+	float	NoiseMin;	// NS minimum tracker
+	int		NoiseCnt;
+	float	NsGain;
+	float	AgcGain;
+};
+
+
+#pragma managed(pop)
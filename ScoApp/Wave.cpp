@@ -9,12 +9,7 @@
 #include "Wave.h"
 #include "ScoApp.h"
 #include "HfpSm.h"
-
-// DMO
-#include <wmcodecdsp.h>
-#include <uuids.h>
-#include <dmort.h>
-#include <propsys.h>
+#include "hfppublic.h"
 
 
 
@@ -22,25 +17,9 @@
 									Class Wave 
 \****************************************************************************************/
 
-Wave::Wave (cchar * task, ScoApp *parent) :
-	DebLog(task), Thread(task), Parent(parent), hWave(0), State(STATE_IDLE), ErrorRaised(false), IoErrorsCnt(0), EventStart(), EventDataReady()
+Wave::Wave (cchar * task, ScoApp *parent, AudioEndpoint *endpoint) :
+	DebLog(task), Thread(task), Parent(parent), Endpoint(endpoint), State(STATE_IDLE), ErrorRaised(false), IoErrorsCnt(0), EventStart(), EventDataReady()
 {
-	memset (&Format, 0, sizeof(WAVEFORMATEX));
-
-	for (int i=0; i<DataBlocks.Size; i++) {
-		memset (&DataBlocks.Addr[i], 0, sizeof(WAVEBLOCK));
-		DataBlocks.Addr[i].Hdr.lpData = (char*) DataBlocks.Addr[i].Data;
-		DataBlocks.Addr[i].Hdr.dwBufferLength = ChunkSize;	// it's actual for WaveIn only, for WaveOut will be overridden 
-	}
-
-	int block = VoiceBitPerSample/8 * VoiceNchan;
-	Format.wFormatTag		= VoiceFormat;
-	Format.nChannels		= VoiceNchan;
-	Format.nSamplesPerSec	= VoiceSampleRate;
-	Format.nAvgBytesPerSec	= block * VoiceSampleRate;
-	Format.nBlockAlign		= block;
-	Format.wBitsPerSample	= VoiceBitPerSample;
-
 	if (!EventStart.GetWaitHandle() || !EventDataReady.GetWaitHandle())
 		throw IntException (DialAppError_InsufficientResources, "CreateEvent() failed");
 
@@ -59,6 +38,7 @@ void Wave::Destruct ()
 	State = STATE_DESTROYING;
 	EventStart.Signal();
 	Thread::WaitEnding();
+	delete Endpoint;
 	LogMsg("Destructed");
 	delete this; // the destructor is empty!
 }
@@ -87,17 +67,6 @@ void Wave::Stop()
 }
 
 
-void Wave::UnprepareHeader (WAVEHDR * whdr)
-{
-	try {
-		CHECK_MMRES (waveUnprepare(hWave, whdr, sizeof(WAVEHDR)));
-	}
-	catch (...) {
-		// do nothing
-	}
-}
-
-
 // virtual from Thread
 void Wave::Run()
 {
@@ -124,15 +93,7 @@ void Wave::Run()
 			RunStart();	// WaveIn or WaveOut Start running 
 			while (State == STATE_PLAYING)
 			{
-				WAVEBLOCK * wblock = DataBlocks.FetchNext ();
-				LogMsg ("WAVEBLOCK Fetched:  %X", wblock);
-				if (!wblock) {
-					LogMsg("ERROR: No free buffers for %s", this->Name);
-					ReportVoiceStreamFailure (DialAppError_WaveBuffersError);
-					break; // ErrorRaised
-				}
-
-				RunBody(wblock);	// WaveIn or WaveOut running part
+				RunBody();	// WaveIn or WaveOut running part
 
 				if (ErrorRaised) {
 					// Stop this playing, waiting close...
@@ -153,55 +114,23 @@ void Wave::Run()
 	}
 	catch (int err)
 	{
-		LogMsg("EXCEPTION %d", err);
+		LogMsg("EXCEPTION %d %s", err, Endpoint->GetError());
 		HfpSm::PutEvent_Failure(err);	// if we have an error when starting voice, we should to notice
 	}
 }
 
 
-void Wave::ReleaseCompletedBlocks (bool clean_all)
+void Wave::RunInit ()
 {
-	// If clean_all = false - to release 1st blocks with WHDR_DONE=1
-	// If clean_all = true  - to release all blocks: with WHDR_DONE=1 and WHDR_DONE=0 after waiting 
-
-	int i = 0;
-
-	while (WAVEBLOCK* wblock = DataBlocks.GetFirst()) 
-	{
-		if (!clean_all && ((wblock->Hdr.dwFlags & WHDR_DONE) == 0))
-			return;
-
-		while ((wblock->Hdr.dwFlags & WHDR_DONE) == 0) {
-			if (i++ == 0)
-				LogMsg ("ReleaseCompletedBlocks: Poling %X ...", wblock);
-			Sleep(0);
-		}
-		if (i) {
-			LogMsg ("ReleaseCompletedBlocks: Poling finished (%d iterations)", i);
-			i = 0;
-		}
-
-		UnprepareHeader (&wblock->Hdr);
-		wblock->Hdr.dwFlags = 0;
-		DataBlocks.ReleaseFirst();
-		LogMsg ("WAVEBLOCK Released: %X", wblock);
-	}
+	AudioEndpoint::FORMAT fmt = { VoiceSampleRate, VoiceNchan, VoiceBitPerSample };
+	Endpoint->Open(fmt);
+	LogMsg("Endpoint opened: %s", Endpoint->GetName());
 }
 
 
-Wave::WAVEBLOCK*  Wave::GetCompletedBlock()
+void Wave::RunEnd ()
 {
-	if (WAVEBLOCK* wblock = DataBlocks.GetFirst()) 
-	{
-		if (wblock->Hdr.dwFlags & WHDR_DONE) {
-			UnprepareHeader (&wblock->Hdr);
-			wblock->Hdr.dwFlags = 0;
-			DataBlocks.ReleaseFirst();
-			LogMsg ("WAVEBLOCK Released: %X", wblock);
-			return wblock;
-		}
-	}
-	return 0;
+	Endpoint->Close();
 }
 
 
@@ -212,70 +141,108 @@ void Wave::ReportVoiceStreamFailure (int error)
 }
 
 
-/****************************************************************************************\
-									Class WaveOut
-\****************************************************************************************/
-
-WaveOut::WaveOut (ScoApp *parent) :
-	Wave ("WaveOut", parent)
+void Wave::ReportEndpointFailure (int error)
 {
-	// WaveOut uses ScoOverlapped.hEvent when doing ReadFile
-	ScoOverlapped.hEvent = (HANDLE) EventDataReady.GetWaitHandle();
-
-	waveOpen	  = WaveOpen(waveOutOpen);
-	waveClose	  = WaveClose(waveOutClose);
-	waveReset	  = WaveReset(waveOutReset);
-	waveUnprepare = WaveUnprepare(waveOutUnprepareHeader);
+	LogMsg("%s failed: %d %s", Endpoint->GetName(), error, Endpoint->GetError());
+	ReportVoiceStreamFailure (error);
 }
 
 
+/****************************************************************************************\
+									Class FarEndTap
+\****************************************************************************************/
 
-void WaveOut::RunInit ()
+int FarEndTap::Get (short * data, int n)
 {
-	CHECK_MMRES (waveOpen (&hWave, WAVE_MAPPER, &Format, 0, (DWORD_PTR)this, CALLBACK_NULL));
-	LogMsg("Open hWave = %X", hWave);
+	int got = Ring.PopSpan (data, n);
+	if (got < n)
+		memset (data + got, 0, (n - got) * sizeof(short));
+	return got;
 }
 
 
-void WaveOut::RunEnd ()
+
+/****************************************************************************************\
+									Class WaveOut
+\****************************************************************************************/
+
+WaveOut::WaveOut (ScoApp *parent, AudioEndpoint *endpoint) :
+	Wave ("WaveOut", parent, endpoint)
 {
-	CHECK_MMRES (waveClose(hWave));
+	// WaveOut uses ScoOverlapped.hEvent when doing ReadFile
+	ScoOverlapped.hEvent = (HANDLE) EventDataReady.GetWaitHandle();
 }
 
 
 void WaveOut::RunStart ()
 {
+	Endpoint->Start();
+
+	#ifdef DRIFTCOMP_ENABLED
+	Resampler.Reset();
+	Parent->Drift.Reset();
+	#endif
 }
 
 
 void WaveOut::RunStop ()
 {
-	/*
-	KS: Do not use waveReset() at all! It is very problematic...
-		We will poll WHDR_DONE in ReleaseCompletedBlocks(true)
-	try {
-		CHECK_MMRES (waveReset(hWave));
-	}
-	catch (...) {
-		ReportVoiceStreamFailure (DialAppError_WaveApiError);
+	Endpoint->Stop();
+
+	#ifdef DRIFTCOMP_ENABLED
+	if (Endpoint->IsDeviceClock()) {
+		const DriftEstimator::Stats & st = Parent->Drift.GetStats();
+		LogMsg("Drift: correction %d ppm, fill %d (target %d, min %d, max %d), resampled %d -> %d samples",
+			   int(st.RatioPpm), st.FillLast, st.FillTarget, st.FillMin, st.FillMax, int(Resampler.GetInTotal()), int(Resampler.GetOutTotal()));
 	}
-	*/
-	ReleaseCompletedBlocks(true);
+	#endif
 }
 
 
 // virtual from Wave
-void WaveOut::RunBody (WAVEBLOCK * wblock)
+void WaveOut::RunBody ()
 {
 	DWORD	nbytes;
 	BOOL	res;
+	void   *rxbuf = Chunk;
+	DWORD	rxsize = ChunkSize;
+
+	#ifdef DRIFTCOMP_ENABLED
+	if (Endpoint->IsDeviceClock()) {
+		// Read to the side buffer, the resampler output may be slightly longer
+		rxbuf  = DriftBuf;
+		rxsize = sizeof(DriftBuf);
+	}
+	#endif
 
-	EventDataReady.Reset();	// this event is also assigned to ScoOverlapped
-	res = ReadFile (Parent->hDevice, wblock->Data, ChunkSize, &nbytes, &ScoOverlapped);
-	if (!res) {
-		if (GetLastError() == ERROR_IO_PENDING) {
-			//LogMsg("Read from SCO pended...");
+	if (Parent->Ring.IsMapped()) {
+		// The driver streams into the shared ring: a chunk is gathered from the Rx slots
+		nbytes = Parent->Ring.Read (rxbuf, rxsize, ChunkTime4Wait);
+		res	   = (nbytes != 0);
+		if (!res)
+			SetLastError (ERROR_TIMEOUT);
+	}
+	else if (Parent->IsScoBatch()) {
+		// One request for all the SCO frames of the chunk
+		ULONG outlen, inlen = RxBatch.PrepareRead (rxsize, &outlen);
+		EventDataReady.Reset();	// this event is also assigned to ScoOverlapped
+		res = DeviceIoControl (Parent->hDevice, IOCTL_HFP_SCO_BATCH, RxBatch.GetBuffer(), inlen, RxBatch.GetBuffer(), outlen, &nbytes, &ScoOverlapped);
+		if (!res && GetLastError() == ERROR_IO_PENDING)
 			res = GetOverlappedResult (Parent->hDevice, &ScoOverlapped, &nbytes, TRUE);
+		if (res) {
+			if (RxBatch.FailedFrames())
+				LogMsg("Read from SCO: %d frames failed", RxBatch.FailedFrames());
+			nbytes = RxBatch.GatherRead (rxbuf, rxsize);
+		}
+	}
+	else {
+		EventDataReady.Reset();	// this event is also assigned to ScoOverlapped
+		res = ReadFile (Parent->hDevice, rxbuf, rxsize, &nbytes, &ScoOverlapped);
+		if (!res) {
+			if (GetLastError() == ERROR_IO_PENDING) {
+				//LogMsg("Read from SCO pended...");
+				res = GetOverlappedResult (Parent->hDevice, &ScoOverlapped, &nbytes, TRUE);
+			}
 		}
 	}
 
@@ -288,27 +255,30 @@ void WaveOut::RunBody (WAVEBLOCK * wblock)
 			ReportVoiceStreamFailure (DialAppError_ReadScoError);
 			IoErrorsCnt = 0;
 		}
-		wblock->Hdr.dwFlags = WHDR_DONE;	// try to continue, mark the buffer as done
-		goto endfunc;
+		return;		// try to continue
 	}
 
-	if (State != STATE_PLAYING) {
-		wblock->Hdr.dwFlags = WHDR_DONE;	// mark the buffer as done
-		goto endfunc;
+	if (State != STATE_PLAYING)
+		return;
+
+	#ifdef DRIFTCOMP_ENABLED
+	if (rxbuf == DriftBuf) {
+		int fill = Endpoint->GetQueueFill();
+		double ratio = (fill >= 0) ? Parent->Drift.Update(fill) : Parent->Drift.GetRatio();
+		nbytes = sizeof(short) * Resampler.Process (DriftBuf, nbytes / sizeof(short), Chunk, ChunkSize / sizeof(short), ratio);
 	}
+	#endif
+
+	if (Parent->FarEnd.IsEnabled())
+		Parent->FarEnd.Put (Chunk, nbytes / sizeof(short));
 
-	// Send wblock to the speaker device
-	wblock->Hdr.dwBufferLength = nbytes;
+	// Send the chunk to the speaker
 	try {
-		CHECK_MMRES (waveOutPrepareHeader(HWAVEOUT(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
-		CHECK_MMRES (waveOutWrite(HWAVEOUT(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
+		Endpoint->Write (Chunk, nbytes);
 	}
-	catch (...) {
-		wblock->Hdr.dwFlags = WHDR_DONE;	// try to continue, mark the buffer as done
+	catch (int err) {
+		ReportEndpointFailure (err);
 	}
-
-	endfunc:
-	ReleaseCompletedBlocks();
 }
 
 
@@ -317,184 +287,175 @@ void WaveOut::RunBody (WAVEBLOCK * wblock)
 									Class WaveIn
 \****************************************************************************************/
 
-WaveIn::WaveIn (ScoApp *parent) :
-	Wave ("WaveIn ", parent), MediaBuffer(ChunkSize)
+WaveIn::WaveIn (ScoApp *parent, AudioEndpoint *endpoint, VOICE_CAPTURE capture) :
+	Wave ("WaveIn ", parent, endpoint), UseVp(capture == VOICE_CAPTURE_NATIVE), TxIdx(0)
 {
-	#ifndef DMO_ENABLED
-	waveOpen	  = WaveOpen(waveInOpen);
-	waveClose	  = WaveClose(waveInClose);
-	waveReset	  = WaveReset(waveInReset);
-	waveUnprepare = WaveUnprepare(waveInUnprepareHeader);
+	for (int i = 0; i < NumTxSlots; i++) {
+		if (!Tx[i].EventDone.GetWaitHandle())
+			throw IntException (DialAppError_InsufficientResources, "CreateEvent() failed");
+		memset (&Tx[i].Overlapped, 0, sizeof(OVERLAPPED));
+		Tx[i].Overlapped.hEvent = (HANDLE) Tx[i].EventDone.GetWaitHandle();
+		Tx[i].Pending = false;
+	}
 
-	#else
-	waveOpen	  = 0;
-	waveClose	  = 0;
-	waveReset	  = 0;
-	waveUnprepare = 0;
-	#endif
+	if (UseVp) {
+		VoiceProc::Config cfg;
+		cfg.SampleRate = VoiceSampleRate;
+		cfg.FrameSize  = VoiceProcFrame;
+		if (!Vp.Init(cfg))
+			throw IntException (DialAppError_InsufficientResources, "VoiceProc init failed");
+	}
+	Parent->FarEnd.Enable (UseVp);
+
+	LogMsg("Voice capture: %s, native processing %d", endpoint->GetName(), UseVp);
 }
 
 
-void WaveIn::RunInit ()
+void WaveIn::RunStart ()
 {
-	DMO_MEDIA_TYPE  mediaType;
-	WAVEFORMATEX*	pwav;
-
-	CHECK_HRESULT (CoInitializeEx (NULL, COINIT_APARTMENTTHREADED));
-
-	MediaObject = NULL;
-	memset(&mediaType, 0, sizeof(mediaType));
-
-	CHECK_HRESULT (CoCreateInstance(CLSID_CWMAudioAEC, NULL, CLSCTX_INPROC_SERVER, IID_IMediaObject, (void**) &MediaObject));
-	CHECK_HRESULT (MoInitMediaType(&mediaType, sizeof(WAVEFORMATEX)));
-
-	mediaType.majortype = MEDIATYPE_Audio;
-	mediaType.subtype = MEDIASUBTYPE_PCM;
-	mediaType.lSampleSize = 0;
-	mediaType.bFixedSizeSamples = TRUE;
-	mediaType.bTemporalCompression = FALSE;
-	mediaType.formattype = FORMAT_WaveFormatEx;
-
-	pwav = (WAVEFORMATEX*)mediaType.pbFormat;
-	memcpy(pwav, &Format, sizeof(Format));
-
-	CHECK_HRESULT (MediaObject->SetOutputType(0, &mediaType, 0));
+	Endpoint->Start();
+	TxIdx = 0;
 
-	IPropertyStore *props;
-	PROPVARIANT propvar = {0};
+	#ifdef DRIFTCOMP_ENABLED
+	Resampler.Reset();
+	#endif
 
-	CHECK_HRESULT (MediaObject->QueryInterface(IID_IPropertyStore, (void**)&props));
+	if (UseVp) {
+		Vp.Reset();
+		Parent->FarEnd.Clear();
+	}
+}
 
-	propvar.vt = VT_I4;
-	propvar.lVal = 0; // System Mode - SINGLE_CHANNEL_AEC
-	CHECK_HRESULT (props->SetValue(MFPKEY_WMAAECMA_SYSTEM_MODE, propvar));
 
-	DataBuffer.dwStatus = 0;
-	DataBuffer.pBuffer = &MediaBuffer;
+void WaveIn::RunStop ()
+{
+	Endpoint->Stop();
 
-	MoFreeMediaType(&mediaType);
+	for (int i = 0; i < NumTxSlots; i++) {
+		if (Tx[i].Pending)
+			CancelIoEx (Parent->hDevice, &Tx[i].Overlapped);
+		WaitWrite (Tx[i]);
+	}
 
-	LogMsg("MediaObject = %X", MediaObject);
+	if (UseVp) {
+		const VoiceProc::Stats & st = Vp.GetStats();
+		LogMsg("VoiceProc: frames %u, double talk %u, ERLE %d dB, noise floor %d, AGC gain x%d/10", 
+			   st.Frames, st.DoubleTalkFrames, int(st.ErleDb()), int(st.NoiseFloor), int(st.AgcGain*10));
+	}
 }
 
 
-void WaveIn::RunEnd ()
+void WaveIn::VoiceProcess (short * data, int n)
 {
-	MediaObject->Release();
-	CoUninitialize();
-}
-
+	if (!UseVp)
+		return;
 
-void WaveIn::RunStart ()
-{
-	MediaObject->AllocateStreamingResources();
-	FirstIter = true;
+	// Process in place by VoiceProcFrame chunks, the tail (if any) passes as is
+	for (int i = 0; i + VoiceProcFrame <= n; i += VoiceProcFrame) {
+		Parent->FarEnd.Get (FarFrame, VoiceProcFrame);
+		Vp.Process (data + i, FarFrame, data + i);
+	}
 }
 
 
-void WaveIn::RunStop ()
+/*
+ Uplink drift compensation: the microphone runs on the sound card clock, the same as the speaker,
+ so the inverse of the downlink ratio is applied. Returns the data to be sent to SCO.
+*/
+void * WaveIn::DriftCompensate (void * data, DWORD & nbytes)
 {
-	MediaObject->FreeStreamingResources();
+	#ifdef DRIFTCOMP_ENABLED
+	double ratio = 1.0 / Parent->Drift.GetRatio();
+	nbytes = sizeof(short) * Resampler.Process ((short*) data, nbytes / sizeof(short), DriftBuf, sizeof(DriftBuf) / sizeof(short), ratio);
+	return DriftBuf;
+	#else
+	return data;
+	#endif
 }
 
 
-// virtual from Wave
-void WaveIn::RunBody (WAVEBLOCK * wblock)
+void WaveIn::WriteSco (void * data, DWORD nbytes)
 {
-	DWORD	n;
-	BOOL	res;
+	DWORD n;
 
-#ifndef DMO_ENABLED
- 	// Send new wblock to the microphone device
-	try {
-		CHECK_MMRES (waveInPrepareHeader(HWAVEIN(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
-		CHECK_MMRES (waveInAddBuffer(HWAVEIN(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
-		CHECK_MMRES (waveInStart(HWAVEIN(hWave)));
-	}
-	catch (...) {
-		// try to continue
-		if (wblock->Hdr.dwFlags & WHDR_PREPARED)
-			UnprepareHeader (&wblock->Hdr);
-		wblock->Hdr.dwFlags = 0;
+	if (Parent->Ring.IsMapped()) {
+		// The driver sends the Tx slots by itself, clocked by the SCO link
+		if ((n = Parent->Ring.Write (data, nbytes)) < nbytes)
+			LogMsg("Write to SCO ring dropped %d bytes", nbytes - n);
+		return;
 	}
 
-	// Try to get another block filled by microphone
-	LogMsg("Waiting data from Microphone...");
-	n = 0;
-	while ((wblock = GetCompletedBlock()) == 0) {
-		if (State != STATE_PLAYING)
-			return;
-		if (++n == 4) {
-			LogMsg("ERROR: Microphone got stuck");
-			ReportVoiceStreamFailure(DialAppError_WaveInError);
+	// The write is not waited for: the next chunk goes through the other slot meanwhile
+	TX_SLOT & slot = Tx[TxIdx];
+	BOOL	  res;
+
+	WaitWrite (slot);
+
+	if (Parent->IsScoBatch()) {
+		// One request for all the SCO frames of the chunk
+		ULONG outlen, inlen = slot.Request.PrepareWrite (data, nbytes, &outlen);
+		if (!inlen) {
+			LogMsg("Write to SCO dropped %d bytes: too long for a batch", nbytes);
 			return;
 		}
-		EventDataReady.Wait(ChunkTime4Wait);
+		slot.Batch = true;
+		res = DeviceIoControl (Parent->hDevice, IOCTL_HFP_SCO_BATCH, slot.Request.GetBuffer(), inlen, slot.Request.GetBuffer(), outlen, &n, &slot.Overlapped);
+	}
+	else {
+		nbytes = MIN(nbytes, DWORD(sizeof(slot.Data)));
+		memcpy (slot.Data, data, nbytes);
+		slot.Batch = false;
+		res = WriteFile (Parent->hDevice, slot.Data, nbytes, &n, &slot.Overlapped);
+	}
+
+	if (res || GetLastError() == ERROR_IO_PENDING) {
+		slot.Pending = true;	// completed or not, the result is taken by WaitWrite
+		TxIdx = (TxIdx + 1) % NumTxSlots;
 	}
+	else
+		LogMsg("Write to SCO failed: GetLastError %d", GetLastError());
+}
+
+
+void WaveIn::WaitWrite (TX_SLOT & slot)
+{
+	DWORD n;
 
-	if (!wblock->Hdr.dwBytesRecorded || State!=STATE_PLAYING)
+	if (!slot.Pending)
 		return;
 
-	res = WriteFile (Parent->hDevice, wblock->Data, wblock->Hdr.dwBytesRecorded, &n, &ScoOverlapped);
-	if (!res) {
-		if (GetLastError() == ERROR_IO_PENDING)
-			LogMsg("Write to SCO pended: %d bytes", wblock->Hdr.dwBytesRecorded);
-		else
+	slot.Pending = false;
+	if (!GetOverlappedResult (Parent->hDevice, &slot.Overlapped, &n, TRUE)) {
+		if (GetLastError() != ERROR_OPERATION_ABORTED)
 			LogMsg("Write to SCO failed: GetLastError %d", GetLastError());
 	}
+	else if (slot.Batch  &&  slot.Request.FailedFrames())
+		LogMsg("Write to SCO: %d frames of the batch failed", slot.Request.FailedFrames());
+}
 
-#else
-	DWORD	dwStatus;
-	HRESULT hr;
-
-	MediaBuffer.m_data   = wblock->Data;
-	MediaBuffer.m_length = 0;
-
-	hr = MediaObject->ProcessOutput(0, 1, &DataBuffer, &dwStatus);
-	LogMsg("IMediaObject::ProcessOutput completed, HRESULT %X", hr);
 
-	if (hr == S_FALSE) // means nothing to process
-		goto finalize;
+// virtual from Wave
+void WaveIn::RunBody ()
+{
+	int nbytes;
 
-	if (hr != S_OK) {
-		ReportVoiceStreamFailure (DialAppError_MediaObjectInError);
+	try {
+		nbytes = Endpoint->Read (Chunk, ChunkSize);		// paced by the endpoint
+	}
+	catch (int err) {
+		ReportEndpointFailure (err);
 		return;
 	}
 
-	/*
-	  IMediaObject::ProcessOutput possible values (according to MSDN):
-		E_FAIL			Failure
-		E_INVALIDARG	Invalid argument
-		E_POINTER		NULL pointer argument
-		S_FALSE			No output was generated
-		S_OK			Success
-	*/
- 
-	if (FirstIter)
-		EventDataReady.Wait (ChunkTime4Wait/2);
-
-	res = WriteFile (Parent->hDevice, MediaBuffer.m_data, MediaBuffer.m_length, &n, &ScoOverlapped);
-
-	if (DataBuffer.dwStatus == DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE)
-		LogMsg("DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE, size %d", MediaBuffer.m_length);
-
-	if (!res) {
-		if (GetLastError() == ERROR_IO_PENDING) 
-			LogMsg("Write to SCO pended: %d bytes", MediaBuffer.m_length);
-		else 
-			LogMsg("Write to SCO failed: GetLastError %d", GetLastError());
-	}
+	if (!nbytes || State != STATE_PLAYING)
+		return;
 
-	finalize:
-	DataBlocks.ReleaseFirst();
-	MediaBuffer.m_data = 0;
+	VoiceProcess (Chunk, nbytes / sizeof(short));
 
-	if (FirstIter)
-		FirstIter = false;
-	else 
-		EventDataReady.Wait (ChunkTime4Wait);
+	DWORD  txsize = nbytes;
+	void * txbuf  = Endpoint->IsDeviceClock() ? DriftCompensate (Chunk, txsize) : Chunk;
 
-#endif // USE_DMO
+	WriteSco (txbuf, txsize);
 }
 
 
@@ -7,95 +7,29 @@
 #pragma managed(push, off)
 
 
-#include <Mediaobj.h>
-
 #include "def.h"
 #include "deblog.h"
 #include "thread.h"
-#include "fifo_cse.h"
+#include "spsc_ring.h"
 #include "DialAppType.h"
+#include "VoiceProc.h"
+#include "AudioEndpoint.h"
+#include "DriftComp.h"
+#include "ScoBatch.h"
 
 
-// Enable DirectX Media Objects for Voice input instead of WaveIn API
-#define DMO_ENABLED
-
-
-class ScoApp;
-
-class MediaBuffer : public IMediaBuffer
-{
-  public:
-
-	MediaBuffer (DWORD maxLength) :
-		m_ref(0),
-		m_maxLength(maxLength),
-		m_length(0),
-		m_data(0)
-	{}
-
-	HRESULT STDMETHODCALLTYPE SetLength (DWORD cbLength)
-	{
-		if (cbLength > m_maxLength) {
-			return E_INVALIDARG;
-		} 
-		else {
-			m_length = cbLength;
-			return S_OK;
-		}
-	}
-
-	HRESULT STDMETHODCALLTYPE GetMaxLength (DWORD *maxLength)
-	{
-		if (!maxLength)
-			return E_POINTER;
-		*maxLength = m_maxLength;
-		return S_OK;
-	}
-
-	HRESULT STDMETHODCALLTYPE GetBufferAndLength (BYTE **buffer, DWORD *length)
-	{
-		if (!buffer || !length)
-			return E_POINTER;
-		*buffer = m_data;
-		*length = m_length;
-		return S_OK;
-	}
-
-	HRESULT STDMETHODCALLTYPE QueryInterface (REFIID riid, void **iface)
-	{
-		if (!iface)
-			return E_POINTER;
-		if (riid == IID_IMediaBuffer || riid == IID_IUnknown) {
-			*iface = static_cast<IMediaBuffer*>(this);
-			AddRef();
-			return S_OK;
-		}
-		*iface = 0;
-		return E_NOINTERFACE;
-	}
-
-	ULONG STDMETHODCALLTYPE AddRef()
-	{
-		return InterlockedIncrement(&m_ref);
-	}
-
-	ULONG STDMETHODCALLTYPE Release()
-	{
-		LONG lRef = InterlockedDecrement(&m_ref);
-		if (!lRef)
-			delete this;
-		return lRef;
-	}
-
-  public:
-	DWORD        m_length;
-	const DWORD  m_maxLength;
-	LONG         m_ref;
-	BYTE         *m_data;
+// Microphone voice capture and processing of WaveIn, selected at run time (see ScoApp::SetVoiceCapture)
+enum VOICE_CAPTURE {
+	VOICE_CAPTURE_DMO,		// DirectX Voice Capture DMO with its own AEC/NS/AGC (default)
+	VOICE_CAPTURE_NATIVE	// WaveIn API (or WAV file/null endpoint) input with the native AEC/NS/AGC processing (VoiceProc)
 };
 
+// Enable SCO link vs sound card clock drift compensation (DriftComp) on the sound card endpoints
+#define DRIFTCOMP_ENABLED
 
 
+class ScoApp;
+
 class Wave : public DebLog, public Thread
 {
   public:
@@ -110,18 +44,11 @@ class Wave : public DebLog, public Thread
 
 		ChunkSize = 4096,								// Size of one chunk for read and write operation 
 		ChunkTime = ChunkSize * 1000 / (VoiceSampleRate * VoiceBitPerSample/8),	// Send time of one chunk in milliseconds
-		#ifndef DMO_ENABLED
 		ChunkTime4Wait = (ChunkTime + ChunkTime/10),	// When waiting on event/semaphore to use this value
-		#else
-		ChunkTime4Wait = 100,
-		#endif
 
-		NumVoiceIoErrors2Report = 6						// Number of possible subsequent errors while Reading from/Writing to SCO, when greater - the failure event will be generated
-	};
+		NumVoiceIoErrors2Report = 6,					// Number of possible subsequent errors while Reading from/Writing to SCO, when greater - the failure event will be generated
 
-	struct WAVEBLOCK {
-		WAVEHDR	Hdr;
-		UINT8	Data[ChunkSize];
+		DriftMargin = ChunkSize/16						// Reserved chunk space for the drift compensation resampling output
 	};
 
 	enum STATE {
@@ -132,58 +59,34 @@ class Wave : public DebLog, public Thread
 	};
 
   public:
-	Wave (cchar * task, ScoApp *parent);
+	Wave (cchar * task, ScoApp *parent, AudioEndpoint *endpoint);	// The endpoint is owned by Wave
 	void Destruct ();	// This is workaround for the C++ problem of calling virtual functions from destructor. So, user should call this method instead of delete!
 
 	void Play();
 	void Stop();
 
   protected:
-	typedef MMRESULT (WINAPI *WaveOpen)	 (HWAVE*, UINT, LPCWAVEFORMATEX, DWORD_PTR, DWORD_PTR, DWORD);
-	typedef MMRESULT (WINAPI *WaveClose) (HWAVE);
-	typedef MMRESULT (WINAPI *WaveReset) (HWAVE);
-	typedef MMRESULT (WINAPI *WaveUnprepare) (HWAVE, WAVEHDR*, UINT);
-
-	WaveOpen		waveOpen;
-	WaveClose		waveClose;
-	WaveReset		waveReset;
-	WaveUnprepare	waveUnprepare;
-
-  protected:
-	void CheckMmres (MMRESULT res, cchar * file, int line) {
-		if (res != MMSYSERR_NOERROR)
-			throw IntException (DialAppError_WaveApiError, "ERROR [%s:%d]: MMRESULT = %d (hWave = %X)", file, line, res, hWave);
-	}
-
-	void CheckHresult (HRESULT res, cchar * file, int line) {
-		if (FAILED(res))
-			throw IntException (DialAppError_InitMediaDeviceError, "ERROR [%s:%d]: HRESULT = %d", file, line, res);
-	}
-
 	void CheckState (STATE expected, cchar * file, int line) {
 		if (State != expected)
 			throw IntException (DialAppError_InternalError, "ERROR [%s:%d]: Wave object unexpected state (%d != %d)", file, line, State, expected);
 	}
 
   protected:
-	void UnprepareHeader (WAVEHDR * whdr);
-    void ReleaseCompletedBlocks (bool clean_all = false);
-	WAVEBLOCK* GetCompletedBlock();
 	void ReportVoiceStreamFailure(int error);
+	void ReportEndpointFailure(int error);
 
     virtual void Run();
 
 	// RunXXX() funcs will be implemented in WaveOut & WaveIn, will be called from Run
-    virtual void RunInit () = 0;
-    virtual void RunEnd () = 0;
+    virtual void RunInit ();
+    virtual void RunEnd ();
     virtual void RunStart () = 0;
     virtual void RunStop () = 0;
-    virtual void RunBody (WAVEBLOCK * wblock) = 0;
+    virtual void RunBody () = 0;
 
   protected:
-	HWAVE			hWave;
 	ScoApp		   *Parent;
-	WAVEFORMATEX	Format;
+	AudioEndpoint  *Endpoint;	// Speaker or microphone: sound card device, WAV file or null (see AUDIO_BACKEND)
 	STATE			State;
 	int				ErrorRaised;
 	int				IoErrorsCnt;
@@ -191,8 +94,37 @@ class Wave : public DebLog, public Thread
 	Event			EventDataReady;
 	OVERLAPPED		ScoOverlapped;
 	Mutex			RunMutex;
+	short			Chunk[ChunkSize / sizeof(short)];	// Voice chunk between SCO and the endpoint
+};
+
+
+
+/*
+ ************************************************************************************************
+ Far-end reference tap: WaveOut puts here the voice received from SCO (i.e. what is played on 
+ the speaker), WaveIn takes it frame by frame as the echo canceller reference.
+ If the reference is late or absent, the missing part is filled by silence; on overflow the
+ newest samples are dropped. WaveOut is the only producer and WaveIn is the only consumer, 
+ so the lock-free SPSC ring is used.
+ ************************************************************************************************
+ */
+class FarEndTap
+{
+  public:
+	enum { Size = 4 * Wave::ChunkSize / sizeof(short) };	// in samples, must be a power of 2
+
+  public:
+	FarEndTap () : Enabled(false) {}
 
-	FIFO_ALLOC<WAVEBLOCK,8>	DataBlocks;
+	void Enable (bool on)					{ Enabled = on; }	// by the consumer, before the voice starts
+	bool IsEnabled () const					{ return Enabled; }
+	void Clear ()							{ Ring.Drain(); }	// consumer side
+	void Put (const short * data, int n)	{ Ring.PushSpan (data, n); }
+	int  Get (short * data, int n);
+
+  protected:
+	SPSC_RING<short,Size>	Ring;
+	volatile bool			Enabled;	// There is a consumer: the producer skips Put otherwise
 };
 
 
@@ -200,14 +132,20 @@ class Wave : public DebLog, public Thread
 class WaveOut : public Wave
 {
   public:
-	WaveOut (ScoApp *parent);
+	WaveOut (ScoApp *parent, AudioEndpoint *endpoint);
+
+  protected:
+	#ifdef DRIFTCOMP_ENABLED
+	short			DriftBuf[(ChunkSize - DriftMargin) / sizeof(short)];
+	FracResampler	Resampler;
+	#endif
+
+	ScoBatch		RxBatch;			// SCO read request in the batch mode (ScoApp::SetScoBatchMode)
 
   protected:
-    virtual void RunInit ();
-    virtual void RunEnd ();
     virtual void RunStart ();
     virtual void RunStop ();
-    virtual void RunBody (WAVEBLOCK * wblock);
+    virtual void RunBody ();
 };
 
 
@@ -215,20 +153,45 @@ class WaveOut : public Wave
 class WaveIn : public Wave
 {
   public:
-	WaveIn (ScoApp *parent);
+	WaveIn (ScoApp *parent, AudioEndpoint *endpoint, VOICE_CAPTURE capture = VOICE_CAPTURE_DMO);	// NATIVE: endpoint is not DmoEndpoint
 
   protected:
-	IMediaObject*			MediaObject;
-	MediaBuffer				MediaBuffer;
-	DMO_OUTPUT_DATA_BUFFER	DataBuffer;
-	bool					FirstIter;	// For jitter
+	const bool				UseVp;		// Native voice processing of the microphone input
+
+	enum { VoiceProcFrame = 128 };		// 16 ms, ChunkSize must be a multiple of it
+	VoiceProc				Vp;
+	short					FarFrame[VoiceProcFrame];
+
+	#ifdef DRIFTCOMP_ENABLED
+	short					DriftBuf[(ChunkSize + DriftMargin) / sizeof(short)];
+	FracResampler			Resampler;
+	#endif
+
+	enum { NumTxSlots = 2 };			// SCO writes in flight: one may be pending while the next chunk is captured
+
+	// SCO write request: its buffer and OVERLAPPED are reused after WaitWrite
+	struct TX_SLOT {
+		Event		EventDone;
+		OVERLAPPED	Overlapped;
+		bool		Pending;
+		bool		Batch;
+		ScoBatch	Request;						// Batch mode (ScoApp::SetScoBatchMode)
+		UINT8		Data[ChunkSize + DriftMargin];	// WriteFile mode
+	};
+
+	TX_SLOT					Tx[NumTxSlots];
+	int						TxIdx;		// Slot of the next write
+
+  protected:
+	void VoiceProcess (short * data, int n);
+	void * DriftCompensate (void * data, DWORD & nbytes);
+	void WriteSco (void * data, DWORD nbytes);
+	void WaitWrite (TX_SLOT & slot);
 
   protected:
-    virtual void RunInit ();
-    virtual void RunEnd ();
     virtual void RunStart ();
     virtual void RunStop ();
-    virtual void RunBody (WAVEBLOCK * wblock);
+    virtual void RunBody ();
 };
 
 
@@ -237,8 +200,6 @@ class WaveIn : public Wave
 					Error Codes Check Macros
 \*******************************************************************/
 
-#define CHECK_MMRES(res)		CheckMmres (res,__FUNCTION__,__LINE__)
-#define CHECK_HRESULT(res)		CheckHresult(res,__FUNCTION__,__LINE__)
 #define CHECK_STATE(state)		CheckState(state,__FUNCTION__,__LINE__)
 
 
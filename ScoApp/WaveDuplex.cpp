@@ -0,0 +1,361 @@
+/*******************************************************************\
+ Filename    :  WaveDuplex.cpp
+ Purpose     :  Full-duplex single-thread voice engine
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#include "def.h"
+#include "WaveDuplex.h"
+#include "ScoApp.h"
+#include "HfpSm.h"
+
+
+
+/****************************************************************************************\
+									Class WaveDuplex
+\****************************************************************************************/
+
+WaveDuplex::WaveDuplex (ScoApp *parent, AudioEndpoint *speaker, AudioEndpoint *mic) :
+	DebLog("WaveDplx"), Thread("WaveDplx", PRIORITY_HIGH), Parent(parent), Speaker(speaker), Mic(mic),
+	Playing(false), Destroying(false), ErrorRaised(0), IoErrorsCnt(0), RxRest(0), TxIdx(0)
+{
+	if (!EventCmd.GetWaitHandle() || !EventAck.GetWaitHandle() || !EventRead.GetWaitHandle())
+		throw IntException (DialAppError_InsufficientResources, "CreateEvent() failed");
+
+	memset (&ReadOverlapped,  0, sizeof(OVERLAPPED));
+	memset (WriteOverlapped, 0, sizeof(WriteOverlapped));
+	ReadOverlapped.hEvent = (HANDLE) EventRead.GetWaitHandle();
+	for (int i = 0; i < NumTxFrames; i++) {
+		if (!EventWrite[i].GetWaitHandle())
+			throw IntException (DialAppError_InsufficientResources, "CreateEvent() failed");
+		WriteOverlapped[i].hEvent = (HANDLE) EventWrite[i].GetWaitHandle();
+		WritePending[i] = false;
+	}
+
+	VoiceProc::Config cfg;
+	cfg.SampleRate = Wave::VoiceSampleRate;
+	cfg.FrameSize  = VoiceProcFrame;
+	if (!Vp.Init(cfg))
+		throw IntException (DialAppError_InsufficientResources, "VoiceProc init failed");
+
+	Thread::Construct();
+	Thread::Execute();
+	LogMsg("Thread ID = %d", Thread::GetThreadId());
+}
+
+
+void WaveDuplex::Destruct ()
+{
+	SendCommand (CMD_DESTROY);
+	Thread::WaitEnding();
+	delete Speaker;
+	delete Mic;
+	LogMsg("Destructed");
+	delete this;
+}
+
+
+void WaveDuplex::Play ()
+{
+	SendCommand (CMD_PLAY);
+}
+
+
+void WaveDuplex::Stop ()
+{
+	SendCommand (CMD_STOP);
+}
+
+
+void WaveDuplex::SendCommand (CMD cmd)
+{
+	if (!Commands.Push(cmd)) {
+		LogMsg("ERROR: command ring overflow, cmd %d lost", cmd);
+		return;
+	}
+	EventCmd.Signal();
+	EventAck.Wait(FrameTime * 4);	// normally the engine takes the command within one frame
+}
+
+
+void WaveDuplex::ReportFailure (int error)
+{
+	ErrorRaised = error;
+	HfpSm::PutEvent_Failure (error);
+}
+
+
+// virtual from Thread
+void WaveDuplex::Run ()
+{
+	LogMsg("Task started...");
+
+	try {
+		Init();
+		HfpSm::PutEvent_Ok ();	// HFP SM expects two Ok reports: for downlink (WaveOut) and uplink (WaveIn)
+		HfpSm::PutEvent_Ok ();
+
+		for (;;)
+		{
+			CMD cmd = WaitCommand();
+			EventAck.Signal();
+
+			if (cmd == CMD_DESTROY || Destroying)
+				break;
+			if (cmd != CMD_PLAY || Playing)
+				continue;
+
+			LogMsg("Start playing");
+			Start();
+
+			while (Playing && !ErrorRaised) {
+				if (!PollCommands())
+					break;
+				if (!Cycle())
+					break;
+			}
+
+			Halt();
+			LogMsg("Playback stopped");
+
+			if (Destroying)
+				break;
+		}
+
+		End();
+	}
+	catch (int err)
+	{
+		LogMsg("EXCEPTION %d %s %s", err, Speaker->GetError(), Mic->GetError());
+		HfpSm::PutEvent_Failure(err);
+	}
+}
+
+
+WaveDuplex::CMD WaveDuplex::WaitCommand ()
+{
+	int cmd;
+	while (!Commands.Pop(cmd))
+		EventCmd.Wait();
+	return CMD(cmd);
+}
+
+
+bool WaveDuplex::PollCommands ()
+{
+	int cmd;
+	while (Commands.Pop(cmd)) {
+		EventAck.Signal();
+		switch (cmd) {
+			case CMD_STOP:
+				Playing = false;
+				return false;
+			case CMD_DESTROY:
+				Playing = false;
+				Destroying = true;
+				return false;
+		}
+	}
+	return true;
+}
+
+
+void WaveDuplex::Init ()
+{
+	AudioEndpoint::FORMAT fmt = { Wave::VoiceSampleRate, Wave::VoiceNchan, Wave::VoiceBitPerSample };
+	Speaker->Open(fmt);
+	Mic->Open(fmt);
+	LogMsg("Opened: speaker %s, microphone %s", Speaker->GetName(), Mic->GetName());
+}
+
+
+void WaveDuplex::End ()
+{
+	Speaker->Close();
+	Mic->Close();
+}
+
+
+void WaveDuplex::Start ()
+{
+	ErrorRaised = IoErrorsCnt = 0;
+	RxRest = 0;
+	TxIdx  = 0;
+	Vp.Reset();
+
+	try {
+		Speaker->Start();
+		Mic->Start();
+	}
+	catch (int err) {
+		LogMsg("Start failed: %d %s%s", err, Speaker->GetError(), Mic->GetError());
+		ReportFailure (err);
+	}
+
+	Playing = true;
+}
+
+
+void WaveDuplex::Halt ()
+{
+	Playing = false;
+
+	// The SCO writes in flight use TxFrame and WriteOverlapped: they must be finished before these are reused or freed
+	for (int i = 0; i < NumTxFrames; i++) {
+		if (WritePending[i])
+			CancelIoEx (Parent->hDevice, &WriteOverlapped[i]);
+		WaitWrite (i);
+	}
+
+	try {
+		Speaker->Stop();
+		Mic->Stop();
+	}
+	catch (int err) {
+		LogMsg("Stop failed: %d %s%s", err, Speaker->GetError(), Mic->GetError());
+	}
+
+	const VoiceProc::Stats & st = Vp.GetStats();
+	LogMsg("VoiceProc: frames %u, double talk %u, ERLE %d dB", st.Frames, st.DoubleTalkFrames, int(st.ErleDb()));
+}
+
+
+/*
+ One engine cycle, paced by the SCO downlink. Whole VoiceProc frames are processed, the rest of
+ the received data (SCO frames are 48..480 bytes) is kept at the start of RxFrame for the next cycle.
+*/
+bool WaveDuplex::Cycle ()
+{
+	DWORD nbytes;
+
+	if (!ReadSco (RxFrame + RxRest, FrameSize - RxRest, nbytes))
+		return !ErrorRaised;
+
+	nbytes += RxRest;
+	RxRest  = nbytes % (VoiceProcFrame*2);
+	nbytes -= RxRest;
+
+	if (nbytes) {
+		UINT8 * tx = TxFrame[TxIdx];
+
+		WaitWrite (TxIdx);
+		Render  (RxFrame, nbytes);
+		Capture (tx, nbytes);
+
+		for (DWORD i = 0; i < nbytes; i += VoiceProcFrame*2)
+			Vp.Process ((short*)(tx + i), (short*)(RxFrame + i), (short*)(tx + i));
+
+		WriteSco (TxIdx, nbytes);
+		TxIdx = (TxIdx + 1) % NumTxFrames;
+	}
+
+	memmove (RxFrame, RxFrame + nbytes, RxRest);
+	return !ErrorRaised;
+}
+
+
+bool WaveDuplex::ReadSco (void * data, DWORD size, DWORD & nbytes)
+{
+	if (Parent->Ring.IsMapped()) {
+		nbytes = Parent->Ring.Read (data, size, FrameTime * 2);
+		if (!nbytes) {
+			LogMsg("Read from SCO ring timed out");
+			if (++IoErrorsCnt > Wave::NumVoiceIoErrors2Report) {
+				ReportFailure (DialAppError_ReadScoError);
+				IoErrorsCnt = 0;
+			}
+			return false;
+		}
+		return true;
+	}
+
+	BOOL res = ReadFile (Parent->hDevice, data, size, &nbytes, &ReadOverlapped);
+	if (!res && GetLastError() == ERROR_IO_PENDING)
+		res = GetOverlappedResult (Parent->hDevice, &ReadOverlapped, &nbytes, TRUE);
+
+	if (!res) {
+		LogMsg("Read from SCO failed: GetLastError %d", GetLastError());
+		if (++IoErrorsCnt > Wave::NumVoiceIoErrors2Report) {
+			ReportFailure (DialAppError_ReadScoError);
+			IoErrorsCnt = 0;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ Sends TxFrame[idx]; the write is not waited for, so the next frame is captured meanwhile.
+ TxFrame[idx] and WriteOverlapped[idx] are reused after WaitWrite(idx).
+*/
+void WaveDuplex::WriteSco (int idx, DWORD nbytes)
+{
+	DWORD n;
+
+	if (Parent->Ring.IsMapped()) {
+		if ((n = Parent->Ring.Write (TxFrame[idx], nbytes)) < nbytes)
+			LogMsg("Write to SCO ring dropped %d bytes", nbytes - n);
+		return;
+	}
+
+	if (WriteFile (Parent->hDevice, TxFrame[idx], nbytes, &n, &WriteOverlapped[idx]) || GetLastError() == ERROR_IO_PENDING)
+		WritePending[idx] = true;	// completed or not, the result is taken by WaitWrite
+	else
+		LogMsg("Write to SCO failed: GetLastError %d", GetLastError());
+}
+
+
+void WaveDuplex::WaitWrite (int idx)
+{
+	DWORD n;
+
+	if (!WritePending[idx])
+		return;
+
+	WritePending[idx] = false;
+	if (!GetOverlappedResult (Parent->hDevice, &WriteOverlapped[idx], &n, TRUE)  &&  GetLastError() != ERROR_OPERATION_ABORTED)
+		LogMsg("Write to SCO failed: GetLastError %d", GetLastError());
+}
+
+
+void WaveDuplex::Render (const void * data, int nbytes)
+{
+	try {
+		Speaker->Write (data, nbytes);
+	}
+	catch (int err) {
+		if (err == DialAppError_WaveBuffersError) {
+			// The speaker is behind the SCO clock: drop the frame rather than to delay the uplink
+			LogMsg("Render overrun, frame dropped");
+			return;
+		}
+		LogMsg("Render failed: %d %s", err, Speaker->GetError());
+		ReportFailure (err);
+	}
+}
+
+
+void WaveDuplex::Capture (void * data, int nbytes)
+{
+	int got = 0, n;
+
+	// The sound card microphone returns one MicBlockSize block per Read
+	try {
+		while (got < nbytes  &&  (n = Mic->Read ((UINT8*)data + got, nbytes - got)) > 0)
+			got += n;
+	}
+	catch (int err) {
+		LogMsg("Capture failed: %d %s", err, Mic->GetError());
+		ReportFailure (err);
+	}
+
+	// If the microphone is behind the SCO clock, silence is sent to keep the frame alignment
+	if (got < nbytes)
+		memset ((UINT8*)data + got, 0, nbytes - got);
+}
+
+
+#pragma managed(pop)
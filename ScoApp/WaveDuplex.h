@@ -0,0 +1,107 @@
+/*******************************************************************\
+ Filename    :  WaveDuplex.h
+ Purpose     :  Full-duplex single-thread voice engine
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+
+#include "def.h"
+#include "deblog.h"
+#include "thread.h"
+#include "spsc_ring.h"
+#include "Wave.h"
+#include "VoiceProc.h"
+#include "AudioEndpoint.h"
+
+
+class ScoApp;
+
+
+/*
+ ************************************************************************************************
+ Duplex engine: an alternative to the pair of WaveOut/WaveIn threads. One real-time thread does
+ per frame:
+	SCO read -> speaker render -> microphone capture -> AEC/NS/AGC -> SCO write
+
+ The SCO downlink is the only clock: every received frame pulls exactly one microphone frame,
+ so the uplink and downlink stay aligned and the far-end reference of the echo canceller is
+ exactly the frame just sent to the speaker. Render and capture devices are AudioEndpoint objects:
+ WinMM devices (no DMO), WAV files or null.
+
+ Control methods (Play/Stop/Destruct) are called from the SM thread; they post commands into
+ a lock-free ring, which is polled once per frame by the engine thread.
+ ************************************************************************************************
+ */
+class WaveDuplex : public DebLog, public Thread
+{
+  public:
+	enum {
+		FrameSize	= 1024,		// Bytes per cycle, 64 ms at 8000/16 bit
+		FrameTime	= FrameSize * 1000 / (Wave::VoiceSampleRate * Wave::VoiceBitPerSample/8),
+		VoiceProcFrame = 128,	// FrameSize must be a multiple of VoiceProcFrame*2
+		MicBlockSize = VoiceProcFrame*2,	// Bytes per microphone block, a cycle takes as many blocks as it has VoiceProc frames
+		NumTxFrames	= 2			// SCO writes in flight: one is being written while the next one is captured
+	};
+
+	enum CMD {
+		CMD_PLAY,
+		CMD_STOP,
+		CMD_DESTROY
+	};
+
+  public:
+	WaveDuplex (ScoApp *parent, AudioEndpoint *speaker, AudioEndpoint *mic);	// The endpoints are owned by WaveDuplex
+	void Destruct ();	// Call it instead of delete, as for Wave objects
+
+	void Play ();
+	void Stop ();
+
+  protected:
+    virtual void Run ();
+
+	void Init ();
+	void End ();
+	void Start ();
+	void Halt ();
+	bool Cycle ();
+	void WaitWrite (int idx);
+	CMD  WaitCommand ();
+	bool PollCommands ();
+
+	bool ReadSco  (void * data, DWORD size, DWORD & nbytes);
+	void WriteSco (int idx, DWORD nbytes);
+	void Render	  (const void * data, int nbytes);
+	void Capture  (void * data, int nbytes);
+
+	void SendCommand (CMD cmd);
+	void ReportFailure (int error);
+
+  protected:
+	ScoApp		   *Parent;
+	AudioEndpoint  *Speaker;
+	AudioEndpoint  *Mic;		// WaveInEndpoint of MicBlockSize blocks for the sound card
+	bool			Playing;
+	bool			Destroying;
+	int				ErrorRaised;
+	int				IoErrorsCnt;
+
+	SPSC_RING<int,8> Commands;	// SM thread -> engine thread
+	Event			EventCmd;		// wakes up the idle engine
+	Event			EventAck;		// command is executed
+	Event			EventRead;
+	Event			EventWrite[NumTxFrames];
+	OVERLAPPED		ReadOverlapped;
+	OVERLAPPED		WriteOverlapped[NumTxFrames];
+	bool			WritePending[NumTxFrames];
+
+	UINT8			RxFrame[FrameSize];
+	DWORD			RxRest;		// Bytes of RxFrame past the last whole VoiceProc frame, carried to the next cycle
+	UINT8			TxFrame[NumTxFrames][FrameSize];
+	int				TxIdx;		// TxFrame to be captured next
+	VoiceProc		Vp;
+};
+
+
+#pragma managed(pop)
@@ -0,0 +1,380 @@
+/*******************************************************************\
+ Filename    :  WinMmEndpoint.cpp
+ Purpose     :  Sound card audio endpoints: WinMM devices and DMO
+\*******************************************************************/
+
+#pragma managed(push, off)
+
+#include "def.h"
+#include "WinMmEndpoint.h"
+
+// DMO
+#include <wmcodecdsp.h>
+#include <uuids.h>
+#include <dmort.h>
+#include <propsys.h>
+
+
+
+/****************************************************************************************\
+									Class WinMmEndpoint
+\****************************************************************************************/
+
+WinMmEndpoint::WinMmEndpoint (cchar * name, bool capture) :
+	AudioEndpoint(name, capture, true, true), DebLog(name), hWave(0)
+{
+	memset (&WaveFormat, 0, sizeof(WAVEFORMATEX));
+
+	for (int i=0; i<Blocks.Size; i++) {
+		memset (&Blocks.Addr[i], 0, sizeof(WAVEBLOCK));
+		Blocks.Addr[i].Hdr.lpData = (char*) Blocks.Addr[i].Data;
+	}
+}
+
+
+void WinMmEndpoint::SetWaveFormat (const FORMAT & fmt)
+{
+	WaveFormat.wFormatTag		= WAVE_FORMAT_PCM;
+	WaveFormat.nChannels		= fmt.Nchan;
+	WaveFormat.nSamplesPerSec	= fmt.SampleRate;
+	WaveFormat.nAvgBytesPerSec	= fmt.BytesPerSec();
+	WaveFormat.nBlockAlign		= fmt.BlockAlign();
+	WaveFormat.wBitsPerSample	= fmt.BitsPerSample;
+}
+
+
+void WinMmEndpoint::UnprepareHeader (WAVEHDR * whdr)
+{
+	MMRESULT res = Capture ? waveInUnprepareHeader(HWAVEIN(hWave), whdr, sizeof(WAVEHDR)) : waveOutUnprepareHeader(HWAVEOUT(hWave), whdr, sizeof(WAVEHDR));
+	if (res != MMSYSERR_NOERROR)
+		LogMsg("Unprepare header failed: MMRESULT = %d", res);
+}
+
+
+
+/****************************************************************************************\
+									Class WaveOutEndpoint
+\****************************************************************************************/
+
+void WaveOutEndpoint::Open (const FORMAT & fmt)
+{
+	AudioEndpoint::Open(fmt);
+	SetWaveFormat(fmt);
+	CHECK_MMRES (waveOutOpen ((HWAVEOUT*)&hWave, WAVE_MAPPER, &WaveFormat, 0, (DWORD_PTR)this, CALLBACK_NULL));
+	LogMsg("Open hWave = %X", hWave);
+}
+
+
+void WaveOutEndpoint::Close ()
+{
+	CHECK_MMRES (waveOutClose(HWAVEOUT(hWave)));
+}
+
+
+void WaveOutEndpoint::Start ()
+{
+	// waveOut position is not reset between sessions, so the written counter starts from it
+	MMTIME mmt;
+	mmt.wType = TIME_SAMPLES;
+	WrittenSamples = (waveOutGetPosition(HWAVEOUT(hWave), &mmt, sizeof(mmt)) == MMSYSERR_NOERROR) ? mmt.u.sample : 0;
+}
+
+
+void WaveOutEndpoint::Stop ()
+{
+	/*
+	KS: Do not use waveReset() at all! It is very problematic...
+		We will poll WHDR_DONE in ReleaseCompletedBlocks(true)
+	*/
+	ReleaseCompletedBlocks(true);
+}
+
+
+int WaveOutEndpoint::GetQueueFill ()
+{
+	MMTIME mmt;
+	mmt.wType = TIME_SAMPLES;
+	if (waveOutGetPosition(HWAVEOUT(hWave), &mmt, sizeof(mmt)) != MMSYSERR_NOERROR || mmt.wType != TIME_SAMPLES)
+		return -1;
+	return int(WrittenSamples - mmt.u.sample);
+}
+
+
+void WaveOutEndpoint::ReleaseCompletedBlocks (bool clean_all)
+{
+	// If clean_all = false - to release 1st blocks with WHDR_DONE=1
+	// If clean_all = true  - to release all blocks: with WHDR_DONE=1 and WHDR_DONE=0 after waiting
+
+	int i = 0;
+
+	while (WAVEBLOCK* wblock = Blocks.GetFirst())
+	{
+		if (!clean_all && ((wblock->Hdr.dwFlags & WHDR_DONE) == 0))
+			return;
+
+		while ((wblock->Hdr.dwFlags & WHDR_DONE) == 0) {
+			if (i++ == 0)
+				LogMsg ("ReleaseCompletedBlocks: Poling %X ...", wblock);
+			Sleep(0);
+		}
+		if (i) {
+			LogMsg ("ReleaseCompletedBlocks: Poling finished (%d iterations)", i);
+			i = 0;
+		}
+
+		if (wblock->Hdr.dwFlags & WHDR_PREPARED)
+			UnprepareHeader (&wblock->Hdr);
+		wblock->Hdr.dwFlags = 0;
+		Blocks.ReleaseFirst();
+	}
+}
+
+
+void WaveOutEndpoint::Write (const void * data, int nbytes)
+{
+	if (nbytes > BlockSize)
+		throw Fail (DialAppError_InternalError, "Write of %d bytes to speaker, max %d", nbytes, BlockSize);
+
+	ReleaseCompletedBlocks();
+
+	WAVEBLOCK * wblock = Blocks.FetchNext();
+	if (!wblock) {
+		LogMsg("ERROR: No free buffers");
+		throw Fail (DialAppError_WaveBuffersError, "No free speaker buffers");
+	}
+
+	// Send wblock to the speaker device
+	memcpy (wblock->Data, data, nbytes);
+	wblock->Hdr.dwBufferLength = nbytes;
+	try {
+		CHECK_MMRES (waveOutPrepareHeader(HWAVEOUT(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
+		CHECK_MMRES (waveOutWrite(HWAVEOUT(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
+		WrittenSamples += nbytes / WaveFormat.nBlockAlign;
+	}
+	catch (...) {
+		wblock->Hdr.dwFlags |= WHDR_DONE;	// try to continue, mark the buffer as done
+	}
+}
+
+
+
+/****************************************************************************************\
+									Class WaveInEndpoint
+\****************************************************************************************/
+
+void WaveInEndpoint::Open (const FORMAT & fmt)
+{
+	if (!EventBlock.GetWaitHandle())
+		throw Fail (DialAppError_InsufficientResources, "CreateEvent() failed");
+
+	AudioEndpoint::Open(fmt);
+	SetWaveFormat(fmt);
+
+	// Completed microphone blocks are signaled by EventBlock
+	CHECK_MMRES (waveInOpen ((HWAVEIN*)&hWave, WAVE_MAPPER, &WaveFormat, (DWORD_PTR)EventBlock.GetWaitHandle(), (DWORD_PTR)this, CALLBACK_EVENT));
+	LogMsg("Open hWave = %X", hWave);
+}
+
+
+void WaveInEndpoint::Close ()
+{
+	CHECK_MMRES (waveInClose(HWAVEIN(hWave)));
+}
+
+
+void WaveInEndpoint::AddBlock ()
+{
+	WAVEBLOCK * wblock = Blocks.FetchNext();
+
+	wblock->Hdr.dwBufferLength	= RecordSize;
+	wblock->Hdr.dwBytesRecorded = 0;
+	wblock->Hdr.dwFlags			= 0;
+	try {
+		CHECK_MMRES (waveInPrepareHeader(HWAVEIN(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
+		CHECK_MMRES (waveInAddBuffer(HWAVEIN(hWave), &wblock->Hdr, sizeof(WAVEHDR)));
+	}
+	catch (...) {
+		// try to continue: the block is returned empty
+		if (wblock->Hdr.dwFlags & WHDR_PREPARED)
+			UnprepareHeader (&wblock->Hdr);
+		wblock->Hdr.dwFlags = WHDR_DONE;
+	}
+}
+
+
+void WaveInEndpoint::Start ()
+{
+	if (RecordSize > BlockSize)
+		throw Fail (DialAppError_InternalError, "Microphone block of %d bytes, max %d", RecordSize, BlockSize);
+
+	LateReads = 0;
+	EventBlock.Reset();
+	while (!Blocks.IsFull())
+		AddBlock();
+	CHECK_MMRES (waveInStart(HWAVEIN(hWave)));
+}
+
+
+void WaveInEndpoint::Stop ()
+{
+	try {
+		CHECK_MMRES (waveInReset(HWAVEIN(hWave)));	// returns all pending microphone blocks marked as done
+	}
+	catch (...) {
+		// do nothing
+	}
+
+	while (WAVEBLOCK* wblock = Blocks.GetFirst()) {
+		if (wblock->Hdr.dwFlags & WHDR_PREPARED)
+			UnprepareHeader (&wblock->Hdr);
+		wblock->Hdr.dwFlags = 0;
+		Blocks.ReleaseFirst();
+	}
+}
+
+
+int WaveInEndpoint::Read (void * data, int nbytes)
+{
+	WAVEBLOCK * wblock = Blocks.GetFirst();
+
+	if (!(wblock->Hdr.dwFlags & WHDR_DONE)) {
+		EventBlock.Wait (RecordSize * 1100 / WaveFormat.nAvgBytesPerSec);	// block time + 10%
+		if (!(wblock->Hdr.dwFlags & WHDR_DONE)) {
+			if (++LateReads >= NumLateReads) {
+				LateReads = 0;
+				LogMsg("ERROR: Microphone got stuck");
+				throw Fail (DialAppError_WaveInError, "Microphone got stuck");
+			}
+			return 0;
+		}
+	}
+	LateReads = 0;
+
+	int got = MIN(nbytes, int(wblock->Hdr.dwBytesRecorded));
+	memcpy (data, wblock->Data, got);
+
+	// Return the block to the device
+	if (wblock->Hdr.dwFlags & WHDR_PREPARED)
+		UnprepareHeader (&wblock->Hdr);
+	Blocks.ReleaseFirst();
+	AddBlock();
+	return got;
+}
+
+
+
+/****************************************************************************************\
+									Class DmoEndpoint
+\****************************************************************************************/
+
+void DmoEndpoint::Open (const FORMAT & fmt)
+{
+	DMO_MEDIA_TYPE  mediaType;
+	WAVEFORMATEX*	pwav;
+
+	AudioEndpoint::Open(fmt);
+	SetWaveFormat(fmt);
+
+	CHECK_HRESULT (CoInitializeEx (NULL, COINIT_APARTMENTTHREADED));
+
+	MediaObject = NULL;
+	memset(&mediaType, 0, sizeof(mediaType));
+
+	CHECK_HRESULT (CoCreateInstance(CLSID_CWMAudioAEC, NULL, CLSCTX_INPROC_SERVER, IID_IMediaObject, (void**) &MediaObject));
+	CHECK_HRESULT (MoInitMediaType(&mediaType, sizeof(WAVEFORMATEX)));
+
+	mediaType.majortype = MEDIATYPE_Audio;
+	mediaType.subtype = MEDIASUBTYPE_PCM;
+	mediaType.lSampleSize = 0;
+	mediaType.bFixedSizeSamples = TRUE;
+	mediaType.bTemporalCompression = FALSE;
+	mediaType.formattype = FORMAT_WaveFormatEx;
+
+	pwav = (WAVEFORMATEX*)mediaType.pbFormat;
+	memcpy(pwav, &WaveFormat, sizeof(WaveFormat));
+
+	CHECK_HRESULT (MediaObject->SetOutputType(0, &mediaType, 0));
+
+	IPropertyStore *props;
+	PROPVARIANT propvar = {0};
+
+	CHECK_HRESULT (MediaObject->QueryInterface(IID_IPropertyStore, (void**)&props));
+
+	propvar.vt = VT_I4;
+	propvar.lVal = 0; // System Mode - SINGLE_CHANNEL_AEC
+	CHECK_HRESULT (props->SetValue(MFPKEY_WMAAECMA_SYSTEM_MODE, propvar));
+
+	DataBuffer.dwStatus = 0;
+	DataBuffer.pBuffer = &MediaBuffer;
+
+	MoFreeMediaType(&mediaType);
+
+	LogMsg("MediaObject = %X", MediaObject);
+}
+
+
+void DmoEndpoint::Close ()
+{
+	MediaObject->Release();
+	MediaObject = 0;
+	CoUninitialize();
+}
+
+
+void DmoEndpoint::Start ()
+{
+	MediaObject->AllocateStreamingResources();
+	FirstIter = true;
+}
+
+
+void DmoEndpoint::Stop ()
+{
+	MediaObject->FreeStreamingResources();
+}
+
+
+int DmoEndpoint::Read (void * data, int nbytes)
+{
+	DWORD	dwStatus;
+	HRESULT hr;
+	int		got = 0;
+
+	// The output is polled: the previous Read took the available data
+	if (!FirstIter)
+		Sleep (DmoPollTime);
+
+	MediaBuffer.m_data   = Data;
+	MediaBuffer.m_length = 0;
+
+	hr = MediaObject->ProcessOutput(0, 1, &DataBuffer, &dwStatus);
+	LogMsg("IMediaObject::ProcessOutput completed, HRESULT %X", hr);
+
+	/*
+	  IMediaObject::ProcessOutput possible values (according to MSDN):
+		E_FAIL			Failure
+		E_INVALIDARG	Invalid argument
+		E_POINTER		NULL pointer argument
+		S_FALSE			No output was generated
+		S_OK			Success
+	*/
+	if (hr == S_OK) {
+		if (FirstIter)
+			Sleep (DmoPollTime/2);
+
+		if (DataBuffer.dwStatus == DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE)
+			LogMsg("DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE, size %d", MediaBuffer.m_length);
+
+		got = MIN(nbytes, int(MediaBuffer.m_length));
+		memcpy (data, Data, got);
+	}
+	else if (hr != S_FALSE)		// S_FALSE means nothing to process
+		throw Fail (DialAppError_MediaObjectInError, "IMediaObject::ProcessOutput failed, HRESULT %X", hr);
+
+	MediaBuffer.m_data = 0;
+	FirstIter = false;
+	return got;
+}
+
+
+#pragma managed(pop)
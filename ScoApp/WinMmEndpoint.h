@@ -0,0 +1,243 @@
+/*******************************************************************\
+ Filename    :  WinMmEndpoint.h
+ Purpose     :  Sound card audio endpoints: WinMM devices and DMO
+\*******************************************************************/
+
+#pragma once
+#pragma managed(push, off)
+
+
+#include <Mediaobj.h>
+
+#include "def.h"
+#include "deblog.h"
+#include "mutex.h"
+#include "fixed_cont.h"
+#include "AudioEndpoint.h"
+
+
+class MediaBuffer : public IMediaBuffer
+{
+  public:
+
+	MediaBuffer (DWORD maxLength) :
+		m_ref(0),
+		m_maxLength(maxLength),
+		m_length(0),
+		m_data(0)
+	{}
+
+	HRESULT STDMETHODCALLTYPE SetLength (DWORD cbLength)
+	{
+		if (cbLength > m_maxLength) {
+			return E_INVALIDARG;
+		}
+		else {
+			m_length = cbLength;
+			return S_OK;
+		}
+	}
+
+	HRESULT STDMETHODCALLTYPE GetMaxLength (DWORD *maxLength)
+	{
+		if (!maxLength)
+			return E_POINTER;
+		*maxLength = m_maxLength;
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE GetBufferAndLength (BYTE **buffer, DWORD *length)
+	{
+		if (!buffer || !length)
+			return E_POINTER;
+		*buffer = m_data;
+		*length = m_length;
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface (REFIID riid, void **iface)
+	{
+		if (!iface)
+			return E_POINTER;
+		if (riid == IID_IMediaBuffer || riid == IID_IUnknown) {
+			*iface = static_cast<IMediaBuffer*>(this);
+			AddRef();
+			return S_OK;
+		}
+		*iface = 0;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef()
+	{
+		return InterlockedIncrement(&m_ref);
+	}
+
+	ULONG STDMETHODCALLTYPE Release()
+	{
+		LONG lRef = InterlockedDecrement(&m_ref);
+		if (!lRef)
+			delete this;
+		return lRef;
+	}
+
+  public:
+	DWORD        m_length;
+	const DWORD  m_maxLength;
+	LONG         m_ref;
+	BYTE         *m_data;
+};
+
+
+
+/*
+ ************************************************************************************************
+ Base of the sound card endpoints: the wave blocks queued to a WinMM device and its errors.
+ The endpoints are clocked by the sound card (see DriftComp.h). They are opened, started and
+ used by one thread: DMO requires it, and the blocks are not locked.
+ ************************************************************************************************
+ */
+class WinMmEndpoint : public AudioEndpoint, public DebLog
+{
+  public:
+	enum {
+		BlockSize = 4096,	// Max size of one Write or Read, Wave::ChunkSize
+		NumBlocks = 8		// Blocks queued to the device
+	};
+
+	struct WAVEBLOCK {
+		WAVEHDR	Hdr;
+		UINT8	Data[BlockSize];
+	};
+
+  protected:
+	WinMmEndpoint (cchar * name, bool capture);
+
+	void SetWaveFormat (const FORMAT & fmt);
+	void UnprepareHeader (WAVEHDR * whdr);
+
+	void CheckMmres (MMRESULT res, cchar * file, int line) {
+		if (res != MMSYSERR_NOERROR) {
+			LogMsg("ERROR [%s:%d]: MMRESULT = %d (hWave = %X)", file, line, res, hWave);
+			throw Fail (DialAppError_WaveApiError, "ERROR [%s:%d]: MMRESULT = %d", file, line, res);
+		}
+	}
+
+	void CheckHresult (HRESULT res, cchar * file, int line) {
+		if (FAILED(res)) {
+			LogMsg("ERROR [%s:%d]: HRESULT = %d", file, line, res);
+			throw Fail (DialAppError_InitMediaDeviceError, "ERROR [%s:%d]: HRESULT = %d", file, line, res);
+		}
+	}
+
+  protected:
+	HWAVE			hWave;
+	WAVEFORMATEX	WaveFormat;
+
+	RING_BUFFER_ALLOC<WAVEBLOCK,NumBlocks>	Blocks;		// Queued to the device, the first one is the oldest
+};
+
+
+
+/*
+ ************************************************************************************************
+ Speaker: waveOut device. Write queues the data and returns, throws DialAppError_WaveBuffersError
+ if all the blocks are still playing (the device got stuck); a block which the device refuses
+ is dropped.
+ ************************************************************************************************
+ */
+class WaveOutEndpoint : public WinMmEndpoint
+{
+  public:
+	WaveOutEndpoint () : WinMmEndpoint("SpkWinMM", false), WrittenSamples(0) {}
+
+	virtual void Open  (const FORMAT & fmt);
+	virtual void Close ();
+	virtual void Start ();
+	virtual void Stop  ();
+	virtual void Write (const void * data, int nbytes);
+	virtual int  Read  (void * data, int nbytes)	{ throw Fail (DialAppError_InternalError, "Read from speaker"); }
+	virtual int  GetQueueFill ();
+
+  protected:
+	void ReleaseCompletedBlocks (bool clean_all = false);
+
+  protected:
+	DWORD	WrittenSamples;		// Samples sent to waveOut, compared with its playing position
+};
+
+
+
+/*
+ ************************************************************************************************
+ Microphone: waveIn device, all the blocks of blocksize bytes are kept queued to it. Read takes
+ the oldest recorded block: it waits for it up to the block time and returns 0 if the block is
+ late; DialAppError_WaveInError is thrown when the microphone got stuck for NumLateReads reads.
+ ************************************************************************************************
+ */
+class WaveInEndpoint : public WinMmEndpoint
+{
+  public:
+	enum { NumLateReads = 4 };
+
+  public:
+	WaveInEndpoint (int blocksize) : WinMmEndpoint("MicWinMM", true), RecordSize(blocksize), LateReads(0) {}
+
+	virtual void Open  (const FORMAT & fmt);
+	virtual void Close ();
+	virtual void Start ();
+	virtual void Stop  ();
+	virtual void Write (const void * data, int nbytes)	{ throw Fail (DialAppError_InternalError, "Write to microphone"); }
+	virtual int  Read  (void * data, int nbytes);
+
+  protected:
+	void AddBlock ();
+
+  protected:
+	int		RecordSize;		// Bytes per block
+	int		LateReads;
+	Event	EventBlock;		// waveIn block completion
+};
+
+
+
+/*
+ ************************************************************************************************
+ Microphone: DirectX Voice Capture DMO with its own AEC/NS/AGC. The DMO output is polled each
+ DmoPollTime by Read, it returns 0 if there was nothing to process.
+ ************************************************************************************************
+ */
+class DmoEndpoint : public WinMmEndpoint
+{
+  public:
+	enum { DmoPollTime = 100 };
+
+  public:
+	DmoEndpoint () : WinMmEndpoint("MicDmo  ", true), MediaObject(0), MediaBuffer(BlockSize), FirstIter(true) {}
+
+	virtual void Open  (const FORMAT & fmt);
+	virtual void Close ();
+	virtual void Start ();
+	virtual void Stop  ();
+	virtual void Write (const void * data, int nbytes)	{ throw Fail (DialAppError_InternalError, "Write to microphone"); }
+	virtual int  Read  (void * data, int nbytes);
+
+  protected:
+	IMediaObject*			MediaObject;
+	MediaBuffer				MediaBuffer;
+	DMO_OUTPUT_DATA_BUFFER	DataBuffer;
+	bool					FirstIter;	// For jitter
+	UINT8					Data[BlockSize];
+};
+
+
+
+/*******************************************************************\
+					Error Codes Check Macros
+\*******************************************************************/
+
+#define CHECK_MMRES(res)		CheckMmres (res,__FUNCTION__,__LINE__)
+#define CHECK_HRESULT(res)		CheckHresult(res,__FUNCTION__,__LINE__)
+
+
+#pragma managed(pop)
@@ -15,8 +15,11 @@
 										Static data
 \***********************************************************************************************/
 DebLog  DebLog::GlobalObj("-------");
+cchar*  DebLog::ApplName = "";
+bool	DebLog::Tracing  = true;
 
-FIFO_SIMPLE_ALLOC<STRBUF,DebLog::MsgMaxNum>  strallocCyclicBuffer;
+// Messages 1st prefix, the Appl name set by Init
+static char deblogPrefix [DebLog::Msg1stPrefixSize] = { ' ',' ',' ',' ',' ',' ',' ',':',' ' };
 
 
 
@@ -24,10 +27,19 @@ FIFO_SIMPLE_ALLOC<STRBUF,DebLog::MsgMaxNum>  strallocCyclicBuffer;
 									Protected Static functions
 \***********************************************************************************************/
 
-void DebLog::LogMsgHelper (cchar * msg, va_list args)
+void DebLog::LogMsgHelper (cchar * msg, va_list args, bool error)
 {
-	char * newstr = strallocCyclicBuffer.FetchNext()->str;
+	// Errors are rare and needed most when the tracing is off
+	if (!Tracing  &&  !error)
+		return;
+
+	// On the stack: the message is built by each thread in its own buffer
+	char newstr [MsgMaxSize+1];
+	memcpy (newstr, deblogPrefix, Msg1stPrefixSize);
 	memcpy (newstr + Msg1stPrefixSize, Module, Msg2ndPrefixSize - 2);
+	newstr[MsgPrefixSize - 2] = ':';
+	newstr[MsgPrefixSize - 1] = ' ';
+	newstr[MsgMaxSize] = '\0';			// vsnprintf doesn't terminate a truncated message
 	vsnprintf (newstr+MsgPrefixSize, MsgMaxSize-MsgPrefixSize, msg, args);
 	OutputDebugString (newstr);
 }
@@ -39,15 +51,10 @@ void DebLog::LogMsgHelper (cchar * msg, va_list args)
 
 void DebLog::Init (cchar * applname)
 {
-	char *s;
-	for (int i=0; i<strallocCyclicBuffer.Size; i++) {
-		s = strallocCyclicBuffer.Addr[i].str;
-		memcpy (s, applname, Msg1stPrefixSize - 2);
-		s[Msg1stPrefixSize - 2] = ':';
-		s[Msg1stPrefixSize - 1] = ' ';
-		s[MsgPrefixSize - 2]    = ':';
-		s[MsgPrefixSize - 1]    = ' ';
-	}
+	ApplName = applname;
+	memcpy (deblogPrefix, applname, Msg1stPrefixSize - 2);
+	deblogPrefix[Msg1stPrefixSize - 2] = ':';
+	deblogPrefix[Msg1stPrefixSize - 1] = ' ';
 }
 
 
@@ -10,7 +10,6 @@
 
 
 #include "def.h"
-#include "fifo_cse.h"
 
 
 /*
@@ -22,7 +21,6 @@ class DebLog
 {
   public:
 	enum { 
-		MsgMaxNum		 =	8,	// Number of strings for simultaneous messages
 		MsgMaxSize		 = 250,	// Max size of string buffer for trace/exception messages
 		Msg1stPrefixSize =  9, 	// Size of messages 1st prefix, that is Appl name (e.g. "DialApp: ")
 		Msg2ndPrefixSize =  9, 	// Size of messages 2nd prefix, that is module name
@@ -38,6 +36,11 @@ class DebLog
   public:
 	static DebLog  GlobalObj;	// Object for printing from the global context (C-style and static code)
 	static cchar * ApplName;
+	static bool	   Tracing;		// When off, LogMsg messages are not formatted at all; IntException errors are always printed
+
+  public:
+	static bool IsTracing ()			{ return Tracing; }
+	static void SetTracing (bool on)	{ Tracing = on; }
 
   public:
 	static void Init (cchar * applname);
@@ -55,12 +58,12 @@ class DebLog
 	{
 		va_list  argptr;
 		va_start (argptr, msg);
-		LogMsgHelper(msg, argptr);
+		LogMsgHelper(msg, argptr, true);
 		return error;
 	}
 
   public:
-	void LogMsgHelper (cchar * msg, va_list args);
+	void LogMsgHelper (cchar * msg, va_list args, bool error = false);
 };
 
 
@@ -81,17 +84,9 @@ inline int IntException (int error, char * msg, ...)
 {
 	va_list  argptr;
 	va_start (argptr, msg);
-	DebLog::GlobalObj.LogMsgHelper(msg, argptr);
+	DebLog::GlobalObj.LogMsgHelper(msg, argptr, true);
 	return error;
 }
 
 
-struct STRBUF
-{
-    char str[DebLog::MsgMaxSize+1];
-};
-
-extern FIFO_SIMPLE_ALLOC<STRBUF,DebLog::MsgMaxNum>  strallocCyclicBuffer;
-
-
 #pragma managed(pop)
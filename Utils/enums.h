@@ -9,8 +9,25 @@
 #define _ENUMS_H
 
 
+/*
+ The names tables are constant data (no runtime construction): each entry
+ is the name literal with its length, the accessors cost an index check.
+ */
+struct ENUM_NAME
+{
+    const char * Str;
+    int          Len;
+};
+
+inline const ENUM_NAME & enumNameUnknown ()
+{
+    static const ENUM_NAME unknown = { "?", 1 };
+    return unknown;
+}
+
+
 #define ENUM_ENTRY_DECL(eprefix,ename)              eprefix##_##ename
-#define ENUM_ENTRY_IMPL(eprefix,ename)              #ename
+#define ENUM_ENTRY_IMPL(eprefix,ename)              { #ename, sizeof(#ename) - 1 }
 
 #define ENUM_ENTRY   ENUM_ENTRY_DECL
 
@@ -24,10 +41,18 @@
         TNAME##_NONE = -1                                       \
     } TNAME;                                                    \
                                                                 \
-    extern const char *enumTable_##TNAME [];                    \
-    extern int   enumTable_##TNAME##Size;                       \
+    extern const ENUM_NAME enumTable_##TNAME [TNAME##_NUMS];    \
                                                                 \
-    const char* enum_##TNAME (int val);                      
+    inline const ENUM_NAME & enumName_##TNAME (int val)         \
+    {                                                           \
+        return (unsigned(val) < unsigned(TNAME##_NUMS)) ?       \
+            enumTable_##TNAME [val] : enumNameUnknown();        \
+    }                                                           \
+                                                                \
+    inline const char* enum_##TNAME (int val)                   \
+    {                                                           \
+        return enumName_##TNAME(val).Str;                       \
+    }
 
 
 #endif /* _ENUMS_H */
@@ -12,12 +12,8 @@
 #define ENUM_ENTRY  ENUM_ENTRY_IMPL
 
 
-#define GetStringArraySize(array)   (sizeof(array) / sizeof (char*))
-
-
 #define IMPL_ENUM(TNAME,ENLIST)                                                 \
-    const char * enumTable_##TNAME [] = { ENLIST };                             \
-    int enumTable_##TNAME##Size = GetStringArraySize(enumTable_##TNAME);
+    const ENUM_NAME enumTable_##TNAME [TNAME##_NUMS] = { ENLIST };
 
 
 
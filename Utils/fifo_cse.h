@@ -17,7 +17,8 @@
  **************************************************************************
  FIFO_SIMPLE_ALLOC template implements a simple cyclic buffer of one-type 
  elements with one pointer (elements array is part of the class).
- FetchNext() is always returns non-null pointer.
+ FetchNext() is always returns non-null pointer: the oldest elements are
+ reused. FetchNext(count) returns 0 if count exceeds the buffer size.
  **************************************************************************
 */
 template <class T, int MaxElements> class FIFO_SIMPLE_ALLOC
@@ -47,14 +48,17 @@ template <class T, int MaxElements> class FIFO_SIMPLE_ALLOC
 
     T * FetchNext (int count)
     {
-        // Get count contiguous elements
-        if (MaxElements-1 - NextInputInd >= count) {
-            T * ret = & Addr [NextInputInd];
-            NextInputInd += count;
-            return ret;
-        }
-        NextInputInd = count;
-        return &Addr[0];
+        // Get count contiguous elements, from index 0 if the tail is short
+        if (count <= 0  ||  count > MaxElements)
+            return 0;
+        if (MaxElements - NextInputInd < count)
+            NextInputInd = 0;
+
+        T * ret = & Addr [NextInputInd];
+        NextInputInd += count;
+        if (NextInputInd == MaxElements)
+            NextInputInd = 0;
+        return ret;
     }
 
   public:
@@ -146,15 +150,15 @@ template <class T> class FIFO
         return & Addr[FirstOutputInd];
     }
 
-    T GetElement ()
+    bool GetElement (T & element)
     {
         LOCKFUNC_FIFO();
         if (Empty)
-            return (T) 0;
+            return false;
 
-        T ret = Addr[FirstOutputInd];
+        element = Addr[FirstOutputInd];
         IncrementFirstOutput();
-        return ret;
+        return true;
     }
 
     bool ReleaseFirst ()
@@ -0,0 +1,253 @@
+/****************************************************************************************\
+ Library     :  Utils
+ Filename    :  fixed_cont.h
+ Purpose     :  Fixed capacity containers: SPAN, STATIC_VECTOR, RING_BUFFER
+\****************************************************************************************/
+
+#ifndef _FIXED_CONT_H
+#define _FIXED_CONT_H
+
+#include "def.h"
+
+
+/*
+ **************************************************************************
+ The containers keep their elements in the object (no heap), the capacity
+ is a template parameter (an enum, v110 has no constexpr). The alignment
+ of the storage is the alignment of T: declare T with __declspec(align(N))
+ to get cache line or SIMD aligned elements.
+ Pointers serve as iterators, begin()/end() enable range-based for.
+ **************************************************************************
+*/
+
+
+/*
+ **************************************************************************
+ SPAN is a non-owning view of count contiguous elements.
+ **************************************************************************
+*/
+template <class T> struct SPAN
+{
+	T *  Ptr;
+	int  Count;
+
+	SPAN ()						: Ptr(0), Count(0)		{}
+	SPAN (T * ptr, int count)	: Ptr(ptr), Count(count) {}
+
+	// SPAN<T> to SPAN<const T>
+	template <class U>
+	SPAN (const SPAN<U> & s)	: Ptr(s.Ptr), Count(s.Count) {}
+
+	bool IsEmpty () const			{ return Count == 0; }
+	T &  operator [] (int i) const	{ return Ptr[i]; }
+	T *  begin () const				{ return Ptr; }
+	T *  end () const				{ return Ptr + Count; }
+};
+
+
+
+/*
+ **************************************************************************
+ STATIC_VECTOR: a vector of up to MaxElements elements.
+ Append(n) takes n contiguous elements at once, 0 when they don't fit.
+ **************************************************************************
+*/
+template <class T, int MaxElements> class STATIC_VECTOR
+{
+  public:
+	enum { Size = MaxElements };
+
+  public:
+	STATIC_VECTOR ()	{ Count = 0; }
+
+	void Clear ()				{ Count = 0; }
+	int  GetCount () const		{ return Count; }
+	int  GetMaxElements () const{ return MaxElements; }
+	bool IsEmpty () const		{ return Count == 0; }
+	bool IsFull () const		{ return Count == MaxElements; }
+
+	T &  operator [] (int i)	{ return Addr[i]; }
+	T *  begin ()				{ return Addr; }
+	T *  end ()					{ return Addr + Count; }
+	SPAN<T> GetSpan ()			{ return SPAN<T> (Addr, Count); }
+
+	bool PushBack (const T & element)
+	{
+		if (Count == MaxElements)
+			return false;
+		Addr[Count++] = element;
+		return true;
+	}
+
+	T * Append (int n)
+	{
+		if (n > MaxElements - Count)
+			return 0;
+		T * ret = &Addr[Count];
+		Count += n;
+		return ret;
+	}
+
+	bool PopBack ()
+	{
+		if (Count == 0)
+			return false;
+		Count--;
+		return true;
+	}
+
+	// Order is not kept: the last element takes the erased place
+	void EraseUnordered (int i)
+	{
+		Addr[i] = Addr[--Count];
+	}
+
+  protected:
+	T    Addr [MaxElements];
+	int  Count;
+};
+
+
+
+/*
+ **************************************************************************
+ RING_BUFFER: a FIFO of a power of 2 size. The indices are free running and
+ masked (no CYCLIC_INC branches, no Full/Empty flags), so all Size elements
+ are usable. The interface follows FIFO<T>: FetchNext/PutElement at the
+ input, GetFirst/ReleaseFirst/GetElement at the output. The batch functions
+ move spans in one call, AcquireWrite/AcquireRead give the contiguous part
+ of the free/used space for the zero-copy access.
+ Like FIFO, it is not thread safe (see SPSC_RING for the lock-free one).
+
+ RING_BUFFER_ALLOC adds the storage, as FIFO_ALLOC does for FIFO.
+ **************************************************************************
+*/
+template <class T> class RING_BUFFER
+{
+  public:
+	void Construct (T * addr, int maxelements)
+	{
+		ASSERT__ ((maxelements & (maxelements-1)) == 0);
+		Addr = addr;
+		Mask = maxelements - 1;
+		Clear ();
+	}
+
+	void Clear ()					{ Head = Tail = 0; }
+
+	int  GetMaxElements () const	{ return int(Mask + 1); }
+	int  GetCount () const			{ return int(Head - Tail); }
+	bool IsEmpty () const			{ return Head == Tail; }
+	bool IsFull () const			{ return Head - Tail > Mask; }
+
+	// i-th element from the first one
+	T &  operator [] (int i)		{ return Addr[(Tail + i) & Mask]; }
+
+
+	/************************** Input **************************/
+
+	T * GetNextFree ()
+	{
+		return IsFull() ? 0 : &Addr[Head & Mask];
+	}
+
+	T * FetchNext ()
+	{
+		if (IsFull())
+			return 0;
+		return &Addr[Head++ & Mask];
+	}
+
+	bool PutElement (const T & element)
+	{
+		if (IsFull())
+			return false;
+		Addr[Head++ & Mask] = element;
+		return true;
+	}
+
+	// Puts up to src.Count elements, returns the number of put ones
+	int PutSpan (const SPAN<const T> & src)
+	{
+		int n = MIN(src.Count, GetMaxElements() - GetCount());
+		for (int i = 0; i < n; i++)
+			Addr[Head++ & Mask] = src.Ptr[i];
+		return n;
+	}
+
+	// The contiguous free space at the input, CommitWrite(n) puts n elements of it
+	SPAN<T> AcquireWrite ()
+	{
+		int i = int(Head & Mask);
+		return SPAN<T> (&Addr[i], MIN(GetMaxElements() - GetCount(), GetMaxElements() - i));
+	}
+
+	void CommitWrite (int n)		{ Head += n; }
+
+
+	/************************** Output **************************/
+
+	T * GetFirst ()
+	{
+		return IsEmpty() ? 0 : &Addr[Tail & Mask];
+	}
+
+	bool ReleaseFirst ()
+	{
+		if (IsEmpty())
+			return false;
+		Tail++;
+		return true;
+	}
+
+	bool GetElement (T & element)
+	{
+		if (IsEmpty())
+			return false;
+		element = Addr[Tail++ & Mask];
+		return true;
+	}
+
+	// Gets up to dst.Count elements, returns the number of got ones
+	int GetSpan (const SPAN<T> & dst)
+	{
+		int n = MIN(dst.Count, GetCount());
+		for (int i = 0; i < n; i++)
+			dst.Ptr[i] = Addr[Tail++ & Mask];
+		return n;
+	}
+
+	// The contiguous used space at the output, CommitRead(n) releases n elements of it
+	SPAN<T> AcquireRead ()
+	{
+		int i = int(Tail & Mask);
+		return SPAN<T> (&Addr[i], MIN(GetCount(), GetMaxElements() - i));
+	}
+
+	void CommitRead (int n)			{ Tail += n; }
+
+  protected:
+	T  *	Addr;
+	uint32	Mask;
+	uint32	Head, Tail;
+};
+
+
+template <class T, int MaxElements_> class RING_BUFFER_ALLOC : public RING_BUFFER<T>
+{
+  public:
+	enum { Size = MaxElements_ };
+
+  private:
+	typedef char SizeMustBePowerOf2 [(MaxElements_ & (MaxElements_-1)) == 0 ? 1 : -1];
+
+  public:
+	RING_BUFFER_ALLOC ()	{ Construct (); }
+	void Construct ()		{ RING_BUFFER<T>::Construct (Addr, MaxElements_); }
+
+  public:
+	T  Addr [MaxElements_];
+};
+
+
+#endif // _FIXED_CONT_H
@@ -0,0 +1,191 @@
+/****************************************************************************************\
+ Library     :  Utils
+ Filename    :  spsc_ring.h
+ Purpose     :  Lock-free Single Producer/Single Consumer ring for constant size elements
+\****************************************************************************************/
+
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include "def.h"
+
+
+#define SPSC_CACHE_LINE		64
+
+
+/*
+ **************************************************************************
+ SPSC_RING template implements a wait-free cyclic buffer for exactly one
+ producer thread and one consumer thread (a sibling of FIFO_ALLOC, which
+ is not thread safe).
+
+ - Size must be a power of 2; indices are free-running and masked.
+ - Producer and consumer indices live on separate cache lines, and each
+   side caches the other side's index, so the shared lines are touched
+   only when the cached value is exhausted.
+ - Publishing is release-ordered and observing is acquire-ordered
+   (explicit barriers, correct for x86/x64 and ARM).
+ - Batch API: PushSpan/PopSpan copy contiguous spans (at most two memcpy
+   calls on wrap), AcquireWrite/CommitWrite and AcquireRead/CommitRead
+   give zero-copy access to the contiguous part of the free/used space.
+
+ Elements must be POD, they are moved by memcpy.
+ **************************************************************************
+*/
+template <class T, int Size_> class SPSC_RING
+{
+  public:
+	enum { Size = Size_, Mask = Size_ - 1 };
+
+  private:
+	typedef char SizeMustBePowerOf2 [(Size_ & (Size_-1)) == 0 ? 1 : -1];
+
+  public:
+	SPSC_RING ()	{ Head = Tail = CachedHead = CachedTail = 0; }
+
+	// Both sides must be stopped
+	void Clear ()	{ Head = Tail = CachedHead = CachedTail = 0; }
+
+	// Approximate when called concurrently
+	int  GetCount ()	{ return int(Head - Tail); }
+	bool IsEmpty ()		{ return Head == Tail;	   }
+
+
+	/************************** Producer side **************************/
+
+	bool Push (const T & v)
+	{
+		uint32 h = Head;
+		if (h - CachedTail == Size) {
+			CachedTail = LoadAcquire(&Tail);
+			if (h - CachedTail == Size)
+				return false;
+		}
+		Buf[h & Mask] = v;
+		StoreRelease (&Head, h + 1);
+		return true;
+	}
+
+	// Pushes up to n elements, returns the number of pushed ones
+	int PushSpan (const T * src, int n)
+	{
+		uint32 h    = Head;
+		int	   free = Size - int(h - CachedTail);
+		if (free < n) {
+			CachedTail = LoadAcquire(&Tail);
+			free = Size - int(h - CachedTail);
+		}
+		if (n > free)
+			n = free;
+		if (n <= 0)
+			return 0;
+
+		int i	  = h & Mask;
+		int first = MIN(n, Size - i);
+		memcpy (&Buf[i], src, first * sizeof(T));
+		if (n > first)
+			memcpy (&Buf[0], src + first, (n - first) * sizeof(T));
+
+		StoreRelease (&Head, h + n);
+		return n;
+	}
+
+	// Returns pointer to the contiguous free space, n gets its size (may be 0)
+	T * AcquireWrite (int & n)
+	{
+		uint32 h = Head;
+		CachedTail = LoadAcquire(&Tail);
+		int free = Size - int(h - CachedTail);
+		int i	 = h & Mask;
+		n = MIN(free, Size - i);
+		return &Buf[i];
+	}
+
+	void CommitWrite (int n)	{ StoreRelease (&Head, Head + n); }
+
+
+	/************************** Consumer side **************************/
+
+	bool Pop (T & v)
+	{
+		uint32 t = Tail;
+		if (t == CachedHead) {
+			CachedHead = LoadAcquire(&Head);
+			if (t == CachedHead)
+				return false;
+		}
+		v = Buf[t & Mask];
+		StoreRelease (&Tail, t + 1);
+		return true;
+	}
+
+	// Pops up to n elements, returns the number of popped ones
+	int PopSpan (T * dst, int n)
+	{
+		uint32 t    = Tail;
+		int	   used = int(CachedHead - t);
+		if (used < n) {
+			CachedHead = LoadAcquire(&Head);
+			used = int(CachedHead - t);
+		}
+		if (n > used)
+			n = used;
+		if (n <= 0)
+			return 0;
+
+		int i	  = t & Mask;
+		int first = MIN(n, Size - i);
+		memcpy (dst, &Buf[i], first * sizeof(T));
+		if (n > first)
+			memcpy (dst + first, &Buf[0], (n - first) * sizeof(T));
+
+		StoreRelease (&Tail, t + n);
+		return n;
+	}
+
+	// Returns pointer to the contiguous used space, n gets its size (may be 0)
+	const T * AcquireRead (int & n)
+	{
+		uint32 t = Tail;
+		CachedHead = LoadAcquire(&Head);
+		int used = int(CachedHead - t);
+		int i	 = t & Mask;
+		n = MIN(used, Size - i);
+		return &Buf[i];
+	}
+
+	void CommitRead (int n)		{ StoreRelease (&Tail, Tail + n); }
+
+	// Consumer side clear: drops all currently available elements
+	void Drain ()				{ StoreRelease (&Tail, LoadAcquire(&Head)); }
+
+
+  protected:
+	static uint32 LoadAcquire (volatile uint32 * p)
+	{
+		uint32 v = *p;
+		MemoryBarrier();
+		return v;
+	}
+
+	static void StoreRelease (volatile uint32 * p, uint32 v)
+	{
+		MemoryBarrier();
+		*p = v;
+	}
+
+  protected:
+	// Producer's cache line
+	__declspec(align(SPSC_CACHE_LINE)) volatile uint32 Head;
+	uint32	CachedTail;
+
+	// Consumer's cache line
+	__declspec(align(SPSC_CACHE_LINE)) volatile uint32 Tail;
+	uint32	CachedHead;
+
+	__declspec(align(SPSC_CACHE_LINE)) T Buf [Size_];
+};
+
+
+
+#endif // _SPSC_RING_H
@@ -11,6 +11,7 @@
 
 
 #include "def.h"
+#include "strscan.h"
 
 
 
@@ -27,6 +28,8 @@
 
   - Concatenation execution time is much smaller than that of strncat
   - Len member execution time is much smaller than that os strlen
+  - Scan methods use the strscan.h kernels, SeekInt doesn't use sscanf
+  - += of the numbers and AddHex don't use sprintf
   - Operator char* returns the pointers to string
   - Operator int converts string to integer
  *********************************************************************
@@ -92,6 +95,9 @@ class STRB
     int    Add  (cchar * s, int size);
     int    Add  (cchar * s, char terminator);
 
+    // The numbers are formatted without sprintf
+    int    AddHex (UINT64 i)  { return AddNum (i, false, 16); }
+
     int    CopyEx(cchar * s, int size = 0) { Len = 0; return AddEx(s,size); }
     int    AddEx(cchar * s, int size = 0);
 
@@ -151,13 +157,13 @@ class STRB
 
     //********************************************************************
     // Standard string functions wrappers
-    int   Strlen      ()                { return (Len = (unsigned) strlen(Str)); }
+    int   Strlen      ()                { return (Len = (unsigned) strscanLen(Str)); }
     STRB& Strcpy      (cchar* s)        { strcpy(Str,s);  return *this; }
     STRB& Strcat      (cchar* s)        { strcat(Str,s);  return *this; }
     char* Strstr      (cchar* s)        { return strstr(Str,s);  }
     int   Strcmp      (cchar* s)        const { return strcmp(Str,s); }
     int   Strncmp     (cchar* s, int n) const { return strncmp(Str,s,n); }
-    char* Strchr      (char ch)         { return strchr(Str,ch); }
+    char* Strchr      (char ch)         { return (char*) strscanChar(Str,ch); }
     char* Strrchr     (char ch)         { return strrchr(Str,ch); }
     int   Sprintf     (cchar * sformat, ...);
     int   Vsprintf    (cchar * sformat, va_list arglist);
@@ -180,19 +186,21 @@ class STRB
     // Seek methods look for characters next to the current position 
     char  SeekChar    ()                    { return (*Spos++); }
     char* SeekChar    (char ch)             { return (*Spos==ch) ? ++Spos : 0; }
-    char* SeekStr     (cchar* s)            { int l; return (memcmp(Spos,s,l=(int)strlen(s))==0) ? Spos+=l : 0; }
+    char* SeekStr     (cchar* s);
     char* SeekStr     (STRB & s)            { int l; return (memcmp(Spos,(void*)s,l=s.Length())==0) ? Spos+=l : 0; }
     char* SeekStr     (cchar* s, int slen)  { return (memcmp(Spos,s,slen)==0) ? Spos+=slen : 0; }
     char* SeekInt     (int * x, cchar* sformat = "%d");
 
     //********************************************************************
     // Scan methods look for characters after the current position
-    char* ScanChar    (char ch)          { char * s1 = strchr(Spos,ch);    return (s1) ? Spos=s1 : 0; }
+    char* ScanChar    (char ch)          { char * s1 = (char*) strscanChar(Spos,ch);   return (s1) ? Spos=s1 : 0; }
     char* ScanCharr   (char ch)          { char * s1 = strrchr(Spos,ch);   return (s1) ? Spos=s1 : 0; }
-    char* ScanCharNext(char ch)          { char * s1 = strchr(Spos+1,ch);  return (s1) ? Spos=s1 : 0; }
+    char* ScanCharNext(char ch)          { char * s1 = (char*) strscanChar(Spos+1,ch); return (s1) ? Spos=s1 : 0; }
     char* ScanCharrNext(char ch)         { char * s1 = strrchr(Spos+1,ch); return (s1) ? Spos=s1 : 0; }
     char* ScanStr     (cchar* s)         { char * s1 = strstr(Spos,s);     return (s1) ? Spos=s1 : 0; }
     char* ScanStrNext (cchar* s)         { char * s1 = strstr(Spos+1,s);   return (s1) ? Spos=s1 : 0; }
+    char* ScanAny     (cchar* set)       { char * s1 = (char*) strscanAny(Spos,set);   return (s1) ? Spos=s1 : 0; }
+    char* ScanAnyNext (cchar* set)       { char * s1 = (char*) strscanAny(Spos+1,set); return (s1) ? Spos=s1 : 0; }
     char* ScanStrNextSkip (cchar* s);
     char* ScanStrSkip (cchar* s);
     char* ScanStrSkip (STRB & s);
@@ -213,6 +221,7 @@ class STRB
     bool  IsSizeExceeded (int size)   { return (MaxLen && (unsigned(size) >= MaxLen)); }
     bool  IsLenExceeded ()            { return (MaxLen && (Len >= MaxLen)); }
     bool  IsLenExceeded (int addlen)  { return (MaxLen && ((Len+addlen)>= MaxLen)); }
+    int   AddNum (UINT64 v, bool neg, unsigned base);
     
   protected:
     char     * Str, * Spos;
@@ -377,6 +386,42 @@ inline STRB & STRB::operator = (int i)
 }
 
 
+inline int STRB::AddNum (UINT64 v, bool neg, unsigned base)
+{
+    char  buf[24];
+    char* s = buf + sizeof(buf);
+    do {
+        unsigned d = unsigned(v % base);
+        *--s = char((d < 10) ? '0' + d : 'A' - 10 + d);
+        v /= base;
+    } while (v);
+    if (neg)
+        *--s = '-';
+    return Add (s, int(buf + sizeof(buf) - s));
+}
+
+
+inline STRB & STRB::operator += (int i)
+{
+    AddNum ((i < 0) ? UINT64(-(INT64)i) : UINT64(i), i < 0, 10);
+    return * this;
+}
+
+
+inline STRB & STRB::operator += (unsigned i)
+{
+    AddNum (i, false, 10);
+    return * this;
+}
+
+
+inline STRB & STRB::operator += (UINT64 i)
+{
+    AddNum (i, false, 10);
+    return * this;
+}
+
+
 inline STRB & STRB::operator -= (int i)
 {
     if (Len >= unsigned(i))
@@ -423,31 +468,52 @@ inline int STRB::Sprintf (cchar * sformat, ...)
 inline int STRB::Copy (cchar * s)
 {
     Len = 0;
-    if (s) {
-        for (; s[Len]; Len++) {
-            if (IsLenExceeded())
-                break;
-            Str[Len] = s[Len];
-        }
-    }
-    Str[Len] = '\0';
-    return Len;
+    return Add(s);
+}
+
+
+inline int STRB::Add (cchar * s)
+{
+    if (!s)
+        return 0;
+    unsigned len = strscanLen(s);
+    if (MaxLen && Len + len > MaxLen)
+        len = (Len < MaxLen) ? MaxLen - Len : 0;    // truncated as Copy always did
+    memcpy (Str+Len, s, len);
+    Str [Len+=len] = '\0';
+    return len;
+}
+
+
+inline char* STRB::SeekStr (cchar * s)
+{
+    // One pass, no strlen: stops at the first mismatch or at the end of either string
+    char* p = Spos;
+    while (*s && *p == *s)
+        p++, s++;
+    return *s ? 0 : (Spos = p);
 }
 
 
 inline char* STRB::SeekInt (int * x, cchar * sformat)
 {
-    // sformat must contain only one %d occurrence
-    if (sscanf(Spos, sformat, x) != 1) {
+    // sformat must contain only one %d occurrence: the text before it must match,
+    // the text after it is skipped when it matches. As in sscanf, a space in
+    // sformat matches any whitespace.
+    cchar* d = strstr(sformat, "%d");
+    cchar* s = d ? strscanText(Spos, sformat, d) : 0;
+
+    if (!s) {
         *x = 0;
         return 0;
     }
-    
-    // now calculate number of digits in *x
-    STR<16> s;
-    s = *x;
+    if ( !(s = strscanInt(s, x)) )
+        return 0;
 
-    return Spos += strlen(sformat) - 2 /* %d */ + s.Strlen();
+    Spos = (char*) s;
+    if ( (s = strscanText(s, d + 2)) )
+        Spos = (char*) s;
+    return Spos;
 }
 
 
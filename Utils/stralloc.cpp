@@ -6,24 +6,135 @@
  Created     :  3.9.2009
 \******************************************************************************/
 
+#include <stdlib.h>
 #include "def.h"
-#include "fifo_cse.h"
 #include "stralloc.h"
 
 
 
-struct STRALLOC_ST
+struct STRALLOC_ARENA
 {
-    char str[STRALLOC_MAXLEN];
+    unsigned Top;
+    unsigned Scopes;		// StrallocScope marks taken, no wrap while any is open
+    char     Buf[STRALLOC_ARENASIZE];
 };
 
 
 
-FIFO_SIMPLE_ALLOC<STRALLOC_ST,STRALLOC_MAXSTRS>  strallocCyclicBuffer;
+// Dynamic TLS: __declspec(thread) doesn't work in a DLL loaded by LoadLibrary on XP,
+// the slot is allocated on the first use, the arena of a thread on its first string
+static volatile LONG  strallocTls = TLS_OUT_OF_INDEXES;
+
+
+
+static DWORD strallocTlsIndex ()
+{
+    DWORD idx = (DWORD) strallocTls;
+
+    if (idx == TLS_OUT_OF_INDEXES)
+    {
+        idx = TlsAlloc();
+        if (idx == TLS_OUT_OF_INDEXES)
+            return idx;
+
+        // Another thread may have been first: its slot is used
+        LONG prev = InterlockedCompareExchange (&strallocTls, (LONG)idx, (LONG)TLS_OUT_OF_INDEXES);
+        if (prev != (LONG)TLS_OUT_OF_INDEXES) {
+            TlsFree (idx);
+            idx = (DWORD) prev;
+        }
+    }
+    return idx;
+}
+
+
+static STRALLOC_ARENA* strallocArena ()
+{
+    DWORD idx = strallocTlsIndex();
+    if (idx == TLS_OUT_OF_INDEXES)
+        return 0;
+
+    STRALLOC_ARENA* a = (STRALLOC_ARENA*) TlsGetValue (idx);
+    if (!a)
+    {
+        a = (STRALLOC_ARENA*) calloc (1, sizeof(STRALLOC_ARENA));
+        if (a  &&  !TlsSetValue (idx, a)) {
+            free (a);
+            a = 0;
+        }
+    }
+    return a;
+}
 
 
 
 char* strallocGet()
 {
-    return strallocCyclicBuffer.FetchNext()->str;
+    return strallocGet (STRALLOC_MAXLEN);
+}
+
+
+char* strallocGet (unsigned size)
+{
+    STRALLOC_ARENA* pa = strallocArena();
+    if (!pa)
+        return 0;
+
+    STRALLOC_ARENA& a = *pa;
+
+    size = (size + 7) & ~7u;
+    if (size > STRALLOC_ARENASIZE)
+        return 0;
+
+    if (a.Top + size > STRALLOC_ARENASIZE)
+    {
+        // Wrapping would overwrite strings of an open scope
+        if (a.Scopes)
+            return 0;
+        a.Top = 0;
+    }
+
+    char* s = a.Buf + a.Top;
+    a.Top += size;
+    *s = '\0';
+    return s;
+}
+
+
+unsigned strallocMark()
+{
+    STRALLOC_ARENA* a = strallocArena();
+    if (!a)
+        return STRALLOC_NOMARK;
+
+    a->Scopes++;
+    return a->Top;
+}
+
+
+void strallocRelease (unsigned mark)
+{
+    // The failed mark has not counted a scope: the arena may have been taken after it
+    if (mark == STRALLOC_NOMARK)
+        return;
+
+    // The arena exists if the mark has taken it
+    DWORD idx = (DWORD) strallocTls;
+    STRALLOC_ARENA* a = (idx != TLS_OUT_OF_INDEXES) ? (STRALLOC_ARENA*) TlsGetValue (idx) : 0;
+    if (!a  ||  !a->Scopes)
+        return;
+
+    a->Scopes--;
+    a->Top = mark;
+}
+
+
+void strallocThreadEnd()
+{
+    DWORD idx = (DWORD) strallocTls;
+    if (idx == TLS_OUT_OF_INDEXES)
+        return;
+
+    free (TlsGetValue (idx));
+    TlsSetValue (idx, 0);
 }
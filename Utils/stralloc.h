@@ -10,13 +10,48 @@
 #define _STRALLOC_H
 
 
+/*
+ ******************************************************************************
+ Scratch strings for the formatting helpers: each thread bumps a pointer in its
+ own arena, so there is no locking. A string taken inside a StrallocScope
+ stays valid until the scope ends, which then releases all the strings taken
+ in it at once. The strings taken outside any scope are recycled
+ when the arena wraps around (the former cyclic buffer behaviour, per thread).
+ The arena is allocated on the thread's first string (dynamic TLS, so it works
+ in a DLL loaded at run time) and freed by strallocThreadEnd(), which Thread
+ calls when its function returns; other threads keep it till the process ends.
+
+ Unlike the former cyclic buffer, strallocGet() may return 0: when there is no
+ TLS slot or memory for the arena, when the size is above the arena, or when
+ the arena is full and a scope is open. The callers must check it.
+ strallocMark() returns STRALLOC_NOMARK when there is no arena, then
+ strallocRelease() of it does nothing.
+ ******************************************************************************
+ */
 enum {
-    STRALLOC_MAXSTRS =  20,
-    STRALLOC_MAXLEN  = 200
+    STRALLOC_MAXLEN    =  200,		// size of the strallocGet() string
+    STRALLOC_ARENASIZE = 4096		// per thread
 };
 
+const unsigned STRALLOC_NOMARK = ~0u;
+
+
+char*    strallocGet     ();
+char*    strallocGet     (unsigned size);
+unsigned strallocMark    ();
+void     strallocRelease (unsigned mark);
+void     strallocThreadEnd ();
 
-char* strallocGet();
+
+class StrallocScope
+{
+  public:
+    StrallocScope ()  : Mark(strallocMark())  {}
+    ~StrallocScope ()                         { strallocRelease(Mark); }
+
+  private:
+    unsigned Mark;
+};
 
 
 #endif // _STRALLOC_H
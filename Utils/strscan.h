@@ -0,0 +1,186 @@
+/**********************************************************************\
+ Library     :  Utils
+ Filename    :  strscan.h
+ Purpose     :  String scan kernels (SSE2) and the integer parser
+\**********************************************************************/
+
+#ifndef _STRSCAN_H
+#define _STRSCAN_H
+
+
+#include "def.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define STRSCAN_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+
+/*
+ *********************************************************************
+ The scans go by 16-byte blocks read at the aligned addresses: an aligned
+ block never crosses a page, so the bytes after the terminator may be read
+ safely. The bytes before the string start in the first block are masked.
+
+ strscanChar  - strchr, the terminator is found for ch = '\0'
+ strscanAny   - strpbrk for the sets of up to STRSCAN_MAXSET chars
+ strscanLen   - strlen
+ strscanInt   - "%d" of sscanf: the leading spaces, the sign and the digits.
+                Returns the position after the digits or 0 if there are none
+                or the value does not fit in int.
+ strscanText  - the literal text of a sscanf format, up to its end or fend:
+                a space matches any whitespace (none too), the other chars
+                match exactly. Returns the position after the text or 0.
+ *********************************************************************
+*/
+enum { STRSCAN_MAXSET = 8 };
+
+
+#ifdef STRSCAN_SSE2
+
+inline unsigned strscanCtz (unsigned x)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward (&i, x);
+	return i;
+#else
+	return __builtin_ctz (x);
+#endif
+}
+
+
+inline cchar* strscanChar (cchar* s, char ch)
+{
+	unsigned		off = unsigned((size_t)s & 15);
+	const __m128i*	p	= (const __m128i*) (s - off);
+	const __m128i	z	= _mm_setzero_si128();
+	const __m128i	c	= _mm_set1_epi8 (ch);
+	unsigned		valid = 0xFFFF << off;
+
+	for (;; p++, valid = 0xFFFF)
+	{
+		__m128i	 b	= _mm_load_si128 (p);
+		unsigned m	= unsigned(_mm_movemask_epi8 (_mm_cmpeq_epi8 (b, c)))  & valid;
+		unsigned t	= unsigned(_mm_movemask_epi8 (_mm_cmpeq_epi8 (b, z)))  & valid;
+		if (m | t) {
+			unsigned i = strscanCtz (m | t);
+			return ((m >> i) & 1) ? (cchar*)p + i : 0;
+		}
+	}
+}
+
+
+inline int strscanLen (cchar* s)
+{
+	unsigned		off = unsigned((size_t)s & 15);
+	const __m128i*	p	= (const __m128i*) (s - off);
+	const __m128i	z	= _mm_setzero_si128();
+	unsigned		valid = 0xFFFF << off;
+
+	for (;; p++, valid = 0xFFFF)
+	{
+		unsigned t = unsigned(_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_load_si128 (p), z))) & valid;
+		if (t)
+			return int((cchar*)p + strscanCtz(t) - s);
+	}
+}
+
+
+inline cchar* strscanAny (cchar* s, cchar* set)
+{
+	__m128i	 c[STRSCAN_MAXSET];
+	int		 n;
+
+	for (n = 0;  set[n];  n++) {
+		if (n == STRSCAN_MAXSET)
+			return strpbrk (s, set);
+		c[n] = _mm_set1_epi8 (set[n]);
+	}
+
+	unsigned		off = unsigned((size_t)s & 15);
+	const __m128i*	p	= (const __m128i*) (s - off);
+	const __m128i	z	= _mm_setzero_si128();
+	unsigned		valid = 0xFFFF << off;
+
+	for (;; p++, valid = 0xFFFF)
+	{
+		__m128i	b  = _mm_load_si128 (p);
+		__m128i	eq = _mm_setzero_si128();
+		for (int i = 0; i < n; i++)
+			eq = _mm_or_si128 (eq, _mm_cmpeq_epi8 (b, c[i]));
+
+		unsigned m = unsigned(_mm_movemask_epi8 (eq)) & valid;
+		unsigned t = unsigned(_mm_movemask_epi8 (_mm_cmpeq_epi8 (b, z))) & valid;
+		if (m | t) {
+			unsigned i = strscanCtz (m | t);
+			return ((m >> i) & 1) ? (cchar*)p + i : 0;
+		}
+	}
+}
+
+#else  // STRSCAN_SSE2
+
+inline cchar* strscanChar (cchar* s, char ch)	{ return strchr (s, ch); }
+inline int	  strscanLen  (cchar* s)			{ return (int) strlen (s); }
+inline cchar* strscanAny  (cchar* s, cchar* set){ return strpbrk (s, set); }
+
+#endif // STRSCAN_SSE2
+
+
+inline bool strscanSpace (char c)
+{
+	return c == ' '  ||  unsigned(c - '\t') <= unsigned('\r' - '\t');
+}
+
+
+inline cchar* strscanInt (cchar* s, int* x)
+{
+	unsigned v = 0, dig;
+	bool	 neg = false;
+	cchar*	 d;
+
+	while (strscanSpace (*s))
+		s++;
+	if (*s == '-'  ||  *s == '+')
+		neg = (*s++ == '-');
+
+	// INT_MAX or -INT_MIN
+	unsigned lim = neg ? 0x80000000u : 0x7FFFFFFFu;
+
+	for (d = s;  (dig = unsigned(*s - '0')) <= 9;  s++) {
+		if (v > (lim - dig) / 10) {
+			*x = 0;
+			return 0;
+		}
+		v = v * 10 + dig;
+	}
+
+	if (s == d) {
+		*x = 0;
+		return 0;
+	}
+	*x = neg ? int(0u - v) : int(v);
+	return s;
+}
+
+
+inline cchar* strscanText (cchar* s, cchar* f, cchar* fend = 0)
+{
+	for (;  *f  &&  f != fend;  f++)
+	{
+		if (strscanSpace (*f)) {
+			while (strscanSpace (*s))
+				s++;
+		}
+		else if (*s++ != *f)
+			return 0;
+	}
+	return s;
+}
+
+
+#endif // _STRSCAN_H
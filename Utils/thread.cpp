@@ -10,6 +10,7 @@
 #include "def.h"
 #include "deblog.h"
 #include "thread.h"
+#include "stralloc.h"
 
 
 //static
@@ -60,6 +61,7 @@ int Thread_os::aPriorities [Thread::PRIORITY_CRITICAL + 1] =
 unsigned __stdcall Thread_os::staticThreadFunc (void *param)
 {
     ((Thread*)param)->ThreadFunc ();
+    strallocThreadEnd ();
     return 0;
 }
 